@@ -0,0 +1,1289 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <limits.h>
+#include <new>
+#include "net/async/thread_pool.hpp"
+#include "net/async/stream/socket.hpp"
+#include "net/socket/address.hpp"
+#include "net/library.hpp"
+#include "filesystem/async/file.hpp"
+#include "util/slab.hpp"
+#include "util/timer.hpp"
+
+static uint64_t now();
+static bool selected(const char* name);
+static void report(const char* name,
+                   uint64_t ops,
+                   uint64_t elapsed,
+                   size_t bytes = 0);
+
+static bool parse(const char* s, uint64_t& n);
+
+// Minimum duration of every benchmark (nanoseconds).
+static uint64_t duration = 1000ull * 1000ull * 1000ull;
+
+// Only the benchmarks whose name contains `filter` are run (nullptr: all).
+static const char* filter = nullptr;
+
+// Results of the benchmarked code are added to `sink`, so that the compiler
+// cannot optimize the code away.
+static volatile uintptr_t sink = 0;
+
+// Maximum number of completion handlers nested on a thread: an operation
+// which completes synchronously invokes its handler inline, and a stream of
+// them would overflow the stack. Beyond it, the next operation is started
+// from a thread pool callback.
+static constexpr const unsigned max_nesting = 16;
+
+// Number of completion handlers nested on the current thread.
+static thread_local unsigned nesting = 0;
+
+// Call `obj->fn()` (which starts an asynchronous operation) now or, if too
+// many handlers are nested, from a thread pool callback.
+template<typename T, void (T::*fn)()>
+static void start(T* obj, PTP_CALLBACK_ENVIRON callbackenv);
+
+// Thread pool callback starting a deferred operation.
+template<typename T, void (T::*fn)()>
+static void CALLBACK deferred(PTP_CALLBACK_INSTANCE instance, void* context)
+{
+  (static_cast<T*>(context)->*fn)();
+}
+
+template<typename T, void (T::*fn)()>
+void start(T* obj, PTP_CALLBACK_ENVIRON callbackenv)
+{
+  if ((nesting >= max_nesting) &&
+      (::TrySubmitThreadpoolCallback(deferred<T, fn>, obj, callbackenv))) {
+    return;
+  }
+
+  nesting++;
+  (obj->*fn)();
+  nesting--;
+}
+
+// Run the synchronous benchmark `fn` (`fn(n)` performs `n` operations) in
+// growing batches, until `duration` has elapsed.
+template<typename Fn>
+static void run(const char* name, Fn fn)
+{
+  if (selected(name)) {
+    // Warm up.
+    fn(16);
+
+    uint64_t ops = 0;
+    uint64_t batch = 16;
+    uint64_t elapsed;
+
+    const uint64_t start = now();
+
+    do {
+      fn(batch);
+      ops += batch;
+
+      elapsed = now() - start;
+
+      if (batch < (1ull << 20)) {
+        batch *= 2;
+      }
+    } while (elapsed < duration);
+
+    report(name, ops, elapsed);
+  }
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+//                                                                            //
+// Addresses.                                                                 //
+//                                                                            //
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+
+static void address_benchmarks()
+{
+  static const char* const addresses[][2] = {
+    {"address/build ipv4", "127.0.0.1:8080"},
+    {"address/build ipv6", "[::1]:8080"},
+    {"address/build unix", "benchmark.sock"}
+  };
+
+  for (size_t i = 0; i < sizeof(addresses) / sizeof(addresses[0]); i++) {
+    const char* const address = addresses[i][1];
+
+    run(addresses[i][0], [address](uint64_t n) {
+      net::socket::address addr;
+
+      for (uint64_t j = 0; j < n; j++) {
+        addr.build(address);
+        sink += addr.length();
+      }
+    });
+  }
+
+  static const char* const strings[][2] = {
+    {"address/to_string ipv4", "127.0.0.1:8080"},
+    {"address/to_string ipv6", "[2001:db8::1]:8080"}
+  };
+
+  for (size_t i = 0; i < sizeof(strings) / sizeof(strings[0]); i++) {
+    net::socket::address addr;
+    if (addr.build(strings[i][1])) {
+      run(strings[i][0], [&addr](uint64_t n) {
+        char s[128];
+
+        for (uint64_t j = 0; j < n; j++) {
+          addr.to_string(s, sizeof(s));
+          sink += static_cast<uint8_t>(s[0]);
+        }
+      });
+    }
+  }
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+//                                                                            //
+// Allocators.                                                                //
+//                                                                            //
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+
+static void allocator_benchmarks()
+{
+  // Number of objects allocated before they are released (batch).
+  static constexpr const size_t batch_size = 256;
+
+  // Object sizes (a small object and a connection with its buffers).
+  static constexpr const size_t sizes[] = {256, 64 * 1024};
+
+  for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+    const size_t size = sizes[i];
+
+    util::slab slab;
+    if (!slab.create(size, batch_size)) {
+      fprintf(stderr, "Error creating slab allocator.\n");
+      continue;
+    }
+
+    char name[128];
+
+    // Allocate and release an object at a time.
+    snprintf(name, sizeof(name), "slab/allocate+deallocate %zu B", size);
+    run(name, [&slab](uint64_t n) {
+      for (uint64_t j = 0; j < n; j++) {
+        void* const obj = slab.allocate();
+        sink += reinterpret_cast<uintptr_t>(obj);
+        slab.deallocate(obj);
+      }
+    });
+
+    snprintf(name, sizeof(name), "malloc/malloc+free %zu B", size);
+    run(name, [size](uint64_t n) {
+      for (uint64_t j = 0; j < n; j++) {
+        void* const obj = malloc(size);
+        sink += reinterpret_cast<uintptr_t>(obj);
+        free(obj);
+      }
+    });
+
+    // Allocate a batch of objects, then release them.
+    snprintf(name,
+             sizeof(name),
+             "slab/allocate+deallocate %zu B x%zu",
+             size,
+             batch_size);
+
+    run(name, [&slab](uint64_t n) {
+      void* objs[batch_size];
+
+      for (uint64_t j = 0; j < n; j += batch_size) {
+        const size_t count = (n - j < batch_size) ? n - j : batch_size;
+
+        for (size_t k = 0; k < count; k++) {
+          objs[k] = slab.allocate();
+        }
+
+        for (size_t k = 0; k < count; k++) {
+          sink += reinterpret_cast<uintptr_t>(objs[k]);
+          slab.deallocate(objs[k]);
+        }
+      }
+    });
+
+    snprintf(name,
+             sizeof(name),
+             "malloc/malloc+free %zu B x%zu",
+             size,
+             batch_size);
+
+    run(name, [size](uint64_t n) {
+      void* objs[batch_size];
+
+      for (uint64_t j = 0; j < n; j += batch_size) {
+        const size_t count = (n - j < batch_size) ? n - j : batch_size;
+
+        for (size_t k = 0; k < count; k++) {
+          objs[k] = malloc(size);
+        }
+
+        for (size_t k = 0; k < count; k++) {
+          sink += reinterpret_cast<uintptr_t>(objs[k]);
+          free(objs[k]);
+        }
+      }
+    });
+  }
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+//                                                                            //
+// Timers.                                                                    //
+//                                                                            //
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+
+static void timer_callback(util::timer& t, void* user)
+{
+  sink++;
+}
+
+static void timer_benchmarks(PTP_CALLBACK_ENVIRON callbackenv)
+{
+  // The timers never expire during the benchmarks (microseconds).
+  static constexpr const uint64_t interval = 60ull * 1000ull * 1000ull;
+
+  util::timer timer{timer_callback};
+  if (!timer.create(callbackenv)) {
+    fprintf(stderr, "Error creating timer.\n");
+    return;
+  }
+
+  // Re-arm a pending timer (what the connection timeouts do).
+  run("timer/arm", [&timer](uint64_t n) {
+    for (uint64_t i = 0; i < n; i++) {
+      timer.expires_in(interval);
+    }
+  });
+
+  // Arm and cancel (`cancel()` waits for the outstanding callbacks).
+  run("timer/arm+cancel", [&timer](uint64_t n) {
+    for (uint64_t i = 0; i < n; i++) {
+      timer.expires_in(interval);
+      timer.cancel();
+    }
+  });
+
+  timer.cancel();
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+//                                                                            //
+// Sockets.                                                                   //
+//                                                                            //
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+
+// A client connected to a server over a local address.
+class socket_benchmark {
+  public:
+    // Modes.
+    enum class mode {
+      // The client sends, the server receives.
+      stream,
+
+      // The client sends, the server sends the data back.
+      ping_pong
+    };
+
+    // Maximum size of a message.
+    static constexpr const size_t max_size = 64 * 1024;
+
+    // Constructor.
+    socket_benchmark(PTP_CALLBACK_ENVIRON callbackenv = nullptr);
+
+    // Destructor.
+    ~socket_benchmark();
+
+    // Connect the client to the server.
+    bool open(const net::socket::address& addr);
+
+    // Disconnect.
+    void close();
+
+    // Run benchmark: every operation is a message of `size` bytes sent by
+    // the client (and, in `ping_pong` mode, received back).
+    bool run(mode m, size_t size, uint64_t& ops, uint64_t& elapsed);
+
+  private:
+    // Address length.
+    static constexpr const
+      DWORD address_length = sizeof(struct sockaddr_storage) + 16;
+
+    // Time to wait for the connection and the disconnection (milliseconds).
+    static constexpr const DWORD timeout = 5000;
+
+    // Next operation of a socket.
+    struct action {
+      bool send;
+      uint8_t* buf;
+      size_t len;
+    };
+
+    // Notify of a completed socket I/O operation.
+    void client_complete(net::async::stream::socket::operation op,
+                         DWORD error,
+                         DWORD transferred);
+
+    void server_complete(net::async::stream::socket::operation op,
+                         DWORD error,
+                         DWORD transferred);
+
+    // Listener.
+    net::async::stream::socket _M_listener;
+
+    // Client socket.
+    net::async::stream::basic_socket<
+      net::async::stream::member_handler<
+        socket_benchmark,
+        &socket_benchmark::client_complete
+      >
+    > _M_client;
+
+    // Server socket.
+    net::async::stream::basic_socket<
+      net::async::stream::member_handler<
+        socket_benchmark,
+        &socket_benchmark::server_complete
+      >
+    > _M_server;
+
+    // Signaled by the completions the main thread waits for.
+    HANDLE _M_semaphore = nullptr;
+
+    // Buffers.
+    uint8_t* _M_clientbuf = nullptr;
+    uint8_t* _M_serverbuf = nullptr;
+
+    // Mode.
+    mode _M_mode = mode::stream;
+
+    // Message size.
+    size_t _M_size;
+
+    // Number of bytes of the current message sent (or received back).
+    size_t _M_transferred;
+
+    // Number of completed operations.
+    uint64_t _M_ops;
+
+    // End of the benchmark (nanoseconds).
+    uint64_t _M_deadline;
+    uint64_t _M_end;
+
+    // Number of bytes sent by the client and received by the server
+    // (`stream` mode).
+    volatile LONG64 _M_sent = 0;
+    volatile LONG64 _M_received = 0;
+
+    // Number of bytes received by the server and not sent back yet, and
+    // number of them already sent back (`ping_pong` mode).
+    size_t _M_pending;
+    size_t _M_echoed;
+
+    // Error.
+    DWORD _M_error = 0;
+
+    // Is the client disconnecting?
+    bool _M_closing = false;
+
+    // Next operations.
+    action _M_client_action;
+    action _M_server_action;
+
+    // Callback environment.
+    PTP_CALLBACK_ENVIRON _M_callbackenv;
+
+    // Buffer for storing the local and remote addresses.
+    uint8_t _M_addresses[2 * address_length];
+
+    // Start the next operation of the client.
+    void client_next(bool send, uint8_t* buf, size_t len);
+
+    // Start the next operation of the server.
+    void server_next(bool send, uint8_t* buf, size_t len);
+
+    // Start the saved operation.
+    void client_start();
+    void server_start();
+
+    // A message has been sent (or received back).
+    void completed();
+
+    // Signal the main thread.
+    void signal();
+
+    // Disable copy constructor and assignment operator.
+    socket_benchmark(const socket_benchmark&) = delete;
+    socket_benchmark& operator=(const socket_benchmark&) = delete;
+};
+
+socket_benchmark::socket_benchmark(PTP_CALLBACK_ENVIRON callbackenv)
+  : _M_listener{nullptr, nullptr, callbackenv},
+    _M_client{this, callbackenv},
+    _M_server{this, callbackenv},
+    _M_callbackenv{callbackenv}
+{
+}
+
+socket_benchmark::~socket_benchmark()
+{
+  if (_M_semaphore) {
+    ::CloseHandle(_M_semaphore);
+  }
+
+  free(_M_clientbuf);
+  free(_M_serverbuf);
+}
+
+bool socket_benchmark::open(const net::socket::address& addr)
+{
+  _M_semaphore = ::CreateSemaphore(nullptr, 0, LONG_MAX, nullptr);
+
+  // If the semaphore could be created...
+  if (_M_semaphore) {
+    _M_clientbuf = static_cast<uint8_t*>(malloc(max_size));
+    _M_serverbuf = static_cast<uint8_t*>(malloc(max_size));
+
+    // If the buffers could be allocated...
+    if ((_M_clientbuf) && (_M_serverbuf)) {
+      memset(_M_clientbuf, '0', max_size);
+
+      // Listen.
+      if (_M_listener.listen(addr)) {
+        // Accept and connect.
+        _M_listener.accept(_M_server, _M_addresses, address_length);
+        _M_client.connect(addr);
+
+        // Wait for both to complete.
+        return (::WaitForSingleObject(_M_semaphore, timeout) ==
+                WAIT_OBJECT_0) &&
+               (::WaitForSingleObject(_M_semaphore, timeout) ==
+                WAIT_OBJECT_0) &&
+               (_M_error == 0);
+      }
+    }
+  }
+
+  return false;
+}
+
+void socket_benchmark::close()
+{
+  _M_closing = true;
+
+  // Disconnect the client; the server receives the end of the stream.
+  _M_client.disconnect();
+
+  // Wait for both to complete.
+  ::WaitForSingleObject(_M_semaphore, timeout);
+  ::WaitForSingleObject(_M_semaphore, timeout);
+}
+
+bool socket_benchmark::run(mode m, size_t size, uint64_t& ops,
+                           uint64_t& elapsed)
+{
+  _M_mode = m;
+  _M_size = size;
+  _M_ops = 0;
+
+  const uint64_t start = now();
+  _M_deadline = start + duration;
+
+  // Send the first message.
+  _M_transferred = 0;
+  client_next(true, _M_clientbuf, _M_size);
+
+  // Wait for the benchmark to finish.
+  ::WaitForSingleObject(_M_semaphore, INFINITE);
+
+  if (_M_error == 0) {
+    ops = _M_ops;
+    elapsed = _M_end - start;
+
+    // Wait for the server to receive all the data.
+    while (_M_received < _M_sent) {
+      ::Sleep(1);
+    }
+
+    return true;
+  }
+
+  return false;
+}
+
+void socket_benchmark::client_complete(net::async::stream::socket::operation op,
+                                       DWORD error,
+                                       DWORD transferred)
+{
+  if (error == 0) {
+    switch (op) {
+      case net::async::stream::socket::operation::send:
+        _M_transferred += transferred;
+
+        // `stream` mode?
+        if (_M_mode == mode::stream) {
+          ::InterlockedExchangeAdd64(&_M_sent, transferred);
+        }
+
+        // If the message has not been sent completely...
+        if (_M_transferred < _M_size) {
+          // Send the rest.
+          client_next(true,
+                      _M_clientbuf + _M_transferred,
+                      _M_size - _M_transferred);
+        } else if (_M_mode == mode::stream) {
+          completed();
+        } else {
+          // Receive the message back.
+          _M_transferred = 0;
+          client_next(false, _M_clientbuf, _M_size);
+        }
+
+        break;
+      case net::async::stream::socket::operation::receive:
+        // If the server has closed the connection...
+        if (transferred == 0) {
+          _M_error = WSAECONNRESET;
+          signal();
+        } else {
+          _M_transferred += transferred;
+
+          // If the message has not been received completely...
+          if (_M_transferred < _M_size) {
+            // Receive the rest.
+            client_next(false,
+                        _M_clientbuf + _M_transferred,
+                        _M_size - _M_transferred);
+          } else {
+            completed();
+          }
+        }
+
+        break;
+      case net::async::stream::socket::operation::connect:
+      case net::async::stream::socket::operation::disconnect:
+        signal();
+
+        break;
+      case net::async::stream::socket::operation::accept:
+      default:
+        break;
+    }
+  } else {
+    if (!_M_closing) {
+      _M_error = error;
+    }
+
+    signal();
+  }
+}
+
+void socket_benchmark::server_complete(net::async::stream::socket::operation op,
+                                       DWORD error,
+                                       DWORD transferred)
+{
+  if (error == 0) {
+    switch (op) {
+      case net::async::stream::socket::operation::accept:
+        signal();
+
+        // Receive.
+        server_next(false, _M_serverbuf, max_size);
+
+        break;
+      case net::async::stream::socket::operation::receive:
+        // If the client has disconnected...
+        if (transferred == 0) {
+          signal();
+        } else if (_M_mode == mode::stream) {
+          ::InterlockedExchangeAdd64(&_M_received, transferred);
+
+          // Receive.
+          server_next(false, _M_serverbuf, max_size);
+        } else {
+          _M_pending = transferred;
+          _M_echoed = 0;
+
+          // Send the data back.
+          server_next(true, _M_serverbuf, _M_pending);
+        }
+
+        break;
+      case net::async::stream::socket::operation::send:
+        _M_echoed += transferred;
+
+        // If all the data has been sent back...
+        if (_M_echoed == _M_pending) {
+          // Receive.
+          server_next(false, _M_serverbuf, max_size);
+        } else {
+          // Send the rest.
+          server_next(true,
+                      _M_serverbuf + _M_echoed,
+                      _M_pending - _M_echoed);
+        }
+
+        break;
+      case net::async::stream::socket::operation::connect:
+      case net::async::stream::socket::operation::disconnect:
+      default:
+        break;
+    }
+  } else {
+    if (!_M_closing) {
+      _M_error = error;
+    }
+
+    signal();
+  }
+}
+
+void socket_benchmark::client_next(bool send, uint8_t* buf, size_t len)
+{
+  _M_client_action = action{send, buf, len};
+
+  start<socket_benchmark, &socket_benchmark::client_start>(this,
+                                                           _M_callbackenv);
+}
+
+void socket_benchmark::server_next(bool send, uint8_t* buf, size_t len)
+{
+  _M_server_action = action{send, buf, len};
+
+  start<socket_benchmark, &socket_benchmark::server_start>(this,
+                                                           _M_callbackenv);
+}
+
+void socket_benchmark::client_start()
+{
+  if (_M_client_action.send) {
+    _M_client.send(_M_client_action.buf, _M_client_action.len);
+  } else {
+    _M_client.receive(_M_client_action.buf, _M_client_action.len);
+  }
+}
+
+void socket_benchmark::server_start()
+{
+  if (_M_server_action.send) {
+    _M_server.send(_M_server_action.buf, _M_server_action.len);
+  } else {
+    _M_server.receive(_M_server_action.buf, _M_server_action.len);
+  }
+}
+
+void socket_benchmark::completed()
+{
+  _M_ops++;
+
+  const uint64_t t = now();
+
+  // If the benchmark has finished...
+  if (t >= _M_deadline) {
+    _M_end = t;
+    signal();
+  } else {
+    // Send the next message.
+    _M_transferred = 0;
+    client_next(true, _M_clientbuf, _M_size);
+  }
+}
+
+void socket_benchmark::signal()
+{
+  ::ReleaseSemaphore(_M_semaphore, 1, nullptr);
+}
+
+static void socket_benchmarks(const char* family,
+                              const net::socket::address& addr,
+                              PTP_CALLBACK_ENVIRON callbackenv)
+{
+  static const struct {
+    socket_benchmark::mode mode;
+    const char* name;
+    size_t size;
+  } benchmarks[] = {
+    {socket_benchmark::mode::stream, "send", 64},
+    {socket_benchmark::mode::stream, "send", 4 * 1024},
+    {socket_benchmark::mode::stream, "send", 64 * 1024},
+    {socket_benchmark::mode::ping_pong, "ping-pong", 64},
+    {socket_benchmark::mode::ping_pong, "ping-pong", 4 * 1024}
+  };
+
+  // If no benchmark of the family is selected...
+  bool any = false;
+  char names[sizeof(benchmarks) / sizeof(benchmarks[0])][128];
+  for (size_t i = 0; i < sizeof(benchmarks) / sizeof(benchmarks[0]); i++) {
+    snprintf(names[i],
+             sizeof(names[i]),
+             "socket/%s %s %zu B",
+             family,
+             benchmarks[i].name,
+             benchmarks[i].size);
+
+    any = any || selected(names[i]);
+  }
+
+  if (!any) {
+    return;
+  }
+
+  socket_benchmark* b = new (std::nothrow) socket_benchmark{callbackenv};
+  if (b) {
+    if (b->open(addr)) {
+      for (size_t i = 0; i < sizeof(benchmarks) / sizeof(benchmarks[0]); i++) {
+        if (selected(names[i])) {
+          uint64_t ops, elapsed;
+          if (b->run(benchmarks[i].mode, benchmarks[i].size, ops, elapsed)) {
+            report(names[i], ops, elapsed, benchmarks[i].size);
+          } else {
+            fprintf(stderr, "Error running '%s'.\n", names[i]);
+            break;
+          }
+        }
+      }
+
+      b->close();
+    } else {
+      fprintf(stderr, "Error connecting over %s.\n", family);
+    }
+
+    delete b;
+  } else {
+    fprintf(stderr, "Error allocating memory.\n");
+  }
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+//                                                                            //
+// Files.                                                                     //
+//                                                                            //
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+
+// Writers appending to their own files, a write outstanding per writer (the
+// number of writers is the queue depth).
+class file_benchmark {
+  public:
+    // Maximum queue depth.
+    static constexpr const size_t max_depth = 64;
+
+    // Maximum number of bytes written by a run.
+    static constexpr const uint64_t max_bytes = 1024ull * 1024ull * 1024ull;
+
+    // Constructor.
+    file_benchmark(PTP_CALLBACK_ENVIRON callbackenv = nullptr);
+
+    // Destructor.
+    ~file_benchmark();
+
+    // Run benchmark: every operation is a write of `size` bytes, with
+    // `depth` writes outstanding.
+    bool run(const char* directory,
+             size_t size,
+             size_t depth,
+             uint64_t& ops,
+             uint64_t& elapsed);
+
+  private:
+    // Writer.
+    class writer {
+      public:
+        // Constructor.
+        writer(file_benchmark& owner);
+
+        // Destructor.
+        ~writer() = default;
+
+        // Open file.
+        bool open(const char* pathname);
+
+        // Start writing.
+        void start();
+
+        // Close file.
+        void close();
+
+        // Get number of writes.
+        uint64_t ops() const;
+
+        // Has a write failed?
+        bool failed() const;
+
+      private:
+        // Notify of a completed write.
+        void complete(DWORD error, DWORD transferred);
+
+        // File.
+        filesystem::async::basic_file<
+          filesystem::async::member_handler<writer, &writer::complete>
+        > _M_file;
+
+        // Owner.
+        file_benchmark& _M_owner;
+
+        // Number of writes.
+        uint64_t _M_ops;
+
+        // Number of bytes written.
+        uint64_t _M_bytes;
+
+        // Has a write failed?
+        bool _M_failed;
+
+        // Write.
+        void write();
+
+        // Start a write.
+        void start_write();
+
+        // Disable copy constructor and assignment operator.
+        writer(const writer&) = delete;
+        writer& operator=(const writer&) = delete;
+    };
+
+    // Callback environment.
+    PTP_CALLBACK_ENVIRON _M_callbackenv;
+
+    // Signaled when the last writer finishes.
+    HANDLE _M_event = nullptr;
+
+    // Data.
+    uint8_t* _M_buf = nullptr;
+    size_t _M_size;
+
+    // End of the benchmark (nanoseconds).
+    uint64_t _M_deadline;
+
+    // Maximum number of bytes written by every writer.
+    uint64_t _M_max_bytes;
+
+    // Number of running writers.
+    uint32_t _M_running;
+
+    // End of the last writer (nanoseconds).
+    uint64_t _M_end;
+
+    // A writer has finished.
+    void finished();
+
+    // Disable copy constructor and assignment operator.
+    file_benchmark(const file_benchmark&) = delete;
+    file_benchmark& operator=(const file_benchmark&) = delete;
+};
+
+file_benchmark::file_benchmark(PTP_CALLBACK_ENVIRON callbackenv)
+  : _M_callbackenv{callbackenv}
+{
+}
+
+file_benchmark::~file_benchmark()
+{
+  if (_M_event) {
+    ::CloseHandle(_M_event);
+  }
+
+  free(_M_buf);
+}
+
+bool file_benchmark::run(const char* directory,
+                         size_t size,
+                         size_t depth,
+                         uint64_t& ops,
+                         uint64_t& elapsed)
+{
+  // Sanity check.
+  if ((depth == 0) || (depth > max_depth)) {
+    return false;
+  }
+
+  if (!_M_event) {
+    _M_event = ::CreateEvent(nullptr, FALSE, FALSE, nullptr);
+    if (!_M_event) {
+      return false;
+    }
+  }
+
+  free(_M_buf);
+
+  _M_buf = static_cast<uint8_t*>(malloc(size));
+  if (!_M_buf) {
+    return false;
+  }
+
+  memset(_M_buf, '0', size);
+  _M_size = size;
+
+  writer* writers[max_depth];
+  char pathnames[max_depth][MAX_PATH];
+
+  bool res = true;
+
+  // Create writers.
+  size_t nwriters;
+  for (nwriters = 0; nwriters < depth; nwriters++) {
+    snprintf(pathnames[nwriters],
+             sizeof(pathnames[nwriters]),
+             "%sbenchmark-%lu-%zu.tmp",
+             directory,
+             ::GetCurrentProcessId(),
+             nwriters);
+
+    writers[nwriters] = new (std::nothrow) writer{*this};
+
+    if ((!writers[nwriters]) ||
+        (!writers[nwriters]->open(pathnames[nwriters]))) {
+      delete writers[nwriters];
+
+      res = false;
+      break;
+    }
+  }
+
+  if (res) {
+    _M_max_bytes = max_bytes / depth;
+    _M_running = static_cast<uint32_t>(depth);
+
+    const uint64_t start = now();
+    _M_deadline = start + duration;
+
+    // Start writing.
+    for (size_t i = 0; i < depth; i++) {
+      writers[i]->start();
+    }
+
+    // Wait for the writers to finish.
+    ::WaitForSingleObject(_M_event, INFINITE);
+
+    elapsed = _M_end - start;
+
+    ops = 0;
+    for (size_t i = 0; i < depth; i++) {
+      ops += writers[i]->ops();
+      res = res && !writers[i]->failed();
+    }
+  }
+
+  // Destroy writers and remove their files.
+  for (size_t i = 0; i < nwriters; i++) {
+    writers[i]->close();
+    delete writers[i];
+
+    ::DeleteFile(pathnames[i]);
+  }
+
+  return res;
+}
+
+void file_benchmark::finished()
+{
+  const uint64_t t = now();
+
+  // If this is the last writer...
+  if (::InterlockedDecrement(&_M_running) == 0) {
+    _M_end = t;
+    ::SetEvent(_M_event);
+  }
+}
+
+file_benchmark::writer::writer(file_benchmark& owner)
+  : _M_file{this},
+    _M_owner{owner}
+{
+}
+
+bool file_benchmark::writer::open(const char* pathname)
+{
+  return _M_file.open(pathname,
+                      filesystem::async::file_base::mode::write,
+                      _M_owner._M_callbackenv);
+}
+
+void file_benchmark::writer::start()
+{
+  _M_ops = 0;
+  _M_bytes = 0;
+  _M_failed = false;
+
+  write();
+}
+
+void file_benchmark::writer::close()
+{
+  _M_file.close();
+}
+
+uint64_t file_benchmark::writer::ops() const
+{
+  return _M_ops;
+}
+
+bool file_benchmark::writer::failed() const
+{
+  return _M_failed;
+}
+
+void file_benchmark::writer::complete(DWORD error, DWORD transferred)
+{
+  if (error == 0) {
+    _M_ops++;
+    _M_bytes += transferred;
+
+    // If the benchmark has not finished...
+    if ((_M_bytes < _M_owner._M_max_bytes) && (now() < _M_owner._M_deadline)) {
+      // Write again.
+      write();
+      return;
+    }
+  } else {
+    _M_failed = true;
+  }
+
+  _M_owner.finished();
+}
+
+void file_benchmark::writer::write()
+{
+  ::start<writer, &writer::start_write>(this, _M_owner._M_callbackenv);
+}
+
+void file_benchmark::writer::start_write()
+{
+  _M_file.write(_M_owner._M_buf, _M_owner._M_size);
+}
+
+static void file_benchmarks(PTP_CALLBACK_ENVIRON callbackenv)
+{
+  static constexpr const size_t sizes[] = {4 * 1024, 64 * 1024, 1024 * 1024};
+  static constexpr const size_t depths[] = {1, 4, 16};
+
+  // Temporary directory.
+  char directory[MAX_PATH + 1];
+  const DWORD len = ::GetTempPath(sizeof(directory), directory);
+  if ((len == 0) || (len >= sizeof(directory))) {
+    fprintf(stderr, "Error getting temporary directory.\n");
+    return;
+  }
+
+  file_benchmark b{callbackenv};
+
+  for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+    for (size_t j = 0; j < sizeof(depths) / sizeof(depths[0]); j++) {
+      char name[128];
+      snprintf(name,
+               sizeof(name),
+               "file/write %zu B qd%zu",
+               sizes[i],
+               depths[j]);
+
+      if (selected(name)) {
+        uint64_t ops, elapsed;
+        if (b.run(directory, sizes[i], depths[j], ops, elapsed)) {
+          report(name, ops, elapsed, sizes[i]);
+        } else {
+          fprintf(stderr, "Error running '%s'.\n", name);
+        }
+      }
+    }
+  }
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+//                                                                            //
+// Main function.                                                             //
+//                                                                            //
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+
+// Maximum duration of a benchmark (milliseconds).
+static constexpr const uint64_t max_duration = 3600ull * 1000ull;
+
+int main(int argc, const char* argv[])
+{
+  // Address of the loopback benchmarks.
+  const char* address = "127.0.0.1:9876";
+
+  // Parse options.
+  int i = 1;
+  bool valid = true;
+  while ((valid) && (i < argc)) {
+    if ((strcmp(argv[i], "--filter") == 0) && (i + 1 < argc)) {
+      filter = argv[i + 1];
+
+      i += 2;
+    } else if ((strcmp(argv[i], "--duration") == 0) && (i + 1 < argc)) {
+      uint64_t ms = 0;
+      if ((parse(argv[i + 1], ms)) && (ms > 0) && (ms <= max_duration)) {
+        duration = ms * 1000ull * 1000ull;
+
+        i += 2;
+      } else {
+        valid = false;
+      }
+    } else if ((strcmp(argv[i], "--address") == 0) && (i + 1 < argc)) {
+      address = argv[i + 1];
+
+      i += 2;
+    } else {
+      valid = false;
+    }
+  }
+
+  // Check usage.
+  if (!valid) {
+    fprintf(stderr,
+            "Usage: %s [--filter <substring>] [--duration <milliseconds>] "
+            "[--address <address>]\n",
+            argv[0]);
+
+    return EXIT_FAILURE;
+  }
+
+  // Initiate use of the Winsock DLL.
+  net::library library;
+  if (!library.init()) {
+    fprintf(stderr, "Error initiating use of the Winsock DLL.\n");
+    return EXIT_FAILURE;
+  }
+
+  // Load functions.
+  if (!net::async::stream::socket::load_functions()) {
+    fprintf(stderr, "Error loading functions.\n");
+    return EXIT_FAILURE;
+  }
+
+  // Create thread pool.
+  net::async::thread_pool thread_pool;
+  if (!thread_pool.create()) {
+    fprintf(stderr, "Error creating thread pool.\n");
+    return EXIT_FAILURE;
+  }
+
+  printf("%-44s %12s %14s %12s\n", "Benchmark", "ns/op", "ops/s", "MiB/s");
+
+  address_benchmarks();
+  allocator_benchmarks();
+  timer_benchmarks(thread_pool.callback_environment());
+
+  // Loopback.
+  net::socket::address addr;
+  if (addr.build(address)) {
+    socket_benchmarks("loopback",
+                      addr,
+                      thread_pool.callback_environment());
+  } else {
+    fprintf(stderr, "Error building socket address '%s'.\n", address);
+  }
+
+  // Unix socket.
+  char path[MAX_PATH + 1];
+  const DWORD len = ::GetTempPath(sizeof(path), path);
+  if ((len > 0) &&
+      (len + 32 < sizeof(path)) &&
+      (snprintf(path + len,
+                sizeof(path) - len,
+                "benchmark-%lu.sock",
+                ::GetCurrentProcessId()) > 0) &&
+      (addr.build(path)) &&
+      (addr.family() == AF_UNIX)) {
+    socket_benchmarks("unix", addr, thread_pool.callback_environment());
+
+    ::DeleteFile(path);
+  }
+
+  file_benchmarks(thread_pool.callback_environment());
+
+  return EXIT_SUCCESS;
+}
+
+uint64_t now()
+{
+  static const uint64_t frequency = [] {
+    LARGE_INTEGER freq;
+    ::QueryPerformanceFrequency(&freq);
+    return static_cast<uint64_t>(freq.QuadPart);
+  }();
+
+  LARGE_INTEGER counter;
+  ::QueryPerformanceCounter(&counter);
+
+  const uint64_t ticks = static_cast<uint64_t>(counter.QuadPart);
+
+  // Convert to nanoseconds without overflowing.
+  return ((ticks / frequency) * 1000000000ull) +
+         (((ticks % frequency) * 1000000000ull) / frequency);
+}
+
+bool selected(const char* name)
+{
+  return (!filter) || (strstr(name, filter));
+}
+
+void report(const char* name, uint64_t ops, uint64_t elapsed, size_t bytes)
+{
+  const double seconds = elapsed / 1e9;
+
+  printf("%-44s %12.1f %14.0f",
+         name,
+         (ops > 0) ? static_cast<double>(elapsed) / ops : 0.0,
+         (seconds > 0.0) ? ops / seconds : 0.0);
+
+  if (bytes > 0) {
+    printf(" %12.1f\n",
+           (seconds > 0.0) ? (ops * bytes) / seconds / (1024.0 * 1024.0) : 0.0);
+  } else {
+    printf("\n");
+  }
+}
+
+bool parse(const char* s, uint64_t& n)
+{
+  if (*s) {
+    uint64_t res = 0;
+
+    do {
+      // Digit?
+      if ((*s >= '0') && (*s <= '9')) {
+        const uint64_t tmp = (res * 10) + (*s - '0');
+
+        // If the number doesn't overflow...
+        if (tmp >= res) {
+          res = tmp;
+        } else {
+          return false;
+        }
+      } else {
+        return false;
+      }
+    } while (*++s);
+
+    n = res;
+    return true;
+  }
+
+  return false;
+}
\ No newline at end of file
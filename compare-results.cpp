@@ -0,0 +1,558 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <ctype.h>
+#include <math.h>
+#include <new>
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+//                                                                            //
+// Results.                                                                   //
+//                                                                            //
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+
+// Results of a `test-connector` run (file saved with `--output`, either JSON
+// or CSV), as a list of numeric metrics. The metrics of nested JSON objects
+// are named after their path (`latencies_us.send.p99`), like in the CSV
+// files.
+class results {
+  public:
+    // Maximum length of a metric name.
+    static constexpr const size_t max_name_length = 127;
+
+    // Maximum number of metrics.
+    static constexpr const size_t max_metrics = 512;
+
+    // Constructor.
+    results() = default;
+
+    // Destructor.
+    ~results() = default;
+
+    // Load results.
+    bool load(const char* filename);
+
+    // Get number of metrics.
+    size_t count() const;
+
+    // Get name of the metric `i`.
+    const char* name(size_t i) const;
+
+    // Get value of the metric `i`.
+    double value(size_t i) const;
+
+    // Find metric.
+    bool find(const char* name, double& value) const;
+
+  private:
+    // Metric.
+    struct metric {
+      char name[max_name_length + 1];
+      double value;
+    };
+
+    // Metrics.
+    metric _M_metrics[max_metrics];
+    size_t _M_count = 0;
+
+    // Add metric.
+    bool add(const char* name, size_t len, double value);
+
+    // Parse JSON.
+    bool parse_json(const char*& s, char* path, size_t pathlen);
+
+    // Parse JSON object.
+    bool parse_object(const char*& s, char* path, size_t pathlen);
+
+    // Parse JSON array (its values are skipped).
+    bool parse_array(const char*& s);
+
+    // Parse JSON string.
+    static bool parse_string(const char*& s, char* str, size_t size);
+
+    // Parse CSV.
+    bool parse_csv(const char* s);
+
+    // Skip white spaces.
+    static void skip_spaces(const char*& s);
+
+    // Disable copy constructor and assignment operator.
+    results(const results&) = delete;
+    results& operator=(const results&) = delete;
+};
+
+bool results::load(const char* filename)
+{
+  // Open file for reading.
+  FILE* file = fopen(filename, "rb");
+  if (file) {
+    // Get file size.
+    long size;
+    if ((fseek(file, 0, SEEK_END) == 0) &&
+        ((size = ftell(file)) >= 0) &&
+        (fseek(file, 0, SEEK_SET) == 0)) {
+      // Allocate memory (for the data and the terminating null character).
+      char* data = static_cast<char*>(malloc(size + 1));
+
+      // If the data could be allocated...
+      if (data) {
+        // Read file.
+        if (fread(data, 1, size, file) == static_cast<size_t>(size)) {
+          data[size] = 0;
+
+          fclose(file);
+
+          const char* s = data;
+          skip_spaces(s);
+
+          // JSON?
+          bool res;
+          if (*s == '{') {
+            char path[max_name_length + 1];
+            res = parse_json(s, path, 0);
+          } else {
+            res = parse_csv(s);
+          }
+
+          free(data);
+
+          if (res) {
+            return true;
+          }
+
+          fprintf(stderr, "Error parsing '%s'.\n", filename);
+          return false;
+        } else {
+          fprintf(stderr, "Error reading from '%s'.\n", filename);
+        }
+
+        free(data);
+      } else {
+        fprintf(stderr, "Error allocating memory.\n");
+      }
+    } else {
+      fprintf(stderr, "Error getting size of '%s'.\n", filename);
+    }
+
+    fclose(file);
+  } else {
+    fprintf(stderr, "Error opening file '%s' for reading.\n", filename);
+  }
+
+  return false;
+}
+
+size_t results::count() const
+{
+  return _M_count;
+}
+
+const char* results::name(size_t i) const
+{
+  return _M_metrics[i].name;
+}
+
+double results::value(size_t i) const
+{
+  return _M_metrics[i].value;
+}
+
+bool results::find(const char* name, double& value) const
+{
+  for (size_t i = 0; i < _M_count; i++) {
+    if (strcmp(_M_metrics[i].name, name) == 0) {
+      value = _M_metrics[i].value;
+      return true;
+    }
+  }
+
+  return false;
+}
+
+bool results::add(const char* name, size_t len, double value)
+{
+  // If there is space for another metric and the name is not too long...
+  if ((_M_count < max_metrics) && (len > 0) && (len <= max_name_length)) {
+    metric& m = _M_metrics[_M_count++];
+
+    memcpy(m.name, name, len);
+    m.name[len] = 0;
+
+    m.value = value;
+
+    return true;
+  }
+
+  return false;
+}
+
+bool results::parse_json(const char*& s, char* path, size_t pathlen)
+{
+  skip_spaces(s);
+
+  switch (*s) {
+    case '{':
+      return parse_object(s, path, pathlen);
+    case '[':
+      return parse_array(s);
+    case '"':
+      {
+        // Skip string.
+        char str[max_name_length + 1];
+        return parse_string(s, str, sizeof(str));
+      }
+    default:
+      if (strncmp(s, "true", 4) == 0) {
+        s += 4;
+        return true;
+      } else if (strncmp(s, "false", 5) == 0) {
+        s += 5;
+        return true;
+      } else if (strncmp(s, "null", 4) == 0) {
+        s += 4;
+        return true;
+      } else {
+        // Number.
+        char* end;
+        const double value = strtod(s, &end);
+
+        if (end != s) {
+          s = end;
+
+          // Values outside of an object are skipped.
+          return (pathlen > 0) ? add(path, pathlen, value) : true;
+        }
+
+        return false;
+      }
+  }
+}
+
+bool results::parse_object(const char*& s, char* path, size_t pathlen)
+{
+  // Skip '{'.
+  s++;
+
+  skip_spaces(s);
+
+  // Empty object?
+  if (*s == '}') {
+    s++;
+    return true;
+  }
+
+  do {
+    skip_spaces(s);
+
+    // Parse key.
+    char key[max_name_length + 1];
+    if (!parse_string(s, key, sizeof(key))) {
+      return false;
+    }
+
+    skip_spaces(s);
+
+    if (*s != ':') {
+      return false;
+    }
+
+    s++;
+
+    // Append key to the path.
+    const size_t keylen = strlen(key);
+    const size_t len = (pathlen > 0) ? pathlen + 1 + keylen : keylen;
+
+    if (len > max_name_length) {
+      return false;
+    }
+
+    if (pathlen > 0) {
+      path[pathlen] = '.';
+      memcpy(path + pathlen + 1, key, keylen);
+    } else {
+      memcpy(path, key, keylen);
+    }
+
+    // Parse value.
+    if (!parse_json(s, path, len)) {
+      return false;
+    }
+
+    skip_spaces(s);
+
+    if (*s == ',') {
+      s++;
+    } else if (*s == '}') {
+      s++;
+      return true;
+    } else {
+      return false;
+    }
+  } while (true);
+}
+
+bool results::parse_array(const char*& s)
+{
+  // Skip '['.
+  s++;
+
+  skip_spaces(s);
+
+  // Empty array?
+  if (*s == ']') {
+    s++;
+    return true;
+  }
+
+  do {
+    // Parse value (skipped).
+    char path[max_name_length + 1];
+    if (!parse_json(s, path, 0)) {
+      return false;
+    }
+
+    skip_spaces(s);
+
+    if (*s == ',') {
+      s++;
+    } else if (*s == ']') {
+      s++;
+      return true;
+    } else {
+      return false;
+    }
+  } while (true);
+}
+
+bool results::parse_string(const char*& s, char* str, size_t size)
+{
+  if (*s == '"') {
+    size_t len = 0;
+
+    while (*++s) {
+      if (*s == '"') {
+        s++;
+
+        str[len] = 0;
+        return true;
+      } else if (*s == '\\') {
+        // Escape sequences are kept as they are.
+        if (!*++s) {
+          return false;
+        }
+      }
+
+      if (len + 1 < size) {
+        str[len++] = *s;
+      } else {
+        return false;
+      }
+    }
+  }
+
+  return false;
+}
+
+bool results::parse_csv(const char* s)
+{
+  while (*s) {
+    // Find end of line.
+    const char* eol = strchr(s, '\n');
+    if (!eol) {
+      eol = s + strlen(s);
+    }
+
+    // Find separator.
+    const char* comma = static_cast<const char*>(memchr(s, ',', eol - s));
+
+    if (comma) {
+      char* end;
+      const double value = strtod(comma + 1, &end);
+
+      // If the value is a number (the header is skipped)...
+      if ((end != comma + 1) &&
+          (!add(s, comma - s, value))) {
+        return false;
+      }
+    }
+
+    s = (*eol) ? eol + 1 : eol;
+  }
+
+  return true;
+}
+
+void results::skip_spaces(const char*& s)
+{
+  while (isspace(static_cast<unsigned char>(*s))) {
+    s++;
+  }
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+//                                                                            //
+// Main function.                                                             //
+//                                                                            //
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+
+// Direction of a metric.
+enum class direction {
+  // Not checked (counts, sizes...).
+  none,
+
+  // The higher, the better (throughput).
+  higher,
+
+  // The lower, the better (latencies, errors, CPU time).
+  lower
+};
+
+static direction classify(const char* name);
+static bool ends_with(const char* s, const char* suffix);
+
+// Default threshold (percent).
+static constexpr const double default_threshold = 5.0;
+
+int main(int argc, const char* argv[])
+{
+  double threshold = default_threshold;
+
+  // Parse options.
+  int i = 1;
+  bool valid = true;
+  while ((valid) && (i < argc) && (strncmp(argv[i], "--", 2) == 0)) {
+    if ((strcmp(argv[i], "--threshold") == 0) && (i + 1 < argc)) {
+      char* end;
+      threshold = strtod(argv[i + 1], &end);
+
+      valid = (end != argv[i + 1]) && (!*end) && (threshold >= 0.0);
+
+      i += 2;
+    } else {
+      valid = false;
+    }
+  }
+
+  // Check usage.
+  if ((!valid) || (i + 2 != argc)) {
+    fprintf(stderr,
+            "Usage: %s [--threshold <percent>] <baseline> <current>\n",
+            argv[0]);
+
+    return EXIT_FAILURE;
+  }
+
+  results* baseline = new (std::nothrow) results;
+  results* current = new (std::nothrow) results;
+
+  if ((!baseline) || (!current)) {
+    fprintf(stderr, "Error allocating memory.\n");
+
+    delete baseline;
+    delete current;
+
+    return EXIT_FAILURE;
+  }
+
+  // Load results.
+  if ((!baseline->load(argv[i])) || (!current->load(argv[i + 1]))) {
+    delete baseline;
+    delete current;
+
+    return EXIT_FAILURE;
+  }
+
+  printf("%-32s %14s %14s %9s\n", "Metric", "Baseline", "Current", "Change");
+
+  size_t nregressions = 0;
+
+  for (size_t j = 0; j < baseline->count(); j++) {
+    const char* const name = baseline->name(j);
+    const double before = baseline->value(j);
+
+    double after;
+    if (!current->find(name, after)) {
+      printf("%-32s %14.3f %14s\n", name, before, "missing");
+      continue;
+    }
+
+    // Change (percent).
+    double change;
+    if (before != 0.0) {
+      change = ((after - before) / fabs(before)) * 100.0;
+    } else {
+      change = (after != 0.0) ? INFINITY : 0.0;
+    }
+
+    // Is it a regression?
+    bool regression;
+    switch (classify(name)) {
+      case direction::higher:
+        regression = (-change > threshold);
+        break;
+      case direction::lower:
+        regression = (change > threshold);
+        break;
+      case direction::none:
+      default:
+        regression = false;
+    }
+
+    printf("%-32s %14.3f %14.3f %8.1f%%%s\n",
+           name,
+           before,
+           after,
+           change,
+           regression ? "  REGRESSION" : "");
+
+    if (regression) {
+      nregressions++;
+    }
+  }
+
+  delete baseline;
+  delete current;
+
+  if (nregressions == 0) {
+    printf("No regressions (threshold: %.1f%%).\n", threshold);
+    return EXIT_SUCCESS;
+  }
+
+  printf("%zu regression(s) (threshold: %.1f%%).\n", nregressions, threshold);
+
+  return EXIT_FAILURE;
+}
+
+direction classify(const char* name)
+{
+  // Throughput.
+  if (ends_with(name, "_per_second")) {
+    return direction::higher;
+  }
+
+  // Latency.
+  if (strncmp(name, "latencies_us.", 13) == 0) {
+    return ends_with(name, ".count") ? direction::none : direction::lower;
+  }
+
+  // Errors and CPU time.
+  if ((ends_with(name, "_errors")) || (ends_with(name, "_per_transfer"))) {
+    return direction::lower;
+  }
+
+  return direction::none;
+}
+
+bool ends_with(const char* s, const char* suffix)
+{
+  const size_t len = strlen(s);
+  const size_t suffixlen = strlen(suffix);
+
+  return (len >= suffixlen) && (strcmp(s + len - suffixlen, suffix) == 0);
+}
\ No newline at end of file
@@ -0,0 +1,508 @@
+// TCP receiver written with coroutines (requires `-std=c++20`).
+// Every connection slot is a coroutine which accepts a connection, writes
+// the data it receives to its own file and, once the client has closed the
+// connection, accepts the next one. A reporter coroutine prints the number
+// of accepted connections and the throughput periodically.
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "net/async/thread_pool.hpp"
+#include "net/async/stream/awaitable_socket.hpp"
+#include "net/library.hpp"
+#include "filesystem/async/awaitable_file.hpp"
+#include "util/awaitable_timer.hpp"
+#include "util/coroutine.hpp"
+#include "util/slab.hpp"
+
+static BOOL WINAPI signal_handler(DWORD control_type);
+static bool parse(const char* s, uint64_t& n, uint64_t min, uint64_t max);
+
+static HANDLE stop_event = nullptr;
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+//                                                                            //
+// Receiver.                                                                  //
+//                                                                            //
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+
+class receiver {
+  public:
+    // Minimum number of connections.
+    static constexpr const uint64_t min_connections = 1;
+
+    // Maximum number of connections.
+    static constexpr const uint64_t max_connections = 64 * 1024;
+
+    // Default number of connections.
+    static constexpr const uint64_t default_connections = 256;
+
+    // Minimum report interval (seconds).
+    static constexpr const uint64_t min_report_interval = 1;
+
+    // Maximum report interval (seconds).
+    static constexpr const uint64_t max_report_interval = 3600;
+
+    // Default report interval (seconds).
+    static constexpr const uint64_t default_report_interval = 5;
+
+    // Constructor.
+    receiver();
+
+    // Destructor.
+    ~receiver();
+
+    // Create.
+    bool create(const char* dir, size_t nconnections, uint64_t interval);
+
+    // Listen.
+    bool listen(const net::socket::address& addr);
+
+    // Stop (the coroutines stop at their next operation).
+    void stop();
+
+  private:
+    // Connection slot.
+    class slot {
+      public:
+        // Constructor.
+        slot(receiver& receiver,
+             size_t index,
+             PTP_CALLBACK_ENVIRON callbackenv);
+
+        // Destructor.
+        ~slot() = default;
+
+        // Accept connections and write their data to files.
+        util::coroutine::task run();
+
+        // Number of accepted connections.
+        uint64_t accepts() const;
+
+        // Number of bytes written.
+        uint64_t bytes() const;
+
+      private:
+        // Address length.
+        static constexpr const
+          DWORD address_length = sizeof(struct sockaddr_storage) + 16;
+
+        // Buffer size.
+        static constexpr const size_t buffer_size = 32 * 1024;
+
+        // Socket.
+        net::async::stream::awaitable_socket _M_sock;
+
+        // File.
+        filesystem::async::awaitable_file _M_file;
+
+        // Receiver.
+        receiver& _M_receiver;
+
+        // Index of the slot.
+        const size_t _M_index;
+
+        // Callback environment.
+        const PTP_CALLBACK_ENVIRON _M_callbackenv;
+
+        // Number of files.
+        size_t _M_nfiles = 0;
+
+        // Number of accepted connections.
+        uint64_t _M_accepts = 0;
+
+        // Number of bytes written.
+        uint64_t _M_bytes = 0;
+
+        // Buffer for storing the local and remote addresses.
+        uint8_t _M_addresses[2 * address_length];
+
+        // Buffer.
+        alignas(util::cache_line_size) uint8_t _M_buf[buffer_size];
+
+        // Disable copy constructor and assignment operator.
+        slot(const slot&) = delete;
+        slot& operator=(const slot&) = delete;
+    };
+
+    // Thread pool.
+    net::async::thread_pool _M_thread_pool;
+
+    // Listener.
+    net::async::stream::socket _M_sock;
+
+    // Report timer.
+    util::awaitable_timer _M_timer;
+
+    // Directory where to store the files.
+    const char* _M_dir = nullptr;
+
+    // Slots.
+    slot** _M_slots = nullptr;
+    size_t _M_nslots = 0;
+
+    // Number of slots.
+    size_t _M_maxslots = 0;
+
+    // Report interval (seconds).
+    uint64_t _M_interval = default_report_interval;
+
+    // Has the receiver been stopped?
+    uint32_t _M_stopped = 0;
+
+    // Allocator of slots.
+    util::slab _M_slab;
+
+    // Has the receiver been stopped?
+    bool stopped() const;
+
+    // Print the accepted connections and the throughput periodically.
+    util::coroutine::task report();
+
+    // Disable copy constructor and assignment operator.
+    receiver(const receiver&) = delete;
+    receiver& operator=(const receiver&) = delete;
+};
+
+receiver::receiver()
+  : _M_sock{nullptr, nullptr, _M_thread_pool.callback_environment()}
+{
+}
+
+receiver::~receiver()
+{
+  if (_M_slots) {
+    for (size_t i = 0; i < _M_nslots; i++) {
+      _M_slab.destroy(_M_slots[i]);
+    }
+
+    free(_M_slots);
+  }
+}
+
+bool receiver::create(const char* dir, size_t nconnections, uint64_t interval)
+{
+  // Create thread pool.
+  if (_M_thread_pool.create(net::async::thread_pool::min_threads,
+                            net::async::thread_pool::default_max_threads)) {
+    // Create report timer.
+    if (_M_timer.create(_M_thread_pool.callback_environment())) {
+      _M_dir = dir;
+      _M_maxslots = nconnections;
+      _M_interval = interval;
+
+      return true;
+    }
+  }
+
+  return false;
+}
+
+bool receiver::listen(const net::socket::address& addr)
+{
+  // Listen.
+  if (_M_sock.listen(addr)) {
+    _M_slots = static_cast<slot**>(malloc(_M_maxslots * sizeof(slot*)));
+
+    // Create slab allocator of slots (on the NUMA node of the threads).
+    if ((_M_slots) &&
+        (_M_slab.create(sizeof(slot),
+                        _M_maxslots,
+                        _M_thread_pool.numa_node()))) {
+      // Create slots.
+      for (; _M_nslots < _M_maxslots; _M_nslots++) {
+        slot* const
+          s = _M_slab.construct<slot>(*this,
+                                      _M_nslots,
+                                      _M_thread_pool.callback_environment());
+
+        if (!s) {
+          return false;
+        }
+
+        _M_slots[_M_nslots] = s;
+
+        // Start accepting connections.
+        s->run();
+      }
+
+      // Start reporting.
+      report();
+
+      return true;
+    }
+  }
+
+  return false;
+}
+
+void receiver::stop()
+{
+  ::InterlockedExchange(&_M_stopped, 1);
+}
+
+bool receiver::stopped() const
+{
+  return (::InterlockedCompareExchange(const_cast<uint32_t*>(&_M_stopped),
+                                       0,
+                                       0) != 0);
+}
+
+util::coroutine::task receiver::report()
+{
+  uint64_t bytes = 0;
+
+  while (!stopped()) {
+    // Wait for the next report.
+    co_await _M_timer.sleep(_M_interval * 1000ull * 1000ull);
+
+    // Sum the counters of the slots (every counter is written by a single
+    // slot, and only grows).
+    uint64_t a = 0;
+    uint64_t b = 0;
+    for (size_t i = 0; i < _M_nslots; i++) {
+      a += _M_slots[i]->accepts();
+      b += _M_slots[i]->bytes();
+    }
+
+    printf("%llu connections accepted, %.1f MiB/s.\n",
+           static_cast<unsigned long long>(a),
+           (b - bytes) / static_cast<double>(_M_interval) /
+           (1024.0 * 1024.0));
+
+    fflush(stdout);
+
+    bytes = b;
+  }
+}
+
+receiver::slot::slot(receiver& receiver,
+                     size_t index,
+                     PTP_CALLBACK_ENVIRON callbackenv)
+  : _M_sock{callbackenv},
+    _M_receiver{receiver},
+    _M_index{index},
+    _M_callbackenv{callbackenv}
+{
+}
+
+util::coroutine::task receiver::slot::run()
+{
+  while (!_M_receiver.stopped()) {
+    // Accept connection.
+    util::coroutine::result res = co_await _M_sock.accept(_M_receiver._M_sock,
+                                                          _M_addresses,
+                                                          address_length);
+
+    // If the connection could not be accepted...
+    if (res.error != 0) {
+      continue;
+    }
+
+    _M_accepts++;
+
+    // Compose name of the file to be created.
+    char pathname[MAX_PATH];
+    snprintf(pathname,
+             sizeof(pathname),
+             "%s\\file-%zu-%zu.bin",
+             _M_receiver._M_dir,
+             _M_index,
+             ++_M_nfiles);
+
+    // Open file for writing.
+    if (_M_file.open(pathname,
+                     filesystem::async::file_base::mode::write,
+                     _M_callbackenv)) {
+      // Write the data received to the file until the client closes the
+      // connection.
+      while (((res = co_await _M_sock.receive(_M_buf, sizeof(_M_buf))).error ==
+              0) &&
+             (res.transferred > 0)) {
+        const DWORD len = res.transferred;
+
+        if ((co_await _M_file.write(_M_buf, len)).error != 0) {
+          fprintf(stderr, "Error writing to '%s'.\n", pathname);
+          break;
+        }
+
+        _M_bytes += len;
+      }
+
+      // Close file.
+      _M_file.close();
+    } else {
+      fprintf(stderr, "Error opening file '%s' for writing.\n", pathname);
+    }
+
+    // Disconnect.
+    co_await _M_sock.disconnect();
+  }
+}
+
+uint64_t receiver::slot::accepts() const
+{
+  return _M_accepts;
+}
+
+uint64_t receiver::slot::bytes() const
+{
+  return _M_bytes;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+//                                                                            //
+// Main function.                                                             //
+//                                                                            //
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+
+int main(int argc, const char* argv[])
+{
+  // Number of connections.
+  uint64_t nconnections = receiver::default_connections;
+
+  // Report interval.
+  uint64_t interval = receiver::default_report_interval;
+
+  // Parse options.
+  int i = 1;
+  bool valid = true;
+  while ((valid) && (i < argc) && (strncmp(argv[i], "--", 2) == 0)) {
+    if ((strcmp(argv[i], "--number-connections") == 0) && (i + 1 < argc)) {
+      valid = parse(argv[i + 1],
+                    nconnections,
+                    receiver::min_connections,
+                    receiver::max_connections);
+
+      i += 2;
+    } else if ((strcmp(argv[i], "--report-interval") == 0) &&
+               (i + 1 < argc)) {
+      valid = parse(argv[i + 1],
+                    interval,
+                    receiver::min_report_interval,
+                    receiver::max_report_interval);
+
+      i += 2;
+    } else {
+      valid = false;
+    }
+  }
+
+  // Check usage.
+  if ((valid) && (i + 2 == argc)) {
+    // Initiate use of the Winsock DLL.
+    net::library library;
+    if (library.init()) {
+      // Build socket address.
+      net::socket::address addr;
+      if (addr.build(argv[i])) {
+        // Load functions.
+        if (net::async::stream::socket::load_functions()) {
+          // Create event.
+          stop_event = ::CreateEvent(nullptr, TRUE, FALSE, nullptr);
+
+          // If the event could be created...
+          if (stop_event) {
+            // Install signal handler.
+            if (::SetConsoleCtrlHandler(signal_handler, TRUE)) {
+              // Create receiver.
+              receiver r;
+              if (r.create(argv[i + 1],
+                           static_cast<size_t>(nconnections),
+                           interval)) {
+                // Listen.
+                if (r.listen(addr)) {
+                  printf("Waiting for signal to arrive.\n");
+
+                  // Wait for signal to arrive.
+                  ::WaitForSingleObject(stop_event, INFINITE);
+
+                  printf("Signal received.\n");
+
+                  r.stop();
+
+                  ::CloseHandle(stop_event);
+
+                  return EXIT_SUCCESS;
+                } else {
+                  fprintf(stderr, "Error listening on '%s'.\n", argv[i]);
+                }
+              } else {
+                fprintf(stderr, "Error creating receiver.\n");
+              }
+            } else {
+              fprintf(stderr, "Error installing signal handler.\n");
+            }
+
+            ::CloseHandle(stop_event);
+          } else {
+            fprintf(stderr, "Error creating event.\n");
+          }
+        } else {
+          fprintf(stderr, "Error loading functions.\n");
+        }
+      } else {
+        fprintf(stderr, "Error building socket address '%s'.\n", argv[i]);
+      }
+    } else {
+      fprintf(stderr, "Error initiating use of the Winsock DLL.\n");
+    }
+  } else {
+    fprintf(stderr,
+            "Usage: %s [--number-connections <count>] "
+            "[--report-interval <seconds>] <address> <directory>\n",
+            argv[0]);
+  }
+
+  return EXIT_FAILURE;
+}
+
+BOOL WINAPI signal_handler(DWORD control_type)
+{
+  switch (control_type) {
+    case CTRL_C_EVENT:
+    case CTRL_CLOSE_EVENT:
+      ::SetEvent(stop_event);
+
+      return TRUE;
+    default:
+      return FALSE;
+  }
+}
+
+bool parse(const char* s, uint64_t& n, uint64_t min, uint64_t max)
+{
+  if (*s) {
+    uint64_t res = 0;
+
+    do {
+      // Digit?
+      if ((*s >= '0') && (*s <= '9')) {
+        const uint64_t tmp = (res * 10) + (*s - '0');
+
+        // If the number doesn't overflow and is not too big...
+        if ((tmp >= res) && (tmp <= max)) {
+          res = tmp;
+        } else {
+          return false;
+        }
+      } else {
+        return false;
+      }
+    } while (*++s);
+
+    if (res >= min) {
+      n = res;
+      return true;
+    }
+  }
+
+  return false;
+}
\ No newline at end of file
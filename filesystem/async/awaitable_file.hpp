@@ -0,0 +1,124 @@
+#pragma once
+
+// Requires `-std=c++20`.
+
+#include "filesystem/async/file.hpp"
+#include "util/coroutine.hpp"
+
+namespace filesystem {
+namespace async {
+
+// Asynchronous file awaitable from coroutines.
+// read() and write() return an awaiter whose result is a
+// `util::coroutine::result` (error code and bytes transferred). Only one
+// operation might be outstanding at a time.
+class awaitable_file {
+  public:
+    // Constructor.
+    awaitable_file();
+
+    // Destructor.
+    ~awaitable_file() = default;
+
+    // Open file.
+    bool open(const char* pathname,
+              file_base::mode m,
+              PTP_CALLBACK_ENVIRON callbackenv = nullptr);
+
+    // Is the file open?
+    bool open() const;
+
+    // Close.
+    void close();
+
+    // Read.
+    auto read(void* buf, size_t len);
+
+    // Write.
+    auto write(const void* buf, size_t len);
+
+    // Cancel outstanding operation.
+    void cancel();
+
+  private:
+    // Completion handler.
+    class handler {
+      public:
+        // Constructor.
+        handler(awaitable_file* f);
+
+        // Resume the coroutine awaiting the operation.
+        void operator()(DWORD error, DWORD transferred) const;
+
+      private:
+        // File.
+        awaitable_file* const _M_file;
+    };
+
+    // File.
+    basic_file<handler> _M_file;
+
+    // Operation state.
+    util::coroutine::operation_state _M_state;
+
+    // Disable copy constructor and assignment operator.
+    awaitable_file(const awaitable_file&) = delete;
+    awaitable_file& operator=(const awaitable_file&) = delete;
+};
+
+inline awaitable_file::awaitable_file()
+  : _M_file{this}
+{
+}
+
+inline bool awaitable_file::open(const char* pathname,
+                                 file_base::mode m,
+                                 PTP_CALLBACK_ENVIRON callbackenv)
+{
+  return _M_file.open(pathname, m, callbackenv);
+}
+
+inline bool awaitable_file::open() const
+{
+  return _M_file.open();
+}
+
+inline void awaitable_file::close()
+{
+  _M_file.close();
+}
+
+inline auto awaitable_file::read(void* buf, size_t len)
+{
+  return util::coroutine::awaiter{_M_state,
+                                  [this, buf, len]() {
+                                    _M_file.read(buf, len);
+                                  }};
+}
+
+inline auto awaitable_file::write(const void* buf, size_t len)
+{
+  return util::coroutine::awaiter{_M_state,
+                                  [this, buf, len]() {
+                                    _M_file.write(buf, len);
+                                  }};
+}
+
+inline void awaitable_file::cancel()
+{
+  _M_file.cancel();
+}
+
+inline awaitable_file::handler::handler(awaitable_file* f)
+  : _M_file{f}
+{
+}
+
+inline void awaitable_file::handler::operator()(DWORD error,
+                                                DWORD transferred) const
+{
+  _M_file->_M_state.complete(error, transferred);
+}
+
+} // namespace async
+} // namespace filesystem
\ No newline at end of file
@@ -3,19 +3,23 @@
 namespace filesystem {
 namespace async {
 
-file::file(completefn complete, void* user)
-  : _M_complete{complete},
-    _M_user{user}
+// Are memory ranges registered?
+uint32_t file_base::_M_register_ranges = 1;
+
+file_base::file_base(PTP_WIN32_IO_CALLBACK io_callback)
+  : _M_io_callback{io_callback}
 {
 }
 
-file::~file()
+file_base::~file_base()
 {
   // Close file.
   close();
 }
 
-bool file::open(const char* pathname, mode m, PTP_CALLBACK_ENVIRON callbackenv)
+bool file_base::open(const char* pathname,
+                     mode m,
+                     PTP_CALLBACK_ENVIRON callbackenv)
 {
   // Open file for reading?
   if (m == mode::read) {
@@ -30,7 +34,7 @@ bool file::open(const char* pathname, mode m, PTP_CALLBACK_ENVIRON callbackenv)
   } else {
     // Open file for writing.
     _M_file = ::CreateFile(pathname,
-                           GENERIC_WRITE,
+                           GENERIC_WRITE | FILE_READ_ATTRIBUTES,
                            FILE_SHARE_READ,
                            nullptr,
                            OPEN_ALWAYS,
@@ -43,12 +47,15 @@ bool file::open(const char* pathname, mode m, PTP_CALLBACK_ENVIRON callbackenv)
   // If the file could be opened..
   if (_M_file != INVALID_HANDLE_VALUE) {
     // Do not queue completion packets to the I/O completion port when
-    // I/O operations complete immediately.
-    static constexpr const UCHAR flags = FILE_SKIP_COMPLETION_PORT_ON_SUCCESS;
+    // I/O operations complete immediately and do not signal the file
+    // handle (nobody waits on it).
+    static constexpr const UCHAR flags = FILE_SKIP_COMPLETION_PORT_ON_SUCCESS |
+                                         FILE_SKIP_SET_EVENT_ON_HANDLE;
+
     if (::SetFileCompletionNotificationModes(_M_file, flags)) {
       // Create I/O completion object.
       _M_io = ::CreateThreadpoolIo(_M_file,
-                                   io_completion_callback,
+                                   _M_io_callback,
                                    this,
                                    callbackenv);
 
@@ -57,6 +64,9 @@ bool file::open(const char* pathname, mode m, PTP_CALLBACK_ENVIRON callbackenv)
         // Clear overlapped structure.
         memset(&_M_overlapped, 0, sizeof(OVERLAPPED));
 
+        // Register the memory range with the file handle.
+        register_range();
+
         return true;
       }
     }
@@ -65,12 +75,57 @@ bool file::open(const char* pathname, mode m, PTP_CALLBACK_ENVIRON callbackenv)
   return false;
 }
 
-bool file::open() const
+void file_base::register_range()
+{
+  // If the privilege to lock memory is missing (a previous registration
+  // failed because of it)...
+  if (::InterlockedCompareExchange(&_M_register_ranges, 0, 0) == 0) {
+    // Fall back to locking the pages on every I/O operation.
+    _M_range_error = ERROR_PRIVILEGE_NOT_HELD;
+    return;
+  }
+
+  // The range covers the overlapped structure and the range of the user
+  // (if any).
+  uintptr_t begin = reinterpret_cast<uintptr_t>(&_M_overlapped);
+  uintptr_t end = begin + sizeof(OVERLAPPED);
+
+  if (_M_range) {
+    const uintptr_t b = reinterpret_cast<uintptr_t>(_M_range);
+    const uintptr_t e = b + _M_range_length;
+
+    if (b < begin) {
+      begin = b;
+    }
+
+    if (e > end) {
+      end = e;
+    }
+  }
+
+  // Register the range, so the kernel locks it once instead of on every I/O
+  // operation.
+  if (::SetFileIoOverlappedRange(_M_file,
+                                 reinterpret_cast<PUCHAR>(begin),
+                                 static_cast<ULONG>(end - begin))) {
+    _M_range_error = 0;
+  } else {
+    _M_range_error = ::GetLastError();
+
+    // Without the privilege, no other file will be able to register its
+    // range.
+    if (_M_range_error == ERROR_PRIVILEGE_NOT_HELD) {
+      ::InterlockedExchange(&_M_register_ranges, 0);
+    }
+  }
+}
+
+bool file_base::open() const
 {
   return (_M_file != INVALID_HANDLE_VALUE);
 }
 
-void file::close()
+void file_base::close()
 {
   // Cancel pending callbacks.
   cancel();
@@ -88,17 +143,16 @@ void file::close()
   }
 }
 
-void file::read(void* buf, size_t len)
+DWORD file_base::start_read(void* buf, size_t len, DWORD& count)
 {
   // Notify the thread pool that an I/O operation might begin.
   ::StartThreadpoolIo(_M_io);
 
-  DWORD count;
   if (::ReadFile(_M_file, buf, len, &count, &_M_overlapped)) {
     // Cancel notification.
     ::CancelThreadpoolIo(_M_io);
 
-    _M_complete(*this, 0, count, _M_user);
+    return 0;
   } else {
     // Get error code.
     const DWORD error = ::GetLastError();
@@ -106,13 +160,13 @@ void file::read(void* buf, size_t len)
     if (error != ERROR_IO_PENDING) {
       // Cancel notification.
       ::CancelThreadpoolIo(_M_io);
-
-      _M_complete(*this, error, count, _M_user);
     }
+
+    return error;
   }
 }
 
-void file::write(const void* buf, size_t len)
+DWORD file_base::start_write(const void* buf, size_t len, DWORD& count)
 {
   // Notify the thread pool that an I/O operation might begin.
   ::StartThreadpoolIo(_M_io);
@@ -121,12 +175,11 @@ void file::write(const void* buf, size_t len)
   _M_overlapped.Offset = 0xffffffff;
   _M_overlapped.OffsetHigh = 0xffffffff;
 
-  DWORD count;
   if (::WriteFile(_M_file, buf, len, &count, &_M_overlapped)) {
     // Cancel notification.
     ::CancelThreadpoolIo(_M_io);
 
-    _M_complete(*this, 0, count, _M_user);
+    return 0;
   } else {
     // Get error code.
     const DWORD error = ::GetLastError();
@@ -134,29 +187,18 @@ void file::write(const void* buf, size_t len)
     if (error != ERROR_IO_PENDING) {
       // Cancel notification.
       ::CancelThreadpoolIo(_M_io);
-
-      _M_complete(*this, error, count, _M_user);
     }
+
+    return error;
   }
 }
 
-void file::cancel()
+void file_base::cancel()
 {
   if (_M_file != INVALID_HANDLE_VALUE) {
     ::CancelIoEx(_M_file, &_M_overlapped);
   }
 }
 
-void CALLBACK file::io_completion_callback(PTP_CALLBACK_INSTANCE instance,
-                                           void* context,
-                                           void* overlapped,
-                                           ULONG result,
-                                           ULONG_PTR transferred,
-                                           PTP_IO io)
-{
-  file* const f = static_cast<file*>(context);
-  f->_M_complete(*f, result, transferred, f->_M_user);
-}
-
 } // namespace async
 } // namespace filesystem
\ No newline at end of file
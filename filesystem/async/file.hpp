@@ -1,27 +1,14 @@
 #pragma once
 
+#include <stdint.h>
 #include <windows.h>
 
 namespace filesystem {
 namespace async {
 
-// Asynchronous file.
-class file {
+// Asynchronous file (part independent of the completion handler).
+class file_base {
   public:
-    // Notify of a completed I/O operation.
-    // Arguments:
-    //   file&: file
-    //   DWORD: error number
-    //   DWORD: number of bytes transferred in the I/O operation
-    //   void*: pointer to user data
-    typedef void (*completefn)(file&, DWORD, DWORD, void*);
-
-    // Constructor.
-    file(completefn complete, void* user = nullptr);
-
-    // Destructor.
-    ~file();
-
     // Open mode.
     enum class mode {
       read,
@@ -39,16 +26,29 @@ class file {
     // Close.
     void close();
 
-    // Read.
-    void read(void* buf, size_t len);
-
-    // Write.
-    void write(const void* buf, size_t len);
-
     // Cancel pending callbacks.
     void cancel();
 
+    // Set the memory range registered with the file handle when the file is
+    // opened (`SetFileIoOverlappedRange()`), together with the overlapped
+    // structure: typically the object containing the file and the buffers
+    // it writes from. The kernel then locks the range once, instead of on
+    // every I/O operation. The range must outlive the file.
+    void io_range(const void* addr, size_t len);
+
+    // Error registering the memory range of the open file (0 on success).
+    // Registering requires the `SeLockMemoryPrivilege` privilege: without
+    // it (`ERROR_PRIVILEGE_NOT_HELD`), no other file tries to register its
+    // range, and the pages are locked on every I/O operation.
+    DWORD io_range_error() const;
+
   protected:
+    // Constructor.
+    file_base(PTP_WIN32_IO_CALLBACK io_callback);
+
+    // Destructor.
+    ~file_base();
+
     // File handle.
     HANDLE _M_file = INVALID_HANDLE_VALUE;
 
@@ -58,11 +58,62 @@ class file {
     // I/O completion object.
     PTP_IO _M_io = nullptr;
 
-    // Completion callback.
-    const completefn _M_complete;
+    // I/O completion callback.
+    const PTP_WIN32_IO_CALLBACK _M_io_callback;
 
-    // Pointer to user data.
-    void* _M_user;
+    // Memory range registered with the file handle (besides the overlapped
+    // structure).
+    const void* _M_range = nullptr;
+    size_t _M_range_length = 0;
+
+    // Error registering the memory range.
+    DWORD _M_range_error = 0;
+
+    // Are memory ranges registered? (cleared when the privilege is missing)
+    static uint32_t _M_register_ranges;
+
+    // Register the memory range with the file handle.
+    void register_range();
+
+    // The following functions start an asynchronous operation.
+    // They return `ERROR_IO_PENDING` if the operation is in progress,
+    // otherwise the operation has already completed and the result is
+    // returned (0 on success).
+
+    // Start an asynchronous read.
+    DWORD start_read(void* buf, size_t len, DWORD& count);
+
+    // Start an asynchronous write.
+    DWORD start_write(const void* buf, size_t len, DWORD& count);
+
+    // Disable copy constructor and assignment operator.
+    file_base(const file_base&) = delete;
+    file_base& operator=(const file_base&) = delete;
+};
+
+// Asynchronous file.
+// `Handler` is invoked on every completion as:
+//   handler(DWORD error, DWORD transferred)
+// The handler is stored by value and called directly from the completion
+// dispatch, so the compiler can inline it.
+template<typename Handler>
+class basic_file : public file_base {
+  public:
+    // Constructor.
+    basic_file(Handler handler);
+
+    // Destructor.
+    ~basic_file() = default;
+
+    // Read.
+    void read(void* buf, size_t len);
+
+    // Write.
+    void write(const void* buf, size_t len);
+
+  private:
+    // Completion handler.
+    Handler _M_handler;
 
     // I/O completion callback.
     static void CALLBACK io_completion_callback(PTP_CALLBACK_INSTANCE instance,
@@ -71,11 +122,157 @@ class file {
                                                 ULONG result,
                                                 ULONG_PTR transferred,
                                                 PTP_IO io);
+};
 
-    // Disable copy constructor and assignment operator.
-    file(const file&) = delete;
-    file& operator=(const file&) = delete;
+// Forward declaration.
+class file;
+
+// Completion handler calling a function pointer.
+class callback_handler {
+  public:
+    // Notify of a completed I/O operation.
+    // Arguments:
+    //   file&: file
+    //   DWORD: error number
+    //   DWORD: number of bytes transferred in the I/O operation
+    //   void*: pointer to user data
+    typedef void (*completefn)(file&, DWORD, DWORD, void*);
+
+    // Constructor.
+    callback_handler(file& f, completefn complete, void* user);
+
+    // Invoke callback.
+    void operator()(DWORD error, DWORD transferred) const;
+
+  private:
+    // File.
+    file& _M_file;
+
+    // Completion callback.
+    const completefn _M_complete;
+
+    // Pointer to user data.
+    void* const _M_user;
+};
+
+// Completion handler calling the member function `fn` of an object.
+template<typename T, void (T::*fn)(DWORD, DWORD)>
+class member_handler {
+  public:
+    // Constructor.
+    member_handler(T* object);
+
+    // Invoke member function.
+    void operator()(DWORD error, DWORD transferred) const;
+
+  private:
+    // Object.
+    T* const _M_object;
 };
 
+// Asynchronous file with a function pointer callback.
+class file : public basic_file<callback_handler> {
+  public:
+    // Notify of a completed I/O operation.
+    typedef callback_handler::completefn completefn;
+
+    // Constructor.
+    file(completefn complete, void* user = nullptr);
+
+    // Destructor.
+    ~file() = default;
+};
+
+inline void file_base::io_range(const void* addr, size_t len)
+{
+  _M_range = addr;
+  _M_range_length = len;
+}
+
+inline DWORD file_base::io_range_error() const
+{
+  return _M_range_error;
+}
+
+template<typename Handler>
+inline basic_file<Handler>::basic_file(Handler handler)
+  : file_base{io_completion_callback},
+    _M_handler{handler}
+{
+}
+
+template<typename Handler>
+inline void basic_file<Handler>::read(void* buf, size_t len)
+{
+  // Start an asynchronous read.
+  DWORD count;
+  const DWORD error = start_read(buf, len, count);
+
+  // If the read has already completed...
+  if (error != ERROR_IO_PENDING) {
+    _M_handler(error, count);
+  }
+}
+
+template<typename Handler>
+inline void basic_file<Handler>::write(const void* buf, size_t len)
+{
+  // Start an asynchronous write.
+  DWORD count;
+  const DWORD error = start_write(buf, len, count);
+
+  // If the write has already completed...
+  if (error != ERROR_IO_PENDING) {
+    _M_handler(error, count);
+  }
+}
+
+template<typename Handler>
+void CALLBACK
+basic_file<Handler>::io_completion_callback(PTP_CALLBACK_INSTANCE instance,
+                                            void* context,
+                                            void* overlapped,
+                                            ULONG result,
+                                            ULONG_PTR transferred,
+                                            PTP_IO io)
+{
+  basic_file* const
+    f = static_cast<basic_file*>(static_cast<file_base*>(context));
+
+  f->_M_handler(result, transferred);
+}
+
+inline callback_handler::callback_handler(file& f,
+                                          completefn complete,
+                                          void* user)
+  : _M_file{f},
+    _M_complete{complete},
+    _M_user{user}
+{
+}
+
+inline void callback_handler::operator()(DWORD error, DWORD transferred) const
+{
+  _M_complete(_M_file, error, transferred, _M_user);
+}
+
+template<typename T, void (T::*fn)(DWORD, DWORD)>
+inline member_handler<T, fn>::member_handler(T* object)
+  : _M_object{object}
+{
+}
+
+template<typename T, void (T::*fn)(DWORD, DWORD)>
+inline void member_handler<T, fn>::operator()(DWORD error,
+                                              DWORD transferred) const
+{
+  (_M_object->*fn)(error, transferred);
+}
+
+inline file::file(completefn complete, void* user)
+  : basic_file{callback_handler{*this, complete, user}}
+{
+}
+
 } // namespace async
 } // namespace filesystem
\ No newline at end of file
@@ -0,0 +1,222 @@
+#pragma once
+
+// Requires `-std=c++20`.
+
+#include "net/async/stream/socket.hpp"
+#include "util/coroutine.hpp"
+
+namespace net {
+namespace async {
+namespace stream {
+
+// Asynchronous stream socket awaitable from coroutines.
+// Every operation returns an awaiter whose result is a
+// `util::coroutine::result` (error code and bytes transferred):
+//
+//   util::coroutine::task echo(awaitable_socket& sock)
+//   {
+//     uint8_t buf[4096];
+//     util::coroutine::result res;
+//     while (((res = co_await sock.receive(buf, sizeof(buf))).error == 0) &&
+//            (res.transferred > 0)) {
+//       if ((co_await sock.send(buf, res.transferred)).error != 0) {
+//         break;
+//       }
+//     }
+//
+//     co_await sock.disconnect();
+//   }
+//
+// A receive and a send might be awaited at the same time (by different
+// coroutines), but not two operations of the same kind. As with the other
+// sockets, the buffer belongs to the socket until the operation completes.
+class awaitable_socket {
+  public:
+    // Constructor.
+    awaitable_socket(PTP_CALLBACK_ENVIRON callbackenv = nullptr);
+
+    // Destructor.
+    ~awaitable_socket() = default;
+
+    // Accept a connection from `listener`.
+    template<typename Handler>
+    auto accept(basic_socket<Handler>& listener,
+                void* addresses,
+                DWORD addrlen);
+
+    // Connect.
+    auto connect(const net::socket::address& addr);
+
+    // Receive.
+    auto receive(void* buf, size_t len, DWORD flags = 0);
+
+    // Send.
+    auto send(const void* buf, size_t len, DWORD flags = 0);
+
+    // Disconnect.
+    auto disconnect();
+
+    // Get local address.
+    void local(void* addresses, DWORD addrlen, net::socket::address& addr);
+
+    // Get remote addess.
+    void remote(void* addresses, DWORD addrlen, net::socket::address& addr);
+
+    // Cancel all outstanding operations.
+    void cancel();
+
+    // Cancel outstanding operation.
+    void cancel(socket_base::operation op);
+
+    // Enable or disable zero-copy sends.
+    void zero_copy_send(bool enable);
+
+  private:
+    // Completion handler.
+    class handler {
+      public:
+        // Constructor.
+        handler(awaitable_socket* sock);
+
+        // Resume the coroutine awaiting the operation.
+        void operator()(socket_base::operation op,
+                        DWORD error,
+                        DWORD transferred) const;
+
+      private:
+        // Socket.
+        awaitable_socket* const _M_sock;
+    };
+
+    // Socket.
+    basic_socket<handler> _M_sock;
+
+    // State of the accept or connect operation.
+    util::coroutine::operation_state _M_connection;
+
+    // State of the receive operation.
+    util::coroutine::operation_state _M_receive;
+
+    // State of the send operation.
+    util::coroutine::operation_state _M_send;
+
+    // State of the disconnect operation.
+    util::coroutine::operation_state _M_disconnect;
+
+    // Disable copy constructor and assignment operator.
+    awaitable_socket(const awaitable_socket&) = delete;
+    awaitable_socket& operator=(const awaitable_socket&) = delete;
+};
+
+inline awaitable_socket::awaitable_socket(PTP_CALLBACK_ENVIRON callbackenv)
+  : _M_sock{this, callbackenv}
+{
+}
+
+template<typename Handler>
+inline auto awaitable_socket::accept(basic_socket<Handler>& listener,
+                                     void* addresses,
+                                     DWORD addrlen)
+{
+  return util::coroutine::awaiter{
+           _M_connection,
+           [this, &listener, addresses, addrlen]() {
+             listener.accept(_M_sock, addresses, addrlen);
+           }
+         };
+}
+
+inline auto awaitable_socket::connect(const net::socket::address& addr)
+{
+  return util::coroutine::awaiter{_M_connection,
+                                  [this, &addr]() {
+                                    _M_sock.connect(addr);
+                                  }};
+}
+
+inline auto awaitable_socket::receive(void* buf, size_t len, DWORD flags)
+{
+  return util::coroutine::awaiter{_M_receive,
+                                  [this, buf, len, flags]() {
+                                    _M_sock.receive(buf, len, flags);
+                                  }};
+}
+
+inline auto awaitable_socket::send(const void* buf, size_t len, DWORD flags)
+{
+  return util::coroutine::awaiter{_M_send,
+                                  [this, buf, len, flags]() {
+                                    _M_sock.send(buf, len, flags);
+                                  }};
+}
+
+inline auto awaitable_socket::disconnect()
+{
+  return util::coroutine::awaiter{_M_disconnect,
+                                  [this]() {
+                                    _M_sock.disconnect();
+                                  }};
+}
+
+inline void awaitable_socket::local(void* addresses,
+                                    DWORD addrlen,
+                                    net::socket::address& addr)
+{
+  _M_sock.local(addresses, addrlen, addr);
+}
+
+inline void awaitable_socket::remote(void* addresses,
+                                     DWORD addrlen,
+                                     net::socket::address& addr)
+{
+  _M_sock.remote(addresses, addrlen, addr);
+}
+
+inline void awaitable_socket::cancel()
+{
+  _M_sock.cancel();
+}
+
+inline void awaitable_socket::cancel(socket_base::operation op)
+{
+  _M_sock.cancel(op);
+}
+
+inline void awaitable_socket::zero_copy_send(bool enable)
+{
+  _M_sock.zero_copy_send(enable);
+}
+
+inline awaitable_socket::handler::handler(awaitable_socket* sock)
+  : _M_sock{sock}
+{
+}
+
+inline void awaitable_socket::handler::operator()(socket_base::operation op,
+                                                  DWORD error,
+                                                  DWORD transferred) const
+{
+  switch (op) {
+    case socket_base::operation::receive:
+      _M_sock->_M_receive.complete(error, transferred);
+
+      break;
+    case socket_base::operation::send:
+      _M_sock->_M_send.complete(error, transferred);
+
+      break;
+    case socket_base::operation::accept:
+    case socket_base::operation::connect:
+      _M_sock->_M_connection.complete(error, transferred);
+
+      break;
+    case socket_base::operation::disconnect:
+      _M_sock->_M_disconnect.complete(error, transferred);
+
+      break;
+  }
+}
+
+} // namespace stream
+} // namespace async
+} // namespace net
\ No newline at end of file
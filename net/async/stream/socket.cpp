@@ -1,22 +1,27 @@
 #include "net/async/stream/socket.hpp"
 
+// Older SDKs don't define SO_PORT_SCALABILITY (ws2def.h).
+#ifndef SO_PORT_SCALABILITY
+#define SO_PORT_SCALABILITY 0x3006
+#endif
+
 namespace net {
 namespace async {
 namespace stream {
 
 // Pointer to the AcceptEx() function.
-LPFN_ACCEPTEX socket::_M_acceptex = nullptr;
+LPFN_ACCEPTEX socket_base::_M_acceptex = nullptr;
 
 // Pointer to the GetAcceptExSockaddrs() function.
-LPFN_GETACCEPTEXSOCKADDRS socket::_M_getacceptexsockaddrs = nullptr;
+LPFN_GETACCEPTEXSOCKADDRS socket_base::_M_getacceptexsockaddrs = nullptr;
 
 // Pointer to the ConnectEx() function.
-LPFN_CONNECTEX socket::_M_connectex = nullptr;
+LPFN_CONNECTEX socket_base::_M_connectex = nullptr;
 
 // Pointer to the DisconnectEx() function.
-LPFN_DISCONNECTEX socket::_M_disconnectex = nullptr;
+LPFN_DISCONNECTEX socket_base::_M_disconnectex = nullptr;
 
-bool socket::load_functions()
+bool socket_base::load_functions()
 {
   // Create socket.
   const SOCKET sock = ::WSASocket(AF_INET,
@@ -105,19 +110,19 @@ bool socket::load_functions()
   return false;
 }
 
-socket::socket(callbackfn callback,
-               void* user,
-               PTP_CALLBACK_ENVIRON callbackenv)
+socket_base::socket_base(PTP_WIN32_IO_CALLBACK io_callback,
+                         acceptfn accept_callback,
+                         PTP_CALLBACK_ENVIRON callbackenv)
   : _M_receiveov{operation::receive},
     _M_sendov{operation::send},
     _M_disconnectov{operation::disconnect},
-    _M_callback{callback},
-    _M_user{user},
+    _M_io_callback{io_callback},
+    _M_accept_callback{accept_callback},
     _M_callbackenv{callbackenv}
 {
 }
 
-socket::~socket()
+socket_base::~socket_base()
 {
   // Cancel outstanding socket operations.
   cancel();
@@ -133,7 +138,7 @@ socket::~socket()
   }
 }
 
-bool socket::listen(const net::socket::address& addr)
+bool socket_base::listen(const net::socket::address& addr)
 {
   // Initialize socket.
   if (init(addr.family()) == 0) {
@@ -171,15 +176,16 @@ bool socket::listen(const net::socket::address& addr)
   return false;
 }
 
-void socket::accept(socket& sock, void* addresses, DWORD addrlen)
+DWORD socket_base::start_accept(socket_base& sock,
+                                void* addresses,
+                                DWORD addrlen)
 {
-  // Initialize socket.
-  DWORD error = sock.init(_M_domain);
+  // Prepare socket (reusing it, if possible).
+  DWORD error = sock.prepare(_M_domain, true);
 
   // Error?
   if (error != 0) {
-    sock._M_callback(operation::accept, error, 0, sock._M_user);
-    return;
+    return error;
   }
 
   // Save listener.
@@ -207,15 +213,13 @@ void socket::accept(socket& sock, void* addresses, DWORD addrlen)
     // Update accept context.
     error = sock.update_accept_context();
 
-    // Success?
-    if (error == 0) {
-      sock._M_callback(operation::accept, 0, 0, sock._M_user);
-    } else {
+    // Error?
+    if (error != 0) {
       // Close socket.
       sock.close();
-
-      sock._M_callback(operation::accept, error, 0, sock._M_user);
     }
+
+    return error;
   } else {
     // Get error code.
     const int error = ::WSAGetLastError();
@@ -228,13 +232,15 @@ void socket::accept(socket& sock, void* addresses, DWORD addrlen)
 
       // Close socket.
       sock.close();
-
-      sock._M_callback(operation::accept, error, 0, sock._M_user);
     }
+
+    return error;
   }
 }
 
-void socket::local(void* addresses, DWORD addrlen, net::socket::address& addr)
+void socket_base::local(void* addresses,
+                        DWORD addrlen,
+                        net::socket::address& addr)
 {
   struct sockaddr* local;
   struct sockaddr* remote;
@@ -252,7 +258,9 @@ void socket::local(void* addresses, DWORD addrlen, net::socket::address& addr)
   addr.build(*local, locallen);
 }
 
-void socket::remote(void* addresses, DWORD addrlen, net::socket::address& addr)
+void socket_base::remote(void* addresses,
+                         DWORD addrlen,
+                         net::socket::address& addr)
 {
   struct sockaddr* local;
   struct sockaddr* remote;
@@ -270,27 +278,29 @@ void socket::remote(void* addresses, DWORD addrlen, net::socket::address& addr)
   addr.build(*remote, remotelen);
 }
 
-void socket::connect(const net::socket::address& addr)
+DWORD socket_base::start_connect(const net::socket::address& addr)
 {
-  // Initialize socket.
-  DWORD error = init(addr.family());
+  // Prepare socket (reusing it, if possible).
+  DWORD error = prepare(addr.family(), false);
+
+  // Error?
+  if (error != 0) {
+    return error;
+  }
 
-  // Success?
-  if (error == 0) {
-    // Bind.
-    error = bind(addr.family());
+  // If the socket is not reused (a reused socket is still bound)...
+  if (!_M_reused) {
+    // Bind (to the source address, if any).
+    error = (_M_source_address) ? bind(*_M_source_address) :
+                                  bind(addr.family());
 
     // Error?
     if (error != 0) {
       // Close socket.
       close();
 
-      _M_callback(operation::connect, error, 0, _M_user);
-      return;
+      return error;
     }
-  } else {
-    _M_callback(operation::connect, error, 0, _M_user);
-    return;
   }
 
   // Set socket operation.
@@ -313,15 +323,13 @@ void socket::connect(const net::socket::address& addr)
     // Update connect context.
     error = update_connect_context();
 
-    // Success?
-    if (error == 0) {
-      _M_callback(operation::connect, 0, 0, _M_user);
-    } else {
+    // Error?
+    if (error != 0) {
       // Close socket.
       close();
-
-      _M_callback(operation::connect, error, 0, _M_user);
     }
+
+    return error;
   } else {
     // Get error code.
     const int error = ::WSAGetLastError();
@@ -334,19 +342,21 @@ void socket::connect(const net::socket::address& addr)
 
       // Close socket.
       close();
-
-      _M_callback(operation::connect, error, 0, _M_user);
     }
+
+    return error;
   }
 }
 
-void socket::receive(void* buf, size_t len, DWORD flags)
+DWORD socket_base::start_receive(void* buf,
+                                 size_t len,
+                                 DWORD flags,
+                                 DWORD& received)
 {
   // Notify the thread pool that an I/O operation might begin.
   ::StartThreadpoolIo(_M_io);
 
   WSABUF wsabuf{static_cast<ULONG>(len), static_cast<char*>(buf)};
-  DWORD received;
   if (::WSARecv(_M_sock,
                 &wsabuf,
                 1,
@@ -357,7 +367,7 @@ void socket::receive(void* buf, size_t len, DWORD flags)
     // Cancel notification.
     ::CancelThreadpoolIo(_M_io);
 
-    _M_callback(operation::receive, 0, received, _M_user);
+    return 0;
   } else {
     // Get error code.
     const int error = ::WSAGetLastError();
@@ -367,13 +377,16 @@ void socket::receive(void* buf, size_t len, DWORD flags)
     } else {
       // Cancel notification.
       ::CancelThreadpoolIo(_M_io);
-
-      _M_callback(operation::receive, error, received, _M_user);
     }
+
+    return error;
   }
 }
 
-void socket::send(const void* buf, size_t len, DWORD flags)
+DWORD socket_base::start_send(const void* buf,
+                              size_t len,
+                              DWORD flags,
+                              DWORD& sent)
 {
   // Notify the thread pool that an I/O operation might begin.
   ::StartThreadpoolIo(_M_io);
@@ -381,7 +394,6 @@ void socket::send(const void* buf, size_t len, DWORD flags)
   WSABUF wsabuf{static_cast<ULONG>(len),
                 static_cast<char*>(const_cast<void*>(buf))};
 
-  DWORD sent;
   if (::WSASend(_M_sock,
                 &wsabuf,
                 1,
@@ -392,7 +404,7 @@ void socket::send(const void* buf, size_t len, DWORD flags)
     // Cancel notification.
     ::CancelThreadpoolIo(_M_io);
 
-    _M_callback(operation::send, 0, sent, _M_user);
+    return 0;
   } else {
     // Get error code.
     const int error = ::WSAGetLastError();
@@ -402,13 +414,13 @@ void socket::send(const void* buf, size_t len, DWORD flags)
     } else {
       // Cancel notification.
       ::CancelThreadpoolIo(_M_io);
-
-      _M_callback(operation::send, error, sent, _M_user);
     }
+
+    return error;
   }
 }
 
-void socket::disconnect()
+DWORD socket_base::start_disconnect()
 {
   // Notify the thread pool that an I/O operation might begin.
   ::StartThreadpoolIo(_M_io);
@@ -421,10 +433,10 @@ void socket::disconnect()
     // Cancel notification.
     ::CancelThreadpoolIo(_M_io);
 
-    // Close socket.
-    close();
+    // Keep the socket for the next accept or connect.
+    _M_reusable = true;
 
-    _M_callback(operation::disconnect, 0, 0, _M_user);
+    return 0;
   } else {
     // Save error code.
     const int error = ::WSAGetLastError();
@@ -437,13 +449,129 @@ void socket::disconnect()
 
       // Close socket.
       close();
-
-      _M_callback(operation::disconnect, error, 0, _M_user);
     }
+
+    return error;
   }
 }
 
-void socket::cancel()
+DWORD socket_base::completed(operation op, DWORD result)
+{
+  switch (op) {
+    case operation::receive:
+      _M_receiveov.io_pending(false);
+
+      break;
+    case operation::send:
+      _M_sendov.io_pending(false);
+
+      break;
+    case operation::accept:
+      // Success?
+      if (result == 0) {
+        // Update accept context.
+        result = update_accept_context();
+
+        // Error?
+        if (result != 0) {
+          // Close socket.
+          close();
+        }
+      } else {
+        // Close socket.
+        close();
+      }
+
+      _M_overlapped.io_pending(false);
+
+      break;
+    case operation::connect:
+      // Success?
+      if (result == 0) {
+        // Update connect context.
+        result = update_connect_context();
+
+        // Error?
+        if (result != 0) {
+          // Close socket.
+          close();
+        }
+      } else {
+        // Close socket.
+        close();
+      }
+
+      _M_overlapped.io_pending(false);
+
+      break;
+    case operation::disconnect:
+      // Success?
+      if (result == 0) {
+        // Keep the socket for the next accept or connect.
+        _M_reusable = true;
+      } else {
+        if (_M_io) {
+          // Release I/O completion object.
+          ::CloseThreadpoolIo(_M_io);
+          _M_io = nullptr;
+        }
+
+        if (_M_sock != INVALID_SOCKET) {
+          // Close socket.
+          ::closesocket(_M_sock);
+          _M_sock = INVALID_SOCKET;
+        }
+      }
+
+      _M_disconnectov.io_pending(false);
+
+      break;
+    default:
+
+      break;
+  }
+
+  return result;
+}
+
+void socket_base::accept_completed(void* overlapped,
+                                   DWORD result,
+                                   DWORD transferred)
+{
+  socket_base* const sock = CONTAINING_RECORD(overlapped,
+                                              socket_base,
+                                              _M_overlapped);
+
+  sock->_M_accept_callback(*sock,
+                           sock->completed(operation::accept, result),
+                           transferred);
+}
+
+bool socket_base::shutdown_send()
+{
+  return (::shutdown(_M_sock, SD_SEND) == 0);
+}
+
+void socket_base::abort()
+{
+  if (_M_sock != INVALID_SOCKET) {
+    // Reset the connection when closing the socket.
+    struct linger linger;
+    linger.l_onoff = 1;
+    linger.l_linger = 0;
+
+    ::setsockopt(_M_sock,
+                 SOL_SOCKET,
+                 SO_LINGER,
+                 reinterpret_cast<const char*>(&linger),
+                 sizeof(struct linger));
+
+    // Close socket.
+    close();
+  }
+}
+
+void socket_base::cancel()
 {
   if (_M_sock != INVALID_SOCKET) {
     // If there is an outstanding receive...
@@ -472,7 +600,7 @@ void socket::cancel()
   }
 }
 
-void socket::cancel(operation op)
+void socket_base::cancel(operation op)
 {
   if (_M_sock != INVALID_SOCKET) {
     switch (op) {
@@ -515,7 +643,38 @@ void socket::cancel(operation op)
   }
 }
 
-DWORD socket::init(int domain)
+DWORD socket_base::prepare(int domain, bool accept)
+{
+  // If the socket has been disconnected for reuse...
+  if (_M_reusable) {
+    _M_reusable = false;
+
+    // A socket disconnected with `TF_REUSE_SOCKET` can only be reused by the
+    // same operation (it is still bound, when connected by a connect).
+    if ((_M_accepted == accept) && (_M_family == domain)) {
+      // Clear overlapped structures.
+      _M_overlapped.clear();
+      _M_receiveov.clear();
+      _M_sendov.clear();
+      _M_disconnectov.clear();
+
+      _M_reused = true;
+
+      return 0;
+    }
+
+    // Close socket.
+    close();
+  }
+
+  _M_reused = false;
+  _M_accepted = accept;
+
+  // Initialize socket.
+  return init(domain);
+}
+
+DWORD socket_base::init(int domain)
 {
   // Create non-overlapped socket.
   _M_sock = ::WSASocket(domain,
@@ -528,13 +687,19 @@ DWORD socket::init(int domain)
   // If the socket could be created...
   if (_M_sock != INVALID_SOCKET) {
     // Do not queue completion packets to the I/O completion port when
-    // I/O operations complete immediately.
-    static constexpr const UCHAR flags = FILE_SKIP_COMPLETION_PORT_ON_SUCCESS;
+    // I/O operations complete immediately and do not signal the socket
+    // handle (nobody waits on it).
+    // The buffers are not registered: Registered I/O (RIO) would register
+    // them once, but RIO sockets complete through their own completion
+    // queues instead of the thread pool I/O object used here.
+    static constexpr const UCHAR flags = FILE_SKIP_COMPLETION_PORT_ON_SUCCESS |
+                                         FILE_SKIP_SET_EVENT_ON_HANDLE;
+
     if (::SetFileCompletionNotificationModes(reinterpret_cast<HANDLE>(_M_sock),
                                              flags)) {
       // Create I/O completion object.
       _M_io = ::CreateThreadpoolIo(reinterpret_cast<HANDLE>(_M_sock),
-                                   io_completion_callback,
+                                   _M_io_callback,
                                    this,
                                    _M_callbackenv);
 
@@ -546,6 +711,9 @@ DWORD socket::init(int domain)
         _M_sendov.clear();
         _M_disconnectov.clear();
 
+        // Save address family.
+        _M_family = domain;
+
         return 0;
       }
     }
@@ -563,7 +731,7 @@ DWORD socket::init(int domain)
   }
 }
 
-void socket::close()
+void socket_base::close()
 {
   // Release I/O completion object.
   ::CloseThreadpoolIo(_M_io);
@@ -572,9 +740,11 @@ void socket::close()
   // Close socket.
   ::closesocket(_M_sock);
   _M_sock = INVALID_SOCKET;
+
+  _M_reusable = false;
 }
 
-DWORD socket::bind(int domain)
+DWORD socket_base::bind(int domain)
 {
   switch (domain) {
     case AF_INET:
@@ -638,141 +808,67 @@ DWORD socket::bind(int domain)
   }
 }
 
-DWORD socket::update_accept_context()
+DWORD socket_base::bind(const net::socket::address& addr)
+{
+  // Without port scalability, binding to a specific address with port 0
+  // takes the port from the ephemeral ports shared by all the local
+  // addresses; with it, every local address has its own ephemeral ports.
+  static constexpr const DWORD scalable = 1;
+  ::setsockopt(_M_sock,
+               SOL_SOCKET,
+               SO_PORT_SCALABILITY,
+               reinterpret_cast<const char*>(&scalable),
+               sizeof(DWORD));
+
+  // ConnectEx() requires the socket to be bound.
+  if (::bind(_M_sock,
+             static_cast<const struct sockaddr*>(addr),
+             addr.length()) == 0) {
+    return 0;
+  } else {
+    return ::WSAGetLastError();
+  }
+}
+
+DWORD socket_base::update_accept_context()
 {
-  // Update accept context.
+  // Update accept context and set socket options (the accept context
+  // overwrites the options with the ones of the listener).
   return (::setsockopt(_M_sock,
                        SOL_SOCKET,
                        SO_UPDATE_ACCEPT_CONTEXT,
                        reinterpret_cast<const char*>(&_M_listener),
-                       sizeof(SOCKET)) == 0) ? 0 : ::WSAGetLastError();
+                       sizeof(SOCKET)) == 0) ? set_options() :
+                                               ::WSAGetLastError();
 }
 
-DWORD socket::update_connect_context()
+DWORD socket_base::update_connect_context()
 {
-  // Update connect context.
+  // Update connect context and set socket options.
   return (::setsockopt(_M_sock,
                        SOL_SOCKET,
                        SO_UPDATE_CONNECT_CONTEXT,
                        nullptr,
-                       0) == 0) ? 0 : ::WSAGetLastError();
+                       0) == 0) ? set_options() : ::WSAGetLastError();
 }
 
-void CALLBACK socket::io_completion_callback(PTP_CALLBACK_INSTANCE instance,
-                                             void* context,
-                                             void* overlapped,
-                                             ULONG result,
-                                             ULONG_PTR transferred,
-                                             PTP_IO io)
+DWORD socket_base::set_options()
 {
-  switch (static_cast<class overlapped*>(overlapped)->operation()) {
-    case operation::receive:
-      {
-        socket* const sock = static_cast<socket*>(context);
-
-        sock->_M_receiveov.io_pending(false);
-        sock->_M_callback(operation::receive,
-                          result,
-                          transferred,
-                          sock->_M_user);
-      }
-
-      break;
-    case operation::send:
-      {
-        socket* const sock = static_cast<socket*>(context);
-
-        sock->_M_sendov.io_pending(false);
-        sock->_M_callback(operation::send,
-                          result,
-                          transferred,
-                          sock->_M_user);
-      }
-
-      break;
-    case operation::accept:
-      {
-        socket* const sock = CONTAINING_RECORD(overlapped,
-                                               socket,
-                                               _M_overlapped);
-
-        // Success?
-        if (result == 0) {
-          // Update accept context.
-          result = sock->update_accept_context();
-
-          // Error?
-          if (result != 0) {
-            // Close socket.
-            sock->close();
-          }
-        } else {
-          // Close socket.
-          sock->close();
-        }
-
-        sock->_M_overlapped.io_pending(false);
-        sock->_M_callback(operation::accept,
-                          result,
-                          transferred,
-                          sock->_M_user);
-      }
-
-      break;
-    case operation::connect:
-      {
-        socket* const sock = static_cast<socket*>(context);
-
-        // Success?
-        if (result == 0) {
-          // Update connect context.
-          result = sock->update_connect_context();
-
-          // Error?
-          if (result != 0) {
-            // Close socket.
-            sock->close();
-          }
-        } else {
-          // Close socket.
-          sock->close();
-        }
-
-        sock->_M_overlapped.io_pending(false);
-        sock->_M_callback(operation::connect,
-                          result,
-                          transferred,
-                          sock->_M_user);
-      }
-
-      break;
-    case operation::disconnect:
-      {
-        socket* const sock = static_cast<socket*>(context);
-
-        if (sock->_M_io) {
-          // Release I/O completion object.
-          ::CloseThreadpoolIo(sock->_M_io);
-          sock->_M_io = nullptr;
-        }
-
-        if (sock->_M_sock != INVALID_SOCKET) {
-          // Close socket.
-          ::closesocket(sock->_M_sock);
-          sock->_M_sock = INVALID_SOCKET;
-        }
-
-        sock->_M_disconnectov.io_pending(false);
-        sock->_M_callback(operation::disconnect,
-                          result,
-                          transferred,
-                          sock->_M_user);
-      }
-
-      break;
-    default:
-      break;
+  // If zero-copy sends are enabled...
+  if (_M_zero_copy_send) {
+    // Disable the send buffer, so Winsock sends directly from the user
+    // buffer instead of copying it.
+    static constexpr const int sndbuf = 0;
+    if (::setsockopt(_M_sock,
+                     SOL_SOCKET,
+                     SO_SNDBUF,
+                     reinterpret_cast<const char*>(&sndbuf),
+                     sizeof(int)) != 0) {
+      return ::WSAGetLastError();
+    }
   }
+
+  return 0;
 }
 
 } // namespace stream
@@ -11,8 +11,8 @@ namespace net {
 namespace async {
 namespace stream {
 
-// Asynchronous stream socket.
-class socket {
+// Asynchronous stream socket (part independent of the completion handler).
+class socket_base {
   public:
     // Socket operation.
     enum class operation {
@@ -23,48 +23,26 @@ class socket {
       disconnect
     };
 
-    // Completion callback.
-    // Arguments:
-    //   operation: socket operation which triggered the callback
-    //   DWORD: error code
-    //   DWORD: how much data was transferred
-    //   void*: pointer to user data
-    typedef void (*callbackfn)(operation, DWORD, DWORD, void*);
-
     // Load functions.
     static bool load_functions();
 
-    // Constructor.
-    socket(callbackfn callback,
-           void* user = nullptr,
-           PTP_CALLBACK_ENVIRON callbackenv = nullptr);
-
-    // Destructor.
-    ~socket();
-
     // Listen.
     bool listen(const net::socket::address& addr);
 
-    // Accept.
-    void accept(socket& sock, void* addresses, DWORD addrlen);
-
     // Get local address.
     void local(void* addresses, DWORD addrlen, net::socket::address& addr);
 
     // Get remote addess.
     void remote(void* addresses, DWORD addrlen, net::socket::address& addr);
 
-    // Connect.
-    void connect(const net::socket::address& addr);
-
-    // Receive.
-    void receive(void* buf, size_t len, DWORD flags = 0);
-
-    // Send.
-    void send(const void* buf, size_t len, DWORD flags = 0);
+    // Shut down the sending side of the connection (half-close): the peer
+    // receives a FIN, and the socket can still receive.
+    bool shutdown_send();
 
-    // Disconnect.
-    void disconnect();
+    // Abort the connection: the socket is closed with a zero linger timeout,
+    // so the peer receives a reset (RST) instead of a FIN. There must be no
+    // outstanding operations.
+    void abort();
 
     // Cancel all outstanding operations.
     void cancel();
@@ -72,7 +50,38 @@ class socket {
     // Cancel outstanding operation.
     void cancel(operation op);
 
-  private:
+    // Enable or disable zero-copy sends (disabled by default).
+    // When enabled, the socket send buffer is disabled (`SO_SNDBUF` = 0) and
+    // Winsock transmits directly from the buffer passed to send(), which stays
+    // locked until the send completes. Takes effect on the next accept or
+    // connect.
+    void zero_copy_send(bool enable);
+
+    // Set the local address connects are bound to (nullptr, the default:
+    // any address). The socket is bound with port scalability
+    // (`SO_PORT_SCALABILITY`), so binding the connections to several local
+    // addresses gives every address its own range of ephemeral ports. The
+    // address must outlive the socket. Takes effect on the next connect.
+    void source_address(const net::socket::address* addr);
+
+    // Does the current connection reuse the socket of the previous one?
+    // After a successful disconnect, the socket (and its I/O completion
+    // object) is kept (`TF_REUSE_SOCKET`) and the next accept or connect
+    // reuses it instead of creating a new one.
+    bool reused() const;
+
+  protected:
+    // Notify the accepting socket of a completed accept.
+    typedef void (*acceptfn)(socket_base&, DWORD, DWORD);
+
+    // Constructor.
+    socket_base(PTP_WIN32_IO_CALLBACK io_callback,
+                acceptfn accept_callback,
+                PTP_CALLBACK_ENVIRON callbackenv);
+
+    // Destructor.
+    ~socket_base();
+
     // Extended overlapped structure containing a socket operation.
     class overlapped {
       public:
@@ -133,15 +142,33 @@ class socket {
     overlapped _M_sendov;
     overlapped _M_disconnectov;
 
-    // Callback.
-    const callbackfn _M_callback;
+    // I/O completion callback.
+    const PTP_WIN32_IO_CALLBACK _M_io_callback;
 
-    // Pointer to user data.
-    void* _M_user;
+    // Accept callback.
+    const acceptfn _M_accept_callback;
 
     // Callback environment.
     PTP_CALLBACK_ENVIRON _M_callbackenv;
 
+    // Zero-copy sends?
+    bool _M_zero_copy_send = false;
+
+    // Local address connects are bound to (nullptr: any address).
+    const net::socket::address* _M_source_address = nullptr;
+
+    // Address family of the socket.
+    int _M_family = AF_UNSPEC;
+
+    // Has the socket been connected by an accept (or by a connect)?
+    bool _M_accepted = false;
+
+    // Has the socket been disconnected for reuse?
+    bool _M_reusable = false;
+
+    // Does the current connection reuse the socket of the previous one?
+    bool _M_reused = false;
+
     // Pointer to the AcceptEx() function.
     static LPFN_ACCEPTEX _M_acceptex;
 
@@ -154,21 +181,117 @@ class socket {
     // Pointer to the DisconnectEx() function.
     static LPFN_DISCONNECTEX _M_disconnectex;
 
+    // The following functions start an asynchronous operation.
+    // They return `WSA_IO_PENDING` if the operation is in progress, otherwise
+    // the operation has already completed and the result is returned
+    // (0 on success).
+
+    // Start an asynchronous accept of `sock`.
+    DWORD start_accept(socket_base& sock, void* addresses, DWORD addrlen);
+
+    // Start an asynchronous connect.
+    DWORD start_connect(const net::socket::address& addr);
+
+    // Start an asynchronous receive.
+    DWORD start_receive(void* buf, size_t len, DWORD flags, DWORD& received);
+
+    // Start an asynchronous send.
+    DWORD start_send(const void* buf, size_t len, DWORD flags, DWORD& sent);
+
+    // Start an asynchronous disconnect.
+    DWORD start_disconnect();
+
+    // Operation `op` has completed with result `result`.
+    // Returns the result to be notified to the handler.
+    DWORD completed(operation op, DWORD result);
+
+    // An accept operation has completed (accept completions are notified to
+    // the listener).
+    static void accept_completed(void* overlapped,
+                                 DWORD result,
+                                 DWORD transferred);
+
+    // Prepare the socket for an accept (`accept` = true) or a connect: the
+    // socket is reused if it has been disconnected for reuse by the same
+    // operation and for the same address family, otherwise a new socket is
+    // created.
+    DWORD prepare(int domain, bool accept);
+
     // Initialize socket.
     DWORD init(int domain);
 
     // Close socket.
     void close();
 
-    // Bind socket.
+    // Bind socket (to any address of the domain).
     DWORD bind(int domain);
 
+    // Bind socket to `addr`.
+    DWORD bind(const net::socket::address& addr);
+
     // Update accept context.
     DWORD update_accept_context();
 
     // Update connect context.
     DWORD update_connect_context();
 
+    // Set options of a connected socket.
+    DWORD set_options();
+
+    // Disable copy constructor and assignment operator.
+    socket_base(const socket_base&) = delete;
+    socket_base& operator=(const socket_base&) = delete;
+};
+
+// Asynchronous stream socket.
+// `Handler` is invoked on every completion as:
+//   handler(operation op, DWORD error, DWORD transferred)
+// The handler is stored by value and called directly from the completion
+// dispatch, so the compiler can inline it.
+//
+// The buffer passed to receive() or send() belongs to the socket until the
+// handler for that operation has been invoked; only then can it be modified
+// or released. This also holds for zero-copy sends, where the send
+// completion is the notification that Winsock has released the buffer.
+template<typename Handler>
+class basic_socket : public socket_base {
+  public:
+    // Constructor.
+    basic_socket(Handler handler, PTP_CALLBACK_ENVIRON callbackenv = nullptr);
+
+    // Destructor.
+    ~basic_socket() = default;
+
+    // Accept.
+    template<typename AcceptHandler>
+    void accept(basic_socket<AcceptHandler>& sock,
+                void* addresses,
+                DWORD addrlen);
+
+    // Connect.
+    void connect(const net::socket::address& addr);
+
+    // Receive.
+    void receive(void* buf, size_t len, DWORD flags = 0);
+
+    // Send.
+    void send(const void* buf, size_t len, DWORD flags = 0);
+
+    // Disconnect.
+    void disconnect();
+
+  private:
+    template<typename>
+    friend class basic_socket;
+
+    // Completion handler.
+    Handler _M_handler;
+
+    // Accept callback.
+    static void accept_callback(socket_base& sock,
+                                DWORD error,
+                                DWORD transferred);
+
     // I/O completion callback.
     static void CALLBACK io_completion_callback(PTP_CALLBACK_INSTANCE instance,
                                                 void* context,
@@ -176,58 +299,272 @@ class socket {
                                                 ULONG result,
                                                 ULONG_PTR transferred,
                                                 PTP_IO io);
+};
 
-    // Disable copy constructor and assignment operator.
-    socket(const socket&) = delete;
-    socket& operator=(const socket&) = delete;
+// Completion handler calling a function pointer.
+class callback_handler {
+  public:
+    // Completion callback.
+    // Arguments:
+    //   operation: socket operation which triggered the callback
+    //   DWORD: error code
+    //   DWORD: how much data was transferred
+    //   void*: pointer to user data
+    typedef void (*callbackfn)(socket_base::operation, DWORD, DWORD, void*);
+
+    // Constructor.
+    callback_handler(callbackfn callback, void* user);
+
+    // Invoke callback.
+    void operator()(socket_base::operation op,
+                    DWORD error,
+                    DWORD transferred) const;
+
+  private:
+    // Callback.
+    const callbackfn _M_callback;
+
+    // Pointer to user data.
+    void* const _M_user;
+};
+
+// Completion handler calling the member function `fn` of an object.
+template<typename T,
+         void (T::*fn)(socket_base::operation, DWORD, DWORD)>
+class member_handler {
+  public:
+    // Constructor.
+    member_handler(T* object);
+
+    // Invoke member function.
+    void operator()(socket_base::operation op,
+                    DWORD error,
+                    DWORD transferred) const;
+
+  private:
+    // Object.
+    T* const _M_object;
 };
 
-inline socket::overlapped::overlapped()
+// Asynchronous stream socket with a function pointer callback.
+class socket : public basic_socket<callback_handler> {
+  public:
+    // Completion callback.
+    typedef callback_handler::callbackfn callbackfn;
+
+    // Constructor.
+    socket(callbackfn callback,
+           void* user = nullptr,
+           PTP_CALLBACK_ENVIRON callbackenv = nullptr);
+
+    // Destructor.
+    ~socket() = default;
+};
+
+inline void socket_base::zero_copy_send(bool enable)
+{
+  _M_zero_copy_send = enable;
+}
+
+inline void socket_base::source_address(const net::socket::address* addr)
+{
+  _M_source_address = addr;
+}
+
+inline bool socket_base::reused() const
+{
+  return _M_reused;
+}
+
+inline socket_base::overlapped::overlapped()
 {
   clear();
 }
 
-inline socket::overlapped::overlapped(enum operation op)
+inline socket_base::overlapped::overlapped(enum operation op)
   : _M_operation{op}
 {
   clear();
 }
 
-inline void socket::overlapped::clear()
+inline void socket_base::overlapped::clear()
 {
   memset(&_M_overlapped, 0, sizeof(OVERLAPPED));
 }
 
-inline enum socket::operation socket::overlapped::operation() const
+inline enum socket_base::operation socket_base::overlapped::operation() const
 {
   return _M_operation;
 }
 
-inline void socket::overlapped::operation(enum operation op)
+inline void socket_base::overlapped::operation(enum operation op)
 {
   _M_operation = op;
 }
 
-inline bool socket::overlapped::io_pending() const
+inline bool socket_base::overlapped::io_pending() const
 {
   return _M_io_pending;
 }
 
-inline void socket::overlapped::io_pending(bool val)
+inline void socket_base::overlapped::io_pending(bool val)
 {
   _M_io_pending = val;
 }
 
-inline socket::overlapped::operator const OVERLAPPED*() const
+inline socket_base::overlapped::operator const OVERLAPPED*() const
 {
   return &_M_overlapped;
 }
 
-inline socket::overlapped::operator OVERLAPPED*()
+inline socket_base::overlapped::operator OVERLAPPED*()
 {
   return &_M_overlapped;
 }
 
+template<typename Handler>
+inline basic_socket<Handler>::basic_socket(Handler handler,
+                                           PTP_CALLBACK_ENVIRON callbackenv)
+  : socket_base{io_completion_callback, accept_callback, callbackenv},
+    _M_handler{handler}
+{
+}
+
+template<typename Handler>
+template<typename AcceptHandler>
+inline void basic_socket<Handler>::accept(basic_socket<AcceptHandler>& sock,
+                                          void* addresses,
+                                          DWORD addrlen)
+{
+  // Start an asynchronous accept.
+  const DWORD error = start_accept(sock, addresses, addrlen);
+
+  // If the accept has already completed...
+  if (error != WSA_IO_PENDING) {
+    sock._M_handler(operation::accept, error, 0);
+  }
+}
+
+template<typename Handler>
+inline void basic_socket<Handler>::connect(const net::socket::address& addr)
+{
+  // Start an asynchronous connect.
+  const DWORD error = start_connect(addr);
+
+  // If the connect has already completed...
+  if (error != WSA_IO_PENDING) {
+    _M_handler(operation::connect, error, 0);
+  }
+}
+
+template<typename Handler>
+inline void basic_socket<Handler>::receive(void* buf, size_t len, DWORD flags)
+{
+  // Start an asynchronous receive.
+  DWORD received;
+  const DWORD error = start_receive(buf, len, flags, received);
+
+  // If the receive has already completed...
+  if (error != WSA_IO_PENDING) {
+    _M_handler(operation::receive, error, received);
+  }
+}
+
+template<typename Handler>
+inline void basic_socket<Handler>::send(const void* buf,
+                                        size_t len,
+                                        DWORD flags)
+{
+  // Start an asynchronous send.
+  DWORD sent;
+  const DWORD error = start_send(buf, len, flags, sent);
+
+  // If the send has already completed...
+  if (error != WSA_IO_PENDING) {
+    _M_handler(operation::send, error, sent);
+  }
+}
+
+template<typename Handler>
+inline void basic_socket<Handler>::disconnect()
+{
+  // Start an asynchronous disconnect.
+  const DWORD error = start_disconnect();
+
+  // If the disconnect has already completed...
+  if (error != WSA_IO_PENDING) {
+    _M_handler(operation::disconnect, error, 0);
+  }
+}
+
+template<typename Handler>
+void basic_socket<Handler>::accept_callback(socket_base& sock,
+                                            DWORD error,
+                                            DWORD transferred)
+{
+  static_cast<basic_socket&>(sock)._M_handler(operation::accept,
+                                              error,
+                                              transferred);
+}
+
+template<typename Handler>
+void CALLBACK
+basic_socket<Handler>::io_completion_callback(PTP_CALLBACK_INSTANCE instance,
+                                              void* context,
+                                              void* overlapped,
+                                              ULONG result,
+                                              ULONG_PTR transferred,
+                                              PTP_IO io)
+{
+  const enum operation
+    op = static_cast<class overlapped*>(overlapped)->operation();
+
+  // Accept completions are notified to the listener.
+  if (op != operation::accept) {
+    basic_socket* const
+      sock = static_cast<basic_socket*>(static_cast<socket_base*>(context));
+
+    sock->_M_handler(op, sock->completed(op, result), transferred);
+  } else {
+    // The accepting socket might have a different handler type.
+    accept_completed(overlapped, result, transferred);
+  }
+}
+
+inline callback_handler::callback_handler(callbackfn callback, void* user)
+  : _M_callback{callback},
+    _M_user{user}
+{
+}
+
+inline void callback_handler::operator()(socket_base::operation op,
+                                         DWORD error,
+                                         DWORD transferred) const
+{
+  _M_callback(op, error, transferred, _M_user);
+}
+
+template<typename T, void (T::*fn)(socket_base::operation, DWORD, DWORD)>
+inline member_handler<T, fn>::member_handler(T* object)
+  : _M_object{object}
+{
+}
+
+template<typename T, void (T::*fn)(socket_base::operation, DWORD, DWORD)>
+inline void member_handler<T, fn>::operator()(socket_base::operation op,
+                                              DWORD error,
+                                              DWORD transferred) const
+{
+  (_M_object->*fn)(op, error, transferred);
+}
+
+inline socket::socket(callbackfn callback,
+                      void* user,
+                      PTP_CALLBACK_ENVIRON callbackenv)
+  : basic_socket{callback_handler{callback, user}, callbackenv}
+{
+}
+
 } // namespace stream
 } // namespace async
 } // namespace net
\ No newline at end of file
@@ -3,6 +3,76 @@
 namespace net {
 namespace async {
 
+// Context of the work items which place the threads of the pool.
+struct placement_context {
+  // Processors on which the threads may run.
+  GROUP_AFFINITY affinity;
+
+  // Pin every thread to its own processor?
+  bool pin_threads;
+
+  // Processor to which the first thread is pinned.
+  DWORD first_processor;
+
+  // Number of threads.
+  DWORD nthreads;
+
+  // Number of threads which have been placed.
+  uint32_t placed;
+
+  // Number of threads which failed to be placed.
+  uint32_t failed;
+
+  // Event signaled once all the threads have been placed.
+  HANDLE event;
+};
+
+// Place the thread running the work item.
+// Every work item blocks until all the threads have been placed, so that
+// each one runs on a different thread.
+static void CALLBACK place_thread(PTP_CALLBACK_INSTANCE instance,
+                                  void* context,
+                                  PTP_WORK work)
+{
+  placement_context* const ctx = static_cast<placement_context*>(context);
+
+  GROUP_AFFINITY affinity = ctx->affinity;
+
+  // Get thread number.
+  const uint32_t n = ::InterlockedIncrement(&ctx->placed) - 1;
+
+  // If the thread should be pinned...
+  if (ctx->pin_threads) {
+    // Count processors.
+    uint32_t nprocessors = 0;
+    for (KAFFINITY mask = affinity.Mask; mask != 0; mask &= mask - 1) {
+      nprocessors++;
+    }
+
+    // Select the (first + n)-th processor (modulo the number of
+    // processors).
+    KAFFINITY mask = affinity.Mask;
+    for (uint32_t i = (ctx->first_processor + n) % nprocessors; i > 0; i--) {
+      mask &= mask - 1;
+    }
+
+    affinity.Mask = mask & (~mask + 1);
+  }
+
+  // Set thread affinity.
+  if (!::SetThreadGroupAffinity(::GetCurrentThread(), &affinity, nullptr)) {
+    ::InterlockedIncrement(&ctx->failed);
+  }
+
+  // If this is the last thread...
+  if (n + 1 == ctx->nthreads) {
+    ::SetEvent(ctx->event);
+  } else {
+    // Wait for the other threads.
+    ::WaitForSingleObject(ctx->event, INFINITE);
+  }
+}
+
 thread_pool::~thread_pool()
 {
   // Stop thread pool.
@@ -17,12 +87,15 @@ void thread_pool::stop()
   }
 }
 
-bool thread_pool::create(DWORD minthreads, DWORD maxthreads)
+bool thread_pool::create(DWORD minthreads,
+                         DWORD maxthreads,
+                         const placement* placement)
 {
   // Sanity checks.
   if ((minthreads >= min_threads) &&
       (maxthreads <= max_threads) &&
-      (minthreads <= maxthreads)) {
+      (minthreads <= maxthreads) &&
+      ((!placement) || (minthreads == maxthreads))) {
     // Create thread pool.
     _M_threadpool = ::CreateThreadpool(nullptr);
 
@@ -39,8 +112,13 @@ bool thread_pool::create(DWORD minthreads, DWORD maxthreads)
         // Set thread pool to be used when generating callbacks.
         ::SetThreadpoolCallbackPool(&_M_callbackenv, _M_threadpool);
 
-        return true;
+        // If the threads don't have to be placed or could be placed...
+        if ((!placement) || (place(*placement, maxthreads))) {
+          return true;
+        }
       }
+
+      stop();
     }
   }
 
@@ -52,5 +130,75 @@ PTP_CALLBACK_ENVIRON thread_pool::callback_environment()
   return &_M_callbackenv;
 }
 
+ULONG thread_pool::numa_node() const
+{
+  return _M_numa_node;
+}
+
+bool thread_pool::place(const placement& placement, DWORD nthreads)
+{
+  placement_context ctx;
+
+  // If the threads have to run on a given NUMA node...
+  if (placement.node != any_node) {
+    // Get the processors of the NUMA node.
+    if (!::GetNumaNodeProcessorMaskEx(static_cast<USHORT>(placement.node),
+                                      &ctx.affinity)) {
+      return false;
+    }
+  } else {
+    // Get the processors on which the current thread may run.
+    if (!::GetThreadGroupAffinity(::GetCurrentThread(), &ctx.affinity)) {
+      return false;
+    }
+  }
+
+  // If there are no processors...
+  if (ctx.affinity.Mask == 0) {
+    return false;
+  }
+
+  ctx.pin_threads = placement.pin_threads;
+  ctx.first_processor = placement.first_processor;
+  ctx.nthreads = nthreads;
+  ctx.placed = 0;
+  ctx.failed = 0;
+
+  // Create event.
+  ctx.event = ::CreateEvent(nullptr, TRUE, FALSE, nullptr);
+
+  // If the event could be created...
+  if (ctx.event) {
+    // Create work item.
+    PTP_WORK work = ::CreateThreadpoolWork(place_thread, &ctx, &_M_callbackenv);
+
+    // If the work item could be created...
+    if (work) {
+      // Run the work item once per thread.
+      for (DWORD i = 0; i < nthreads; i++) {
+        ::SubmitThreadpoolWork(work);
+      }
+
+      // Wait for the threads to be placed.
+      static constexpr const BOOL cancel_pending_callbacks = FALSE;
+      ::WaitForThreadpoolWorkCallbacks(work, cancel_pending_callbacks);
+
+      ::CloseThreadpoolWork(work);
+    }
+
+    ::CloseHandle(ctx.event);
+
+    // If all the threads have been placed...
+    if ((ctx.placed == nthreads) && (ctx.failed == 0)) {
+      // Save NUMA node.
+      _M_numa_node = placement.node;
+
+      return true;
+    }
+  }
+
+  return false;
+}
+
 } // namespace async
 } // namespace net
\ No newline at end of file
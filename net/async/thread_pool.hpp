@@ -1,5 +1,6 @@
 #pragma once
 
+#include <stdint.h>
 #include <windows.h>
 
 namespace net {
@@ -17,6 +18,24 @@ class thread_pool {
     // Default maximum number of threads.
     static constexpr const DWORD default_max_threads = 4;
 
+    // Any NUMA node.
+    static constexpr const ULONG any_node = NUMA_NO_PREFERRED_NODE;
+
+    // Placement of the threads.
+    // Requires a fixed number of threads (`minthreads == maxthreads`), as
+    // threads created later by the system wouldn't be placed.
+    struct placement {
+      // NUMA node on which the threads run (`any_node`: any node).
+      ULONG node;
+
+      // Pin every thread to its own processor (of the NUMA node)?
+      bool pin_threads;
+
+      // Index (among the processors of the NUMA node) of the processor to
+      // which the first thread is pinned.
+      DWORD first_processor;
+    };
+
     // Constructor.
     thread_pool() = default;
 
@@ -28,11 +47,15 @@ class thread_pool {
 
     // Create thread pool.
     bool create(DWORD minthreads = min_threads,
-                DWORD maxthreads = default_max_threads);
+                DWORD maxthreads = default_max_threads,
+                const placement* placement = nullptr);
 
     // Get callback environment.
     PTP_CALLBACK_ENVIRON callback_environment();
 
+    // Get the NUMA node on which the threads run (`any_node`: any node).
+    ULONG numa_node() const;
+
   private:
     // Thread pool.
     PTP_POOL _M_threadpool = nullptr;
@@ -40,6 +63,12 @@ class thread_pool {
     // Callback environment.
     TP_CALLBACK_ENVIRON _M_callbackenv;
 
+    // NUMA node.
+    ULONG _M_numa_node = any_node;
+
+    // Place the `nthreads` threads of the pool.
+    bool place(const placement& placement, DWORD nthreads);
+
     // Disable copy constructor and assignment operator.
     thread_pool(const thread_pool&) = delete;
     thread_pool& operator=(const thread_pool&) = delete;
@@ -0,0 +1,365 @@
+#include <string.h>
+#include <new>
+#include "net/dns/resolver.hpp"
+
+namespace net {
+namespace dns {
+
+resolver::~resolver()
+{
+  stop();
+
+  for (size_t i = 0; i < _M_count; i++) {
+    delete _M_entries[i];
+  }
+}
+
+bool resolver::create(const socket::address* server)
+{
+  if (server) {
+    const struct sockaddr& sa = *server;
+
+    // Sanity check.
+    if (((sa.sa_family == AF_INET) || (sa.sa_family == AF_INET6)) &&
+        (server->length() <= DNS_ADDR_MAX_SOCKADDR_LENGTH)) {
+      memset(&_M_servers, 0, sizeof(DNS_ADDR_ARRAY));
+
+      _M_servers.MaxCount = 1;
+      _M_servers.AddrCount = 1;
+      _M_servers.Family = sa.sa_family;
+
+      memcpy(_M_servers.AddrArray[0].MaxSa, &sa, server->length());
+
+      _M_custom_server = true;
+    } else {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+size_t resolver::add(const char* host,
+                     in_port_t port,
+                     callbackfn callback,
+                     void* user)
+{
+  // If there is space for another name...
+  if (_M_count < max_names) {
+    entry* e = new (std::nothrow) entry{*this, _M_count, port, callback, user};
+
+    if (e) {
+      if (e->create(host)) {
+        _M_entries[_M_count] = e;
+
+        return _M_count++;
+      }
+
+      delete e;
+    }
+  }
+
+  return none;
+}
+
+void resolver::start()
+{
+  for (size_t i = 0; i < _M_count; i++) {
+    _M_entries[i]->resolve();
+  }
+}
+
+void resolver::stop()
+{
+  for (size_t i = 0; i < _M_count; i++) {
+    _M_entries[i]->stop();
+  }
+}
+
+resolver::entry::entry(resolver& resolver,
+                       size_t id,
+                       in_port_t port,
+                       callbackfn callback,
+                       void* user)
+  : _M_resolver{resolver},
+    _M_id{id},
+    _M_port{port},
+    _M_callback{callback},
+    _M_user{user},
+    _M_timer{this}
+{
+  for (size_t i = 0; i < nqueries; i++) {
+    _M_queries[i].owner = this;
+    _M_queries[i].active = false;
+    _M_queries[i].count = 0;
+  }
+}
+
+bool resolver::entry::create(const char* host)
+{
+  // Convert the host name to UTF-16.
+  if (::MultiByteToWideChar(CP_UTF8,
+                            0,
+                            host,
+                            -1,
+                            _M_host,
+                            sizeof(_M_host) / sizeof(wchar_t)) > 1) {
+    // Create the refresh timer (on the default thread pool).
+    return _M_timer.create();
+  }
+
+  return false;
+}
+
+void resolver::entry::resolve()
+{
+  ::AcquireSRWLockExclusive(&_M_lock);
+
+  // If the entry has been stopped or a resolution is in progress...
+  if ((_M_stopped) || (_M_busy)) {
+    ::ReleaseSRWLockExclusive(&_M_lock);
+    return;
+  }
+
+  _M_busy = true;
+  _M_left = nqueries;
+
+  // IPv6 first.
+  start(_M_queries[0], DNS_TYPE_AAAA);
+  start(_M_queries[1], DNS_TYPE_A);
+
+  // If both queries have completed synchronously...
+  const bool done = (_M_left == 0);
+
+  ::ReleaseSRWLockExclusive(&_M_lock);
+
+  if (done) {
+    finished();
+  }
+}
+
+void resolver::entry::stop()
+{
+  ::AcquireSRWLockExclusive(&_M_lock);
+
+  _M_stopped = true;
+
+  // Collect the cancel handles of the queries in progress (no new query is
+  // started once the entry has been stopped, so they stay valid).
+  DNS_QUERY_CANCEL* cancel[nqueries];
+  size_t ncancel = 0;
+  for (size_t i = 0; i < nqueries; i++) {
+    if (_M_queries[i].active) {
+      cancel[ncancel++] = &_M_queries[i].cancel;
+    }
+  }
+
+  ::ReleaseSRWLockExclusive(&_M_lock);
+
+  // Cancel the queries in progress without the lock held: their completion
+  // callback takes it, and might run during the cancel.
+  for (size_t i = 0; i < ncancel; i++) {
+    ::DnsCancelQuery(cancel[i]);
+  }
+
+  ::AcquireSRWLockExclusive(&_M_lock);
+
+  // Wait for the resolution in progress to finish.
+  while (_M_busy) {
+    ::SleepConditionVariableSRW(&_M_idle, &_M_lock, INFINITE, 0);
+  }
+
+  ::ReleaseSRWLockExclusive(&_M_lock);
+
+  // Cancel the refresh.
+  _M_timer.cancel();
+}
+
+void resolver::entry::start(query& q, WORD type)
+{
+  memset(&q.request, 0, sizeof(DNS_QUERY_REQUEST));
+
+  q.request.Version = DNS_QUERY_REQUEST_VERSION1;
+  q.request.QueryName = _M_host;
+  q.request.QueryType = type;
+  q.request.pQueryCompletionCallback = completed;
+  q.request.pQueryContext = &q;
+
+  if (_M_resolver._M_custom_server) {
+    q.request.QueryOptions = DNS_QUERY_BYPASS_CACHE;
+    q.request.pDnsServerList = &_M_resolver._M_servers;
+  } else {
+    q.request.QueryOptions = DNS_QUERY_STANDARD;
+  }
+
+  memset(&q.result, 0, sizeof(DNS_QUERY_RESULT));
+  q.result.Version = DNS_QUERY_RESULTS_VERSION1;
+
+  q.active = true;
+
+  const DNS_STATUS status = ::DnsQueryEx(&q.request, &q.result, &q.cancel);
+
+  // If the query has completed synchronously (the completion routine is
+  // not called)...
+  if (status != DNS_REQUEST_PENDING) {
+    q.result.QueryStatus = status;
+
+    q.active = false;
+    save(q);
+
+    _M_left--;
+  }
+}
+
+void resolver::entry::save(query& q)
+{
+  q.count = 0;
+  q.ttl = max_ttl;
+
+  if (q.result.QueryStatus == ERROR_SUCCESS) {
+    for (const DNS_RECORD* r = q.result.pQueryRecords;
+         (r) && (q.count < max_addresses);
+         r = r->pNext) {
+      // Skip other records (CNAME).
+      if (r->wType == q.request.QueryType) {
+        struct sockaddr_storage addr;
+        socklen_t addrlen;
+
+        memset(&addr, 0, sizeof(struct sockaddr_storage));
+
+        if (r->wType == DNS_TYPE_AAAA) {
+          struct sockaddr_in6* const
+            sin = reinterpret_cast<struct sockaddr_in6*>(&addr);
+
+          sin->sin6_family = AF_INET6;
+          sin->sin6_port = htons(_M_port);
+
+          memcpy(&sin->sin6_addr,
+                 &r->Data.AAAA.Ip6Address,
+                 sizeof(struct in6_addr));
+
+          addrlen = sizeof(struct sockaddr_in6);
+        } else {
+          struct sockaddr_in* const
+            sin = reinterpret_cast<struct sockaddr_in*>(&addr);
+
+          sin->sin_family = AF_INET;
+          sin->sin_port = htons(_M_port);
+
+          memcpy(&sin->sin_addr,
+                 &r->Data.A.IpAddress,
+                 sizeof(struct in_addr));
+
+          addrlen = sizeof(struct sockaddr_in);
+        }
+
+        q.addrs[q.count++].build(reinterpret_cast<const struct sockaddr&>(
+                                   addr
+                                 ),
+                                 addrlen);
+
+        if (r->dwTtl < q.ttl) {
+          q.ttl = r->dwTtl;
+        }
+      }
+    }
+  }
+
+  if (q.result.pQueryRecords) {
+    ::DnsRecordListFree(q.result.pQueryRecords, DnsFreeRecordList);
+    q.result.pQueryRecords = nullptr;
+  }
+}
+
+void WINAPI resolver::entry::completed(void* context, DNS_QUERY_RESULT* result)
+{
+  query& q = *static_cast<query*>(context);
+  entry& e = *q.owner;
+
+  ::AcquireSRWLockExclusive(&e._M_lock);
+
+  q.active = false;
+  e.save(q);
+
+  // Is this the last query?
+  const bool done = (--e._M_left == 0);
+
+  ::ReleaseSRWLockExclusive(&e._M_lock);
+
+  if (done) {
+    e.finished();
+  }
+}
+
+void resolver::entry::finished()
+{
+  socket::address addrs[max_addresses];
+  size_t count = 0;
+  uint32_t ttl = max_ttl;
+
+  // Merge the addresses of the queries (IPv6 first).
+  for (size_t i = 0; i < nqueries; i++) {
+    const query& q = _M_queries[i];
+
+    for (size_t j = 0; (j < q.count) && (count < max_addresses); j++) {
+      addrs[count++] = q.addrs[j];
+    }
+
+    if ((q.count > 0) && (q.ttl < ttl)) {
+      ttl = q.ttl;
+    }
+  }
+
+  ::AcquireSRWLockExclusive(&_M_lock);
+
+  bool changed = false;
+
+  // If the name has been resolved...
+  if (count > 0) {
+    if (ttl < min_ttl) {
+      ttl = min_ttl;
+    }
+
+    // Have the addresses changed?
+    changed = (count != _M_count);
+    for (size_t i = 0; (!changed) && (i < count); i++) {
+      changed = (addrs[i].length() != _M_addrs[i].length()) ||
+                (memcmp(static_cast<const struct sockaddr*>(addrs[i]),
+                        static_cast<const struct sockaddr*>(_M_addrs[i]),
+                        addrs[i].length()) != 0);
+    }
+
+    if (changed) {
+      for (size_t i = 0; i < count; i++) {
+        _M_addrs[i] = addrs[i];
+      }
+
+      _M_count = count;
+    }
+  } else {
+    // Keep the previous addresses and retry.
+    ttl = retry_interval;
+  }
+
+  // Refresh when the addresses expire.
+  if (!_M_stopped) {
+    _M_timer.expires_in(ttl * 1000ull * 1000ull);
+  }
+
+  ::ReleaseSRWLockExclusive(&_M_lock);
+
+  // Notify the new addresses.
+  if (changed) {
+    _M_callback(_M_id, addrs, count, _M_user);
+  }
+
+  ::AcquireSRWLockExclusive(&_M_lock);
+
+  _M_busy = false;
+  ::WakeAllConditionVariable(&_M_idle);
+
+  ::ReleaseSRWLockExclusive(&_M_lock);
+}
+
+} // namespace dns
+} // namespace net
\ No newline at end of file
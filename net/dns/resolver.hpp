@@ -0,0 +1,196 @@
+#pragma once
+
+#include <stdint.h>
+#include <windows.h>
+#include <windns.h>
+#include "net/socket/address.hpp"
+#include "util/timer.hpp"
+
+namespace net {
+namespace dns {
+
+// Asynchronous DNS resolver.
+// The names are resolved with DnsQueryEx() (an AAAA and an A query in
+// parallel), which completes on the threads of the DNS client, so a lookup
+// never blocks the caller. The addresses of every name are cached for the
+// TTL of its records and refreshed in the background (on the default
+// thread pool) when they expire; the callback of the name is invoked
+// whenever they change.
+// If a refresh fails, the previous addresses are kept (they are served
+// stale, as in RFC 8767) and the name is retried every `retry_interval`
+// seconds.
+class resolver {
+  public:
+    // Maximum number of names.
+    static constexpr const size_t max_names = 256;
+
+    // Maximum number of addresses per name.
+    static constexpr const size_t max_addresses = 8;
+
+    // Minimum TTL (seconds).
+    static constexpr const uint32_t min_ttl = 1;
+
+    // Maximum TTL (seconds).
+    static constexpr const uint32_t max_ttl = 24 * 60 * 60;
+
+    // Interval between retries of a failed resolution (seconds).
+    static constexpr const uint32_t retry_interval = 5;
+
+    // Invalid name.
+    static constexpr const size_t none = static_cast<size_t>(-1);
+
+    // Callback: the addresses of the name `id` have changed.
+    typedef void (*callbackfn)(size_t id,
+                               const socket::address* addrs,
+                               size_t count,
+                               void* user);
+
+    // Constructor.
+    resolver() = default;
+
+    // Destructor.
+    ~resolver();
+
+    // Create.
+    // If `server` is not null, the queries are sent to it (for instance,
+    // to a local stub DNS server) instead of the DNS servers of the system,
+    // bypassing the DNS cache of the system.
+    bool create(const socket::address* server = nullptr);
+
+    // Add the name `host` (the addresses get the port `port`).
+    // Returns the id of the name (names are numbered from 0, in the order
+    // they are added) or `none` on error.
+    size_t add(const char* host,
+               in_port_t port,
+               callbackfn callback,
+               void* user = nullptr);
+
+    // Start resolving the names.
+    void start();
+
+    // Stop resolving: cancel the queries in progress and the refreshes.
+    void stop();
+
+  private:
+    // Name.
+    class entry {
+      public:
+        // Constructor.
+        entry(resolver& resolver,
+              size_t id,
+              in_port_t port,
+              callbackfn callback,
+              void* user);
+
+        // Destructor.
+        ~entry() = default;
+
+        // Create.
+        bool create(const char* host);
+
+        // Start resolving.
+        void resolve();
+
+        // Stop resolving.
+        void stop();
+
+      private:
+        // Number of queries (AAAA and A).
+        static constexpr const size_t nqueries = 2;
+
+        // Query.
+        struct query {
+          entry* owner;
+
+          // Is the query in progress?
+          bool active;
+
+          DNS_QUERY_REQUEST request;
+          DNS_QUERY_RESULT result;
+          DNS_QUERY_CANCEL cancel;
+
+          // Addresses received.
+          socket::address addrs[max_addresses];
+          size_t count;
+
+          // Lowest TTL of the records (seconds).
+          uint32_t ttl;
+        };
+
+        // Resolver.
+        resolver& _M_resolver;
+
+        // Id of the name.
+        const size_t _M_id;
+
+        // Port.
+        const in_port_t _M_port;
+
+        // Callback.
+        const callbackfn _M_callback;
+
+        // Pointer to user data.
+        void* const _M_user;
+
+        // Host name.
+        wchar_t _M_host[DNS_MAX_NAME_LENGTH + 1];
+
+        // Queries.
+        query _M_queries[nqueries];
+
+        // Number of queries left in the resolution in progress.
+        size_t _M_left = 0;
+
+        // Is a resolution in progress (including its callback)?
+        bool _M_busy = false;
+
+        // Has the entry been stopped?
+        bool _M_stopped = false;
+
+        // Cached addresses.
+        socket::address _M_addrs[max_addresses];
+        size_t _M_count = 0;
+
+        // Lock.
+        mutable SRWLOCK _M_lock = SRWLOCK_INIT;
+
+        // Signaled when a resolution finishes.
+        CONDITION_VARIABLE _M_idle = CONDITION_VARIABLE_INIT;
+
+        // Refresh timer.
+        util::basic_timer<
+          util::timer_member_handler<entry, &entry::resolve>
+        > _M_timer;
+
+        // Start query (with the lock held).
+        void start(query& q, WORD type);
+
+        // Save the addresses received by a query and free its records.
+        void save(query& q);
+
+        // A query has completed.
+        static void WINAPI completed(void* context, DNS_QUERY_RESULT* result);
+
+        // All the queries have completed.
+        void finished();
+
+        // Disable copy constructor and assignment operator.
+        entry(const entry&) = delete;
+        entry& operator=(const entry&) = delete;
+    };
+
+    // Names.
+    entry* _M_entries[max_names];
+    size_t _M_count = 0;
+
+    // DNS server.
+    DNS_ADDR_ARRAY _M_servers;
+    bool _M_custom_server = false;
+
+    // Disable copy constructor and assignment operator.
+    resolver(const resolver&) = delete;
+    resolver& operator=(const resolver&) = delete;
+};
+
+} // namespace dns
+} // namespace net
\ No newline at end of file
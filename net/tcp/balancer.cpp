@@ -0,0 +1,663 @@
+#include <stdlib.h>
+#include <string.h>
+#include <malloc.h>
+#include <new>
+#include "net/tcp/balancer.hpp"
+
+namespace net {
+namespace tcp {
+
+balancer::balancer()
+  : _M_timer{this}
+{
+}
+
+balancer::~balancer()
+{
+  // Stop the probes.
+  ::InterlockedExchange(&_M_stopped, 1);
+  _M_timer.cancel();
+
+  if (_M_probes) {
+    for (size_t i = 0; i < _M_count; i++) {
+      delete _M_probes[i];
+    }
+
+    free(_M_probes);
+  }
+
+  if (_M_backends) {
+    for (size_t i = 0; i < _M_count; i++) {
+      _M_backends[i].~backend();
+    }
+
+    _aligned_free(_M_backends);
+  }
+
+  free(_M_ring);
+}
+
+bool balancer::create(const addresses* backends,
+                      size_t count,
+                      policy policy,
+                      const health_check* health,
+                      PTP_CALLBACK_ENVIRON callbackenv)
+{
+  // Sanity checks.
+  if ((count > 0) && (count <= max_backends)) {
+    // Create backends (each one on its own cache line).
+    _M_backends = static_cast<backend*>(
+                    _aligned_malloc(count * sizeof(backend),
+                                    util::cache_line_size)
+                  );
+
+    // If the backends could be created...
+    if (_M_backends) {
+      // Construct backends.
+      for (size_t i = 0; i < count; i++) {
+        new (&_M_backends[i]) backend;
+      }
+
+      _M_count = count;
+
+      for (size_t i = 0; i < count; i++) {
+        // If the backend is a host name...
+        if (backends[i].host) {
+          const in_port_t port = backends[i].port;
+
+          // The points of the backend on the hash ring depend on its name.
+          _M_backends[i].hash = hash(&port,
+                                     sizeof(in_port_t),
+                                     hash(backends[i].host,
+                                          strlen(backends[i].host),
+                                          offset_basis));
+        } else if (save_addresses(i, backends[i])) {
+          _M_backends[i].hash = hash(_M_backends[i].addrs[0]);
+        } else {
+          return false;
+        }
+      }
+
+      _M_policy = policy;
+
+      // Save health checking.
+      if (health) {
+        _M_health = *health;
+      } else {
+        _M_health.max_failures = default_max_failures;
+        _M_health.ejection_time = default_ejection_time;
+        _M_health.probe_interval = default_probe_interval;
+      }
+
+      // Build hash ring (if needed).
+      if ((policy == policy::consistent_hash) && (!build_ring())) {
+        return false;
+      }
+
+      // Create connect probes (if needed).
+      return ((_M_health.probe_interval == 0) ||
+              (create_probes(callbackenv)));
+    }
+  }
+
+  return false;
+}
+
+bool balancer::healthy() const
+{
+  for (size_t i = 0; i < _M_count; i++) {
+    if ((_M_backends[i].state == state_healthy) &&
+        (_M_backends[i].naddrs > 0)) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+size_t balancer::select(uint32_t key)
+{
+  const uint64_t now = ::GetTickCount64();
+
+  // Retry if another thread takes the trial connection of the backend.
+  for (size_t i = 0; i < _M_count; i++) {
+    const size_t backend = pick(key, now);
+
+    // If no backend is usable...
+    if (backend == none) {
+      break;
+    }
+
+    if (take(backend)) {
+      ::InterlockedIncrement(&_M_backends[backend].outstanding);
+
+      return backend;
+    }
+  }
+
+  return none;
+}
+
+void balancer::succeeded(size_t backend)
+{
+  struct backend& b = _M_backends[backend];
+
+  if (b.failures != 0) {
+    ::InterlockedExchange(&b.failures, 0);
+  }
+
+  // If the backend was ejected or on trial...
+  if (b.state != state_healthy) {
+    ::InterlockedExchange(&b.state, state_healthy);
+  }
+}
+
+void balancer::failed(size_t backend)
+{
+  struct backend& b = _M_backends[backend];
+
+  const uint32_t failures = ::InterlockedIncrement(&b.failures);
+
+  // If the trial connection has failed or there have been too many
+  // consecutive failures...
+  if ((b.state == state_trial) ||
+      ((_M_health.max_failures > 0) &&
+       (failures >= _M_health.max_failures) &&
+       (b.state == state_healthy))) {
+    eject(backend);
+  }
+}
+
+bool balancer::address(size_t backend,
+                       size_t n,
+                       socket::address& addr) const
+{
+  const struct backend& b = _M_backends[backend];
+
+  ::AcquireSRWLockShared(&b.lock);
+
+  const bool ret = (n < b.naddrs);
+  if (ret) {
+    addr = b.addrs[n];
+  }
+
+  ::ReleaseSRWLockShared(&b.lock);
+
+  return ret;
+}
+
+bool balancer::update(size_t backend,
+                      const socket::address* addrs,
+                      size_t count)
+{
+  // Sanity check.
+  if ((backend < _M_count) && (count > 0)) {
+    addresses a;
+    for (a.count = 0; (a.count < count) && (a.count < max_addresses);
+         a.count++) {
+      a.addrs[a.count] = addrs[a.count];
+    }
+
+    struct backend& b = _M_backends[backend];
+
+    ::AcquireSRWLockExclusive(&b.lock);
+
+    save_addresses(backend, a);
+
+    ::ReleaseSRWLockExclusive(&b.lock);
+
+    return true;
+  }
+
+  return false;
+}
+
+uint32_t balancer::hash(const socket::address& addr)
+{
+  const struct sockaddr& sa = addr;
+
+  switch (sa.sa_family) {
+    case AF_INET:
+      return hash(&reinterpret_cast<const struct sockaddr_in&>(sa).sin_addr,
+                  sizeof(struct in_addr),
+                  offset_basis);
+    case AF_INET6:
+      return hash(&reinterpret_cast<const struct sockaddr_in6&>(sa).sin6_addr,
+                  sizeof(struct in6_addr),
+                  offset_basis);
+    default:
+      return hash(&sa, addr.length(), offset_basis);
+  }
+}
+
+size_t balancer::pick(uint32_t key, uint64_t now)
+{
+  if (_M_count > 1) {
+    switch (_M_policy) {
+      case policy::least_outstanding:
+        return least_outstanding(now);
+      case policy::power_of_two_choices:
+        return power_of_two_choices(now);
+      case policy::consistent_hash:
+        return consistent_hash(key, now);
+      case policy::round_robin:
+      default:
+        return round_robin(::InterlockedIncrement(&_M_next) % _M_count, now);
+    }
+  } else {
+    return usable(0, now) ? 0 : none;
+  }
+}
+
+size_t balancer::round_robin(size_t first, uint64_t now) const
+{
+  for (size_t i = 0; i < _M_count; i++) {
+    const size_t backend = (first + i) % _M_count;
+
+    if (usable(backend, now)) {
+      return backend;
+    }
+  }
+
+  return none;
+}
+
+size_t balancer::least_outstanding(uint64_t now)
+{
+  // Start at a different backend every time, so that ties are spread.
+  const size_t first = ::InterlockedIncrement(&_M_next) % _M_count;
+
+  size_t backend = none;
+  uint32_t min = 0;
+
+  for (size_t i = 0; i < _M_count; i++) {
+    const size_t b = (first + i) % _M_count;
+
+    if (usable(b, now)) {
+      const uint32_t outstanding = _M_backends[b].outstanding;
+
+      if ((backend == none) || (outstanding < min)) {
+        backend = b;
+        min = outstanding;
+
+        // If the backend is idle...
+        if (min == 0) {
+          break;
+        }
+      }
+    }
+  }
+
+  return backend;
+}
+
+size_t balancer::power_of_two_choices(uint64_t now)
+{
+  const uint32_t r = random();
+
+  // Two different backends.
+  const size_t b1 = r % _M_count;
+  const size_t b2 = (b1 + 1 + ((r >> 16) % (_M_count - 1))) % _M_count;
+
+  if (usable(b1, now)) {
+    if (usable(b2, now)) {
+      return (_M_backends[b2].outstanding < _M_backends[b1].outstanding) ?
+               b2 :
+               b1;
+    }
+
+    return b1;
+  } else if (usable(b2, now)) {
+    return b2;
+  } else {
+    // Try the other backends.
+    return round_robin(b1, now);
+  }
+}
+
+size_t balancer::consistent_hash(uint32_t key, uint64_t now) const
+{
+  // Find the first point whose hash is not less than the key.
+  size_t lo = 0;
+  size_t hi = _M_npoints;
+
+  while (lo < hi) {
+    const size_t mid = (lo + hi) / 2;
+
+    if (_M_ring[mid].hash < key) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+
+  // Walk the ring (wrapping around) up to the first usable backend, so that
+  // the clients of an ejected backend are spread over the others.
+  for (size_t i = 0; i < _M_npoints; i++) {
+    const size_t backend = _M_ring[(lo + i) % _M_npoints].backend;
+
+    if (usable(backend, now)) {
+      return backend;
+    }
+  }
+
+  return none;
+}
+
+bool balancer::usable(size_t backend, uint64_t now) const
+{
+  const struct backend& b = _M_backends[backend];
+
+  // If the backend has no addresses (its host name has not been resolved
+  // yet)...
+  if (b.naddrs == 0) {
+    return false;
+  }
+
+  switch (b.state) {
+    case state_healthy:
+      return true;
+    case state_ejected:
+      // If the ejection has ended...
+      return (now >= b.ejected_until);
+    default:
+      return false;
+  }
+}
+
+bool balancer::take(size_t backend)
+{
+  struct backend& b = _M_backends[backend];
+
+  // If the backend is healthy, otherwise if this is the trial connection...
+  return ((b.state == state_healthy) ||
+          (::InterlockedCompareExchange(&b.state,
+                                        state_trial,
+                                        state_ejected) == state_ejected));
+}
+
+void balancer::eject(size_t backend)
+{
+  struct backend& b = _M_backends[backend];
+
+  b.ejected_until = ::GetTickCount64() + (_M_health.ejection_time * 1000ull);
+
+  ::InterlockedExchange(&b.state, state_ejected);
+}
+
+bool balancer::create_probes(PTP_CALLBACK_ENVIRON callbackenv)
+{
+  // Create probe timer.
+  if (_M_timer.create(callbackenv)) {
+    _M_probes = static_cast<probe**>(calloc(_M_count, sizeof(probe*)));
+
+    if (_M_probes) {
+      for (size_t i = 0; i < _M_count; i++) {
+        _M_probes[i] = new (std::nothrow) probe{*this, i, callbackenv};
+
+        // If the probe could not be created...
+        if (!_M_probes[i]) {
+          return false;
+        }
+      }
+
+      // Start the probe timer.
+      _M_timer.expires_in(_M_health.probe_interval * 1000ull * 1000ull);
+
+      return true;
+    }
+  }
+
+  return false;
+}
+
+void balancer::probe_timer()
+{
+  // Probe every backend.
+  for (size_t i = 0; i < _M_count; i++) {
+    _M_probes[i]->start();
+  }
+
+  // If the balancer has not been stopped...
+  if (::InterlockedCompareExchange(&_M_stopped, 0, 0) == 0) {
+    _M_timer.expires_in(_M_health.probe_interval * 1000ull * 1000ull);
+  }
+}
+
+bool balancer::save_addresses(size_t backend, const addresses& addrs)
+{
+  // Sanity check.
+  if ((addrs.count > 0) && (addrs.count <= max_addresses)) {
+    struct backend& b = _M_backends[backend];
+
+    // Indices of the next IPv6 address and of the next other address.
+    size_t next6 = 0;
+    size_t next4 = 0;
+
+    // Is an IPv6 address next?
+    bool ipv6 = true;
+
+    // Interleave the addresses in a local array.
+    socket::address interleaved[max_addresses];
+
+    for (size_t i = 0; i < addrs.count; i++) {
+      next6 = find(addrs, next6, true);
+      next4 = find(addrs, next4, false);
+
+      // Take an address of the preferred family if there are any left,
+      // otherwise of the other family.
+      if ((next6 < addrs.count) && ((ipv6) || (next4 == addrs.count))) {
+        interleaved[i] = addrs.addrs[next6++];
+        ipv6 = false;
+      } else {
+        interleaved[i] = addrs.addrs[next4++];
+        ipv6 = true;
+      }
+    }
+
+    for (size_t i = 0; i < addrs.count; i++) {
+      b.addrs[i] = interleaved[i];
+    }
+
+    // Publish the number of addresses at once: usable() and healthy() read
+    // it without the lock, and must never see a backend being updated
+    // without addresses.
+    ::InterlockedExchange(&b.naddrs, static_cast<uint32_t>(addrs.count));
+
+    return true;
+  }
+
+  return false;
+}
+
+size_t balancer::find(const addresses& addrs, size_t from, bool ipv6)
+{
+  while ((from < addrs.count) &&
+         ((addrs.addrs[from].family() == AF_INET6) != ipv6)) {
+    from++;
+  }
+
+  return from;
+}
+
+bool balancer::build_ring()
+{
+  _M_ring = static_cast<point*>(
+              malloc(_M_count * points_per_backend * sizeof(point))
+            );
+
+  if (_M_ring) {
+    // The points of a backend only depend on its address (or its name), so
+    // that the ring only changes around the backends which are added or
+    // removed.
+    for (size_t i = 0; i < _M_count; i++) {
+      const uint32_t h = _M_backends[i].hash;
+
+      for (uint32_t j = 0; j < points_per_backend; j++) {
+        _M_ring[_M_npoints].hash = hash(&j, sizeof(uint32_t), h);
+        _M_ring[_M_npoints].backend = static_cast<uint32_t>(i);
+
+        _M_npoints++;
+      }
+    }
+
+    // Sort points.
+    qsort(_M_ring, _M_npoints, sizeof(point), compare);
+
+    return true;
+  }
+
+  return false;
+}
+
+int balancer::compare(const void* p1, const void* p2)
+{
+  const point* const pt1 = static_cast<const point*>(p1);
+  const point* const pt2 = static_cast<const point*>(p2);
+
+  if (pt1->hash < pt2->hash) {
+    return -1;
+  } else if (pt1->hash > pt2->hash) {
+    return 1;
+  } else {
+    return (pt1->backend < pt2->backend) ? -1 :
+                                           (pt1->backend > pt2->backend);
+  }
+}
+
+uint32_t balancer::hash(const void* data, size_t len, uint32_t h)
+{
+  // FNV-1a.
+  static constexpr const uint32_t prime = 16777619u;
+
+  const uint8_t* const bytes = static_cast<const uint8_t*>(data);
+
+  for (size_t i = 0; i < len; i++) {
+    h = (h ^ bytes[i]) * prime;
+  }
+
+  // Mix the bits, so that close addresses don't end up next to each other
+  // on the ring.
+  h ^= h >> 16;
+  h *= 0x45d9f3bu;
+  h ^= h >> 16;
+
+  return h;
+}
+
+uint32_t balancer::random()
+{
+  static thread_local uint32_t state = 0;
+
+  // Seed the generator of the thread.
+  if (state == 0) {
+    state = (::GetCurrentThreadId() * 2654435761u) | 1;
+  }
+
+  // xorshift32.
+  state ^= state << 13;
+  state ^= state >> 17;
+  state ^= state << 5;
+
+  return state;
+}
+
+balancer::probe::probe(balancer& balancer,
+                       size_t backend,
+                       PTP_CALLBACK_ENVIRON callbackenv)
+  : _M_sock{complete, this, callbackenv},
+    _M_balancer{balancer},
+    _M_backend{backend}
+{
+  ::InitializeCriticalSection(&_M_lock);
+}
+
+balancer::probe::~probe()
+{
+  ::DeleteCriticalSection(&_M_lock);
+}
+
+void balancer::probe::start()
+{
+  ::EnterCriticalSection(&_M_lock);
+
+  // If the previous probe is still in progress...
+  if (_M_in_progress) {
+    // Cancel the connect to the current candidate (its completion tries
+    // the next one, or counts the probe as failed).
+    _M_sock.cancel();
+  } else {
+    _M_in_progress = true;
+
+    // If the backend has no addresses...
+    if (!connect(0)) {
+      _M_in_progress = false;
+    }
+  }
+
+  ::LeaveCriticalSection(&_M_lock);
+}
+
+bool balancer::probe::connect(size_t candidate)
+{
+  socket::address addr;
+
+  // If the backend has this candidate address...
+  if (_M_balancer.address(_M_backend, candidate, addr)) {
+    _M_candidate = candidate;
+
+    // Connect.
+    _M_sock.connect(addr);
+
+    return true;
+  }
+
+  return false;
+}
+
+void balancer::probe::complete(async::stream::socket::operation op,
+                               DWORD error,
+                               DWORD transferred,
+                               void* user)
+{
+  probe* const p = static_cast<probe*>(user);
+
+  ::EnterCriticalSection(&p->_M_lock);
+
+  switch (op) {
+    case async::stream::socket::operation::connect:
+      // Success?
+      if (error == 0) {
+        p->_M_balancer.succeeded(p->_M_backend);
+
+        // Disconnect (the probe ends when the socket is disconnected).
+        p->_M_sock.disconnect();
+
+        ::LeaveCriticalSection(&p->_M_lock);
+        return;
+      }
+
+      // Try the next candidate (for instance, the IPv4 address when the
+      // IPv6 route is broken).
+      if (p->connect(p->_M_candidate + 1)) {
+        ::LeaveCriticalSection(&p->_M_lock);
+        return;
+      }
+
+      // Every candidate has failed.
+      p->_M_balancer.failed(p->_M_backend);
+
+      break;
+    case async::stream::socket::operation::disconnect:
+    default:
+      break;
+  }
+
+  // The probe has ended.
+  p->_M_in_progress = false;
+
+  ::LeaveCriticalSection(&p->_M_lock);
+}
+
+} // namespace tcp
+} // namespace net
\ No newline at end of file
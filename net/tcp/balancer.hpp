@@ -0,0 +1,363 @@
+#pragma once
+
+#include <stdint.h>
+#include "net/async/stream/socket.hpp"
+#include "net/socket/address.hpp"
+#include "util/timer.hpp"
+#include "util/slab.hpp"
+
+namespace net {
+namespace tcp {
+
+// Load balancer: selects the backend of every new upstream connection.
+// The counters of each backend live on their own cache line and are only
+// modified with interlocked operations, so the threads which select
+// backends never block each other.
+//
+// Every backend has a circuit breaker. Failed connects (reported by the
+// users of the balancer and by the periodic connect probes) are counted;
+// after `max_failures` consecutive failures the backend is ejected and not
+// selected for `ejection_time` seconds. Then a single trial connection is
+// let through: if it succeeds (or a probe does) the backend is healthy
+// again, otherwise it is ejected once more.
+class balancer {
+  public:
+    // Balancing policy.
+    enum class policy {
+      // Every backend in turn.
+      round_robin,
+
+      // Backend with the fewest outstanding connections.
+      least_outstanding,
+
+      // The less loaded of two backends chosen at random.
+      power_of_two_choices,
+
+      // Backend chosen by hashing the IP address of the client, so that
+      // a client always reaches the same backend (adding or removing a
+      // backend only moves the clients of that backend).
+      consistent_hash
+    };
+
+    // Health checking.
+    struct health_check {
+      // Consecutive failed connects which eject a backend (0: backends
+      // are never ejected).
+      uint32_t max_failures;
+
+      // Time a backend stays ejected (seconds).
+      uint32_t ejection_time;
+
+      // Interval between connect probes to every backend (seconds, 0: no
+      // probes).
+      uint32_t probe_interval;
+    };
+
+    // Maximum number of backends.
+    static constexpr const size_t max_backends = 256;
+
+    // Maximum number of addresses per backend.
+    static constexpr const size_t max_addresses = 8;
+
+    // Addresses of a backend (for instance, the IPv6 and IPv4 addresses of
+    // a host), which are raced when connecting (Happy Eyeballs).
+    // If `host` is not null, the backend is the host name `host` and port
+    // `port`: it starts without addresses (`count` is 0) and is not
+    // selected until its addresses are set with update().
+    struct addresses {
+      socket::address addrs[max_addresses];
+      size_t count;
+
+      const char* host;
+      in_port_t port;
+    };
+
+    // No backend.
+    static constexpr const size_t none = static_cast<size_t>(-1);
+
+    // Default number of consecutive failed connects which eject a backend.
+    static constexpr const uint32_t default_max_failures = 5;
+
+    // Default ejection time (seconds).
+    static constexpr const uint32_t default_ejection_time = 10;
+
+    // Default interval between connect probes (seconds).
+    static constexpr const uint32_t default_probe_interval = 5;
+
+    // Constructor.
+    balancer();
+
+    // Destructor.
+    ~balancer();
+
+    // Create.
+    // If `health` is null, the default health checking is used. The connect
+    // probes run on the callback environment `callbackenv`.
+    bool create(const addresses* backends,
+                size_t count,
+                policy policy = policy::round_robin,
+                const health_check* health = nullptr,
+                PTP_CALLBACK_ENVIRON callbackenv = nullptr);
+
+    // Get number of backends.
+    size_t count() const;
+
+    // Does the policy need the address of the client?
+    bool hashed() const;
+
+    // Is any backend healthy?
+    bool healthy() const;
+
+    // Select a backend for a new upstream connection and count it as
+    // outstanding.
+    // `key` is the hash of the address of the client (only used by
+    // `policy::consistent_hash`).
+    // Returns `none` if all the backends are ejected.
+    size_t select(uint32_t key = 0);
+
+    // The upstream connection to the backend has finished.
+    void release(size_t backend);
+
+    // A connect to the backend has succeeded.
+    void succeeded(size_t backend);
+
+    // A connect to the backend has failed.
+    void failed(size_t backend);
+
+    // Get number of addresses of the backend.
+    size_t naddresses(size_t backend) const;
+
+    // Get the `n`-th address of the backend.
+    // The addresses alternate between IPv6 and IPv4 (IPv6 first), as
+    // recommended by RFC 8305.
+    // Returns false if the backend has fewer addresses.
+    bool address(size_t backend, size_t n, socket::address& addr) const;
+
+    // Replace the addresses of the backend (for instance, when its host
+    // name has been resolved again).
+    bool update(size_t backend, const socket::address* addrs, size_t count);
+
+    // Get number of outstanding connections to the backend.
+    uint32_t outstanding(size_t backend) const;
+
+    // Hash the IP address of the client (the port is ignored).
+    static uint32_t hash(const socket::address& addr);
+
+  private:
+    // Number of points of each backend on the hash ring.
+    static constexpr const size_t points_per_backend = 160;
+
+    // FNV-1a offset basis.
+    static constexpr const uint32_t offset_basis = 2166136261u;
+
+    // States of the circuit breaker of a backend.
+    // Healthy (connections are let through).
+    static constexpr const uint32_t state_healthy = 0;
+
+    // Ejected (connections are rejected).
+    static constexpr const uint32_t state_ejected = 1;
+
+    // A trial connection is in progress.
+    static constexpr const uint32_t state_trial = 2;
+
+    // Backend.
+    struct backend {
+      // Outstanding connections.
+      alignas(util::cache_line_size) uint32_t outstanding = 0;
+
+      // Consecutive failed connects.
+      uint32_t failures = 0;
+
+      // State of the circuit breaker.
+      uint32_t state = state_healthy;
+
+      // End of the ejection (milliseconds since the system was started).
+      uint64_t ejected_until = 0;
+
+      // Addresses (written with the lock held; the number of addresses is
+      // also read without the lock, so it is published at once).
+      socket::address addrs[max_addresses];
+      uint32_t naddrs = 0;
+
+      // Lock of the addresses.
+      mutable SRWLOCK lock = SRWLOCK_INIT;
+
+      // Hash of the backend (consistent hashing).
+      uint32_t hash = 0;
+    };
+
+    // Point of the hash ring.
+    struct point {
+      uint32_t hash;
+      uint32_t backend;
+    };
+
+    // Connect probe.
+    class probe {
+      public:
+        // Constructor.
+        probe(balancer& balancer,
+              size_t backend,
+              PTP_CALLBACK_ENVIRON callbackenv);
+
+        // Destructor.
+        ~probe();
+
+        // Start a connect probe.
+        // The candidate addresses of the backend are tried in turn, and the
+        // probe only fails once all of them have failed. If the previous
+        // probe is still connecting, the connect to its current candidate
+        // has timed out: it is canceled instead (and the next candidate is
+        // tried).
+        void start();
+
+      private:
+        // Socket.
+        async::stream::socket _M_sock;
+
+        // Balancer.
+        balancer& _M_balancer;
+
+        // Backend.
+        const size_t _M_backend;
+
+        // Is a probe in progress?
+        bool _M_in_progress = false;
+
+        // Candidate address being connected to.
+        size_t _M_candidate = 0;
+
+        // Lock serializing the probe timer and the completions, so that a
+        // cancel never races with the connect to the next candidate. It is
+        // recursive: a completion might be notified inline, by the thread
+        // which started the operation with the lock held.
+        CRITICAL_SECTION _M_lock;
+
+        // Connect to the candidate address `candidate` of the backend.
+        // Returns false if the backend has fewer addresses.
+        bool connect(size_t candidate);
+
+        // Notify of a completed socket I/O operation.
+        static void complete(async::stream::socket::operation op,
+                             DWORD error,
+                             DWORD transferred,
+                             void* user);
+
+        // Disable copy constructor and assignment operator.
+        probe(const probe&) = delete;
+        probe& operator=(const probe&) = delete;
+    };
+
+    // Backends (allocated aligned to a cache line, as operator new doesn't
+    // honor the alignment of `backend` before C++17).
+    backend* _M_backends = nullptr;
+    size_t _M_count = 0;
+
+    // Hash ring (consistent hashing).
+    point* _M_ring = nullptr;
+    size_t _M_npoints = 0;
+
+    // Policy.
+    policy _M_policy = policy::round_robin;
+
+    // Health checking.
+    health_check _M_health;
+
+    // Connect probes (one per backend).
+    probe** _M_probes = nullptr;
+
+    // Probe timer.
+    void probe_timer();
+
+    // Probe timer.
+    util::basic_timer<
+      util::timer_member_handler<balancer, &balancer::probe_timer>
+    > _M_timer;
+
+    // Has the balancer been stopped?
+    uint32_t _M_stopped = 0;
+
+    // Next backend (round robin).
+    alignas(util::cache_line_size) uint32_t _M_next = 0;
+
+    // Pick a backend according to the policy, among those which are
+    // healthy or whose ejection has ended.
+    size_t pick(uint32_t key, uint64_t now);
+
+    // Pick the first usable backend, starting with `first`.
+    size_t round_robin(size_t first, uint64_t now) const;
+
+    // Pick the usable backend with the fewest outstanding connections.
+    size_t least_outstanding(uint64_t now);
+
+    // Pick the less loaded of two random backends.
+    size_t power_of_two_choices(uint64_t now);
+
+    // Pick the first usable backend on the hash ring after `key`.
+    size_t consistent_hash(uint32_t key, uint64_t now) const;
+
+    // Can the backend be selected?
+    bool usable(size_t backend, uint64_t now) const;
+
+    // Take the backend: if its ejection has ended, the connection is the
+    // trial connection. Returns false if another thread took the trial.
+    bool take(size_t backend);
+
+    // Eject backend.
+    void eject(size_t backend);
+
+    // Create connect probes.
+    bool create_probes(PTP_CALLBACK_ENVIRON callbackenv);
+
+    // Save the addresses of the backend, interleaving the address
+    // families (with the lock of the backend held, if needed).
+    bool save_addresses(size_t backend, const addresses& addrs);
+
+    // Find the first IPv6 address (`ipv6`) or the first address of another
+    // family, starting at `from`.
+    static size_t find(const addresses& addrs, size_t from, bool ipv6);
+
+    // Build hash ring.
+    bool build_ring();
+
+    // Compare points of the hash ring.
+    static int compare(const void* p1, const void* p2);
+
+    // Hash `len` bytes.
+    static uint32_t hash(const void* data, size_t len, uint32_t h);
+
+    // Get a random number (per thread).
+    static uint32_t random();
+
+    // Disable copy constructor and assignment operator.
+    balancer(const balancer&) = delete;
+    balancer& operator=(const balancer&) = delete;
+};
+
+inline size_t balancer::count() const
+{
+  return _M_count;
+}
+
+inline bool balancer::hashed() const
+{
+  return (_M_policy == policy::consistent_hash);
+}
+
+inline void balancer::release(size_t backend)
+{
+  ::InterlockedDecrement(&_M_backends[backend].outstanding);
+}
+
+inline size_t balancer::naddresses(size_t backend) const
+{
+  return _M_backends[backend].naddrs;
+}
+
+inline uint32_t balancer::outstanding(size_t backend) const
+{
+  return _M_backends[backend].outstanding;
+}
+
+} // namespace tcp
+} // namespace net
\ No newline at end of file
@@ -0,0 +1,1077 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <sys/stat.h>
+#include <new>
+#include "net/tcp/connector/configuration.hpp"
+
+namespace net {
+namespace tcp {
+namespace connector {
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+//                                                                            //
+// Configuration.                                                             //
+//                                                                            //
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+
+const char* const configuration::fault_names[nfaults] = {
+  "idle",
+  "trickle",
+  "reset",
+  "half-close"
+};
+
+configuration::~configuration()
+{
+  if (_M_data) {
+    free(_M_data);
+  }
+
+  delete [] _M_files;
+
+  if (_M_payloads) {
+    free(_M_payloads);
+  }
+}
+
+bool configuration::parse(int argc, const char* argv[])
+{
+  const char* address = nullptr;
+  _M_nconnections = default_connections;
+  _M_ntransfers = default_transfers;
+  _M_nloops = default_loops;
+
+  int i = 1;
+  while (i < argc) {
+    if (_stricmp(argv[i], "--address") == 0) {
+      // If not the last argument...
+      if (i + 1 < argc) {
+        // If the address has not been provided yet...
+        if (!address) {
+          // Build address.
+          if (_M_address.build(argv[i + 1])) {
+            address = argv[i + 1];
+
+            i += 2;
+          } else {
+            fprintf(stderr, "Invalid address '%s'.\n", argv[i + 1]);
+            return false;
+          }
+        } else {
+          fprintf(stderr, "\"--address\" has been already provided.\n");
+          return false;
+        }
+      } else {
+        fprintf(stderr, "Expected argument after \"--address\".\n");
+        return false;
+      }
+    } else if (_stricmp(argv[i], "--number-connections") == 0) {
+      // If not the last argument...
+      if (i + 1 < argc) {
+        uint64_t n;
+        if (parse(argv[i + 1], n, min_connections, max_connections)) {
+          _M_nconnections = static_cast<size_t>(n);
+
+          i += 2;
+        } else {
+          fprintf(stderr,
+                  "Invalid number of connections '%s' "
+                  "(valid range: %zu .. %zu).\n",
+                  argv[i + 1],
+                  min_connections,
+                  max_connections);
+
+          return false;
+        }
+      } else {
+        fprintf(stderr, "Expected argument after \"--number-connections\".\n");
+        return false;
+      }
+    } else if (_stricmp(argv[i], "--number-threads") == 0) {
+      // If not the last argument...
+      if (i + 1 < argc) {
+        uint64_t n;
+        if (parse(argv[i + 1], n, min_threads, max_threads)) {
+          _M_nthreads = static_cast<size_t>(n);
+
+          i += 2;
+        } else {
+          fprintf(stderr,
+                  "Invalid number of threads '%s' (valid range: %zu .. %zu)."
+                  "\n",
+                  argv[i + 1],
+                  min_threads,
+                  max_threads);
+
+          return false;
+        }
+      } else {
+        fprintf(stderr, "Expected argument after \"--number-threads\".\n");
+        return false;
+      }
+    } else if (_stricmp(argv[i], "--source-address") == 0) {
+      // If not the last argument...
+      if (i + 1 < argc) {
+        // If there is space for another source address...
+        if (_M_nsource_addresses < max_source_addresses) {
+          // Build address (the port is chosen when binding).
+          if (_M_source_addresses[_M_nsource_addresses].build(argv[i + 1],
+                                                              0)) {
+            _M_nsource_addresses++;
+
+            i += 2;
+          } else {
+            fprintf(stderr, "Invalid source address '%s'.\n", argv[i + 1]);
+            return false;
+          }
+        } else {
+          fprintf(stderr,
+                  "Too many source addresses (maximum: %zu).\n",
+                  max_source_addresses);
+
+          return false;
+        }
+      } else {
+        fprintf(stderr, "Expected argument after \"--source-address\".\n");
+        return false;
+      }
+    } else if (_stricmp(argv[i], "--number-transfers-per-connection") == 0) {
+      // If not the last argument...
+      if (i + 1 < argc) {
+        uint64_t n;
+        if (parse(argv[i + 1], n, min_transfers, max_transfers)) {
+          _M_ntransfers = static_cast<unsigned>(n);
+
+          i += 2;
+        } else {
+          fprintf(stderr,
+                  "Invalid number of transfers '%s' (valid range: %u .. %u).\n",
+                  argv[i + 1],
+                  min_transfers,
+                  max_transfers);
+
+          return false;
+        }
+      } else {
+        fprintf(stderr,
+                "Expected argument after "
+                "\"--number-transfers-per-connection\".\n");
+
+        return false;
+      }
+    } else if (_stricmp(argv[i], "--number-loops") == 0) {
+      // If not the last argument...
+      if (i + 1 < argc) {
+        uint64_t n;
+        if (parse(argv[i + 1], n, min_loops, max_loops)) {
+          _M_nloops = static_cast<unsigned>(n);
+
+          i += 2;
+        } else {
+          fprintf(stderr,
+                  "Invalid number of loops '%s' (valid range: %u .. %u).\n",
+                  argv[i + 1],
+                  min_loops,
+                  max_loops);
+
+          return false;
+        }
+      } else {
+        fprintf(stderr, "Expected argument after \"--number-loops\".\n");
+        return false;
+      }
+    } else if (_stricmp(argv[i], "--file") == 0) {
+      // If not the last argument...
+      if (i + 1 < argc) {
+        // If the payloads have not been provided yet...
+        if (!_M_payloads) {
+          // Load file.
+          if (load_file(argv[i + 1])) {
+            i += 2;
+          } else {
+            return false;
+          }
+        } else {
+          fprintf(stderr,
+                  "\"--file\", \"--data\" or \"--corpus\" has been already "
+                  "provided.\n");
+
+          return false;
+        }
+      } else {
+        fprintf(stderr, "Expected argument after \"--file\".\n");
+        return false;
+      }
+    } else if (_stricmp(argv[i], "--corpus") == 0) {
+      // If not the last argument...
+      if (i + 1 < argc) {
+        // If the payloads have not been provided yet...
+        if (!_M_payloads) {
+          // Load corpus.
+          if (load_corpus(argv[i + 1])) {
+            i += 2;
+          } else {
+            return false;
+          }
+        } else {
+          fprintf(stderr,
+                  "\"--file\", \"--data\" or \"--corpus\" has been already "
+                  "provided.\n");
+
+          return false;
+        }
+      } else {
+        fprintf(stderr, "Expected argument after \"--corpus\".\n");
+        return false;
+      }
+    } else if (_stricmp(argv[i], "--data") == 0) {
+      // If not the last argument...
+      if (i + 1 < argc) {
+        // If the payloads have not been provided yet...
+        if (!_M_payloads) {
+          uint64_t n;
+          if (parse(argv[i + 1], n, min_data_transfer, max_data_transfer)) {
+            const size_t length = static_cast<size_t>(n);
+
+            // Allocate memory.
+            _M_data = static_cast<uint8_t*>(malloc(length));
+            _M_payloads = static_cast<payload*>(malloc(sizeof(payload)));
+
+            // If the data could be allocated...
+            if ((_M_data) && (_M_payloads)) {
+              memset(_M_data, '0', length);
+
+              _M_payloads[0].data = _M_data;
+              _M_payloads[0].length = length;
+              _M_npayloads = 1;
+
+              i += 2;
+            } else {
+              fprintf(stderr, "Error allocating memory.\n");
+              return false;
+            }
+          } else {
+            fprintf(stderr,
+                    "Invalid data transfer '%s' (valid range: %zu .. %zu).\n",
+                    argv[i + 1],
+                    min_data_transfer,
+                    max_data_transfer);
+
+            return false;
+          }
+        } else {
+          fprintf(stderr,
+                  "\"--file\", \"--data\" or \"--corpus\" has been already "
+                  "provided.\n");
+
+          return false;
+        }
+      } else {
+        fprintf(stderr, "Expected argument after \"--data\".\n");
+        return false;
+      }
+    } else if (_stricmp(argv[i], "--zero-copy") == 0) {
+      _M_zero_copy = true;
+
+      i++;
+    } else if (_stricmp(argv[i], "--rate") == 0) {
+      // If not the last argument...
+      if (i + 1 < argc) {
+        if (parse(argv[i + 1], _M_rate, min_rate, max_rate)) {
+          i += 2;
+        } else {
+          fprintf(stderr,
+                  "Invalid rate '%s' (valid range: %llu .. %llu).\n",
+                  argv[i + 1],
+                  static_cast<unsigned long long>(min_rate),
+                  static_cast<unsigned long long>(max_rate));
+
+          return false;
+        }
+      } else {
+        fprintf(stderr, "Expected argument after \"--rate\".\n");
+        return false;
+      }
+    } else if (_stricmp(argv[i], "--echo") == 0) {
+      _M_echo = true;
+
+      i++;
+    } else if (_stricmp(argv[i], "--churn") == 0) {
+      // If not the last argument...
+      if (i + 1 < argc) {
+        if (parse(argv[i + 1], _M_churn, min_churn, max_churn)) {
+          i += 2;
+        } else {
+          fprintf(stderr,
+                  "Invalid connection rate '%s' (valid range: %llu .. %llu)."
+                  "\n",
+                  argv[i + 1],
+                  static_cast<unsigned long long>(min_churn),
+                  static_cast<unsigned long long>(max_churn));
+
+          return false;
+        }
+      } else {
+        fprintf(stderr, "Expected argument after \"--churn\".\n");
+        return false;
+      }
+    } else if (_stricmp(argv[i], "--output") == 0) {
+      // If not the last argument...
+      if (i + 1 < argc) {
+        _M_output = argv[i + 1];
+
+        i += 2;
+      } else {
+        fprintf(stderr, "Expected argument after \"--output\".\n");
+        return false;
+      }
+    } else if (_stricmp(argv[i], "--output-format") == 0) {
+      // If not the last argument...
+      if (i + 1 < argc) {
+        if (_stricmp(argv[i + 1], "json") == 0) {
+          _M_format = output_format::json;
+        } else if (_stricmp(argv[i + 1], "csv") == 0) {
+          _M_format = output_format::csv;
+        } else {
+          fprintf(stderr, "Invalid output format '%s'.\n", argv[i + 1]);
+          return false;
+        }
+
+        i += 2;
+      } else {
+        fprintf(stderr, "Expected argument after \"--output-format\".\n");
+        return false;
+      }
+    } else if (_stricmp(argv[i], "--report-interval") == 0) {
+      // If not the last argument...
+      if (i + 1 < argc) {
+        if (parse(argv[i + 1],
+                  _M_report_interval,
+                  min_report_interval,
+                  max_report_interval)) {
+          i += 2;
+        } else {
+          fprintf(stderr,
+                  "Invalid report interval '%s' (valid range: %llu .. %llu)."
+                  "\n",
+                  argv[i + 1],
+                  static_cast<unsigned long long>(min_report_interval),
+                  static_cast<unsigned long long>(max_report_interval));
+
+          return false;
+        }
+      } else {
+        fprintf(stderr, "Expected argument after \"--report-interval\".\n");
+        return false;
+      }
+    } else if (_stricmp(argv[i], "--fault") == 0) {
+      // If not the last argument...
+      if (i + 1 < argc) {
+        if (parse_fault(argv[i + 1])) {
+          i += 2;
+        } else {
+          return false;
+        }
+      } else {
+        fprintf(stderr, "Expected argument after \"--fault\".\n");
+        return false;
+      }
+    } else if (_stricmp(argv[i], "--trickle-interval") == 0) {
+      // If not the last argument...
+      if (i + 1 < argc) {
+        if (parse(argv[i + 1],
+                  _M_trickle_interval,
+                  min_trickle_interval,
+                  max_trickle_interval)) {
+          i += 2;
+        } else {
+          fprintf(stderr,
+                  "Invalid trickle interval '%s' (valid range: %llu .. %llu)."
+                  "\n",
+                  argv[i + 1],
+                  static_cast<unsigned long long>(min_trickle_interval),
+                  static_cast<unsigned long long>(max_trickle_interval));
+
+          return false;
+        }
+      } else {
+        fprintf(stderr, "Expected argument after \"--trickle-interval\".\n");
+        return false;
+      }
+    } else if (_stricmp(argv[i], "--fault-hold") == 0) {
+      // If not the last argument...
+      if (i + 1 < argc) {
+        if (parse(argv[i + 1],
+                  _M_fault_hold,
+                  min_fault_hold,
+                  max_fault_hold)) {
+          i += 2;
+        } else {
+          fprintf(stderr,
+                  "Invalid fault hold '%s' (valid range: %llu .. %llu).\n",
+                  argv[i + 1],
+                  static_cast<unsigned long long>(min_fault_hold),
+                  static_cast<unsigned long long>(max_fault_hold));
+
+          return false;
+        }
+      } else {
+        fprintf(stderr, "Expected argument after \"--fault-hold\".\n");
+        return false;
+      }
+    } else if (_stricmp(argv[i], "--help") == 0) {
+      usage(argv[0]);
+      return false;
+    } else {
+      fprintf(stderr, "Invalid option '%s'.\n", argv[i]);
+      return false;
+    }
+  }
+
+  // If at least one argument has been provided...
+  if (argc > 1) {
+    // If the address has been provided...
+    if (address) {
+      if (_M_payloads) {
+        // The transfers of a churned connection are not rate limited.
+        if ((_M_churn == 0) || (_M_rate == 0)) {
+          // The source addresses have to be of the family of the address.
+          for (size_t j = 0; j < _M_nsource_addresses; j++) {
+            if (_M_source_addresses[j].family() != _M_address.family()) {
+              fprintf(stderr,
+                      "The source addresses and the address have to be of "
+                      "the same family.\n");
+
+              return false;
+            }
+          }
+
+          // One thread per processor by default.
+          if (_M_nthreads == 0) {
+            _M_nthreads = ::GetActiveProcessorCount(ALL_PROCESSOR_GROUPS);
+
+            if (_M_nthreads > max_threads) {
+              _M_nthreads = max_threads;
+            } else if (_M_nthreads < min_threads) {
+              _M_nthreads = min_threads;
+            }
+          }
+
+          // Every thread drives at least one connection.
+          if (_M_nthreads > _M_nconnections) {
+            _M_nthreads = _M_nconnections;
+          }
+
+          return true;
+        } else {
+          fprintf(stderr,
+                  "\"--rate\" and \"--churn\" cannot be used together.\n");
+        }
+      } else {
+        fprintf(stderr,
+                "Either the argument \"--file\", \"--data\" or "
+                "\"--corpus\" has to be provided.\n");
+      }
+    } else {
+      fprintf(stderr, "Argument \"--address\" has to be provided.\n");
+    }
+  } else {
+    usage(argv[0]);
+  }
+
+  return false;
+}
+
+const net::socket::address& configuration::address() const
+{
+  return _M_address;
+}
+
+size_t configuration::number_connections() const
+{
+  return _M_nconnections;
+}
+
+size_t configuration::number_threads() const
+{
+  return _M_nthreads;
+}
+
+const net::socket::address* configuration::source_addresses() const
+{
+  return _M_source_addresses;
+}
+
+size_t configuration::number_source_addresses() const
+{
+  return _M_nsource_addresses;
+}
+
+unsigned configuration::number_transfers_per_connection() const
+{
+  return _M_ntransfers;
+}
+
+unsigned configuration::number_loops() const
+{
+  return _M_nloops;
+}
+
+const configuration::payload* configuration::payloads() const
+{
+  return _M_payloads;
+}
+
+size_t configuration::number_payloads() const
+{
+  return _M_npayloads;
+}
+
+bool configuration::zero_copy() const
+{
+  return _M_zero_copy;
+}
+
+uint64_t configuration::rate() const
+{
+  return _M_rate;
+}
+
+bool configuration::echo() const
+{
+  return _M_echo;
+}
+
+uint64_t configuration::churn() const
+{
+  return _M_churn;
+}
+
+const char* configuration::output() const
+{
+  return _M_output;
+}
+
+configuration::output_format configuration::format() const
+{
+  return _M_format;
+}
+
+uint64_t configuration::report_interval() const
+{
+  return _M_report_interval;
+}
+
+configuration::fault configuration::fault_for(uint64_t n) const
+{
+  // Spread the faults over every 100 connects (61 and 100 are coprime, so
+  // 100 consecutive connects take all the slots, in a scattered order).
+  unsigned slot = static_cast<unsigned>((n * 61) % 100);
+
+  for (size_t i = 0; i < nfaults; i++) {
+    if (slot < _M_fault_percent[i]) {
+      return static_cast<fault>(i + 1);
+    }
+
+    slot -= _M_fault_percent[i];
+  }
+
+  return fault::none;
+}
+
+bool configuration::faults() const
+{
+  for (size_t i = 0; i < nfaults; i++) {
+    if (_M_fault_percent[i] > 0) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+uint64_t configuration::trickle_interval() const
+{
+  return _M_trickle_interval;
+}
+
+uint64_t configuration::fault_hold() const
+{
+  return _M_fault_hold;
+}
+
+bool configuration::load_file(const char* filename)
+{
+  // Allocate the mapped file and the payload.
+  _M_files = new (std::nothrow) util::mapped_file[1];
+  _M_payloads = static_cast<payload*>(malloc(sizeof(payload)));
+
+  // If they could be allocated...
+  if ((_M_files) && (_M_payloads)) {
+    _M_nfiles = 1;
+
+    // Map file (the data is sent from the mapping).
+    util::mapped_file& file = _M_files[0];
+    if (map_file(filename, file, min_data_transfer, max_file_transfer)) {
+      _M_payloads[0].data = file.data();
+      _M_payloads[0].length = static_cast<size_t>(file.size());
+      _M_npayloads = 1;
+
+      return true;
+    }
+  } else {
+    fprintf(stderr, "Error allocating memory.\n");
+  }
+
+  return false;
+}
+
+bool configuration::load_corpus(const char* name)
+{
+  struct _stat64 sbuf;
+  if (_stat64(name, &sbuf) == 0) {
+    // Directory?
+    if ((sbuf.st_mode & _S_IFDIR) != 0) {
+      return load_corpus_directory(name);
+    } else if ((sbuf.st_mode & _S_IFREG) != 0) {
+      return load_corpus_file(name);
+    }
+  }
+
+  fprintf(stderr,
+          "Corpus '%s' doesn't exist or is neither a directory nor a regular "
+          "file.\n",
+          name);
+
+  return false;
+}
+
+bool configuration::load_corpus_directory(const char* dirname)
+{
+  // Build search pattern.
+  char pattern[MAX_PATH];
+  int len = snprintf(pattern, sizeof(pattern), "%s\\*", dirname);
+  if ((len <= 0) || (static_cast<size_t>(len) >= sizeof(pattern))) {
+    fprintf(stderr, "Directory name '%s' is too long.\n", dirname);
+    return false;
+  }
+
+  // Count the files of the directory.
+  size_t nfiles = 0;
+
+  WIN32_FIND_DATA find_data;
+  HANDLE find = ::FindFirstFile(pattern, &find_data);
+  if (find != INVALID_HANDLE_VALUE) {
+    do {
+      if ((find_data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) == 0) {
+        nfiles++;
+      }
+    } while (::FindNextFile(find, &find_data));
+
+    ::FindClose(find);
+  }
+
+  if ((nfiles == 0) || (nfiles > max_corpus_files)) {
+    fprintf(stderr,
+            "Number of files of '%s' (%zu) out of range (valid range: 1 .. "
+            "%zu).\n",
+            dirname,
+            nfiles,
+            max_corpus_files);
+
+    return false;
+  }
+
+  // Allocate the mapped files and the payloads.
+  _M_files = new (std::nothrow) util::mapped_file[nfiles];
+  _M_payloads = static_cast<payload*>(malloc(nfiles * sizeof(payload)));
+
+  if ((!_M_files) || (!_M_payloads)) {
+    fprintf(stderr, "Error allocating memory.\n");
+    return false;
+  }
+
+  // Map the files (a payload per file).
+  find = ::FindFirstFile(pattern, &find_data);
+  if (find != INVALID_HANDLE_VALUE) {
+    do {
+      // Skip the subdirectories (and the files which have been created since
+      // the files were counted).
+      if (((find_data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) == 0) &&
+          (_M_nfiles < nfiles)) {
+        // Build filename.
+        char filename[MAX_PATH];
+        len = snprintf(filename,
+                       sizeof(filename),
+                       "%s\\%s",
+                       dirname,
+                       find_data.cFileName);
+
+        if ((len <= 0) || (static_cast<size_t>(len) >= sizeof(filename))) {
+          fprintf(stderr,
+                  "Filename '%s\\%s' is too long.\n",
+                  dirname,
+                  find_data.cFileName);
+
+          ::FindClose(find);
+          return false;
+        }
+
+        // Map file.
+        util::mapped_file& file = _M_files[_M_nfiles];
+        if (!map_file(filename, file, min_data_transfer, max_file_transfer)) {
+          ::FindClose(find);
+          return false;
+        }
+
+        _M_payloads[_M_nfiles].data = file.data();
+        _M_payloads[_M_nfiles].length = static_cast<size_t>(file.size());
+
+        _M_nfiles++;
+      }
+    } while (::FindNextFile(find, &find_data));
+
+    ::FindClose(find);
+  }
+
+  _M_npayloads = _M_nfiles;
+
+  if (_M_npayloads > 0) {
+    return true;
+  }
+
+  fprintf(stderr, "Error reading directory '%s'.\n", dirname);
+  return false;
+}
+
+bool configuration::load_corpus_file(const char* filename)
+{
+  // Allocate the mapped file.
+  _M_files = new (std::nothrow) util::mapped_file[1];
+  if (!_M_files) {
+    fprintf(stderr, "Error allocating memory.\n");
+    return false;
+  }
+
+  _M_nfiles = 1;
+
+  // Map file (the data is sent from the mapping).
+  util::mapped_file& file = _M_files[0];
+  if (map_file(filename,
+               file,
+               length_prefix_size + min_data_transfer,
+               SIZE_MAX)) {
+    // Count the records.
+    const size_t nrecords = parse_records(file.data(), file.size(), nullptr);
+
+    // If the file is valid and doesn't have too many records...
+    if ((nrecords > 0) && (nrecords <= max_payloads)) {
+      // Allocate the payloads.
+      _M_payloads = static_cast<payload*>(malloc(nrecords * sizeof(payload)));
+
+      if (_M_payloads) {
+        _M_npayloads = parse_records(file.data(), file.size(), _M_payloads);
+        return true;
+      }
+
+      fprintf(stderr, "Error allocating memory.\n");
+    } else {
+      fprintf(stderr,
+              "Invalid corpus file '%s' (expected 1 .. %zu records of %zu .. "
+              "%zu bytes, every record preceded by its %zu-byte "
+              "little-endian length).\n",
+              filename,
+              max_payloads,
+              min_data_transfer,
+              max_file_transfer,
+              length_prefix_size);
+    }
+  }
+
+  return false;
+}
+
+size_t configuration::parse_records(const uint8_t* data,
+                                    uint64_t size,
+                                    payload* payloads)
+{
+  size_t count = 0;
+
+  uint64_t offset = 0;
+  while (offset < size) {
+    // If the length prefix is truncated...
+    if (size - offset < length_prefix_size) {
+      return 0;
+    }
+
+    // Length (little-endian, the prefix might be unaligned).
+    const uint8_t* const prefix = data + offset;
+    const size_t length = static_cast<size_t>(prefix[0]) |
+                          (static_cast<size_t>(prefix[1]) << 8) |
+                          (static_cast<size_t>(prefix[2]) << 16) |
+                          (static_cast<size_t>(prefix[3]) << 24);
+
+    offset += length_prefix_size;
+
+    // If the length is out of range or the record is truncated...
+    if ((length < min_data_transfer) ||
+        (length > max_file_transfer) ||
+        (length > size - offset)) {
+      return 0;
+    }
+
+    if (payloads) {
+      payloads[count].data = data + offset;
+      payloads[count].length = length;
+    }
+
+    offset += length;
+    count++;
+  }
+
+  return count;
+}
+
+bool configuration::map_file(const char* filename,
+                             util::mapped_file& file,
+                             uint64_t min,
+                             uint64_t max)
+{
+  // If `filename` exists and is a regular file...
+  struct _stat64 sbuf;
+  if ((_stat64(filename, &sbuf) == 0) && ((sbuf.st_mode & _S_IFREG) != 0)) {
+    // If the file is neither too small nor too big...
+    if ((sbuf.st_size >= static_cast<int64_t>(min)) &&
+        (static_cast<uint64_t>(sbuf.st_size) <= max)) {
+      // Map file.
+      if (file.open(filename)) {
+        return true;
+      }
+
+      fprintf(stderr, "Error mapping file '%s'.\n", filename);
+    } else {
+      fprintf(stderr,
+              "Size of '%s' (%lld) out of range (valid range: %llu .. %llu)."
+              "\n",
+              filename,
+              static_cast<long long>(sbuf.st_size),
+              static_cast<unsigned long long>(min),
+              static_cast<unsigned long long>(max));
+    }
+  } else {
+    fprintf(stderr,
+            "File '%s' doesn't exist or is not a regular file.\n",
+            filename);
+  }
+
+  return false;
+}
+
+void configuration::usage(const char* program)
+{
+  fprintf(stderr,
+          "Usage: %s [OPTIONS] --address <address> "
+          "(--file <filename> | --data <number-bytes> | "
+          "--corpus <corpus>)\n\n",
+          program);
+
+  fprintf(stderr, "Options:\n");
+  fprintf(stderr, "  --help\n");
+  fprintf(stderr, "  --number-connections <number-connections>\n");
+  fprintf(stderr, "  --number-threads <number-threads>\n");
+  fprintf(stderr, "  --source-address <source-address>\n");
+  fprintf(stderr,
+          "  --number-transfers-per-connection "
+          "<number-transfers-per-connection>\n");
+
+  fprintf(stderr, "  --number-loops <number-loops>\n");
+  fprintf(stderr, "  --zero-copy\n");
+  fprintf(stderr, "  --rate <transfers-per-second>\n");
+  fprintf(stderr, "  --echo\n");
+  fprintf(stderr, "  --churn <connections-per-second>\n");
+  fprintf(stderr, "  --output <filename>\n");
+  fprintf(stderr, "  --output-format <format>\n");
+  fprintf(stderr, "  --report-interval <seconds>\n");
+  fprintf(stderr, "  --fault <fault>\n");
+  fprintf(stderr, "  --trickle-interval <trickle-seconds>\n");
+  fprintf(stderr, "  --fault-hold <hold-seconds>\n\n");
+
+  fprintf(stderr, "Valid values:\n");
+  fprintf(stderr,
+          "  <number-connections> ::= %zu .. %zu (default: %zu)\n",
+          min_connections,
+          max_connections,
+          default_connections);
+
+  fprintf(stderr,
+          "  <number-threads> ::= %zu .. %zu (default: number of "
+          "processors)\n",
+          min_threads,
+          max_threads);
+
+  fprintf(stderr,
+          "  <source-address> ::= IPv4 or IPv6 address (can be repeated, up "
+          "to %zu times)\n",
+          max_source_addresses);
+
+  fprintf(stderr,
+          "  <number-transfers-per-connection> ::= %u .. %u (default: %u)\n",
+          min_transfers,
+          max_transfers,
+          default_transfers);
+
+  fprintf(stderr,
+          "  <number-loops> ::= %u .. %u (default: %u)\n",
+          min_loops,
+          max_loops,
+          default_loops);
+
+  fprintf(stderr,
+          "  <number-bytes> ::= %zu .. %zu\n",
+          min_data_transfer,
+          max_data_transfer);
+
+  fprintf(stderr,
+          "  <filename> ::= file of %zu .. %zu bytes\n",
+          min_data_transfer,
+          max_file_transfer);
+
+  fprintf(stderr,
+          "  <corpus> ::= directory of up to %zu files of %zu .. %zu bytes\n"
+          "             | file of up to %zu records (%zu-byte little-endian "
+          "length\n"
+          "               followed by %zu .. %zu bytes of data)\n",
+          max_corpus_files,
+          min_data_transfer,
+          max_file_transfer,
+          max_payloads,
+          length_prefix_size,
+          min_data_transfer,
+          max_file_transfer);
+
+  fprintf(stderr,
+          "  <transfers-per-second> ::= %llu .. %llu\n",
+          static_cast<unsigned long long>(min_rate),
+          static_cast<unsigned long long>(max_rate));
+
+  fprintf(stderr,
+          "  <connections-per-second> ::= %llu .. %llu\n",
+          static_cast<unsigned long long>(min_churn),
+          static_cast<unsigned long long>(max_churn));
+
+  fprintf(stderr, "  <format> ::= json (default) | csv\n");
+
+  fprintf(stderr,
+          "  <seconds> ::= %llu .. %llu\n",
+          static_cast<unsigned long long>(min_report_interval),
+          static_cast<unsigned long long>(max_report_interval));
+
+  fprintf(stderr,
+          "  <fault> ::= (idle | trickle | reset | half-close)=<percent> "
+          "(can be repeated)\n"
+          "  <percent> ::= %u .. %u (percentage of the connects, %u at most "
+          "in total)\n",
+          min_fault_percent,
+          max_fault_percent,
+          max_fault_percent);
+
+  fprintf(stderr,
+          "  <trickle-seconds> ::= %llu .. %llu (default: %llu)\n",
+          static_cast<unsigned long long>(min_trickle_interval),
+          static_cast<unsigned long long>(max_trickle_interval),
+          static_cast<unsigned long long>(default_trickle_interval));
+
+  fprintf(stderr,
+          "  <hold-seconds> ::= %llu .. %llu (default: %llu)\n",
+          static_cast<unsigned long long>(min_fault_hold),
+          static_cast<unsigned long long>(max_fault_hold),
+          static_cast<unsigned long long>(default_fault_hold));
+}
+
+bool configuration::parse_fault(const char* s)
+{
+  const char* const equal = strchr(s, '=');
+
+  // If the fault has a percentage...
+  if (equal) {
+    const size_t len = equal - s;
+
+    for (size_t i = 0; i < nfaults; i++) {
+      // If the fault has been found...
+      if ((strlen(fault_names[i]) == len) &&
+          (_strnicmp(s, fault_names[i], len) == 0)) {
+        uint64_t n;
+        if (parse(equal + 1, n, min_fault_percent, max_fault_percent)) {
+          _M_fault_percent[i] = static_cast<unsigned>(n);
+
+          // The percentages of all the faults cannot add up to more than
+          // 100.
+          unsigned total = 0;
+          for (size_t j = 0; j < nfaults; j++) {
+            total += _M_fault_percent[j];
+          }
+
+          if (total <= max_fault_percent) {
+            return true;
+          }
+
+          fprintf(stderr,
+                  "The fault percentages add up to more than %u.\n",
+                  max_fault_percent);
+        } else {
+          fprintf(stderr,
+                  "Invalid fault percentage '%s' (valid range: %u .. %u).\n",
+                  equal + 1,
+                  min_fault_percent,
+                  max_fault_percent);
+        }
+
+        return false;
+      }
+    }
+  }
+
+  fprintf(stderr, "Invalid fault '%s'.\n", s);
+  return false;
+}
+
+bool configuration::parse(const char* s,
+                          uint64_t& n,
+                          uint64_t min,
+                          uint64_t max)
+{
+  if (*s) {
+    uint64_t res = 0;
+
+    do {
+      // Digit?
+      if ((*s >= '0') && (*s <= '9')) {
+        const uint64_t tmp = (res * 10) + (*s - '0');
+
+        // If the number doesn't overflow and is not too big...
+        if ((tmp >= res) && (tmp <= max)) {
+          res = tmp;
+        } else {
+          return false;
+        }
+      } else {
+        return false;
+      }
+    } while (*++s);
+
+    // If the number is not too small...
+    if (res >= min) {
+      n = res;
+      return true;
+    }
+  }
+
+  return false;
+}
+
+} // namespace connector
+} // namespace tcp
+} // namespace net
\ No newline at end of file
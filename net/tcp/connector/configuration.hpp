@@ -0,0 +1,329 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <limits.h>
+#include "net/async/thread_pool.hpp"
+#include "net/socket/address.hpp"
+#include "util/mapped_file.hpp"
+
+namespace net {
+namespace tcp {
+namespace connector {
+
+// Configuration of the test connector (parsed from the command line).
+class configuration {
+  public:
+    // Payload (data sent by a transfer).
+    struct payload {
+      const uint8_t* data;
+      size_t length;
+    };
+
+    // Constructor.
+    configuration() = default;
+
+    // Destructor.
+    ~configuration();
+
+    // Parse.
+    bool parse(int argc, const char* argv[]);
+
+    // Get address to connect to.
+    const net::socket::address& address() const;
+
+    // Get number of connections.
+    size_t number_connections() const;
+
+    // Get number of threads (shards of the connections).
+    size_t number_threads() const;
+
+    // Get the local addresses the connections are bound to (spread over
+    // them).
+    const net::socket::address* source_addresses() const;
+
+    // Get number of source addresses (0: any address).
+    size_t number_source_addresses() const;
+
+    // Get number of transfers per connection.
+    unsigned number_transfers_per_connection() const;
+
+    // Get number of loops.
+    unsigned number_loops() const;
+
+    // Get the payloads (the connections cycle through them).
+    const payload* payloads() const;
+
+    // Get number of payloads.
+    size_t number_payloads() const;
+
+    // Use zero-copy sends?
+    bool zero_copy() const;
+
+    // Get target rate (transfers per second, 0: closed loop).
+    uint64_t rate() const;
+
+    // Wait for the data of every transfer to be echoed back?
+    bool echo() const;
+
+    // Get target connection rate (connections per second, 0: the
+    // connections are reconnected at once).
+    uint64_t churn() const;
+
+    // Output formats.
+    enum class output_format {
+      json,
+      csv
+    };
+
+    // Get the name of the file the results are saved to (nullptr: none).
+    const char* output() const;
+
+    // Get the format of the results file.
+    output_format format() const;
+
+    // Get the interval of the live report (seconds, 0: no live report).
+    uint64_t report_interval() const;
+
+    // Faults injected into the connections.
+    enum class fault {
+      // No fault (normal traffic).
+      none,
+
+      // Open the connection and send nothing.
+      idle,
+
+      // Send a byte every trickle interval (slowloris).
+      trickle,
+
+      // Reset the connection (RST) in the middle of a transfer.
+      reset,
+
+      // Send a transfer and half-close the connection.
+      half_close
+    };
+
+    // Get the fault injected into the connect `n` (counting the connects of
+    // all the connections).
+    fault fault_for(uint64_t n) const;
+
+    // Inject faults?
+    bool faults() const;
+
+    // Get the interval between the bytes of a trickled connection (seconds).
+    uint64_t trickle_interval() const;
+
+    // Get the maximum time a faulty connection is held open waiting for the
+    // peer to close it (seconds).
+    uint64_t fault_hold() const;
+
+  private:
+    // Minimum number of connections.
+    static constexpr const size_t min_connections = 1;
+
+    // Maximum number of connections.
+    static constexpr const size_t max_connections = 1024 * 1024;
+
+    // Default number of connections.
+    static constexpr const size_t default_connections = 4;
+
+    // Minimum number of threads.
+    static constexpr const size_t min_threads = 1;
+
+    // Maximum number of threads.
+    static constexpr const size_t
+      max_threads = net::async::thread_pool::max_threads;
+
+    // Maximum number of source addresses.
+    static constexpr const size_t max_source_addresses = 64;
+
+    // Minimum number of transfers per connection.
+    static constexpr const unsigned min_transfers = 1;
+
+    // Maximum number of transfers per connection.
+    static constexpr const unsigned max_transfers = 1000 * 1000;
+
+    // Default number of transfers per connection.
+    static constexpr const unsigned default_transfers = 1;
+
+    // Minimum number of loops.
+    static constexpr const unsigned min_loops = 1;
+
+    // Maximum number of loops.
+    static constexpr const unsigned max_loops = 1000 * 1000;
+
+    // Default number of loops.
+    static constexpr const unsigned default_loops = 1;
+
+    // Minimum number of bytes to be transferred.
+    static constexpr const size_t min_data_transfer = 1;
+
+    // Maximum number of bytes to be transferred (`--data`).
+    static constexpr const size_t max_data_transfer = 64ul * 1024ul * 1024ul;
+
+    // Maximum number of bytes to be transferred from a mapped file.
+    static constexpr const size_t max_file_transfer = 1024ul * 1024ul * 1024ul;
+
+    // Maximum number of payloads of a corpus file.
+    static constexpr const size_t max_payloads = 1024 * 1024;
+
+    // Maximum number of files of a corpus directory.
+    static constexpr const size_t max_corpus_files = 4096;
+
+    // Size of the length prefix of the records of a corpus file.
+    static constexpr const size_t length_prefix_size = 4;
+
+    // Minimum rate (transfers per second).
+    static constexpr const uint64_t min_rate = 1;
+
+    // Maximum rate (transfers per second).
+    static constexpr const uint64_t max_rate = 10ull * 1000ull * 1000ull;
+
+    // Minimum connection rate (connections per second).
+    static constexpr const uint64_t min_churn = 1;
+
+    // Maximum connection rate (connections per second).
+    static constexpr const uint64_t max_churn = 1000ull * 1000ull;
+
+    // Minimum interval of the live report (seconds).
+    static constexpr const uint64_t min_report_interval = 1;
+
+    // Maximum interval of the live report (seconds).
+    static constexpr const uint64_t max_report_interval = 3600;
+
+    // Number of faults.
+    static constexpr const size_t nfaults = 4;
+
+    // Minimum percentage of the connects of a fault.
+    static constexpr const unsigned min_fault_percent = 1;
+
+    // Maximum percentage of the connects of a fault (and of all the faults).
+    static constexpr const unsigned max_fault_percent = 100;
+
+    // Minimum trickle interval (seconds).
+    static constexpr const uint64_t min_trickle_interval = 1;
+
+    // Maximum trickle interval (seconds).
+    static constexpr const uint64_t max_trickle_interval = 3600;
+
+    // Default trickle interval (seconds).
+    static constexpr const uint64_t default_trickle_interval = 10;
+
+    // Minimum hold of a faulty connection (seconds).
+    static constexpr const uint64_t min_fault_hold = 1;
+
+    // Maximum hold of a faulty connection (seconds).
+    static constexpr const uint64_t max_fault_hold = 3600;
+
+    // Default hold of a faulty connection (seconds).
+    static constexpr const uint64_t default_fault_hold = 60;
+
+    // Names of the faults.
+    static const char* const fault_names[nfaults];
+
+    // Address to connect to.
+    net::socket::address _M_address;
+
+    // Number of connections.
+    size_t _M_nconnections;
+
+    // Number of threads (0: one per processor).
+    size_t _M_nthreads = 0;
+
+    // Source addresses.
+    net::socket::address _M_source_addresses[max_source_addresses];
+    size_t _M_nsource_addresses = 0;
+
+    // Number of transfers per connection.
+    unsigned _M_ntransfers;
+
+    // Number of loops.
+    unsigned _M_nloops;
+
+    // Data to be sent (`--data`).
+    uint8_t* _M_data = nullptr;
+
+    // Mapped files (`--file` and `--corpus`).
+    util::mapped_file* _M_files = nullptr;
+    size_t _M_nfiles = 0;
+
+    // Payloads.
+    payload* _M_payloads = nullptr;
+    size_t _M_npayloads = 0;
+
+    // Use zero-copy sends?
+    bool _M_zero_copy = false;
+
+    // Target rate (transfers per second, 0: closed loop).
+    uint64_t _M_rate = 0;
+
+    // Wait for the data of every transfer to be echoed back?
+    bool _M_echo = false;
+
+    // Target connection rate (connections per second, 0: the connections
+    // are reconnected at once).
+    uint64_t _M_churn = 0;
+
+    // Name of the file the results are saved to (nullptr: none).
+    const char* _M_output = nullptr;
+
+    // Format of the results file.
+    output_format _M_format = output_format::json;
+
+    // Interval of the live report (seconds, 0: no live report).
+    uint64_t _M_report_interval = 0;
+
+    // Percentage of the connects of every fault.
+    unsigned _M_fault_percent[nfaults] = {};
+
+    // Interval between the bytes of a trickled connection (seconds).
+    uint64_t _M_trickle_interval = default_trickle_interval;
+
+    // Maximum hold of a faulty connection (seconds).
+    uint64_t _M_fault_hold = default_fault_hold;
+
+    // Load file (`--file`).
+    bool load_file(const char* filename);
+
+    // Load corpus (`--corpus`): either a directory (a payload per file) or a
+    // file of length-prefixed records.
+    bool load_corpus(const char* name);
+
+    // Load the files of a corpus directory.
+    bool load_corpus_directory(const char* dirname);
+
+    // Load the records of a corpus file.
+    bool load_corpus_file(const char* filename);
+
+    // Parse the records of a corpus file (only counted if `payloads` is
+    // nullptr). Returns the number of records (0: invalid file).
+    static size_t parse_records(const uint8_t* data,
+                                uint64_t size,
+                                payload* payloads);
+
+    // Parse fault (`<mode>=<percent>`).
+    bool parse_fault(const char* s);
+
+    // Map file and check its size.
+    static bool map_file(const char* filename,
+                         util::mapped_file& file,
+                         uint64_t min,
+                         uint64_t max);
+
+    // Print usage.
+    static void usage(const char* program);
+
+    // Parse number.
+    static bool parse(const char* s,
+                      uint64_t& n,
+                      uint64_t min = 0,
+                      uint64_t max = ULLONG_MAX);
+
+    // Disable copy constructor and assignment operator.
+    configuration(const configuration&) = delete;
+    configuration& operator=(const configuration&) = delete;
+};
+
+} // namespace connector
+} // namespace tcp
+} // namespace net
\ No newline at end of file
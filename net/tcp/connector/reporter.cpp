@@ -0,0 +1,155 @@
+#include <stdio.h>
+#include <new>
+#include "net/tcp/connector/reporter.hpp"
+
+namespace net {
+namespace tcp {
+namespace connector {
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+//                                                                            //
+// Reporter.                                                                  //
+//                                                                            //
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+
+reporter::reporter(const statistics& stats, statistics::latency latency)
+  : _M_stats{stats},
+    _M_latency{latency},
+    _M_timer{this}
+{
+}
+
+reporter::~reporter()
+{
+  stop();
+
+  delete [] _M_samples;
+}
+
+bool reporter::start(uint64_t interval)
+{
+  // Allocate samples.
+  _M_samples = new (std::nothrow) statistics::snapshot[2];
+
+  // Create timer.
+  if ((_M_samples) && (_M_timer.create())) {
+    _M_interval = interval * 1000000000ull;
+
+    // Take the first sample.
+    _M_stats.sample(_M_latency, _M_samples[_M_previous]);
+    _M_start = _M_samples[_M_previous].time;
+
+    _M_timer.expires_in(_M_interval / 1000);
+
+    return true;
+  }
+
+  return false;
+}
+
+void reporter::stop()
+{
+  ::InterlockedExchange(&_M_stopped, 1);
+
+  // Cancel the timer twice: a callback running during the first cancel
+  // might have set it again.
+  _M_timer.cancel();
+  _M_timer.cancel();
+}
+
+void reporter::timer()
+{
+  const statistics::snapshot& previous = _M_samples[_M_previous];
+  statistics::snapshot& current = _M_samples[_M_previous ^ 1];
+
+  // Sample the counters.
+  _M_stats.sample(_M_latency, current);
+
+  const double seconds = (current.time - previous.time) / 1e9;
+  const double rate = (seconds > 0.0) ? 1.0 / seconds : 0.0;
+
+  // Latencies of the interval.
+  _M_histogram = current.histogram;
+  _M_histogram.subtract(previous.histogram);
+
+  // Every established connection is eventually disconnected.
+  const uint64_t disconnects =
+    current.events[static_cast<size_t>(statistics::event::disconnect)];
+
+  const uint64_t active = (current.connects > disconnects) ?
+                            current.connects - disconnects :
+                            0;
+
+  // Errors of the interval.
+  char errors[max_errors_length];
+  size_t len = 0;
+
+  for (size_t i = 0; i <= current.errors.ncodes; i++) {
+    uint64_t count;
+    int ret;
+
+    if (i < current.errors.ncodes) {
+      const statistics::error_count& err = current.errors.codes[i];
+
+      count = err.count - previous.errors.count(err.code);
+
+      ret = (count > 0) ? snprintf(errors + len,
+                                   sizeof(errors) - len,
+                                   " %lu:%llu",
+                                   static_cast<unsigned long>(err.code),
+                                   static_cast<unsigned long long>(count)) :
+                          0;
+    } else {
+      count = current.errors.other - previous.errors.other;
+
+      ret = (count > 0) ? snprintf(errors + len,
+                                   sizeof(errors) - len,
+                                   " other:%llu",
+                                   static_cast<unsigned long long>(count)) :
+                          0;
+    }
+
+    // If the errors don't fit...
+    if ((ret < 0) || (static_cast<size_t>(ret) >= sizeof(errors) - len)) {
+      break;
+    }
+
+    len += ret;
+  }
+
+  if (len == 0) {
+    snprintf(errors, sizeof(errors), " none");
+  }
+
+  printf("[%8.1f s] %10.2f MiB/s %12.1f transfers/s %8llu active | "
+         "errors:%s | %s (us): p50 %.1f p99 %.1f p99.9 %.1f max %.1f\n",
+         (current.time - _M_start) / 1e9,
+         (current.bytes - previous.bytes) * rate / (1024.0 * 1024.0),
+         (current.transfers - previous.transfers) * rate,
+         static_cast<unsigned long long>(active),
+         errors,
+         statistics::name(_M_latency),
+         _M_histogram.percentile(50.0) / 1000.0,
+         _M_histogram.percentile(99.0) / 1000.0,
+         _M_histogram.percentile(99.9) / 1000.0,
+         _M_histogram.max() / 1000.0);
+
+  fflush(stdout);
+
+  _M_previous ^= 1;
+
+  // If the reporter has not been stopped...
+  if (::InterlockedCompareExchange(&_M_stopped, 0, 0) == 0) {
+    // Schedule the next report (at a fixed cadence from the first sample).
+    const uint64_t next = _M_start + (++_M_nreports + 1) * _M_interval;
+    const uint64_t now = statistics::now();
+
+    _M_timer.expires_in((next > now) ? (next - now) / 1000 : 0);
+  }
+}
+
+} // namespace connector
+} // namespace tcp
+} // namespace net
\ No newline at end of file
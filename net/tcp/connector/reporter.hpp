@@ -0,0 +1,78 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include "net/tcp/connector/statistics.hpp"
+#include "util/histogram.hpp"
+#include "util/timer.hpp"
+
+namespace net {
+namespace tcp {
+namespace connector {
+
+// Live report: every interval, prints the throughput, the active
+// connections, the errors by code and the percentiles of a latency during
+// the last interval, so that throughput collapses and stalls show up while
+// the test runs. The per-thread counters are sampled from a timer callback,
+// without synchronizing with the threads which update them.
+class reporter {
+  public:
+    // Constructor.
+    reporter(const statistics& stats, statistics::latency latency);
+
+    // Destructor.
+    ~reporter();
+
+    // Start reporting every `interval` seconds.
+    bool start(uint64_t interval);
+
+    // Stop reporting.
+    void stop();
+
+  private:
+    // Maximum length of the errors of a report.
+    static constexpr const size_t max_errors_length = 256;
+
+    // Statistics.
+    const statistics& _M_stats;
+
+    // Latency reported.
+    const statistics::latency _M_latency;
+
+    // Snapshots (the previous and the current ones).
+    statistics::snapshot* _M_samples = nullptr;
+
+    // Index of the previous sample.
+    size_t _M_previous = 0;
+
+    // Histogram of the latencies of the interval.
+    util::histogram _M_histogram;
+
+    // Interval (nanoseconds).
+    uint64_t _M_interval;
+
+    // Time of the first sample (nanoseconds).
+    uint64_t _M_start;
+
+    // Number of reports.
+    uint64_t _M_nreports = 0;
+
+    // Has the reporter been stopped?
+    uint32_t _M_stopped = 0;
+
+    // Timer.
+    void timer();
+
+    // Timer of the reports.
+    util::basic_timer<
+      util::timer_member_handler<reporter, &reporter::timer>
+    > _M_timer;
+
+    // Disable copy constructor and assignment operator.
+    reporter(const reporter&) = delete;
+    reporter& operator=(const reporter&) = delete;
+};
+
+} // namespace connector
+} // namespace tcp
+} // namespace net
\ No newline at end of file
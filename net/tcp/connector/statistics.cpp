@@ -0,0 +1,735 @@
+#include <stdlib.h>
+#include <new>
+#include "net/tcp/connector/statistics.hpp"
+
+namespace net {
+namespace tcp {
+namespace connector {
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+//                                                                            //
+// Statistics.                                                                //
+//                                                                            //
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+
+thread_local statistics::recorder* statistics::_M_current = nullptr;
+
+const char* const statistics::latency_names[nlatencies] = {
+  "connect",
+  "first-byte",
+  "send",
+  "transfer",
+  "round-trip",
+  "fault-hold"
+};
+
+statistics::~statistics()
+{
+  while (_M_recorders) {
+    recorder* next = _M_recorders->next;
+    delete _M_recorders;
+    _M_recorders = next;
+  }
+}
+
+void statistics::record(latency l, uint64_t ns)
+{
+  recorder* r = current();
+  if (r) {
+    r->histograms[static_cast<size_t>(l)].record(ns);
+  }
+}
+
+void statistics::count(event e)
+{
+  recorder* r = current();
+  if (r) {
+    r->events[static_cast<size_t>(e)]++;
+  }
+}
+
+void statistics::count_bytes(uint64_t bytes)
+{
+  recorder* r = current();
+  if (r) {
+    r->bytes += bytes;
+  }
+}
+
+void statistics::error(event e, DWORD code)
+{
+  recorder* r = current();
+  if (r) {
+    r->events[static_cast<size_t>(e)]++;
+
+    // Count the error code (in the first free slot if it hasn't been seen
+    // yet). The slots are only written by this thread; a reader might miss
+    // the error of a slot which is being taken.
+    for (size_t i = 0; i < max_error_codes; i++) {
+      error_count& err = r->errors[i];
+
+      if (err.code == code) {
+        err.count++;
+        return;
+      } else if (err.code == 0) {
+        err.code = code;
+        err.count = 1;
+        return;
+      }
+    }
+
+    r->other_errors++;
+  }
+}
+
+void statistics::sample(latency l, snapshot& s) const
+{
+  s.connects = 0;
+  s.transfers = 0;
+  s.bytes = 0;
+
+  for (size_t i = 0; i < nevents; i++) {
+    s.events[i] = 0;
+  }
+
+  s.errors.clear();
+  s.histogram.reset();
+
+  // The counters are read while their threads keep updating them: every
+  // counter is written by a single thread and read as a whole, so the sample
+  // is at most a few events behind.
+  ::AcquireSRWLockShared(&_M_lock);
+
+  for (const recorder* r = _M_recorders; r; r = r->next) {
+    s.connects +=
+      r->histograms[static_cast<size_t>(latency::connect)].count();
+
+    s.transfers += r->histograms[static_cast<size_t>(latency::send)].count();
+    s.bytes += r->bytes;
+
+    for (size_t i = 0; i < nevents; i++) {
+      s.events[i] += r->events[i];
+    }
+
+    for (size_t i = 0; i < max_error_codes; i++) {
+      if (r->errors[i].code != 0) {
+        s.errors.add(r->errors[i].code, r->errors[i].count);
+      }
+    }
+
+    s.errors.other += r->other_errors;
+
+    s.histogram.merge(r->histograms[static_cast<size_t>(l)]);
+  }
+
+  ::ReleaseSRWLockShared(&_M_lock);
+
+  s.time = now();
+}
+
+const char* statistics::name(latency l)
+{
+  return latency_names[static_cast<size_t>(l)];
+}
+
+void statistics::print(const run& run) const
+{
+  totals* t = new (std::nothrow) totals;
+  if (!t) {
+    fprintf(stderr, "Error allocating memory.\n");
+    return;
+  }
+
+  // Merge the histograms and the counters of all the threads.
+  merge(*t);
+
+  const uint64_t
+    connects = t->histograms[static_cast<size_t>(latency::connect)].count();
+
+  const uint64_t
+    transfers = t->histograms[static_cast<size_t>(latency::send)].count();
+
+  const double seconds = run.elapsed / 1e9;
+
+  printf("%llu connects (%llu failed, %llu disconnects) in %.3f seconds "
+         "(%.1f connects/s).\n",
+         static_cast<unsigned long long>(connects),
+         static_cast<unsigned long long>(
+           t->events[static_cast<size_t>(event::connect_error)]
+         ),
+         static_cast<unsigned long long>(
+           t->events[static_cast<size_t>(event::disconnect)]
+         ),
+         seconds,
+         (seconds > 0.0) ? connects / seconds : 0.0);
+
+  const uint64_t
+    reuses = t->events[static_cast<size_t>(event::socket_reuse)];
+
+  // If sockets have been reused...
+  if (reuses > 0) {
+    printf("%llu connects reused the socket of the previous connection.\n",
+           static_cast<unsigned long long>(reuses));
+  }
+
+  printf("%llu transfers in %.3f seconds (%.1f transfers/s, %.1f MiB/s, "
+         "%llu I/O errors).\n",
+         static_cast<unsigned long long>(transfers),
+         seconds,
+         (seconds > 0.0) ? transfers / seconds : 0.0,
+         (seconds > 0.0) ? t->bytes / seconds / (1024.0 * 1024.0) : 0.0,
+         static_cast<unsigned long long>(
+           t->events[static_cast<size_t>(event::io_error)]
+         ));
+
+  // If there have been errors...
+  if ((t->errors.ncodes > 0) || (t->errors.other > 0)) {
+    printf("Errors by code:");
+
+    for (size_t i = 0; i < t->errors.ncodes; i++) {
+      printf(" %lu (%llu)",
+             static_cast<unsigned long>(t->errors.codes[i].code),
+             static_cast<unsigned long long>(t->errors.codes[i].count));
+    }
+
+    if (t->errors.other > 0) {
+      printf(" other (%llu)", static_cast<unsigned long long>(t->errors.other));
+    }
+
+    printf(".\n");
+  }
+
+  const uint64_t
+    faults = t->events[static_cast<size_t>(event::idle)] +
+             t->events[static_cast<size_t>(event::trickle)] +
+             t->events[static_cast<size_t>(event::reset)] +
+             t->events[static_cast<size_t>(event::half_close)];
+
+  // If faults have been injected...
+  if (faults > 0) {
+    printf("Faults: %llu idle, %llu trickle, %llu reset, %llu half-close "
+           "(%llu held until the hold limit).\n",
+           static_cast<unsigned long long>(
+             t->events[static_cast<size_t>(event::idle)]
+           ),
+           static_cast<unsigned long long>(
+             t->events[static_cast<size_t>(event::trickle)]
+           ),
+           static_cast<unsigned long long>(
+             t->events[static_cast<size_t>(event::reset)]
+           ),
+           static_cast<unsigned long long>(
+             t->events[static_cast<size_t>(event::half_close)]
+           ),
+           static_cast<unsigned long long>(
+             t->events[static_cast<size_t>(event::hold_expired)]
+           ));
+  }
+
+  printf("CPU time: %.3f seconds user, %.3f seconds kernel.\n",
+         run.cpu_user / 1e9,
+         run.cpu_kernel / 1e9);
+
+  printf("%-22s %10s %10s %10s %10s %10s %10s %10s\n",
+         "Latency (microseconds)",
+         "count",
+         "min",
+         "p50",
+         "p90",
+         "p99",
+         "p99.9",
+         "max");
+
+  for (size_t i = 0; i < nlatencies; i++) {
+    const util::histogram& h = t->histograms[i];
+
+    // If the latency has not been measured...
+    if (h.count() == 0) {
+      continue;
+    }
+
+    printf("%-22s %10llu %10.1f %10.1f %10.1f %10.1f %10.1f %10.1f\n",
+           latency_names[i],
+           static_cast<unsigned long long>(h.count()),
+           h.min() / 1000.0,
+           h.percentile(50.0) / 1000.0,
+           h.percentile(90.0) / 1000.0,
+           h.percentile(99.0) / 1000.0,
+           h.percentile(99.9) / 1000.0,
+           h.max() / 1000.0);
+  }
+
+  delete t;
+}
+
+bool statistics::save(const run& run, const configuration& config) const
+{
+  const char* const filename = config.output();
+
+  totals* t = new (std::nothrow) totals;
+  if (!t) {
+    fprintf(stderr, "Error allocating memory.\n");
+    return false;
+  }
+
+  // Merge the histograms and the counters of all the threads.
+  merge(*t);
+
+  // Open file for writing.
+  FILE* file = fopen(filename, "w");
+  if (file) {
+    switch (config.format()) {
+      case configuration::output_format::json:
+        write_json(file, *t, run, config);
+        break;
+      case configuration::output_format::csv:
+        write_csv(file, *t, run, config);
+        break;
+    }
+
+    delete t;
+
+    // Close file.
+    if ((!ferror(file)) && (fclose(file) == 0)) {
+      return true;
+    }
+
+    fprintf(stderr, "Error writing to '%s'.\n", filename);
+  } else {
+    delete t;
+
+    fprintf(stderr, "Error opening file '%s' for writing.\n", filename);
+  }
+
+  return false;
+}
+
+uint64_t statistics::now()
+{
+  static const uint64_t frequency = [] {
+    LARGE_INTEGER freq;
+    ::QueryPerformanceFrequency(&freq);
+    return static_cast<uint64_t>(freq.QuadPart);
+  }();
+
+  LARGE_INTEGER counter;
+  ::QueryPerformanceCounter(&counter);
+
+  const uint64_t ticks = static_cast<uint64_t>(counter.QuadPart);
+
+  // Convert to nanoseconds without overflowing.
+  return ((ticks / frequency) * 1000000000ull) +
+         (((ticks % frequency) * 1000000000ull) / frequency);
+}
+
+void statistics::cpu_time(uint64_t& user, uint64_t& kernel)
+{
+  FILETIME creation, exit, kernel_time, user_time;
+  if (::GetProcessTimes(::GetCurrentProcess(),
+                        &creation,
+                        &exit,
+                        &kernel_time,
+                        &user_time)) {
+    // Convert from 100-nanosecond intervals.
+    user = ((static_cast<uint64_t>(user_time.dwHighDateTime) << 32) |
+            user_time.dwLowDateTime) * 100;
+
+    kernel = ((static_cast<uint64_t>(kernel_time.dwHighDateTime) << 32) |
+              kernel_time.dwLowDateTime) * 100;
+  } else {
+    user = 0;
+    kernel = 0;
+  }
+}
+
+void statistics::errors_by_code::clear()
+{
+  ncodes = 0;
+  other = 0;
+}
+
+void statistics::errors_by_code::add(DWORD code, uint64_t count)
+{
+  for (size_t i = 0; i < ncodes; i++) {
+    if (codes[i].code == code) {
+      codes[i].count += count;
+      return;
+    }
+  }
+
+  if (ncodes < max_reported_errors) {
+    codes[ncodes].code = code;
+    codes[ncodes].count = count;
+
+    ncodes++;
+  } else {
+    other += count;
+  }
+}
+
+uint64_t statistics::errors_by_code::count(DWORD code) const
+{
+  for (size_t i = 0; i < ncodes; i++) {
+    if (codes[i].code == code) {
+      return codes[i].count;
+    }
+  }
+
+  return 0;
+}
+
+statistics::recorder* statistics::current()
+{
+  recorder* r = _M_current;
+
+  // If the thread has no histograms yet...
+  if ((!r) || (r->owner != this)) {
+    r = new (std::nothrow) recorder;
+    if (r) {
+      r->owner = this;
+
+      for (size_t i = 0; i < nevents; i++) {
+        r->events[i] = 0;
+      }
+
+      r->bytes = 0;
+
+      for (size_t i = 0; i < max_error_codes; i++) {
+        r->errors[i].code = 0;
+        r->errors[i].count = 0;
+      }
+
+      r->other_errors = 0;
+
+      ::AcquireSRWLockExclusive(&_M_lock);
+
+      r->next = _M_recorders;
+      _M_recorders = r;
+
+      ::ReleaseSRWLockExclusive(&_M_lock);
+
+      _M_current = r;
+    }
+  }
+
+  return r;
+}
+
+void statistics::merge(totals& t) const
+{
+  for (size_t i = 0; i < nevents; i++) {
+    t.events[i] = 0;
+  }
+
+  t.bytes = 0;
+  t.errors.clear();
+
+  ::AcquireSRWLockShared(&_M_lock);
+
+  for (const recorder* r = _M_recorders; r; r = r->next) {
+    for (size_t i = 0; i < nlatencies; i++) {
+      t.histograms[i].merge(r->histograms[i]);
+    }
+
+    for (size_t i = 0; i < nevents; i++) {
+      t.events[i] += r->events[i];
+    }
+
+    t.bytes += r->bytes;
+
+    for (size_t i = 0; i < max_error_codes; i++) {
+      if (r->errors[i].code != 0) {
+        t.errors.add(r->errors[i].code, r->errors[i].count);
+      }
+    }
+
+    t.errors.other += r->other_errors;
+  }
+
+  ::ReleaseSRWLockShared(&_M_lock);
+}
+
+void statistics::write_json(FILE* file,
+                            const totals& t,
+                            const run& run,
+                            const configuration& config)
+{
+  const uint64_t
+    connects = t.histograms[static_cast<size_t>(latency::connect)].count();
+
+  const uint64_t
+    transfers = t.histograms[static_cast<size_t>(latency::send)].count();
+
+  const double seconds = run.elapsed / 1e9;
+  const double rate = (seconds > 0.0) ? 1.0 / seconds : 0.0;
+
+  fprintf(file, "{\n");
+  fprintf(file, "  \"elapsed_seconds\": %.6f,\n", seconds);
+  fprintf(file, "  \"connections\": %zu,\n", config.number_connections());
+  fprintf(file, "  \"threads\": %zu,\n", config.number_threads());
+  fprintf(file, "  \"payloads\": %zu,\n", config.number_payloads());
+
+  fprintf(file,
+          "  \"bytes\": %llu,\n",
+          static_cast<unsigned long long>(t.bytes));
+
+  fprintf(file,
+          "  \"transfer_bytes\": %.1f,\n",
+          (transfers > 0) ? static_cast<double>(t.bytes) / transfers : 0.0);
+
+
+  fprintf(file,
+          "  \"connects\": %llu,\n",
+          static_cast<unsigned long long>(connects));
+
+  fprintf(file,
+          "  \"transfers\": %llu,\n",
+          static_cast<unsigned long long>(transfers));
+
+  fprintf(file, "  \"connects_per_second\": %.3f,\n", connects * rate);
+  fprintf(file, "  \"transfers_per_second\": %.3f,\n", transfers * rate);
+
+  fprintf(file, "  \"bytes_per_second\": %.3f,\n", t.bytes * rate);
+
+  fprintf(file,
+          "  \"connect_errors\": %llu,\n",
+          static_cast<unsigned long long>(
+            t.events[static_cast<size_t>(event::connect_error)]
+          ));
+
+  fprintf(file,
+          "  \"io_errors\": %llu,\n",
+          static_cast<unsigned long long>(
+            t.events[static_cast<size_t>(event::io_error)]
+          ));
+
+  fprintf(file,
+          "  \"disconnects\": %llu,\n",
+          static_cast<unsigned long long>(
+            t.events[static_cast<size_t>(event::disconnect)]
+          ));
+
+  fprintf(file,
+          "  \"faults_idle\": %llu,\n",
+          static_cast<unsigned long long>(
+            t.events[static_cast<size_t>(event::idle)]
+          ));
+
+  fprintf(file,
+          "  \"faults_trickle\": %llu,\n",
+          static_cast<unsigned long long>(
+            t.events[static_cast<size_t>(event::trickle)]
+          ));
+
+  fprintf(file,
+          "  \"faults_reset\": %llu,\n",
+          static_cast<unsigned long long>(
+            t.events[static_cast<size_t>(event::reset)]
+          ));
+
+  fprintf(file,
+          "  \"faults_half_close\": %llu,\n",
+          static_cast<unsigned long long>(
+            t.events[static_cast<size_t>(event::half_close)]
+          ));
+
+  fprintf(file,
+          "  \"faults_hold_expired\": %llu,\n",
+          static_cast<unsigned long long>(
+            t.events[static_cast<size_t>(event::hold_expired)]
+          ));
+
+  fprintf(file,
+          "  \"socket_reuses\": %llu,\n",
+          static_cast<unsigned long long>(
+            t.events[static_cast<size_t>(event::socket_reuse)]
+          ));
+
+  fprintf(file, "  \"cpu_user_seconds\": %.6f,\n", run.cpu_user / 1e9);
+  fprintf(file, "  \"cpu_kernel_seconds\": %.6f,\n", run.cpu_kernel / 1e9);
+
+  fprintf(file,
+          "  \"cpu_us_per_transfer\": %.3f,\n",
+          (transfers > 0) ?
+            (run.cpu_user + run.cpu_kernel) / 1000.0 / transfers :
+            0.0);
+
+  fprintf(file, "  \"latencies_us\": {");
+
+  bool first = true;
+  for (size_t i = 0; i < nlatencies; i++) {
+    const util::histogram& h = t.histograms[i];
+
+    // If the latency has not been measured...
+    if (h.count() == 0) {
+      continue;
+    }
+
+    fprintf(file,
+            "%s\n    \"%s\": {\"count\": %llu, \"min\": %.1f, "
+            "\"mean\": %.1f, \"p50\": %.1f, \"p90\": %.1f, "
+            "\"p99\": %.1f, \"p99.9\": %.1f, \"max\": %.1f}",
+            first ? "" : ",",
+            latency_names[i],
+            static_cast<unsigned long long>(h.count()),
+            h.min() / 1000.0,
+            h.mean() / 1000.0,
+            h.percentile(50.0) / 1000.0,
+            h.percentile(90.0) / 1000.0,
+            h.percentile(99.0) / 1000.0,
+            h.percentile(99.9) / 1000.0,
+            h.max() / 1000.0);
+
+    first = false;
+  }
+
+  fprintf(file, "\n  }\n");
+  fprintf(file, "}\n");
+}
+
+void statistics::write_csv(FILE* file,
+                           const totals& t,
+                           const run& run,
+                           const configuration& config)
+{
+  const uint64_t
+    connects = t.histograms[static_cast<size_t>(latency::connect)].count();
+
+  const uint64_t
+    transfers = t.histograms[static_cast<size_t>(latency::send)].count();
+
+  const double seconds = run.elapsed / 1e9;
+  const double rate = (seconds > 0.0) ? 1.0 / seconds : 0.0;
+
+  fprintf(file, "metric,value\n");
+  fprintf(file, "elapsed_seconds,%.6f\n", seconds);
+  fprintf(file, "connections,%zu\n", config.number_connections());
+  fprintf(file, "threads,%zu\n", config.number_threads());
+  fprintf(file, "payloads,%zu\n", config.number_payloads());
+  fprintf(file, "bytes,%llu\n", static_cast<unsigned long long>(t.bytes));
+
+  fprintf(file,
+          "transfer_bytes,%.1f\n",
+          (transfers > 0) ? static_cast<double>(t.bytes) / transfers : 0.0);
+
+  fprintf(file, "connects,%llu\n", static_cast<unsigned long long>(connects));
+
+  fprintf(file,
+          "transfers,%llu\n",
+          static_cast<unsigned long long>(transfers));
+
+  fprintf(file, "connects_per_second,%.3f\n", connects * rate);
+  fprintf(file, "transfers_per_second,%.3f\n", transfers * rate);
+
+  fprintf(file, "bytes_per_second,%.3f\n", t.bytes * rate);
+
+  fprintf(file,
+          "connect_errors,%llu\n",
+          static_cast<unsigned long long>(
+            t.events[static_cast<size_t>(event::connect_error)]
+          ));
+
+  fprintf(file,
+          "io_errors,%llu\n",
+          static_cast<unsigned long long>(
+            t.events[static_cast<size_t>(event::io_error)]
+          ));
+
+  fprintf(file,
+          "disconnects,%llu\n",
+          static_cast<unsigned long long>(
+            t.events[static_cast<size_t>(event::disconnect)]
+          ));
+
+  fprintf(file,
+          "faults_idle,%llu\n",
+          static_cast<unsigned long long>(
+            t.events[static_cast<size_t>(event::idle)]
+          ));
+
+  fprintf(file,
+          "faults_trickle,%llu\n",
+          static_cast<unsigned long long>(
+            t.events[static_cast<size_t>(event::trickle)]
+          ));
+
+  fprintf(file,
+          "faults_reset,%llu\n",
+          static_cast<unsigned long long>(
+            t.events[static_cast<size_t>(event::reset)]
+          ));
+
+  fprintf(file,
+          "faults_half_close,%llu\n",
+          static_cast<unsigned long long>(
+            t.events[static_cast<size_t>(event::half_close)]
+          ));
+
+  fprintf(file,
+          "faults_hold_expired,%llu\n",
+          static_cast<unsigned long long>(
+            t.events[static_cast<size_t>(event::hold_expired)]
+          ));
+
+  fprintf(file,
+          "socket_reuses,%llu\n",
+          static_cast<unsigned long long>(
+            t.events[static_cast<size_t>(event::socket_reuse)]
+          ));
+
+  fprintf(file, "cpu_user_seconds,%.6f\n", run.cpu_user / 1e9);
+  fprintf(file, "cpu_kernel_seconds,%.6f\n", run.cpu_kernel / 1e9);
+
+  fprintf(file,
+          "cpu_us_per_transfer,%.3f\n",
+          (transfers > 0) ?
+            (run.cpu_user + run.cpu_kernel) / 1000.0 / transfers :
+            0.0);
+
+  for (size_t i = 0; i < nlatencies; i++) {
+    const util::histogram& h = t.histograms[i];
+
+    // If the latency has not been measured...
+    if (h.count() == 0) {
+      continue;
+    }
+
+    const char* const name = latency_names[i];
+
+    fprintf(file,
+            "latencies_us.%s.count,%llu\n",
+            name,
+            static_cast<unsigned long long>(h.count()));
+
+    fprintf(file, "latencies_us.%s.min,%.1f\n", name, h.min() / 1000.0);
+    fprintf(file, "latencies_us.%s.mean,%.1f\n", name, h.mean() / 1000.0);
+
+    fprintf(file,
+            "latencies_us.%s.p50,%.1f\n",
+            name,
+            h.percentile(50.0) / 1000.0);
+
+    fprintf(file,
+            "latencies_us.%s.p90,%.1f\n",
+            name,
+            h.percentile(90.0) / 1000.0);
+
+    fprintf(file,
+            "latencies_us.%s.p99,%.1f\n",
+            name,
+            h.percentile(99.0) / 1000.0);
+
+    fprintf(file,
+            "latencies_us.%s.p99.9,%.1f\n",
+            name,
+            h.percentile(99.9) / 1000.0);
+
+    fprintf(file, "latencies_us.%s.max,%.1f\n", name, h.max() / 1000.0);
+  }
+}
+
+} // namespace connector
+} // namespace tcp
+} // namespace net
\ No newline at end of file
@@ -0,0 +1,231 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <windows.h>
+#include "net/tcp/connector/configuration.hpp"
+#include "util/histogram.hpp"
+
+namespace net {
+namespace tcp {
+namespace connector {
+
+// Latency statistics and event counters.
+// Every thread records into its own histograms and counters (no
+// synchronization); they are merged when the statistics are printed or
+// saved.
+class statistics {
+  public:
+    // Latencies.
+    enum class latency {
+      // From the start of the connect until the connection is established.
+      connect,
+
+      // From the start of the connect until the first send has completed.
+      first_byte,
+
+      // From the start of a transfer until all its data has been sent.
+      send,
+
+      // From the establishment of the connection until all its transfers
+      // have been sent (and echoed back, in echo mode).
+      transfer,
+
+      // From the start of a transfer until all its data has been echoed
+      // back (echo mode).
+      round_trip,
+
+      // From the establishment of a faulty connection until the peer closes
+      // it.
+      hold
+    };
+
+    // Number of latencies.
+    static constexpr const size_t nlatencies = 6;
+
+    // Events.
+    enum class event {
+      // A connect has failed.
+      connect_error,
+
+      // A send or a receive has failed.
+      io_error,
+
+      // A connection has been disconnected.
+      disconnect,
+
+      // A connection has been held open without sending (fault).
+      idle,
+
+      // A connection has trickled its data (fault).
+      trickle,
+
+      // A connection has been reset in the middle of a transfer (fault).
+      reset,
+
+      // A connection has been half-closed after a transfer (fault).
+      half_close,
+
+      // A faulty connection has been held open until the hold limit (the
+      // peer hasn't closed it).
+      hold_expired,
+
+      // A connect has reused the socket of the previous connection
+      // (`TF_REUSE_SOCKET`).
+      socket_reuse
+    };
+
+    // Number of events.
+    static constexpr const size_t nevents = 9;
+
+    // Maximum number of error codes counted by a thread (the next ones are
+    // counted as other errors).
+    static constexpr const size_t max_error_codes = 8;
+
+    // Maximum number of error codes reported (the next ones are reported as
+    // other errors).
+    static constexpr const size_t max_reported_errors = 16;
+
+    // Number of errors of an error code.
+    struct error_count {
+      DWORD code;
+      uint64_t count;
+    };
+
+    // Errors by code.
+    struct errors_by_code {
+      error_count codes[max_reported_errors];
+      size_t ncodes;
+      uint64_t other;
+
+      // Clear.
+      void clear();
+
+      // Add errors.
+      void add(DWORD code, uint64_t count);
+
+      // Get the number of errors of `code`.
+      uint64_t count(DWORD code) const;
+    };
+
+    // Snapshot of the counters (live report).
+    struct snapshot {
+      // Time of the sample (nanoseconds).
+      uint64_t time;
+
+      uint64_t connects;
+      uint64_t transfers;
+      uint64_t bytes;
+      uint64_t events[nevents];
+      errors_by_code errors;
+
+      // Histogram of the sampled latency.
+      util::histogram histogram;
+    };
+
+    // Run.
+    struct run {
+      // Duration (nanoseconds).
+      uint64_t elapsed;
+
+      // CPU time of the process (nanoseconds).
+      uint64_t cpu_user;
+      uint64_t cpu_kernel;
+    };
+
+    // Constructor.
+    statistics() = default;
+
+    // Destructor.
+    ~statistics();
+
+    // Record latency (nanoseconds).
+    void record(latency l, uint64_t ns);
+
+    // Count event.
+    void count(event e);
+
+    // Count the bytes of a transfer which has been sent.
+    void count_bytes(uint64_t bytes);
+
+    // Count an error event and its error code.
+    void error(event e, DWORD code);
+
+    // Sample the counters and the histogram of the latency `l` (while the
+    // threads keep recording).
+    void sample(latency l, snapshot& s) const;
+
+    // Get name of a latency.
+    static const char* name(latency l);
+
+    // Print statistics.
+    void print(const run& run) const;
+
+    // Save statistics to the results file of the configuration.
+    bool save(const run& run, const configuration& config) const;
+
+    // Get current time (nanoseconds).
+    static uint64_t now();
+
+    // Get the CPU time of the process (nanoseconds).
+    static void cpu_time(uint64_t& user, uint64_t& kernel);
+
+  private:
+    // Histograms of a thread.
+    struct recorder {
+      const statistics* owner;
+      util::histogram histograms[nlatencies];
+      uint64_t events[nevents];
+      uint64_t bytes;
+      error_count errors[max_error_codes];
+      uint64_t other_errors;
+      recorder* next;
+    };
+
+    // Histograms and counters of all the threads, merged.
+    struct totals {
+      util::histogram histograms[nlatencies];
+      uint64_t events[nevents];
+      uint64_t bytes;
+      errors_by_code errors;
+    };
+
+    // Names of the latencies.
+    static const char* const latency_names[nlatencies];
+
+    // Histograms of all the threads.
+    recorder* _M_recorders = nullptr;
+
+    // Lock of `_M_recorders`.
+    mutable SRWLOCK _M_lock = SRWLOCK_INIT;
+
+    // Histograms of the current thread.
+    static thread_local recorder* _M_current;
+
+    // Get the histograms of the current thread (creating them if needed).
+    recorder* current();
+
+    // Merge the histograms and the counters of all the threads.
+    void merge(totals& t) const;
+
+    // Write statistics as JSON.
+    static void write_json(FILE* file,
+                           const totals& t,
+                           const run& run,
+                           const configuration& config);
+
+    // Write statistics as CSV.
+    static void write_csv(FILE* file,
+                          const totals& t,
+                          const run& run,
+                          const configuration& config);
+
+    // Disable copy constructor and assignment operator.
+    statistics(const statistics&) = delete;
+    statistics& operator=(const statistics&) = delete;
+};
+
+} // namespace connector
+} // namespace tcp
+} // namespace net
\ No newline at end of file
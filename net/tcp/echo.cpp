@@ -0,0 +1,244 @@
+#include <stdlib.h>
+#include "net/tcp/echo.hpp"
+
+namespace net {
+namespace tcp {
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+//                                                                            //
+// Echo server.                                                               //
+//                                                                            //
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+
+echo::echo()
+  : _M_sock{nullptr, nullptr, _M_thread_pool.callback_environment()}
+{
+}
+
+echo::~echo()
+{
+  if (_M_connections) {
+    for (size_t i = 0; i < _M_nconnections; i++) {
+      _M_slab.destroy(_M_connections[i]);
+    }
+
+    free(_M_connections);
+  }
+}
+
+bool echo::create(DWORD minthreads, DWORD maxthreads, size_t nconnections)
+{
+  // Sanity checks.
+  if ((nconnections >= min_connections) &&
+      (nconnections <= max_connections)) {
+    // Create thread pool.
+    if (_M_thread_pool.create(minthreads, maxthreads)) {
+      // Save number of connections.
+      _M_maxconnections = nconnections;
+
+      return true;
+    }
+  }
+
+  return false;
+}
+
+bool echo::listen(const socket::address& addr)
+{
+  // Listen.
+  if (_M_sock.listen(addr)) {
+    _M_connections = static_cast<connection**>(
+                       malloc(_M_maxconnections * sizeof(connection*))
+                     );
+
+    // Create slab allocator of connections (on the NUMA node of the
+    // threads).
+    if ((_M_connections) &&
+        (_M_slab.create(sizeof(connection),
+                        _M_maxconnections,
+                        _M_thread_pool.numa_node()))) {
+      // Create connections.
+      for (; _M_nconnections < _M_maxconnections; _M_nconnections++) {
+        connection* const
+          conn = _M_slab.construct<connection>(
+                   _M_sock,
+                   _M_thread_pool.callback_environment()
+                 );
+
+        if (!conn) {
+          return false;
+        }
+
+        _M_connections[_M_nconnections] = conn;
+
+        // Start an asynchronous accept.
+        conn->accept();
+      }
+
+      return true;
+    }
+  }
+
+  return false;
+}
+
+uint64_t echo::accepts(uint64_t& first, uint64_t& last) const
+{
+  uint64_t count = 0;
+
+  first = 0;
+  last = 0;
+
+  // Sum the counters of the connections.
+  for (size_t i = 0; i < _M_nconnections; i++) {
+    const connection* const conn = _M_connections[i];
+
+    if (conn->accepts() > 0) {
+      if ((count == 0) || (conn->first_accept() < first)) {
+        first = conn->first_accept();
+      }
+
+      if (conn->last_accept() > last) {
+        last = conn->last_accept();
+      }
+
+      count += conn->accepts();
+    }
+  }
+
+  return count;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+//                                                                            //
+// Connection.                                                                //
+//                                                                            //
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+
+echo::connection::connection(async::stream::socket& listener,
+                             PTP_CALLBACK_ENVIRON callbackenv)
+  : _M_sock{this, callbackenv},
+    _M_listener{listener}
+{
+}
+
+void echo::connection::accept()
+{
+  // Start an asynchronous accept.
+  _M_listener.accept(_M_sock, _M_addresses, address_length);
+}
+
+void echo::connection::complete(async::stream::socket::operation op,
+                                DWORD error,
+                                DWORD transferred)
+{
+  // Success?
+  if (error == 0) {
+    switch (op) {
+      case async::stream::socket::operation::receive:
+        // Data has been received.
+        received(transferred);
+
+        break;
+      case async::stream::socket::operation::send:
+        // Data has been sent.
+        sent(transferred);
+
+        break;
+      case async::stream::socket::operation::disconnect:
+        // Start another asynchronous accept.
+        accept();
+
+        break;
+      case async::stream::socket::operation::accept:
+        // Accepted.
+        accepted();
+
+        break;
+      case async::stream::socket::operation::connect:
+      default:
+        break;
+    }
+  } else {
+    switch (op) {
+      case async::stream::socket::operation::receive:
+      case async::stream::socket::operation::send:
+        if (error != WSA_OPERATION_ABORTED) {
+          // Close connection.
+          close();
+        }
+
+        break;
+      case async::stream::socket::operation::disconnect:
+      case async::stream::socket::operation::accept:
+        // Start another asynchronous accept.
+        accept();
+
+        break;
+      case async::stream::socket::operation::connect:
+      default:
+        break;
+    }
+  }
+}
+
+void echo::connection::accepted()
+{
+  _M_last_accept = ::GetTickCount64();
+
+  if (_M_accepts++ == 0) {
+    _M_first_accept = _M_last_accept;
+  }
+
+  // Start an asynchronous receive.
+  receive();
+}
+
+void echo::connection::receive()
+{
+  // Start an asynchronous receive.
+  _M_sock.receive(_M_buf, sizeof(_M_buf));
+}
+
+void echo::connection::received(DWORD transferred)
+{
+  // If some data has been received...
+  if (transferred > 0) {
+    _M_pending = transferred;
+    _M_sent = 0;
+
+    // Send it back.
+    _M_sock.send(_M_buf, _M_pending);
+  } else {
+    // The client has closed the connection.
+    close();
+  }
+}
+
+void echo::connection::sent(DWORD count)
+{
+  _M_sent += count;
+
+  // If all the data has been sent back...
+  if (_M_sent == _M_pending) {
+    // Start an asynchronous receive.
+    receive();
+  } else {
+    // Send the rest.
+    _M_sock.send(_M_buf + _M_sent, _M_pending - _M_sent);
+  }
+}
+
+void echo::connection::close()
+{
+  // Disconnect (the socket is reused by the next accept).
+  _M_sock.disconnect();
+}
+
+} // namespace tcp
+} // namespace net
\ No newline at end of file
@@ -0,0 +1,164 @@
+#pragma once
+
+#include <stdint.h>
+#include "net/async/thread_pool.hpp"
+#include "net/async/stream/socket.hpp"
+#include "util/slab.hpp"
+
+namespace net {
+namespace tcp {
+
+// TCP echo server: sends back whatever it receives.
+// It is the target of the request/response benchmarks of `test-connector`
+// (directly or through `tcp-proxy`). Every connection slot accepts a
+// connection, echoes its data until the client closes it, and is then
+// recycled to accept another connection on the same socket (the disconnect
+// keeps it for reuse).
+class echo {
+  public:
+    // Minimum number of connections.
+    static constexpr const size_t min_connections = 1;
+
+    // Maximum number of connections.
+    static constexpr const size_t max_connections = 64 * 1024;
+
+    // Default number of connections.
+    static constexpr const size_t default_connections = 256;
+
+    // Constructor.
+    echo();
+
+    // Destructor.
+    ~echo();
+
+    // Create.
+    bool create(DWORD minthreads = async::thread_pool::min_threads,
+                DWORD maxthreads = async::thread_pool::default_max_threads,
+                size_t nconnections = default_connections);
+
+    // Listen.
+    bool listen(const socket::address& addr);
+
+    // Get the number of accepted connections and the times of the first
+    // and the last accepts (milliseconds, `GetTickCount64()`).
+    uint64_t accepts(uint64_t& first, uint64_t& last) const;
+
+  private:
+    // Connection.
+    class connection {
+      public:
+        // Constructor.
+        connection(async::stream::socket& listener,
+                   PTP_CALLBACK_ENVIRON callbackenv = nullptr);
+
+        // Destructor.
+        ~connection() = default;
+
+        // Accept connection.
+        void accept();
+
+        // Number of accepted connections.
+        uint64_t accepts() const;
+
+        // Times of the first and the last accepts (milliseconds).
+        uint64_t first_accept() const;
+        uint64_t last_accept() const;
+
+      private:
+        // Address length.
+        static constexpr const
+          DWORD address_length = sizeof(struct sockaddr_storage) + 16;
+
+        // Buffer size.
+        static constexpr const size_t buffer_size = 32 * 1024;
+
+        // Notify of a completed socket I/O operation.
+        void complete(async::stream::socket::operation op,
+                      DWORD error,
+                      DWORD transferred);
+
+        // Socket.
+        async::stream::basic_socket<
+          async::stream::member_handler<connection, &connection::complete>
+        > _M_sock;
+
+        // Listener.
+        async::stream::socket& _M_listener;
+
+        // Number of bytes received and not sent back yet.
+        DWORD _M_pending = 0;
+
+        // Number of bytes sent back.
+        DWORD _M_sent = 0;
+
+        // Number of accepted connections.
+        uint64_t _M_accepts = 0;
+
+        // Times of the first and the last accepts (milliseconds).
+        uint64_t _M_first_accept = 0;
+        uint64_t _M_last_accept = 0;
+
+        // Buffer for storing the local and remote addresses.
+        uint8_t _M_addresses[2 * address_length];
+
+        // Buffer.
+        alignas(util::cache_line_size) uint8_t _M_buf[buffer_size];
+
+        // Accepted.
+        void accepted();
+
+        // Receive.
+        void receive();
+
+        // Data has been received.
+        void received(DWORD transferred);
+
+        // Data has been sent.
+        void sent(DWORD count);
+
+        // Close connection.
+        void close();
+
+        // Disable copy constructor and assignment operator.
+        connection(const connection&) = delete;
+        connection& operator=(const connection&) = delete;
+    };
+
+    // Thread pool.
+    async::thread_pool _M_thread_pool;
+
+    // Listener.
+    async::stream::socket _M_sock;
+
+    // Connections.
+    connection** _M_connections = nullptr;
+    size_t _M_nconnections = 0;
+
+    // Number of connections.
+    size_t _M_maxconnections = default_connections;
+
+    // Allocator of connections.
+    util::slab _M_slab;
+
+    // Disable copy constructor and assignment operator.
+    echo(const echo&) = delete;
+    echo& operator=(const echo&) = delete;
+};
+
+inline uint64_t echo::connection::accepts() const
+{
+  return _M_accepts;
+}
+
+inline uint64_t echo::connection::first_accept() const
+{
+  return _M_first_accept;
+}
+
+inline uint64_t echo::connection::last_accept() const
+{
+  return _M_last_accept;
+}
+
+} // namespace tcp
+} // namespace net
\ No newline at end of file
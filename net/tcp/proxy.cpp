@@ -1,6 +1,7 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <stdarg.h>
+#include <malloc.h>
 #include <new>
 #include "net/tcp/proxy.hpp"
 
@@ -36,21 +37,45 @@ static void print(const char* fmt, ...)
 bool proxy::create(DWORD minthreads,
                    DWORD maxthreads,
                    size_t nconnections,
-                   uint64_t timeout)
+                   size_t maxconnections,
+                   uint64_t timeout,
+                   const async::thread_pool::placement* placement,
+                   bool large_pages)
 {
   // Sanity checks.
   if ((nconnections >= min_connections) &&
-      (nconnections <= max_connections) &&
+      (nconnections <= maxconnections) &&
+      (maxconnections <= max_connections) &&
       (timeout >= min_timeout) &&
       (timeout <= max_timeout)) {
     // Create thread pool.
-    if (_M_thread_pool.create(minthreads, maxthreads)) {
+    if (_M_thread_pool.create(minthreads, maxthreads, placement)) {
       // Save number of connections per acceptor.
       _M_config.nconnections = nconnections;
 
+      // Save maximum number of connections per acceptor.
+      _M_config.maxconnections = maxconnections;
+
       // Save connection timeout.
       _M_config.timeout = timeout;
 
+      // Allocate the connections on large pages?
+      _M_config.large_pages = large_pages;
+
+      // Connect on accept.
+      _M_config.upstreams = 0;
+
+      // Default health checking.
+      _M_config.health.max_failures = balancer::default_max_failures;
+      _M_config.health.ejection_time = balancer::default_ejection_time;
+      _M_config.health.probe_interval = balancer::default_probe_interval;
+
+      // Default timeout of a connect attempt.
+      _M_config.connect_timeout = default_connect_timeout;
+
+      // DNS servers of the system.
+      _M_config.custom_dns_server = false;
+
       return true;
     }
   }
@@ -58,12 +83,226 @@ bool proxy::create(DWORD minthreads,
   return false;
 }
 
+bool proxy::create_per_core(size_t nconnections,
+                            size_t maxconnections,
+                            uint64_t timeout,
+                            bool large_pages)
+{
+  // Sanity checks.
+  if ((nconnections >= min_connections) &&
+      (nconnections <= maxconnections) &&
+      (maxconnections <= max_connections) &&
+      (timeout >= min_timeout) &&
+      (timeout <= max_timeout)) {
+    // Create one thread pool per core.
+    if (_M_cores.create()) {
+      // Split the connections between the cores.
+      _M_config.nconnections = (nconnections + _M_cores.count() - 1) /
+                               _M_cores.count();
+
+      _M_config.maxconnections = (maxconnections + _M_cores.count() - 1) /
+                                 _M_cores.count();
+
+      // Save connection timeout.
+      _M_config.timeout = timeout;
+
+      // Allocate the connections on large pages?
+      _M_config.large_pages = large_pages;
+
+      // Connect on accept.
+      _M_config.upstreams = 0;
+
+      // Default health checking.
+      _M_config.health.max_failures = balancer::default_max_failures;
+      _M_config.health.ejection_time = balancer::default_ejection_time;
+      _M_config.health.probe_interval = balancer::default_probe_interval;
+
+      // Default timeout of a connect attempt.
+      _M_config.connect_timeout = default_connect_timeout;
+
+      // DNS servers of the system.
+      _M_config.custom_dns_server = false;
+
+      return true;
+    }
+  }
+
+  return false;
+}
+
+bool proxy::preconnect(size_t count)
+{
+  // Split the upstream connections between the cores (thread-per-core
+  // mode).
+  const size_t ncores = (_M_cores.count() > 0) ? _M_cores.count() : 1;
+  const size_t upstreams = (count + ncores - 1) / ncores;
+
+  // Sanity check.
+  if (upstreams <= _M_config.nconnections) {
+    _M_config.upstreams = upstreams;
+    return true;
+  }
+
+  return false;
+}
+
+void proxy::health_check(uint32_t max_failures,
+                         uint32_t ejection_time,
+                         uint32_t probe_interval)
+{
+  _M_config.health.max_failures = max_failures;
+  _M_config.health.ejection_time = ejection_time;
+  _M_config.health.probe_interval = probe_interval;
+}
+
+bool proxy::connect_timeout(uint32_t timeout)
+{
+  // Sanity check.
+  if ((timeout >= min_connect_timeout) && (timeout <= max_connect_timeout)) {
+    _M_config.connect_timeout = timeout;
+    return true;
+  }
+
+  return false;
+}
+
+bool proxy::dns_server(const socket::address& server)
+{
+  // Sanity check.
+  if ((server.family() == AF_INET) || (server.family() == AF_INET6)) {
+    _M_config.dns_server = server;
+    _M_config.custom_dns_server = true;
+
+    return true;
+  }
+
+  return false;
+}
+
 bool proxy::listen(const socket::address& local, const socket::address& remote)
 {
-  return _M_acceptors.listen(local,
-                             remote,
-                             _M_config,
-                             _M_thread_pool.callback_environment());
+  balancer::addresses backend;
+  backend.addrs[0] = remote;
+  backend.count = 1;
+  backend.host = nullptr;
+
+  return listen(local, &backend, 1);
+}
+
+bool proxy::listen(const socket::address& local,
+                   const balancer::addresses* backends,
+                   size_t nbackends,
+                   balancer::policy policy)
+{
+  // Thread-per-core mode?
+  if (_M_cores.count() > 0) {
+    return _M_acceptors.listen(local,
+                               backends,
+                               nbackends,
+                               policy,
+                               _M_config,
+                               _M_cores.thread_pools(),
+                               _M_cores.count());
+  } else {
+    return _M_acceptors.listen(local,
+                               backends,
+                               nbackends,
+                               policy,
+                               _M_config,
+                               &_M_thread_pool,
+                               1);
+  }
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+//                                                                            //
+// Cores.                                                                     //
+//                                                                            //
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+
+// Count the processors in `mask`.
+static size_t count_processors(KAFFINITY mask)
+{
+  size_t count = 0;
+  for (; mask != 0; mask &= mask - 1) {
+    count++;
+  }
+
+  return count;
+}
+
+proxy::cores::~cores()
+{
+  delete [] _M_thread_pools;
+}
+
+bool proxy::cores::create()
+{
+  // Get the highest NUMA node number.
+  ULONG highest;
+  if (::GetNumaHighestNodeNumber(&highest)) {
+    GROUP_AFFINITY affinity;
+
+    // Count processors.
+    size_t nprocessors = 0;
+    for (ULONG node = 0; node <= highest; node++) {
+      if (::GetNumaNodeProcessorMaskEx(static_cast<USHORT>(node),
+                                       &affinity)) {
+        nprocessors += count_processors(affinity.Mask);
+      }
+    }
+
+    if (nprocessors > max_cores) {
+      nprocessors = max_cores;
+    }
+
+    if (nprocessors > 0) {
+      // Create thread pools.
+      _M_thread_pools = new (std::nothrow) async::thread_pool[nprocessors];
+
+      // If the thread pools could be created...
+      if (_M_thread_pools) {
+        for (ULONG node = 0; node <= highest; node++) {
+          if (::GetNumaNodeProcessorMaskEx(static_cast<USHORT>(node),
+                                           &affinity)) {
+            const size_t count = count_processors(affinity.Mask);
+
+            for (size_t i = 0; (i < count) && (_M_count < nprocessors); i++) {
+              // One thread pinned to the i-th processor of the node.
+              const async::thread_pool::placement placement{
+                node,
+                true,
+                static_cast<DWORD>(i)
+              };
+
+              if (!_M_thread_pools[_M_count].create(1, 1, &placement)) {
+                return false;
+              }
+
+              _M_count++;
+            }
+          }
+        }
+
+        return (_M_count > 0);
+      }
+    }
+  }
+
+  return false;
+}
+
+async::thread_pool* proxy::cores::thread_pools()
+{
+  return _M_thread_pools;
+}
+
+size_t proxy::cores::count() const
+{
+  return _M_count;
 }
 
 
@@ -77,21 +316,29 @@ bool proxy::listen(const socket::address& local, const socket::address& remote)
 
 proxy::connection::connection(acceptor& acceptor,
                               PTP_CALLBACK_ENVIRON callbackenv)
-  : _M_server{acceptor, _M_client, callbackenv},
-    _M_client{_M_server, callbackenv}
+  : _M_server{*this, acceptor, _M_client, callbackenv},
+    _M_client{_M_server, acceptor, callbackenv}
 {
 }
 
 bool proxy::connection::create(PTP_CALLBACK_ENVIRON callbackenv)
 {
-  return _M_server.create(callbackenv);
+  return ((_M_server.create(callbackenv)) && (_M_client.create(callbackenv)));
 }
 
 void proxy::connection::accept()
 {
+  // The upstream connection is free until a connection is accepted.
+  _M_client.reset();
+
   _M_server.accept();
 }
 
+bool proxy::connection::preconnect()
+{
+  return _M_client.preconnect();
+}
+
 
 ////////////////////////////////////////////////////////////////////////////////
 ////////////////////////////////////////////////////////////////////////////////
@@ -101,13 +348,15 @@ void proxy::connection::accept()
 ////////////////////////////////////////////////////////////////////////////////
 ////////////////////////////////////////////////////////////////////////////////
 
-proxy::connection::server::server(acceptor& acceptor,
+proxy::connection::server::server(connection& connection,
+                                  acceptor& acceptor,
                                   client& client,
                                   PTP_CALLBACK_ENVIRON callbackenv)
-  : _M_sock{complete, this, callbackenv},
+  : _M_sock{this, callbackenv},
+    _M_timer{this},
+    _M_connection{connection},
     _M_acceptor{acceptor},
-    _M_client{client},
-    _M_timer{timer, this}
+    _M_client{client}
 {
 }
 
@@ -129,14 +378,18 @@ void proxy::connection::server::accept()
 
 void proxy::connection::server::connected()
 {
-  // Two open connections.
-  _M_nconnections = 2;
-
-  // Start an asynchronous receive on the server side.
-  receive();
+  // If the server connection is still open...
+  if (_M_state.is_open()) {
+    // Start an asynchronous receive on the server side.
+    receive();
 
-  // Start an asynchronous receive on the client side.
-  _M_client.receive();
+    // Start an asynchronous receive on the client side.
+    _M_client.receive();
+  } else {
+    // The server connection has been closed while the client was
+    // connecting.
+    _M_client.close();
+  }
 }
 
 void proxy::connection::server::receive()
@@ -144,8 +397,11 @@ void proxy::connection::server::receive()
   // Stop timer.
   stop_timer();
 
-  // Start an asynchronous receive.
-  _M_sock.receive(_M_recvbuf, sizeof(_M_recvbuf));
+  // If the connection is still open...
+  if (_M_state.acquire()) {
+    // Start an asynchronous receive.
+    _M_sock.receive(_M_recvbuf, sizeof(_M_recvbuf));
+  }
 }
 
 void proxy::connection::server::send(const void* buf, DWORD len)
@@ -157,8 +413,11 @@ void proxy::connection::server::send(const void* buf, DWORD len)
   // Start timer.
   start_timer();
 
-  // Start an asynchronous send.
-  _M_sock.send(buf, len);
+  // If the connection is still open...
+  if (_M_state.acquire()) {
+    // Start an asynchronous send.
+    _M_sock.send(buf, len);
+  }
 }
 
 void proxy::connection::server::close_connections(bool cancel_timer)
@@ -167,25 +426,18 @@ void proxy::connection::server::close_connections(bool cancel_timer)
   print("[server] Closing connections...\n");
 #endif
 
-  // Close client connection.
-  _M_client.close();
-
   // Close server connection.
   close(cancel_timer);
+
+  // Close client connection (after the server connection, so that a client
+  // which connects meanwhile is closed by server::connected()).
+  _M_client.close();
 }
 
 void proxy::connection::server::close(bool cancel_timer)
 {
-  // Lock mutex.
-  while (::InterlockedCompareExchange(&_M_mutex, 1, 0) != 0);
-
-  // If the connection is open...
-  if (_M_open) {
-    _M_open = false;
-
-    // Unlock mutex.
-    ::InterlockedDecrement(&_M_mutex);
-
+  // If the connection was open...
+  if (_M_state.close()) {
 #if DEBUG
     print("[server] Closing connection...\n");
 #endif
@@ -200,19 +452,22 @@ void proxy::connection::server::close(bool cancel_timer)
     _M_sock.cancel(async::stream::socket::operation::receive);
     _M_sock.cancel(async::stream::socket::operation::send);
 
-    // Disconnect.
-    _M_sock.disconnect();
-  } else {
-    // Unlock mutex.
-    ::InterlockedDecrement(&_M_mutex);
+    // Release our reference (the last reference disconnects).
+    release();
   }
 }
 
 void proxy::connection::server::disconnected()
 {
   if (::InterlockedDecrement(&_M_nconnections) == 0) {
-    // Start another asynchronous accept.
-    accept();
+    // If the connection hasn't been parked...
+    if (_M_acceptor.closed(_M_connection)) {
+      // Start another asynchronous accept.
+      _M_connection.accept();
+
+      // Pre-connect upstream connections (if needed).
+      _M_acceptor.refill();
+    }
   }
 }
 
@@ -243,8 +498,8 @@ void proxy::connection::server::complete(async::stream::socket::operation op,
 
         break;
       case async::stream::socket::operation::accept:
-        // Connection has been accepted.
-        accepted();
+        // An accept has completed.
+        accept_completed(0);
 
         break;
       case async::stream::socket::operation::connect:
@@ -269,8 +524,8 @@ void proxy::connection::server::complete(async::stream::socket::operation op,
 
         break;
       case async::stream::socket::operation::accept:
-        // Start another asynchronous accept.
-        accept();
+        // An accept has failed.
+        accept_completed(error);
 
         break;
       case async::stream::socket::operation::connect:
@@ -278,6 +533,54 @@ void proxy::connection::server::complete(async::stream::socket::operation op,
         break;
     }
   }
+
+  // If a receive or a send has completed...
+  if ((op == async::stream::socket::operation::receive) ||
+      (op == async::stream::socket::operation::send)) {
+    release();
+  }
+}
+
+void proxy::connection::server::accept_completed(DWORD error)
+{
+  // If the accept has been notified on the thread pool of the primary
+  // acceptor...
+  if (_M_acceptor.secondary()) {
+    _M_accept_error = error;
+
+    // Hand the connection over to the thread pool of its acceptor, so that
+    // the connection is only touched by the core which owns it.
+    if (::TrySubmitThreadpoolCallback(accept_callback,
+                                      this,
+                                      _M_acceptor.callback_environment())) {
+      return;
+    }
+  }
+
+  handle_accept(error);
+}
+
+void proxy::connection::server::accept_callback(PTP_CALLBACK_INSTANCE instance,
+                                                void* context)
+{
+  server* const s = static_cast<server*>(context);
+
+  s->handle_accept(s->_M_accept_error);
+}
+
+void proxy::connection::server::handle_accept(DWORD error)
+{
+  // Success?
+  if (error == 0) {
+    // Notify the acceptor.
+    _M_acceptor.accepted();
+
+    // Connection has been accepted.
+    accepted();
+  } else {
+    // Start another asynchronous accept.
+    accept();
+  }
 }
 
 void proxy::connection::server::accepted()
@@ -293,13 +596,37 @@ void proxy::connection::server::accepted()
   }
 #endif // DEBUG
 
-  // One open connection.
-  _M_nconnections = 1;
+  // Two connections: the server connection and the client connection
+  // which is about to be connected.
+  _M_nconnections = 2;
 
-  _M_open = true;
+  _M_state.open();
 
-  // Connect client.
-  connect();
+  // Take the upstream connection.
+  switch (_M_client.claim()) {
+    case client::upstream_ready:
+      // Start an asynchronous receive on the server side (the client side
+      // is already receiving).
+      receive();
+
+      break;
+    case client::upstream_buffered:
+      // Start an asynchronous receive on the server side.
+      receive();
+
+      // Send the data received on the client side meanwhile.
+      _M_client.forward();
+
+      break;
+    case client::upstream_connecting:
+      // Wait for the client to connect.
+      start_timer();
+
+      break;
+    default:
+      // Connect client.
+      connect();
+  }
 }
 
 void proxy::connection::server::connect()
@@ -307,8 +634,19 @@ void proxy::connection::server::connect()
   // Start timer.
   start_timer();
 
+  uint32_t key = 0;
+
+  // If the backend depends on the client...
+  if (_M_acceptor.backends().hashed()) {
+    // Get remote address.
+    socket::address addr;
+    _M_sock.remote(_M_addresses, address_length, addr);
+
+    key = balancer::hash(addr);
+  }
+
   // Connect client.
-  _M_client.connect(_M_acceptor.remote());
+  _M_client.connect(key);
 }
 
 void proxy::connection::server::received(DWORD transferred)
@@ -363,6 +701,15 @@ void proxy::connection::server::timer()
   close_connections(cancel_timer);
 }
 
+void proxy::connection::server::release()
+{
+  // If this was the last reference of a closing connection...
+  if (_M_state.release()) {
+    // Disconnect.
+    _M_sock.disconnect();
+  }
+}
+
 void proxy::connection::server::start_timer()
 {
   _M_timer.expires_in(_M_acceptor.config().timeout * 1000 * 1000);
@@ -373,19 +720,6 @@ void proxy::connection::server::stop_timer()
   _M_timer.cancel();
 }
 
-void proxy::connection::server::complete(async::stream::socket::operation op,
-                                         DWORD error,
-                                         DWORD transferred,
-                                         void* user)
-{
-  static_cast<server*>(user)->complete(op, error, transferred);
-}
-
-void proxy::connection::server::timer(util::timer& timer, void* user)
-{
-  static_cast<server*>(user)->timer();
-}
-
 
 ////////////////////////////////////////////////////////////////////////////////
 ////////////////////////////////////////////////////////////////////////////////
@@ -396,53 +730,144 @@ void proxy::connection::server::timer(util::timer& timer, void* user)
 ////////////////////////////////////////////////////////////////////////////////
 
 proxy::connection::client::client(server& server,
+                                  acceptor& acceptor,
                                   PTP_CALLBACK_ENVIRON callbackenv)
-  : _M_sock{complete, this, callbackenv},
-    _M_server{server}
+  : _M_socks{{socket_handler{this, 0}, callbackenv},
+             {socket_handler{this, 1}, callbackenv}},
+    _M_attempt_timer{this},
+    _M_server{server},
+    _M_acceptor{acceptor}
 {
+  for (size_t i = 0; i < nsockets; i++) {
+    _M_attempt[i].state = attempt_idle;
+    _M_attempt[i].race = 0;
+    _M_attempt[i].started = 0;
+  }
+}
+
+bool proxy::connection::client::create(PTP_CALLBACK_ENVIRON callbackenv)
+{
+  // Create attempt timer.
+  return _M_attempt_timer.create(callbackenv);
 }
 
-void proxy::connection::client::connect(const socket::address& addr)
+void proxy::connection::client::connect(uint32_t key)
 {
+  // Select backend.
+  _M_backend = _M_acceptor.backends().select(key);
+
+  // If all the backends are ejected...
+  if (_M_backend == balancer::none) {
 #if DEBUG
-  print("[client] Connecting...\n");
+    print("[client] No backend available.\n");
 #endif
 
-  _M_sock.connect(addr);
+    // Fail fast.
+    connect_failed();
+
+    return;
+  }
+
+#if DEBUG
+  print("[client] Connecting to backend %zu...\n", _M_backend);
+#endif
+
+  // Start a new race.
+  ::AcquireSRWLockExclusive(&_M_race_lock);
+
+  _M_winner = 0;
+  _M_attempts = 0;
+  _M_next_address = 0;
+  _M_race++;
+
+  // Check the attempts periodically.
+  _M_attempt_timer.expires_in(attempt_delay * 1000);
+
+  ::ReleaseSRWLockExclusive(&_M_race_lock);
+
+  // Start the first attempt.
+  start_attempt();
 }
 
-void proxy::connection::client::close()
+void proxy::connection::client::reset()
+{
+  ::InterlockedExchange(&_M_upstream, upstream_free);
+}
+
+bool proxy::connection::client::preconnect()
 {
-  // Lock mutex.
-  while (::InterlockedCompareExchange(&_M_mutex, 1, 0) != 0);
+  // If the upstream connection is not free...
+  if (::InterlockedCompareExchange(&_M_upstream,
+                                   upstream_connecting,
+                                   upstream_free) != upstream_free) {
+    return false;
+  }
+
+  _M_acceptor.add_upstream();
+
+  // Connect.
+  connect();
 
-  // If the connection is open...
-  if (_M_open) {
-    _M_open = false;
+  return true;
+}
 
-    // Unlock mutex.
-    ::InterlockedDecrement(&_M_mutex);
+uint32_t proxy::connection::client::claim()
+{
+  do {
+    const uint32_t upstream = _M_upstream;
+
+    // If the upstream connection is being pre-connected, the server
+    // connection waits for it; otherwise it is taken.
+    const uint32_t newupstream = (upstream == upstream_connecting) ?
+                                 upstream_waiting :
+                                 upstream_busy;
+
+    if (::InterlockedCompareExchange(&_M_upstream,
+                                     newupstream,
+                                     upstream) == upstream) {
+      // If the upstream connection was pre-connected...
+      if (upstream != upstream_free) {
+        _M_acceptor.remove_upstream();
+
+        // Pre-connect another upstream connection.
+        _M_acceptor.refill();
+      }
+
+      return upstream;
+    }
+  } while (true);
+}
 
+void proxy::connection::client::forward()
+{
+  // Send data to the server.
+  _M_server.send(_M_recvbuf, _M_pending);
+}
+
+void proxy::connection::client::close()
+{
+  // If the connection was open...
+  if (_M_state.close()) {
 #if DEBUG
     print("[client] Closing connection...\n");
 #endif
 
     // Cancel outstanding requests.
-    _M_sock.cancel(async::stream::socket::operation::receive);
-    _M_sock.cancel(async::stream::socket::operation::send);
+    sock().cancel(async::stream::socket::operation::receive);
+    sock().cancel(async::stream::socket::operation::send);
 
-    // Disconnect.
-    _M_sock.disconnect();
-  } else {
-    // Unlock mutex.
-    ::InterlockedDecrement(&_M_mutex);
+    // Release our reference (the last reference disconnects).
+    release();
   }
 }
 
 void proxy::connection::client::receive()
 {
-  // Start an asynchronous receive.
-  _M_sock.receive(_M_recvbuf, sizeof(_M_recvbuf));
+  // If the connection is still open...
+  if (_M_state.acquire()) {
+    // Start an asynchronous receive.
+    sock().receive(_M_recvbuf, sizeof(_M_recvbuf));
+  }
 }
 
 void proxy::connection::client::send(const void* buf, DWORD len)
@@ -451,14 +876,30 @@ void proxy::connection::client::send(const void* buf, DWORD len)
   _M_sendbuf.data = static_cast<const uint8_t*>(buf);
   _M_sendbuf.length = len;
 
-  // Start an asynchronous send.
-  _M_sock.send(buf, len);
+  // If the connection is still open...
+  if (_M_state.acquire()) {
+    // Start an asynchronous send.
+    sock().send(buf, len);
+  }
 }
 
-void proxy::connection::client::complete(async::stream::socket::operation op,
+void proxy::connection::client::complete(size_t index,
+                                         async::stream::socket::operation op,
                                          DWORD error,
                                          DWORD transferred)
 {
+  // If a connect attempt has completed...
+  if (op == async::stream::socket::operation::connect) {
+    attempt_completed(index, error);
+    return;
+  }
+
+  // If the socket has lost a race (it has been disconnected)...
+  if ((op == async::stream::socket::operation::disconnect) &&
+      (discarded(index))) {
+    return;
+  }
+
   // Success?
   if (error == 0) {
     switch (op) {
@@ -482,10 +923,6 @@ void proxy::connection::client::complete(async::stream::socket::operation op,
 
         break;
       case async::stream::socket::operation::connect:
-        // Connected.
-        connected();
-
-        break;
       case async::stream::socket::operation::accept:
       default:
         break;
@@ -495,6 +932,15 @@ void proxy::connection::client::complete(async::stream::socket::operation op,
 
     switch (op) {
       case async::stream::socket::operation::receive:
+        if (error != WSA_OPERATION_ABORTED) {
+          // If the upstream connection was not idle...
+          if (!idle_completed(error, 0)) {
+            // Close server and client connections.
+            _M_server.close_connections();
+          }
+        }
+
+        break;
       case async::stream::socket::operation::send:
         if (error != WSA_OPERATION_ABORTED) {
           // Close server and client connections.
@@ -508,15 +954,223 @@ void proxy::connection::client::complete(async::stream::socket::operation op,
 
         break;
       case async::stream::socket::operation::connect:
-        // Close server connection.
-        _M_server.close();
-
-        break;
       case async::stream::socket::operation::accept:
       default:
         break;
     }
   }
+
+  // If a receive or a send has completed...
+  if ((op == async::stream::socket::operation::receive) ||
+      (op == async::stream::socket::operation::send)) {
+    release();
+  }
+}
+
+async::stream::basic_socket<proxy::connection::client::socket_handler>&
+proxy::connection::client::sock()
+{
+  return _M_socks[_M_active];
+}
+
+void proxy::connection::client::start_attempt()
+{
+  ::AcquireSRWLockExclusive(&_M_race_lock);
+
+  // If the race is over...
+  if (_M_winner != 0) {
+    ::ReleaseSRWLockExclusive(&_M_race_lock);
+    return;
+  }
+
+  // Look for a socket which is not busy (the socket which lost the
+  // previous race might still be disconnecting).
+  size_t index;
+  for (index = 0;
+       (index < nsockets) && (_M_attempt[index].state != attempt_idle);
+       index++);
+
+  // If all the sockets are busy...
+  if (index == nsockets) {
+    ::ReleaseSRWLockExclusive(&_M_race_lock);
+    return;
+  }
+
+  socket::address addr;
+
+  // If there are addresses left...
+  if (_M_acceptor.backends().address(_M_backend, _M_next_address, addr)) {
+    attempt& a = _M_attempt[index];
+
+    a.state = attempt_connecting;
+    a.race = _M_race;
+    a.started = ::GetTickCount64();
+
+    _M_last_attempt = a.started;
+    _M_attempts++;
+
+#if DEBUG
+    const size_t n = _M_next_address;
+#endif
+
+    _M_next_address++;
+
+    ::ReleaseSRWLockExclusive(&_M_race_lock);
+
+#if DEBUG
+    print("[client] Connect attempt to address %zu...\n", n);
+#endif
+
+    // Connect (outside of the lock: the connect might complete inline).
+    _M_socks[index].connect(addr);
+
+    return;
+  }
+
+  // If no attempt is in progress anymore, the race has failed.
+  const bool failed = (_M_attempts == 0);
+  if (failed) {
+    _M_winner = race_failed;
+  }
+
+  ::ReleaseSRWLockExclusive(&_M_race_lock);
+
+  if (failed) {
+    attempts_failed();
+  }
+}
+
+void proxy::connection::client::attempt_completed(size_t index, DWORD error)
+{
+  ::AcquireSRWLockExclusive(&_M_race_lock);
+
+  attempt& a = _M_attempt[index];
+
+  // If the attempt belongs to the current race and the race is not over...
+  if ((a.race == _M_race) && (_M_winner == 0)) {
+    _M_attempts--;
+
+    a.state = attempt_idle;
+
+    // Success?
+    if (error == 0) {
+      // The attempt has won the race.
+      _M_winner = index + 1;
+      _M_active = index;
+
+      // Cancel the other attempts (their completions lose the race).
+      for (size_t i = 0; i < nsockets; i++) {
+        if ((i != index) && (_M_attempt[i].state == attempt_connecting)) {
+          _M_socks[i].cancel(async::stream::socket::operation::connect);
+        }
+      }
+
+      ::ReleaseSRWLockExclusive(&_M_race_lock);
+
+      // Connected.
+      connected();
+    } else {
+      ::ReleaseSRWLockExclusive(&_M_race_lock);
+
+      print("[client] Connect attempt failed (error %lu).\n", error);
+
+      // Try the next address.
+      start_attempt();
+    }
+
+    return;
+  }
+
+  // The attempt has lost the race (the socket is busy until it is
+  // disconnected).
+  a.state = (error == 0) ? attempt_discarding : attempt_idle;
+
+  ::ReleaseSRWLockExclusive(&_M_race_lock);
+
+  if (error == 0) {
+    // Disconnect.
+    _M_socks[index].disconnect();
+  }
+}
+
+bool proxy::connection::client::discarded(size_t index)
+{
+  ::AcquireSRWLockExclusive(&_M_race_lock);
+
+  attempt& a = _M_attempt[index];
+
+  const bool ret = (a.state == attempt_discarding);
+  if (ret) {
+    a.state = attempt_idle;
+  }
+
+  ::ReleaseSRWLockExclusive(&_M_race_lock);
+
+  return ret;
+}
+
+void proxy::connection::client::attempts_failed()
+{
+  // Passive health checking.
+  _M_acceptor.backends().failed(_M_backend);
+
+  // The connection to the backend has finished.
+  _M_acceptor.backends().release(_M_backend);
+
+  connect_failed();
+}
+
+void proxy::connection::client::attempt_timer()
+{
+  const uint64_t now = ::GetTickCount64();
+  const uint64_t timeout = _M_acceptor.config().connect_timeout;
+
+  ::AcquireSRWLockExclusive(&_M_race_lock);
+
+  // If the race is over...
+  if (_M_winner != 0) {
+    ::ReleaseSRWLockExclusive(&_M_race_lock);
+    return;
+  }
+
+  const uint32_t race = _M_race;
+
+  // Next time the attempts have to be checked.
+  uint64_t next = now + attempt_delay;
+
+  for (size_t i = 0; i < nsockets; i++) {
+    const attempt& a = _M_attempt[i];
+
+    // If the attempt is in progress...
+    if ((a.state == attempt_connecting) && (a.race == race)) {
+      // If the attempt has timed out...
+      if (now - a.started >= timeout) {
+        // Cancel it (its completion tries the next address).
+        _M_socks[i].cancel(async::stream::socket::operation::connect);
+      } else if (a.started + timeout < next) {
+        next = a.started + timeout;
+      }
+    }
+  }
+
+  // Has the last attempt started long enough ago?
+  const bool start = (now - _M_last_attempt >= attempt_delay);
+
+  ::ReleaseSRWLockExclusive(&_M_race_lock);
+
+  if (start) {
+    // Start the next attempt.
+    start_attempt();
+  }
+
+  ::AcquireSRWLockExclusive(&_M_race_lock);
+
+  // If the race is still running...
+  if ((_M_race == race) && (_M_winner == 0)) {
+    _M_attempt_timer.expires_in((next - now) * 1000);
+  }
+
+  ::ReleaseSRWLockExclusive(&_M_race_lock);
 }
 
 void proxy::connection::client::connected()
@@ -525,18 +1179,62 @@ void proxy::connection::client::connected()
   print("[client] Connected.\n");
 #endif
 
-  _M_open = true;
+  _M_state.open();
+
+  // Passive health checking.
+  _M_acceptor.backends().succeeded(_M_backend);
+
+  // If the upstream connection has been pre-connected...
+  if (::InterlockedCompareExchange(&_M_upstream,
+                                   upstream_ready,
+                                   upstream_connecting) ==
+      upstream_connecting) {
+    // Receive while idle, to notice if the remote host closes the
+    // connection.
+    receive();
+
+    return;
+  }
+
+  // If the server connection was waiting for it, it isn't anymore.
+  ::InterlockedExchange(&_M_upstream, upstream_busy);
 
   // Notify the server connection that the connection suceeded.
   _M_server.connected();
 }
 
+void proxy::connection::client::connect_failed()
+{
+  // If the upstream connection was being pre-connected...
+  if (::InterlockedCompareExchange(&_M_upstream,
+                                   upstream_free,
+                                   upstream_connecting) ==
+      upstream_connecting) {
+    // The server connection will connect when it accepts a connection.
+    _M_acceptor.remove_upstream();
+  } else {
+    // If the server connection was waiting for it, it isn't anymore.
+    ::InterlockedExchange(&_M_upstream, upstream_busy);
+
+    // Close server connection.
+    _M_server.close();
+
+    // The client connection won't be open.
+    _M_server.disconnected();
+  }
+}
+
 void proxy::connection::client::received(DWORD transferred)
 {
 #if DEBUG
   print("[client] Received %lu byte(s).\n", transferred);
 #endif
 
+  // If the upstream connection was idle...
+  if (idle_completed(0, transferred)) {
+    return;
+  }
+
   // If some data has been received...
   if (transferred > 0) {
 #if DEBUG
@@ -567,16 +1265,74 @@ void proxy::connection::client::sent(DWORD count)
 
 void proxy::connection::client::disconnected()
 {
-  // Notify the server that the connection has been disconnected.
-  _M_server.disconnected();
+  // The connection to the backend has finished.
+  _M_acceptor.backends().release(_M_backend);
+
+  const uint32_t upstream = _M_upstream;
+
+  // If an idle upstream connection has been lost...
+  if ((upstream == upstream_connecting) || (upstream == upstream_waiting)) {
+    // Connect again.
+    connect();
+  } else {
+    // Notify the server that the connection has been disconnected.
+    _M_server.disconnected();
+  }
 }
 
-void proxy::connection::client::complete(async::stream::socket::operation op,
-                                         DWORD error,
-                                         DWORD transferred,
-                                         void* user)
+bool proxy::connection::client::idle_completed(DWORD error,
+                                               DWORD transferred)
+{
+  // Data received while idle is kept until a connection is accepted;
+  // otherwise the remote host has closed the connection.
+  const bool lost = ((error != 0) || (transferred == 0));
+
+  _M_pending = transferred;
+
+  // If the upstream connection was not idle...
+  if (::InterlockedCompareExchange(&_M_upstream,
+                                   lost ? upstream_connecting :
+                                          upstream_buffered,
+                                   upstream_ready) != upstream_ready) {
+    return false;
+  }
+
+  // If the connection has been lost...
+  if (lost) {
+#if DEBUG
+    print("[client] Idle upstream connection lost.\n");
+#endif
+
+    // Close connection (it is connected again once disconnected).
+    close();
+  }
+
+  return true;
+}
+
+void proxy::connection::client::release()
 {
-  static_cast<client*>(user)->complete(op, error, transferred);
+  // If this was the last reference of a closing connection...
+  if (_M_state.release()) {
+    // Disconnect.
+    sock().disconnect();
+  }
+}
+
+proxy::connection::client::socket_handler::socket_handler(client* c,
+                                                          size_t index)
+  : _M_client{c},
+    _M_index{index}
+{
+}
+
+void proxy::connection::client::socket_handler::operator()(
+  async::stream::socket::operation op,
+  DWORD error,
+  DWORD transferred
+) const
+{
+  _M_client->complete(_M_index, op, error, transferred);
 }
 
 
@@ -589,8 +1345,11 @@ void proxy::connection::client::complete(async::stream::socket::operation op,
 ////////////////////////////////////////////////////////////////////////////////
 
 proxy::acceptor::acceptor(const configuration& config,
-                          PTP_CALLBACK_ENVIRON callbackenv)
-  : _M_sock{nullptr, nullptr, callbackenv},
+                          async::thread_pool& thread_pool,
+                          acceptor* primary)
+  : _M_sock{nullptr, nullptr, thread_pool.callback_environment()},
+    _M_primary{primary},
+    _M_thread_pool{thread_pool},
     _M_config{config}
 {
 }
@@ -599,66 +1358,120 @@ proxy::acceptor::~acceptor()
 {
   if (_M_connections) {
     for (size_t i = 0; i < _M_nconnections; i++) {
-      delete _M_connections[i];
+      _M_slab.destroy(_M_connections[i]);
     }
 
     free(_M_connections);
   }
+
+  free(_M_parked);
 }
 
 bool proxy::acceptor::listen(const socket::address& local,
-                             const socket::address& remote,
-                             PTP_CALLBACK_ENVIRON callbackenv)
+                             const balancer::addresses* backends,
+                             size_t nbackends,
+                             balancer::policy policy)
 {
-  // Listen.
-  if (_M_sock.listen(local)) {
+  // Listen (unless the socket of the primary acceptor is used).
+  if ((_M_primary) || (_M_sock.listen(local))) {
     _M_connections = static_cast<connection**>(
-                       malloc(_M_config.nconnections * sizeof(connection*))
+                       malloc(_M_config.maxconnections * sizeof(connection*))
                      );
 
-    if (_M_connections) {
-      for (_M_nconnections = 0;
-           _M_nconnections < _M_config.nconnections;
-           _M_nconnections++) {
-        // Create connection.
-        connection* const conn = new (std::nothrow) connection{*this,
-                                                               callbackenv};
-
-        // If the connection could be created...
-        if (conn) {
-          if (conn->create(callbackenv)) {
-            // Start an asynchronous accept.
-            conn->accept();
-
-            // Save connection.
-            _M_connections[_M_nconnections] = conn;
-          } else {
-            delete conn;
-            return false;
-          }
-        } else {
+    _M_parked = static_cast<connection**>(
+                  malloc(_M_config.maxconnections * sizeof(connection*))
+                );
+
+    // Create slab allocator of connections (on the NUMA node of the
+    // threads), allocating `nconnections` connections at a time.
+    if ((_M_connections) &&
+        (_M_parked) &&
+        (_M_slab.create(sizeof(connection),
+                        _M_config.nconnections,
+                        _M_thread_pool.numa_node(),
+                        _M_config.large_pages)) &&
+        ((_M_primary) ||
+         ((_M_balancer.create(backends,
+                              nbackends,
+                              policy,
+                              &_M_config.health,
+                              _M_thread_pool.callback_environment())) &&
+          (resolve(backends, nbackends))))) {
+      // Create the initial connections.
+      return (grow(_M_config.nconnections) == _M_config.nconnections);
+    }
+  }
+
+  return false;
+}
+
+bool proxy::acceptor::resolve(const balancer::addresses* backends,
+                              size_t nbackends)
+{
+  // Create resolver.
+  if (_M_resolver.create(_M_config.custom_dns_server ?
+                           &_M_config.dns_server :
+                           nullptr)) {
+    for (size_t i = 0; i < nbackends; i++) {
+      // If the backend is a host name...
+      if (backends[i].host) {
+        const size_t id = _M_resolver.add(backends[i].host,
+                                          backends[i].port,
+                                          resolved,
+                                          this);
+
+        if (id == dns::resolver::none) {
           return false;
         }
+
+        _M_hosts[id] = i;
       }
+    }
 
-      // Save remote address.
-      _M_remote = remote;
+    // Start resolving (the queries complete on the threads of the DNS
+    // client, never on the threads of the acceptor).
+    _M_resolver.start();
 
-      return true;
-    }
+    return true;
   }
 
   return false;
 }
 
+void proxy::acceptor::resolved(size_t id,
+                               const socket::address* addrs,
+                               size_t count,
+                               void* user)
+{
+  acceptor* const a = static_cast<acceptor*>(user);
+
+#if DEBUG
+  print("[acceptor] Backend %zu resolved (%zu addresses).\n",
+        a->_M_hosts[id],
+        count);
+#endif
+
+  a->_M_balancer.update(a->_M_hosts[id], addrs, count);
+}
+
 async::stream::socket& proxy::acceptor::socket()
 {
-  return _M_sock;
+  return _M_primary ? _M_primary->_M_sock : _M_sock;
+}
+
+bool proxy::acceptor::secondary() const
+{
+  return (_M_primary != nullptr);
+}
+
+PTP_CALLBACK_ENVIRON proxy::acceptor::callback_environment()
+{
+  return _M_thread_pool.callback_environment();
 }
 
-const socket::address& proxy::acceptor::remote() const
+balancer& proxy::acceptor::backends()
 {
-  return _M_remote;
+  return _M_primary ? _M_primary->_M_balancer : _M_balancer;
 }
 
 const proxy::configuration& proxy::acceptor::config() const
@@ -666,6 +1479,151 @@ const proxy::configuration& proxy::acceptor::config() const
   return _M_config;
 }
 
+void proxy::acceptor::accepted()
+{
+  const size_t accepting = ::InterlockedDecrement(&_M_accepting);
+
+  // If few connections are waiting for a connection and the acceptor might
+  // grow...
+  if ((accepting < (_M_config.nconnections + 3) / 4) &&
+      (_M_active < _M_config.maxconnections)) {
+    grow(_M_config.nconnections);
+  }
+}
+
+bool proxy::acceptor::closed(connection& conn)
+{
+  // If enough connections are waiting for a connection...
+  if (_M_accepting >= _M_config.nconnections) {
+    do {
+      const uint32_t active = _M_active;
+
+      // If the acceptor cannot shrink...
+      if (active <= _M_config.nconnections) {
+        break;
+      }
+
+      if (::InterlockedCompareExchange(&_M_active,
+                                       active - 1,
+                                       active) == active) {
+        // Park connection.
+        ::AcquireSRWLockExclusive(&_M_lock);
+        _M_parked[_M_nparked++] = &conn;
+        ::ReleaseSRWLockExclusive(&_M_lock);
+
+        return false;
+      }
+    } while (true);
+  }
+
+  ::InterlockedIncrement(&_M_accepting);
+
+  return true;
+}
+
+size_t proxy::acceptor::grow(size_t count)
+{
+  // If another thread is already growing the acceptor...
+  if (::InterlockedCompareExchange(&_M_growing, 1, 0) != 0) {
+    return 0;
+  }
+
+  size_t i;
+  for (i = 0; (i < count) && (_M_active < _M_config.maxconnections); i++) {
+    connection* conn = nullptr;
+
+    // Reuse a parked connection (if any).
+    ::AcquireSRWLockExclusive(&_M_lock);
+    if (_M_nparked > 0) {
+      conn = _M_parked[--_M_nparked];
+    }
+    ::ReleaseSRWLockExclusive(&_M_lock);
+
+    // If there are no parked connections...
+    if (!conn) {
+      // Create connection.
+      if ((conn = create_connection()) == nullptr) {
+        break;
+      }
+
+      // Save connection and publish it (refill() might be reading the
+      // connections from another thread).
+      _M_connections[_M_nconnections] = conn;
+      ::InterlockedExchange(&_M_nconnections, _M_nconnections + 1);
+    }
+
+    ::InterlockedIncrement(&_M_active);
+    ::InterlockedIncrement(&_M_accepting);
+
+    // Start an asynchronous accept.
+    conn->accept();
+  }
+
+  ::InterlockedExchange(&_M_growing, 0);
+
+  // Pre-connect upstream connections (if needed).
+  refill();
+
+  return i;
+}
+
+void proxy::acceptor::refill()
+{
+  // If enough upstream connections are pre-connected, the backend depends
+  // on the client, no backend is healthy or another thread is already
+  // pre-connecting...
+  if ((_M_upstreams >= _M_config.upstreams) ||
+      (backends().hashed()) ||
+      (!backends().healthy()) ||
+      (::InterlockedCompareExchange(&_M_refilling, 1, 0) != 0)) {
+    return;
+  }
+
+  // Only the connections which have been published.
+  const size_t nconnections = ::InterlockedCompareExchange(&_M_nconnections,
+                                                           0,
+                                                           0);
+
+  for (size_t i = 0;
+       (i < nconnections) && (_M_upstreams < _M_config.upstreams);
+       i++) {
+    // Pre-connect the upstream connection of the next connection (if it is
+    // waiting for a connection).
+    _M_connections[_M_next++ % nconnections]->preconnect();
+  }
+
+  ::InterlockedExchange(&_M_refilling, 0);
+}
+
+void proxy::acceptor::add_upstream()
+{
+  ::InterlockedIncrement(&_M_upstreams);
+}
+
+void proxy::acceptor::remove_upstream()
+{
+  ::InterlockedDecrement(&_M_upstreams);
+}
+
+proxy::connection* proxy::acceptor::create_connection()
+{
+  PTP_CALLBACK_ENVIRON callbackenv = _M_thread_pool.callback_environment();
+
+  // Create connection.
+  connection* const conn = _M_slab.construct<connection>(*this, callbackenv);
+
+  // If the connection could be created...
+  if (conn) {
+    if (conn->create(callbackenv)) {
+      return conn;
+    }
+
+    _M_slab.destroy(conn);
+  }
+
+  return nullptr;
+}
+
 
 ////////////////////////////////////////////////////////////////////////////////
 ////////////////////////////////////////////////////////////////////////////////
@@ -678,8 +1636,10 @@ const proxy::configuration& proxy::acceptor::config() const
 proxy::acceptors::~acceptors()
 {
   if (_M_acceptors) {
-    for (size_t i = 0; i < _M_used; i++) {
-      delete _M_acceptors[i];
+    // Delete the acceptors in reverse order (secondary acceptors use the
+    // socket of their primary acceptor).
+    for (size_t i = _M_used; i > 0; i--) {
+      destroy(_M_acceptors[i - 1]);
     }
 
     free(_M_acceptors);
@@ -687,31 +1647,52 @@ proxy::acceptors::~acceptors()
 }
 
 bool proxy::acceptors::listen(const socket::address& local,
-                              const socket::address& remote,
+                              const balancer::addresses* backends,
+                              size_t nbackends,
+                              balancer::policy policy,
                               const configuration& config,
-                              PTP_CALLBACK_ENVIRON callbackenv)
+                              async::thread_pool* thread_pools,
+                              size_t count)
 {
-  // If space for a new acceptor can be allocated...
-  if (allocate()) {
+  // Primary acceptor.
+  proxy::acceptor* primary = nullptr;
+
+  for (size_t i = 0; i < count; i++) {
+    // If space for a new acceptor cannot be allocated...
+    if (!allocate()) {
+      return false;
+    }
+
+    // Allocate acceptor (aligned: operator new doesn't honor the cache line
+    // alignment of the counters of its balancer before C++17).
+    void* const mem = _aligned_malloc(sizeof(proxy::acceptor),
+                                      alignof(proxy::acceptor));
+
+    // If the acceptor could not be allocated...
+    if (!mem) {
+      return false;
+    }
+
     // Create acceptor.
     proxy::acceptor* const
-      acceptor = new (std::nothrow) proxy::acceptor{config, callbackenv};
-
-    // If the acceptor could be created...
-    if (acceptor) {
-      // Listen.
-      if (acceptor->listen(local, remote, callbackenv)) {
-        // Save acceptor.
-        _M_acceptors[_M_used++] = acceptor;
-
-        return true;
-      } else {
-        delete acceptor;
-      }
+      acceptor = new (mem) proxy::acceptor{config, thread_pools[i], primary};
+
+    // Listen.
+    if (!acceptor->listen(local, backends, nbackends, policy)) {
+      destroy(acceptor);
+      return false;
+    }
+
+    // Save acceptor.
+    _M_acceptors[_M_used++] = acceptor;
+
+    // The first acceptor is the primary acceptor.
+    if (!primary) {
+      primary = acceptor;
     }
   }
 
-  return false;
+  return true;
 }
 
 bool proxy::acceptors::allocate()
@@ -736,5 +1717,11 @@ bool proxy::acceptors::allocate()
   }
 }
 
+void proxy::acceptors::destroy(acceptor* a)
+{
+  a->~acceptor();
+  _aligned_free(a);
+}
+
 } // namespace tcp
 } // namespace net
\ No newline at end of file
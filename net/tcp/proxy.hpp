@@ -3,7 +3,11 @@
 #include <stdint.h>
 #include "net/async/thread_pool.hpp"
 #include "net/async/stream/socket.hpp"
+#include "net/tcp/balancer.hpp"
+#include "net/dns/resolver.hpp"
 #include "util/timer.hpp"
+#include "util/lifecycle.hpp"
+#include "util/slab.hpp"
 
 namespace net {
 namespace tcp {
@@ -15,11 +19,17 @@ class proxy {
     static constexpr const size_t min_connections = 1;
 
     // Maximum number of connections per acceptor.
-    static constexpr const size_t max_connections = 4096;
+    static constexpr const size_t max_connections = 64 * 1024;
 
-    // Default number of connections per acceptor.
+    // Default number of connections per acceptor (low watermark: the
+    // connections created when listening, which are always kept).
     static constexpr const size_t default_connections = 256;
 
+    // Default maximum number of connections per acceptor (high watermark:
+    // the acceptor grows up to this number of connections under accept
+    // pressure).
+    static constexpr const size_t default_max_connections = 4096;
+
     // Minimum connection timeout (seconds).
     static constexpr const uint64_t min_timeout = 5;
 
@@ -29,6 +39,18 @@ class proxy {
     // Default connection timeout (seconds).
     static constexpr const uint64_t default_timeout = 30;
 
+    // Minimum timeout of a connect attempt (milliseconds).
+    static constexpr const uint32_t min_connect_timeout = 100;
+
+    // Maximum timeout of a connect attempt (milliseconds).
+    static constexpr const uint32_t max_connect_timeout = 60 * 1000;
+
+    // Default timeout of a connect attempt (milliseconds).
+    static constexpr const uint32_t default_connect_timeout = 3 * 1000;
+
+    // Maximum number of cores (thread-per-core mode).
+    static constexpr const size_t max_cores = async::thread_pool::max_threads;
+
     // Constructor.
     proxy() = default;
 
@@ -39,22 +61,132 @@ class proxy {
     bool create(DWORD minthreads = async::thread_pool::min_threads,
                 DWORD maxthreads = async::thread_pool::default_max_threads,
                 size_t nconnections = default_connections,
-                uint64_t timeout = default_timeout);
+                size_t maxconnections = default_max_connections,
+                uint64_t timeout = default_timeout,
+                const async::thread_pool::placement* placement = nullptr,
+                bool large_pages = false);
+
+    // Create in thread-per-core mode.
+    // Every processor runs its own single-threaded pool, pinned to it. Each
+    // pool owns a share of the connections of every acceptor (allocated on
+    // its NUMA node) and their timers, so a connection never migrates to
+    // another processor. `nconnections` and `maxconnections` are split
+    // between the cores.
+    bool create_per_core(size_t nconnections = default_connections,
+                         size_t maxconnections = default_max_connections,
+                         uint64_t timeout = default_timeout,
+                         bool large_pages = false);
+
+    // Set the number of upstream connections which each acceptor keeps
+    // pre-connected to the backends (split between the cores in
+    // thread-per-core mode), so that accepted connections don't wait for a
+    // TCP handshake. 0 (default) connects on accept.
+    // Has to be called after create() and before listen(). Upstream
+    // connections are not pre-connected with
+    // `balancer::policy::consistent_hash` (the backend depends on the
+    // client).
+    bool preconnect(size_t count);
+
+    // Set the health checking of the backends (see `balancer`): backends
+    // are ejected after `max_failures` consecutive failed connects (0:
+    // never) for `ejection_time` seconds, and probed every
+    // `probe_interval` seconds (0: no probes). While all the backends are
+    // ejected, accepted connections are closed at once.
+    // Has to be called after create() and before listen().
+    void health_check(uint32_t max_failures,
+                      uint32_t ejection_time,
+                      uint32_t probe_interval);
+
+    // Set the timeout of every connect attempt to a backend address
+    // (milliseconds). When a backend has several addresses, they are raced
+    // as described in RFC 8305 (Happy Eyeballs): the next address is tried
+    // when the previous attempt fails or hasn't connected within 250 ms.
+    // Has to be called after create() and before listen().
+    bool connect_timeout(uint32_t timeout);
+
+    // Send the DNS queries which resolve the host names of the backends to
+    // `server` (for instance, a local stub DNS server) instead of the DNS
+    // servers of the system.
+    // Has to be called after create() and before listen().
+    bool dns_server(const socket::address& server);
 
     // Listen.
     bool listen(const socket::address& local, const socket::address& remote);
 
+    // Listen and balance the connections between several backends.
+    // The host names of the backends are resolved asynchronously (see
+    // `dns::resolver`) and kept up to date: a backend is not selected until
+    // its name has been resolved.
+    bool listen(const socket::address& local,
+                const balancer::addresses* backends,
+                size_t nbackends,
+                balancer::policy policy = balancer::policy::round_robin);
+
   private:
     // Thread pool.
     async::thread_pool _M_thread_pool;
 
+    // Thread pools of the cores (thread-per-core mode).
+    class cores {
+      public:
+        // Constructor.
+        cores() = default;
+
+        // Destructor.
+        ~cores();
+
+        // Create one thread pool per processor.
+        bool create();
+
+        // Get thread pools.
+        async::thread_pool* thread_pools();
+
+        // Get number of thread pools.
+        size_t count() const;
+
+      private:
+        // Thread pools.
+        async::thread_pool* _M_thread_pools = nullptr;
+
+        // Number of thread pools.
+        size_t _M_count = 0;
+
+        // Disable copy constructor and assignment operator.
+        cores(const cores&) = delete;
+        cores& operator=(const cores&) = delete;
+    };
+
+    cores _M_cores;
+
     // Configuration.
     struct configuration {
-      // Number of connections per acceptor.
+      // Number of connections per acceptor (per core in thread-per-core
+      // mode).
       size_t nconnections;
 
+      // Maximum number of connections per acceptor (per core in
+      // thread-per-core mode).
+      size_t maxconnections;
+
       // Connection timeout (seconds).
       uint64_t timeout;
+
+      // Allocate the connections on large pages?
+      bool large_pages;
+
+      // Number of pre-connected upstream connections per acceptor (per
+      // core in thread-per-core mode).
+      size_t upstreams;
+
+      // Health checking of the backends.
+      balancer::health_check health;
+
+      // Timeout of a connect attempt (milliseconds).
+      uint32_t connect_timeout;
+
+      // DNS server (if `custom_dns_server`).
+      socket::address dns_server;
+      bool custom_dns_server;
     };
 
     configuration _M_config;
@@ -78,6 +210,11 @@ class proxy {
         // Accept connection.
         void accept();
 
+        // Pre-connect the upstream connection.
+        // Returns false if the connection is not waiting for a connection
+        // or its upstream connection is not free.
+        bool preconnect();
+
       private:
         // Buffer size.
         static constexpr const size_t buffer_size = 32 * 1024;
@@ -95,7 +232,8 @@ class proxy {
         class server {
           public:
             // Constructor.
-            server(acceptor& acceptor,
+            server(connection& connection,
+                   acceptor& acceptor,
                    client& client,
                    PTP_CALLBACK_ENVIRON callbackenv = nullptr);
 
@@ -131,40 +269,66 @@ class proxy {
             static constexpr const
               DWORD address_length = sizeof(struct sockaddr_storage) + 16;
 
-            // Socket.
-            async::stream::socket _M_sock;
+            // Notify of a completed socket I/O operation.
+            void complete(async::stream::socket::operation op,
+                          DWORD error,
+                          DWORD transferred);
 
-            // Buffer for storing the local and remote addresses.
-            uint8_t _M_addresses[2 * address_length];
+            // Timer.
+            void timer();
 
-            // Acceptor.
-            acceptor& _M_acceptor;
+            // Handle a completed accept on the thread pool of the acceptor.
+            static void CALLBACK accept_callback(PTP_CALLBACK_INSTANCE instance,
+                                                 void* context);
 
-            // Client.
-            client& _M_client;
+            // The state written by the threads of both sides of the
+            // connection comes first, on its own cache line.
 
-            // Receive buffer.
-            uint8_t _M_recvbuf[buffer_size];
+            // Lifecycle of the server connection.
+            alignas(util::cache_line_size) util::lifecycle _M_state;
+
+            // Number of open connections.
+            uint32_t _M_nconnections;
 
             // Send buffer view.
             buffer_view _M_sendbuf;
 
-            // Number of open connections.
-            uint32_t _M_nconnections;
+            // Socket.
+            alignas(util::cache_line_size) async::stream::basic_socket<
+              async::stream::member_handler<server, &server::complete>
+            > _M_sock;
 
             // Timer.
-            util::timer _M_timer;
+            util::basic_timer<
+              util::timer_member_handler<server, &server::timer>
+            > _M_timer;
+
+            // Connection.
+            connection& _M_connection;
 
-            // Is the connection open?
-            bool _M_open = false;
+            // Acceptor.
+            acceptor& _M_acceptor;
 
-            // Mutex.
-            uint32_t _M_mutex = 0;
+            // Client.
+            client& _M_client;
 
-            // Notify of a completed socket I/O operation.
-            void complete(async::stream::socket::operation op,
-                          DWORD error,
-                          DWORD transferred);
+            // Buffer for storing the local and remote addresses.
+            uint8_t _M_addresses[2 * address_length];
+
+            // Result of the accept handed over to the thread pool of the
+            // acceptor.
+            DWORD _M_accept_error;
+
+            // Receive buffer.
+            alignas(util::cache_line_size) uint8_t _M_recvbuf[buffer_size];
+
+            // An accept has completed (on the thread pool of the listening
+            // socket).
+            void accept_completed(DWORD error);
+
+            // Handle a completed accept (on the thread pool of the
+            // acceptor).
+            void handle_accept(DWORD error);
 
             // Connection has been accepted.
             void accepted();
@@ -178,8 +342,8 @@ class proxy {
             // Data has been sent.
             void sent(DWORD count);
 
-            // Timer.
-            void timer();
+            // Release a reference to the server connection.
+            void release();
 
             // Start timer.
             void start_timer();
@@ -187,31 +351,68 @@ class proxy {
             // Stop timer.
             void stop_timer();
 
-            // Notify of a completed socket I/O operation.
-            static void complete(async::stream::socket::operation op,
-                                 DWORD error,
-                                 DWORD transferred,
-                                 void* user);
-
-            // Timer.
-            static void timer(util::timer& t, void* user);
-
             // Disable copy constructor and assignment operator.
             server(const server&) = delete;
             server& operator=(const server&) = delete;
         };
 
         // Client connection.
+        // While the server connection waits for a connection, the client
+        // connection might be pre-connected (upstream connection). An idle
+        // upstream connection keeps a receive outstanding, to notice when
+        // the remote host closes it (it is then connected again) or sends
+        // data (which is kept until a connection is accepted).
         class client {
           public:
+            // States of the upstream connection.
+            // In use by the server connection (or parked).
+            static constexpr const uint32_t upstream_busy = 0;
+
+            // Free (the server connection is waiting for a connection).
+            static constexpr const uint32_t upstream_free = 1;
+
+            // Being pre-connected.
+            static constexpr const uint32_t upstream_connecting = 2;
+
+            // Pre-connected and idle.
+            static constexpr const uint32_t upstream_ready = 3;
+
+            // Pre-connected, with received data.
+            static constexpr const uint32_t upstream_buffered = 4;
+
+            // Being pre-connected, the server connection waits for it.
+            static constexpr const uint32_t upstream_waiting = 5;
+
             // Constructor.
-            client(server& server, PTP_CALLBACK_ENVIRON callbackenv = nullptr);
+            client(server& server,
+                   acceptor& acceptor,
+                   PTP_CALLBACK_ENVIRON callbackenv = nullptr);
 
             // Destructor.
             ~client() = default;
 
-            // Connect.
-            void connect(const socket::address& addr);
+            // Create client connection.
+            bool create(PTP_CALLBACK_ENVIRON callbackenv = nullptr);
+
+            // Connect to the backend selected by the balancer.
+            // `key` is the hash of the address of the client (consistent
+            // hashing).
+            void connect(uint32_t key = 0);
+
+            // The server connection is about to wait for a connection: the
+            // upstream connection is free.
+            void reset();
+
+            // Pre-connect (if the upstream connection is free).
+            bool preconnect();
+
+            // A connection has been accepted: take the upstream connection.
+            // Returns the previous state of the upstream connection.
+            uint32_t claim();
+
+            // Send the data received while the upstream connection was idle
+            // to the server connection.
+            void forward();
 
             // Close connection.
             void close();
@@ -223,32 +424,151 @@ class proxy {
             void send(const void* buf, DWORD len);
 
           private:
-            // Socket.
-            async::stream::socket _M_sock;
+            // Number of sockets (connect attempts which can race).
+            static constexpr const size_t nsockets = 2;
 
-            // Server.
-            server& _M_server;
+            // Delay before starting the next connect attempt (milliseconds,
+            // "Connection Attempt Delay" of RFC 8305).
+            static constexpr const uint64_t attempt_delay = 250;
 
-            // Receive buffer.
-            uint8_t _M_recvbuf[buffer_size];
+            // Completion handler of a socket of the client connection.
+            class socket_handler {
+              public:
+                // Constructor.
+                socket_handler(client* c, size_t index);
 
-            // Send buffer view.
-            buffer_view _M_sendbuf;
+                // Invoke handler.
+                void operator()(async::stream::socket::operation op,
+                                DWORD error,
+                                DWORD transferred) const;
+
+              private:
+                // Client connection.
+                client* const _M_client;
+
+                // Index of the socket.
+                const size_t _M_index;
+            };
+
+            // The socket is not busy.
+            static constexpr const uint32_t attempt_idle = 0;
+
+            // The socket is connecting.
+            static constexpr const uint32_t attempt_connecting = 1;
 
-            // Is the connection open?
-            bool _M_open = false;
+            // The socket is disconnecting after losing a race.
+            static constexpr const uint32_t attempt_discarding = 2;
 
-            // Mutex.
-            uint32_t _M_mutex = 0;
+            // Connect attempt.
+            struct attempt {
+              // State of the socket.
+              uint32_t state;
+
+              // Race the attempt belongs to.
+              uint32_t race;
+
+              // Start time (milliseconds).
+              uint64_t started;
+            };
 
             // Notify of a completed socket I/O operation.
-            void complete(async::stream::socket::operation op,
+            void complete(size_t index,
+                          async::stream::socket::operation op,
                           DWORD error,
                           DWORD transferred);
 
+            // Attempt timer.
+            void attempt_timer();
+
+            // The state written by the threads of both sides of the
+            // connection comes first, on its own cache line.
+
+            // Lifecycle of the client connection.
+            alignas(util::cache_line_size) util::lifecycle _M_state;
+
+            // Send buffer view.
+            buffer_view _M_sendbuf;
+
+            // State of the upstream connection.
+            uint32_t _M_upstream = upstream_busy;
+
+            // Number of bytes received while the upstream connection was
+            // idle.
+            DWORD _M_pending = 0;
+
+            // Backend.
+            size_t _M_backend = 0;
+
+            // Socket carrying the connection (winner of the last race, set
+            // before the connection is used).
+            size_t _M_active = 0;
+
+            // The connect race is run by the attempt timer and by the
+            // connect completions of both sockets, on any thread of the
+            // pool: its state (up to the attempts) is guarded by
+            // `_M_race_lock`.
+            SRWLOCK _M_race_lock = SRWLOCK_INIT;
+
+            // Connect race: number of the race, winner (index of the socket
+            // + 1; `race_failed` if all the attempts have failed), attempts
+            // in progress and next address of the backend.
+            uint32_t _M_race = 0;
+            uint32_t _M_winner = 0;
+            uint32_t _M_attempts = 0;
+            uint32_t _M_next_address = 0;
+
+            // Start time of the last attempt (milliseconds).
+            uint64_t _M_last_attempt = 0;
+
+            // Connect attempts (one per socket).
+            attempt _M_attempt[nsockets];
+
+            // Sockets.
+            alignas(util::cache_line_size)
+              async::stream::basic_socket<socket_handler> _M_socks[nsockets];
+
+            // Attempt timer.
+            util::basic_timer<
+              util::timer_member_handler<client, &client::attempt_timer>
+            > _M_attempt_timer;
+
+            // Server.
+            server& _M_server;
+
+            // Acceptor.
+            acceptor& _M_acceptor;
+
+            // Receive buffer.
+            alignas(util::cache_line_size) uint8_t _M_recvbuf[buffer_size];
+
+            // All the attempts of the race have failed.
+            static constexpr const uint32_t race_failed = nsockets + 1;
+
+            // Get the socket carrying the connection.
+            async::stream::basic_socket<socket_handler>& sock();
+
+            // Start a connect attempt to the next address of the backend on
+            // a socket which is not busy (if the race is not over). If there
+            // are no addresses left and no attempt is in progress, the race
+            // has failed.
+            void start_attempt();
+
+            // A connect attempt has completed.
+            void attempt_completed(size_t index, DWORD error);
+
+            // A socket has been disconnected: returns true if it had lost a
+            // race (the socket is not busy anymore).
+            bool discarded(size_t index);
+
+            // All the attempts of the race have failed.
+            void attempts_failed();
+
             // Client connected.
             void connected();
 
+            // Client could not connect.
+            void connect_failed();
+
             // Data has been received.
             void received(DWORD transferred);
 
@@ -258,11 +578,13 @@ class proxy {
             // Disconnected.
             void disconnected();
 
-            // Notify of a completed socket I/O operation.
-            static void complete(async::stream::socket::operation op,
-                                 DWORD error,
-                                 DWORD transferred,
-                                 void* user);
+            // A receive has completed on the upstream connection.
+            // Returns false if the upstream connection was not idle (the
+            // completion belongs to the server connection).
+            bool idle_completed(DWORD error, DWORD transferred);
+
+            // Release a reference to the client connection.
+            void release();
 
             // Disable copy constructor and assignment operator.
             client(const client&) = delete;
@@ -281,45 +603,145 @@ class proxy {
     };
 
     // Acceptor.
+    // The connections of an acceptor run on its thread pool. Secondary
+    // acceptors (one per core in thread-per-core mode) share the listening
+    // socket of their primary acceptor: their accept completions are
+    // notified on the thread pool of the primary acceptor, and handed over
+    // to their own thread pool before the connection is touched.
+    // The acceptor starts with `nconnections` connections. When fewer than
+    // a quarter of them are waiting for a connection, it adds
+    // `nconnections` more (up to `maxconnections`). When a connection is
+    // closed while at least `nconnections` connections are waiting, it is
+    // parked (it doesn't accept connections anymore, so its socket is
+    // released) until the acceptor grows again.
     class acceptor {
       public:
         // Constructor.
         acceptor(const configuration& config,
-                 PTP_CALLBACK_ENVIRON callbackenv = nullptr);
+                 async::thread_pool& thread_pool,
+                 acceptor* primary = nullptr);
 
         // Destructor.
         ~acceptor();
 
         // Listen.
         bool listen(const socket::address& local,
-                    const socket::address& remote,
-                    PTP_CALLBACK_ENVIRON callbackenv = nullptr);
+                    const balancer::addresses* backends,
+                    size_t nbackends,
+                    balancer::policy policy);
 
         // Get acceptor socket.
         async::stream::socket& socket();
 
-        // Get remote address.
-        const socket::address& remote() const;
+        // Does the acceptor use the listening socket of a primary acceptor
+        // (whose thread pool is notified of the accept completions)?
+        bool secondary() const;
+
+        // Get the callback environment of the thread pool of the acceptor.
+        PTP_CALLBACK_ENVIRON callback_environment();
+
+        // Get balancer (shared with the primary acceptor).
+        balancer& backends();
 
         // Get configuration.
         const configuration& config() const;
 
+        // A connection has been accepted.
+        void accepted();
+
+        // A connection has been closed.
+        // Returns true if the connection should accept another connection,
+        // false if it has been parked.
+        bool closed(connection& conn);
+
+        // Pre-connect upstream connections of the connections waiting for a
+        // connection, up to `upstreams`.
+        void refill();
+
+        // An upstream connection is being pre-connected.
+        void add_upstream();
+
+        // A pre-connected upstream connection has been taken or could not
+        // be connected.
+        void remove_upstream();
+
       private:
         // Acceptor.
         async::stream::socket _M_sock;
 
-        // Connections.
+        // Primary acceptor (if this is a secondary acceptor).
+        acceptor* const _M_primary;
+
+        // Thread pool.
+        async::thread_pool& _M_thread_pool;
+
+        // Connections (`maxconnections` slots).
         connection** _M_connections = nullptr;
 
-        // Number of connections.
-        size_t _M_nconnections = 0;
+        // Number of connections (published after the slot has been
+        // written, as refill() reads it without growing).
+        uint32_t _M_nconnections = 0;
+
+        // Parked connections (`maxconnections` slots).
+        connection** _M_parked = nullptr;
+
+        // Number of parked connections.
+        size_t _M_nparked = 0;
+
+        // Lock of the parked connections.
+        SRWLOCK _M_lock = SRWLOCK_INIT;
+
+        // Number of connections which are not parked.
+        uint32_t _M_active = 0;
+
+        // Number of connections waiting for a connection.
+        uint32_t _M_accepting = 0;
+
+        // Is the acceptor growing?
+        uint32_t _M_growing = 0;
+
+        // Number of pre-connected upstream connections (including those
+        // being connected).
+        uint32_t _M_upstreams = 0;
+
+        // Is the acceptor pre-connecting upstream connections?
+        uint32_t _M_refilling = 0;
+
+        // Next connection to pre-connect.
+        size_t _M_next = 0;
 
-        // Remote address to connect to.
-        socket::address _M_remote;
+        // Allocator of connections.
+        util::slab _M_slab;
+
+        // Balancer of the backends.
+        balancer _M_balancer;
+
+        // Resolver of the host names of the backends (destroyed before the
+        // balancer).
+        dns::resolver _M_resolver;
+
+        // Backend of every name of the resolver.
+        size_t _M_hosts[balancer::max_backends];
 
         // Configuration.
         const configuration& _M_config;
 
+        // Add `count` connections (parked connections are reused first).
+        // Returns the number of connections which have been added.
+        size_t grow(size_t count);
+
+        // Create connection.
+        connection* create_connection();
+
+        // Start resolving the host names of the backends.
+        bool resolve(const balancer::addresses* backends, size_t nbackends);
+
+        // The addresses of a host name have changed.
+        static void resolved(size_t id,
+                             const socket::address* addrs,
+                             size_t count,
+                             void* user);
+
         // Disable copy constructor and assignment operator.
         acceptor(const acceptor&) = delete;
         acceptor& operator=(const acceptor&) = delete;
@@ -335,10 +757,14 @@ class proxy {
         ~acceptors();
 
         // Listen.
+        // Creates one acceptor per thread pool.
         bool listen(const socket::address& local,
-                    const socket::address& remote,
+                    const balancer::addresses* backends,
+                    size_t nbackends,
+                    balancer::policy policy,
                     const configuration& config,
-                    PTP_CALLBACK_ENVIRON callbackenv = nullptr);
+                    async::thread_pool* thread_pools,
+                    size_t count);
 
       private:
         // Allocation.
@@ -352,6 +778,9 @@ class proxy {
         // Allocate.
         bool allocate();
 
+        // Destroy acceptor.
+        static void destroy(acceptor* a);
+
         // Disable copy constructor and assignment operator.
         acceptors(const acceptors&) = delete;
         acceptors& operator=(const acceptors&) = delete;
@@ -25,6 +25,12 @@ static void print(const char* fmt, ...)
   ::InterlockedDecrement(&mutex);
 }
 
+// Request for moving a file to the final directory.
+struct move_request {
+  char oldpath[MAX_PATH];
+  char newpath[MAX_PATH];
+};
+
 
 ////////////////////////////////////////////////////////////////////////////////
 ////////////////////////////////////////////////////////////////////////////////
@@ -39,13 +45,18 @@ bool receiver::create(const char* tmpdir,
                       DWORD minthreads,
                       DWORD maxthreads,
                       size_t nconnections,
+                      size_t maxconnections,
                       uint64_t timeout,
                       uint64_t maxfilesize,
-                      uint64_t maxfileage)
+                      uint64_t maxfileage,
+                      size_t nworkers,
+                      const async::thread_pool::placement* placement,
+                      bool large_pages)
 {
   // Sanity checks.
   if ((nconnections >= min_connections) &&
-      (nconnections <= max_connections) &&
+      (nconnections <= maxconnections) &&
+      (maxconnections <= max_connections) &&
       (timeout >= min_timeout) &&
       (timeout <= max_timeout) &&
       (maxfilesize >= min_file_size) &&
@@ -62,11 +73,15 @@ bool receiver::create(const char* tmpdir,
           ((sbuf.st_mode & _S_IFDIR) != 0) &&
           (_stat64(finaldir, &sbuf) == 0) &&
           ((sbuf.st_mode & _S_IFDIR) != 0)) {
-        // Create thread pool.
-        if (_M_thread_pool.create(minthreads, maxthreads)) {
+        // Create thread pool and worker pool.
+        if ((_M_thread_pool.create(minthreads, maxthreads, placement)) &&
+            (_M_worker_pool.create(nworkers))) {
           // Save number of connections per acceptor.
           _M_config.nconnections = nconnections;
 
+          // Save maximum number of connections per acceptor.
+          _M_config.maxconnections = maxconnections;
+
           // Save directory where to store the temporary files.
           memcpy(_M_config.tmpdir, tmpdir, tmpdirlen + 1);
 
@@ -82,6 +97,12 @@ bool receiver::create(const char* tmpdir,
           // Save maximum file age.
           _M_config.maxfileage = maxfileage;
 
+          // Allocate the connections on the NUMA node of the threads.
+          _M_config.numa_node = _M_thread_pool.numa_node();
+
+          // Allocate the connections on large pages?
+          _M_config.large_pages = large_pages;
+
           return true;
         }
       }
@@ -95,6 +116,7 @@ bool receiver::listen(const socket::address& addr)
 {
   return _M_acceptors.listen(addr,
                              _M_config,
+                             _M_worker_pool,
                              _M_thread_pool.callback_environment());
 }
 
@@ -110,14 +132,16 @@ bool receiver::listen(const socket::address& addr)
 receiver::connection::connection(acceptor& acceptor,
                                  size_t nconnection,
                                  PTP_CALLBACK_ENVIRON callbackenv)
-  : _M_sock{complete, this, callbackenv},
+  : _M_sock{this, callbackenv},
+    _M_file{this},
+    _M_connection_timer{this},
+    _M_file_timer{this},
     _M_acceptor{acceptor},
-    _M_file{complete, this},
-    _M_connection_timer{connection_timer, this},
-    _M_file_timer{file_timer, this},
     _M_nconnection{nconnection},
     _M_callbackenv{callbackenv}
 {
+  // Register the buffer the files are written from with the files.
+  _M_file.io_range(_M_buf, sizeof(_M_buf));
 }
 
 bool receiver::connection::create()
@@ -152,6 +176,16 @@ bool receiver::connection::open_file()
     print("Opened file '%s'.\n", pathname);
 #endif
 
+    // If the buffer could not be registered with the file (reported
+    // once)...
+    static uint32_t reported = 0;
+    const DWORD error = _M_file.io_range_error();
+    if ((error != 0) && (::InterlockedExchange(&reported, 1) == 0)) {
+      print("Cannot register the buffers with the files (error %lu), their "
+            "pages are locked on every write.\n",
+            error);
+    }
+
     // Reset file size.
     _M_filesize = 0;
 
@@ -186,6 +220,11 @@ void receiver::connection::write_file(size_t len)
     }
   }
 
+  // The write holds its own reference to the connection, so that the
+  // connection is not disconnected (and the buffer reused) before the data
+  // has been written.
+  _M_state.retain();
+
   // Start an asynchronous write.
   _M_file.write(_M_buf, len);
 }
@@ -203,21 +242,24 @@ void receiver::connection::close_file(bool cancel_file_timer)
 
 void receiver::connection::close_connection(bool cancel_connection_timer)
 {
+  // If the connection was open...
+  if (_M_state.close()) {
 #if DEBUG
-  print("Closing connection...\n");
+    print("Closing connection...\n");
 #endif
 
-  // If the connection timer should be canceled...
-  if (cancel_connection_timer) {
-    // Cancel connection timer.
-    _M_connection_timer.cancel();
-  }
+    // If the connection timer should be canceled...
+    if (cancel_connection_timer) {
+      // Cancel connection timer.
+      _M_connection_timer.cancel();
+    }
 
-  // Cancel outstanding requests.
-  _M_sock.cancel(async::stream::socket::operation::receive);
+    // Cancel outstanding requests.
+    _M_sock.cancel(async::stream::socket::operation::receive);
 
-  // Disconnect.
-  _M_sock.disconnect();
+    // Release our reference (the last reference disconnects).
+    release();
+  }
 }
 
 void receiver::connection::error_writing_file()
@@ -257,14 +299,8 @@ void receiver::connection::complete(async::stream::socket::operation op,
   if (error == 0) {
     switch (op) {
       case async::stream::socket::operation::receive:
-        // If the connection mutex can be locked...
-        if (::InterlockedCompareExchange(&_M_connection_mutex, 1, 0) == 0) {
-          // Data has been received.
-          received(transferred);
-
-          // Unlock connection mutex.
-          ::InterlockedDecrement(&_M_connection_mutex);
-        }
+        // Data has been received.
+        received(transferred);
 
         break;
       case async::stream::socket::operation::disconnect:
@@ -277,6 +313,9 @@ void receiver::connection::complete(async::stream::socket::operation op,
 
         break;
       case async::stream::socket::operation::accept:
+        // Notify the acceptor.
+        _M_acceptor.accepted();
+
         // Connection has been accepted.
         accepted();
 
@@ -313,6 +352,11 @@ void receiver::connection::complete(async::stream::socket::operation op,
         break;
     }
   }
+
+  // If a receive has completed...
+  if (op == async::stream::socket::operation::receive) {
+    release();
+  }
 }
 
 void receiver::connection::complete(DWORD error, DWORD transferred)
@@ -325,6 +369,8 @@ void receiver::connection::complete(DWORD error, DWORD transferred)
     // Error writing to file.
     error_writing_file();
   }
+
+  release();
 }
 
 void receiver::connection::accepted()
@@ -340,6 +386,8 @@ void receiver::connection::accepted()
   }
 #endif // DEBUG
 
+  _M_state.open();
+
   // Start an asynchronous read.
   receive();
 }
@@ -349,8 +397,11 @@ void receiver::connection::receive()
   // Set connection timer.
   _M_connection_timer.expires_in(_M_acceptor.config().timeout * 1000 * 1000);
 
-  // Start an asynchronous read.
-  _M_sock.receive(_M_buf, sizeof(_M_buf));
+  // If the connection is still open...
+  if (_M_state.acquire()) {
+    // Start an asynchronous read.
+    _M_sock.receive(_M_buf, sizeof(_M_buf));
+  }
 }
 
 void receiver::connection::received(DWORD transferred)
@@ -416,55 +467,84 @@ void receiver::connection::written(DWORD count)
 
 void receiver::connection::disconnected()
 {
-  // Start another asynchronous accept.
-  accept();
+  // If the connection hasn't been parked...
+  if (_M_acceptor.closed(*this)) {
+    // Start another asynchronous accept.
+    accept();
+  }
+}
+
+void receiver::connection::release()
+{
+  // If this was the last reference of a closing connection...
+  if (_M_state.release()) {
+    // Disconnect.
+    _M_sock.disconnect();
+  }
 }
 
 bool receiver::connection::move_file()
 {
-  // Compose name of the old file.
-  char oldpath[MAX_PATH];
-  snprintf(oldpath,
-           sizeof(oldpath),
-           "%s\\file-%zu-%zu.bin",
-           _M_acceptor.config().tmpdir,
-           _M_nconnection,
-           _M_nfile);
+  // Create request.
+  move_request* const req = new (std::nothrow) move_request;
 
-  // Compose name of the new file.
-  char newpath[MAX_PATH];
-  snprintf(newpath,
-           sizeof(newpath),
-           "%s\\file-%zu-%zu.bin",
-           _M_acceptor.config().finaldir,
-           _M_nconnection,
-           _M_nfile);
+  // If the request could be created...
+  if (req) {
+    // Compose name of the old file.
+    snprintf(req->oldpath,
+             sizeof(req->oldpath),
+             "%s\\file-%zu-%zu.bin",
+             _M_acceptor.config().tmpdir,
+             _M_nconnection,
+             _M_nfile);
+
+    // Compose name of the new file.
+    snprintf(req->newpath,
+             sizeof(req->newpath),
+             "%s\\file-%zu-%zu.bin",
+             _M_acceptor.config().finaldir,
+             _M_nconnection,
+             _M_nfile);
+
+    // Move the file from the worker pool, so that the I/O thread doesn't
+    // block. If the task cannot be submitted, move the file now.
+    if (!_M_acceptor.workers().submit(move, req)) {
+      move(req);
+    }
+
+    return true;
+  }
+
+  return false;
+}
+
+void receiver::connection::move(void* arg)
+{
+  move_request* const req = static_cast<move_request*>(arg);
 
 #if DEBUG
-  print("Moving file '%s' -> '%s'.\n", oldpath, newpath);
+  print("Moving file '%s' -> '%s'.\n", req->oldpath, req->newpath);
 #endif
 
   // Move file.
-  return (::MoveFileEx(oldpath, newpath, MOVEFILE_REPLACE_EXISTING) == TRUE);
+  if (!::MoveFileEx(req->oldpath, req->newpath, MOVEFILE_REPLACE_EXISTING)) {
+    print("Error moving file '%s'.\n", req->oldpath);
+  }
+
+  delete req;
 }
 
 void receiver::connection::connection_timer()
 {
-  // If the connection mutex can be locked...
-  if (::InterlockedCompareExchange(&_M_connection_mutex, 1, 0) == 0) {
 #if DEBUG
-    print("[Connection timer] About to close the connection.\n");
+  print("[Connection timer] About to close the connection.\n");
 #endif
 
-    // Close connection.
-    // Do not cancel the connection timer, otherwise this function won't be
-    // further executed.
-    static constexpr const bool cancel_connection_timer = false;
-    close_connection(cancel_connection_timer);
-
-    // Unlock connection mutex.
-    ::InterlockedDecrement(&_M_connection_mutex);
-  }
+  // Close connection.
+  // Do not cancel the connection timer, otherwise this function won't be
+  // further executed.
+  static constexpr const bool cancel_connection_timer = false;
+  close_connection(cancel_connection_timer);
 }
 
 void receiver::connection::file_timer()
@@ -489,32 +569,6 @@ void receiver::connection::file_timer()
   }
 }
 
-void receiver::connection::complete(async::stream::socket::operation op,
-                                    DWORD error,
-                                    DWORD transferred,
-                                    void* user)
-{
-  static_cast<connection*>(user)->complete(op, error, transferred);
-}
-
-void receiver::connection::complete(filesystem::async::file& file,
-                                    DWORD error,
-                                    DWORD transferred,
-                                    void* user)
-{
-  static_cast<connection*>(user)->complete(error, transferred);
-}
-
-void receiver::connection::connection_timer(util::timer& timer, void* user)
-{
-  static_cast<connection*>(user)->connection_timer();
-}
-
-void receiver::connection::file_timer(util::timer& timer, void* user)
-{
-  static_cast<connection*>(user)->file_timer();
-}
-
 
 ////////////////////////////////////////////////////////////////////////////////
 ////////////////////////////////////////////////////////////////////////////////
@@ -525,9 +579,11 @@ void receiver::connection::file_timer(util::timer& timer, void* user)
 ////////////////////////////////////////////////////////////////////////////////
 
 receiver::acceptor::acceptor(const configuration& config,
+                             util::worker_pool& workers,
                              PTP_CALLBACK_ENVIRON callbackenv)
   : _M_sock{nullptr, nullptr, callbackenv},
-    _M_config{config}
+    _M_config{config},
+    _M_workers{workers}
 {
 }
 
@@ -535,11 +591,13 @@ receiver::acceptor::~acceptor()
 {
   if (_M_connections) {
     for (size_t i = 0; i < _M_nconnections; i++) {
-      delete _M_connections[i];
+      _M_slab.destroy(_M_connections[i]);
     }
 
     free(_M_connections);
   }
+
+  free(_M_parked);
 }
 
 bool receiver::acceptor::listen(const socket::address& addr,
@@ -549,39 +607,29 @@ bool receiver::acceptor::listen(const socket::address& addr,
   // Listen.
   if (_M_sock.listen(addr)) {
     _M_connections = static_cast<connection**>(
-                       malloc(_M_config.nconnections * sizeof(connection*))
+                       malloc(_M_config.maxconnections * sizeof(connection*))
                      );
 
-    if (_M_connections) {
-      // Connection number.
-      size_t nconnection = nacceptor * _M_config.nconnections;
-
-      for (_M_nconnections = 0;
-           _M_nconnections < _M_config.nconnections;
-           _M_nconnections++, nconnection++) {
-        // Create connection.
-        connection* const conn = new (std::nothrow) connection{*this,
-                                                               nconnection,
-                                                               callbackenv};
-
-        // If the connection could be created...
-        if (conn) {
-          if (conn->create()) {
-            // Start an asynchronous accept.
-            conn->accept();
-
-            // Save connection.
-            _M_connections[_M_nconnections] = conn;
-          } else {
-            delete conn;
-            return false;
-          }
-        } else {
-          return false;
-        }
-      }
-
-      return true;
+    _M_parked = static_cast<connection**>(
+                  malloc(_M_config.maxconnections * sizeof(connection*))
+                );
+
+    // Create slab allocator of connections (on the NUMA node of the
+    // threads), allocating `nconnections` connections at a time.
+    if ((_M_connections) &&
+        (_M_parked) &&
+        (_M_slab.create(sizeof(connection),
+                        _M_config.nconnections,
+                        _M_config.numa_node,
+                        _M_config.large_pages))) {
+      // Number of the first connection.
+      _M_first_connection = nacceptor * _M_config.maxconnections;
+
+      // Save callback environment.
+      _M_callbackenv = callbackenv;
+
+      // Create the initial connections.
+      return (grow(_M_config.nconnections) == _M_config.nconnections);
     }
   }
 
@@ -598,6 +646,115 @@ const receiver::configuration& receiver::acceptor::config() const
   return _M_config;
 }
 
+util::worker_pool& receiver::acceptor::workers()
+{
+  return _M_workers;
+}
+
+void receiver::acceptor::accepted()
+{
+  const size_t accepting = ::InterlockedDecrement(&_M_accepting);
+
+  // If few connections are waiting for a connection and the acceptor might
+  // grow...
+  if ((accepting < (_M_config.nconnections + 3) / 4) &&
+      (_M_active < _M_config.maxconnections)) {
+    grow(_M_config.nconnections);
+  }
+}
+
+bool receiver::acceptor::closed(connection& conn)
+{
+  // If enough connections are waiting for a connection...
+  if (_M_accepting >= _M_config.nconnections) {
+    do {
+      const uint32_t active = _M_active;
+
+      // If the acceptor cannot shrink...
+      if (active <= _M_config.nconnections) {
+        break;
+      }
+
+      if (::InterlockedCompareExchange(&_M_active,
+                                       active - 1,
+                                       active) == active) {
+        // Park connection.
+        ::AcquireSRWLockExclusive(&_M_lock);
+        _M_parked[_M_nparked++] = &conn;
+        ::ReleaseSRWLockExclusive(&_M_lock);
+
+        return false;
+      }
+    } while (true);
+  }
+
+  ::InterlockedIncrement(&_M_accepting);
+
+  return true;
+}
+
+size_t receiver::acceptor::grow(size_t count)
+{
+  // If another thread is already growing the acceptor...
+  if (::InterlockedCompareExchange(&_M_growing, 1, 0) != 0) {
+    return 0;
+  }
+
+  size_t i;
+  for (i = 0; (i < count) && (_M_active < _M_config.maxconnections); i++) {
+    connection* conn = nullptr;
+
+    // Reuse a parked connection (if any).
+    ::AcquireSRWLockExclusive(&_M_lock);
+    if (_M_nparked > 0) {
+      conn = _M_parked[--_M_nparked];
+    }
+    ::ReleaseSRWLockExclusive(&_M_lock);
+
+    // If there are no parked connections...
+    if (!conn) {
+      // Create connection.
+      if ((conn = create_connection()) == nullptr) {
+        break;
+      }
+
+      // Save connection.
+      _M_connections[_M_nconnections++] = conn;
+    }
+
+    ::InterlockedIncrement(&_M_active);
+    ::InterlockedIncrement(&_M_accepting);
+
+    // Start an asynchronous accept.
+    conn->accept();
+  }
+
+  ::InterlockedExchange(&_M_growing, 0);
+
+  return i;
+}
+
+receiver::connection* receiver::acceptor::create_connection()
+{
+  // Create connection.
+  connection* const conn = _M_slab.construct<connection>(
+                             *this,
+                             _M_first_connection + _M_nconnections,
+                             _M_callbackenv
+                           );
+
+  // If the connection could be created...
+  if (conn) {
+    if (conn->create()) {
+      return conn;
+    }
+
+    _M_slab.destroy(conn);
+  }
+
+  return nullptr;
+}
+
 
 ////////////////////////////////////////////////////////////////////////////////
 ////////////////////////////////////////////////////////////////////////////////
@@ -620,13 +777,16 @@ receiver::acceptors::~acceptors()
 
 bool receiver::acceptors::listen(const socket::address& addr,
                                  const configuration& config,
+                                 util::worker_pool& workers,
                                  PTP_CALLBACK_ENVIRON callbackenv)
 {
   // If space for a new acceptor can be allocated...
   if (allocate()) {
     // Create acceptor.
     receiver::acceptor* const
-      acceptor = new (std::nothrow) receiver::acceptor{config, callbackenv};
+      acceptor = new (std::nothrow) receiver::acceptor{config,
+                                                       workers,
+                                                       callbackenv};
 
     // If the acceptor could be created...
     if (acceptor) {
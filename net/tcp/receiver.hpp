@@ -6,6 +6,9 @@
 #include "net/async/stream/socket.hpp"
 #include "filesystem/async/file.hpp"
 #include "util/timer.hpp"
+#include "util/lifecycle.hpp"
+#include "util/slab.hpp"
+#include "util/worker_pool.hpp"
 
 namespace net {
 namespace tcp {
@@ -17,11 +20,17 @@ class receiver {
     static constexpr const size_t min_connections = 1;
 
     // Maximum number of connections per acceptor.
-    static constexpr const size_t max_connections = 4096;
+    static constexpr const size_t max_connections = 64 * 1024;
 
-    // Default number of connections per acceptor.
+    // Default number of connections per acceptor (low watermark: the
+    // connections created when listening, which are always kept).
     static constexpr const size_t default_connections = 256;
 
+    // Default maximum number of connections per acceptor (high watermark:
+    // the acceptor grows up to this number of connections under accept
+    // pressure).
+    static constexpr const size_t default_max_connections = 4096;
+
     // Minimum connection timeout (seconds).
     static constexpr const uint64_t min_timeout = 5;
 
@@ -62,9 +71,13 @@ class receiver {
                 DWORD minthreads = async::thread_pool::min_threads,
                 DWORD maxthreads = async::thread_pool::default_max_threads,
                 size_t nconnections = default_connections,
+                size_t maxconnections = default_max_connections,
                 uint64_t timeout = default_timeout,
                 uint64_t maxfilesize = default_file_size,
-                uint64_t maxfileage = default_file_age);
+                uint64_t maxfileage = default_file_age,
+                size_t nworkers = util::worker_pool::default_workers,
+                const async::thread_pool::placement* placement = nullptr,
+                bool large_pages = false);
 
     // Listen.
     bool listen(const socket::address& addr);
@@ -73,11 +86,17 @@ class receiver {
     // Thread pool.
     async::thread_pool _M_thread_pool;
 
+    // Worker pool (for moving the files to the final directory).
+    util::worker_pool _M_worker_pool;
+
     // Configuration.
     struct configuration {
       // Number of connections per acceptor.
       size_t nconnections;
 
+      // Maximum number of connections per acceptor.
+      size_t maxconnections;
+
       // Directory where to store the temporary files.
       char tmpdir[MAX_PATH];
 
@@ -92,6 +111,12 @@ class receiver {
 
       // Maximum file age (seconds).
       uint64_t maxfileage;
+
+      // NUMA node on which the connections are allocated.
+      ULONG numa_node;
+
+      // Allocate the connections on large pages?
+      bool large_pages;
     };
 
     configuration _M_config;
@@ -124,33 +149,29 @@ class receiver {
         // Buffer size.
         static constexpr const size_t buffer_size = 32 * 1024;
 
-        // Socket.
-        async::stream::socket _M_sock;
-
-        // Buffer for storing the local and remote addresses.
-        uint8_t _M_addresses[2 * address_length];
-
-        // Acceptor.
-        acceptor& _M_acceptor;
+        // Notify of a completed socket I/O operation.
+        void complete(async::stream::socket::operation op,
+                      DWORD error,
+                      DWORD transferred);
 
-        // File.
-        filesystem::async::file _M_file;
+        // Notify of a completed file I/O operation.
+        void complete(DWORD error, DWORD transferred);
 
         // Connection timer.
-        util::timer _M_connection_timer;
+        void connection_timer();
 
         // File timer.
-        util::timer _M_file_timer;
+        void file_timer();
 
-        // Connection mutex.
-        uint32_t _M_connection_mutex = 0;
+        // The state written by the I/O and timer threads comes first, on
+        // its own cache line.
+
+        // Lifecycle of the connection.
+        alignas(util::cache_line_size) util::lifecycle _M_state;
 
         // File mutex.
         uint32_t _M_file_mutex = 0;
 
-        // Connection number.
-        size_t _M_nconnection;
-
         // File number.
         size_t _M_nfile = 0;
 
@@ -160,12 +181,41 @@ class receiver {
         // File size.
         uint64_t _M_filesize;
 
-        // Buffer.
-        uint8_t _M_buf[buffer_size];
+        // Socket.
+        alignas(util::cache_line_size) async::stream::basic_socket<
+          async::stream::member_handler<connection, &connection::complete>
+        > _M_sock;
+
+        // File.
+        filesystem::async::basic_file<
+          filesystem::async::member_handler<connection, &connection::complete>
+        > _M_file;
+
+        // Connection timer.
+        util::basic_timer<
+          util::timer_member_handler<connection, &connection::connection_timer>
+        > _M_connection_timer;
+
+        // File timer.
+        util::basic_timer<
+          util::timer_member_handler<connection, &connection::file_timer>
+        > _M_file_timer;
+
+        // Acceptor.
+        acceptor& _M_acceptor;
+
+        // Connection number.
+        size_t _M_nconnection;
 
         // Callback environment.
         PTP_CALLBACK_ENVIRON _M_callbackenv;
 
+        // Buffer for storing the local and remote addresses.
+        uint8_t _M_addresses[2 * address_length];
+
+        // Buffer.
+        alignas(util::cache_line_size) uint8_t _M_buf[buffer_size];
+
         // Open file.
         bool open_file();
 
@@ -181,14 +231,6 @@ class receiver {
         // Error writing to file.
         void error_writing_file();
 
-        // Notify of a completed socket I/O operation.
-        void complete(async::stream::socket::operation op,
-                      DWORD error,
-                      DWORD transferred);
-
-        // Notify of a completed file I/O operation.
-        void complete(DWORD error, DWORD transferred);
-
         // Accepted.
         void accepted();
 
@@ -204,32 +246,14 @@ class receiver {
         // Disconnected.
         void disconnected();
 
+        // Release a reference to the connection.
+        void release();
+
         // Move file to the final directory.
         bool move_file();
 
-        // Connection timer.
-        void connection_timer();
-
-        // File timer.
-        void file_timer();
-
-        // Notify of a completed socket I/O operation.
-        static void complete(async::stream::socket::operation op,
-                             DWORD error,
-                             DWORD transferred,
-                             void* user);
-
-        // Notify of a completed file I/O operation.
-        static void complete(filesystem::async::file& file,
-                             DWORD error,
-                             DWORD transferred,
-                             void* user);
-
-        // Connection timer.
-        static void connection_timer(util::timer& timer, void* user);
-
-        // File timer.
-        static void file_timer(util::timer& timer, void* user);
+        // Move file (run by the worker pool).
+        static void move(void* arg);
 
         // Disable copy constructor and assignment operator.
         connection(const connection&) = delete;
@@ -237,10 +261,17 @@ class receiver {
     };
 
     // Acceptor.
+    // The acceptor starts with `nconnections` connections. When fewer than
+    // a quarter of them are waiting for a connection, it adds
+    // `nconnections` more (up to `maxconnections`). When a connection is
+    // closed while at least `nconnections` connections are waiting, it is
+    // parked (it doesn't accept connections anymore, so its socket is
+    // released) until the acceptor grows again.
     class acceptor {
       public:
         // Constructor.
         acceptor(const configuration& config,
+                 util::worker_pool& workers,
                  PTP_CALLBACK_ENVIRON callbackenv = nullptr);
 
         // Destructor.
@@ -257,19 +288,67 @@ class receiver {
         // Get configuration.
         const configuration& config() const;
 
+        // Get worker pool.
+        util::worker_pool& workers();
+
+        // A connection has been accepted.
+        void accepted();
+
+        // A connection has been closed.
+        // Returns true if the connection should accept another connection,
+        // false if it has been parked.
+        bool closed(connection& conn);
+
       private:
         // Acceptor.
         async::stream::socket _M_sock;
 
-        // Connections.
+        // Connections (`maxconnections` slots).
         connection** _M_connections = nullptr;
 
         // Number of connections.
         size_t _M_nconnections = 0;
 
+        // Number of the first connection.
+        size_t _M_first_connection = 0;
+
+        // Parked connections (`maxconnections` slots).
+        connection** _M_parked = nullptr;
+
+        // Number of parked connections.
+        size_t _M_nparked = 0;
+
+        // Lock of the parked connections.
+        SRWLOCK _M_lock = SRWLOCK_INIT;
+
+        // Number of connections which are not parked.
+        uint32_t _M_active = 0;
+
+        // Number of connections waiting for a connection.
+        uint32_t _M_accepting = 0;
+
+        // Is the acceptor growing?
+        uint32_t _M_growing = 0;
+
+        // Callback environment.
+        PTP_CALLBACK_ENVIRON _M_callbackenv = nullptr;
+
+        // Allocator of connections.
+        util::slab _M_slab;
+
         // Configuration.
         const configuration& _M_config;
 
+        // Worker pool.
+        util::worker_pool& _M_workers;
+
+        // Add `count` connections (parked connections are reused first).
+        // Returns the number of connections which have been added.
+        size_t grow(size_t count);
+
+        // Create connection.
+        connection* create_connection();
+
         // Disable copy constructor and assignment operator.
         acceptor(const acceptor&) = delete;
         acceptor& operator=(const acceptor&) = delete;
@@ -287,6 +366,7 @@ class receiver {
         // Listen.
         bool listen(const socket::address& addr,
                     const configuration& config,
+                    util::worker_pool& workers,
                     PTP_CALLBACK_ENVIRON callbackenv = nullptr);
 
       private:
@@ -0,0 +1,147 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "net/tcp/echo.hpp"
+#include "net/library.hpp"
+
+static BOOL WINAPI signal_handler(DWORD control_type);
+static bool parse(const char* s, size_t& n);
+
+static HANDLE stop_event = nullptr;
+
+int main(int argc, const char* argv[])
+{
+  // Number of connections.
+  size_t nconnections = net::tcp::echo::default_connections;
+
+  // Parse options.
+  int i = 1;
+  bool valid = true;
+  while ((valid) && (i < argc) && (strncmp(argv[i], "--", 2) == 0)) {
+    if ((strcmp(argv[i], "--number-connections") == 0) && (i + 1 < argc)) {
+      valid = (parse(argv[i + 1], nconnections)) &&
+              (nconnections >= net::tcp::echo::min_connections) &&
+              (nconnections <= net::tcp::echo::max_connections);
+
+      i += 2;
+    } else {
+      valid = false;
+    }
+  }
+
+  // Check usage.
+  if ((valid) && (i + 1 == argc)) {
+    // Initiate use of the Winsock DLL.
+    net::library library;
+    if (library.init()) {
+      // Build socket address.
+      net::socket::address addr;
+      if (addr.build(argv[i])) {
+        // Load functions.
+        if (net::async::stream::socket::load_functions()) {
+          // Create event.
+          stop_event = ::CreateEvent(nullptr, TRUE, FALSE, nullptr);
+
+          // If the event could be created...
+          if (stop_event) {
+            // Install signal handler.
+            if (::SetConsoleCtrlHandler(signal_handler, TRUE)) {
+              // Create echo server.
+              net::tcp::echo echo;
+              if (echo.create(net::async::thread_pool::min_threads,
+                              net::async::thread_pool::default_max_threads,
+                              nconnections)) {
+                // Listen.
+                if (echo.listen(addr)) {
+                  printf("Waiting for signal to arrive.\n");
+
+                  // Wait for signal to arrive.
+                  ::WaitForSingleObject(stop_event, INFINITE);
+
+                  printf("Signal received.\n");
+
+                  // Print the accept rate.
+                  uint64_t first, last;
+                  const uint64_t accepts = echo.accepts(first, last);
+
+                  printf("%llu connections accepted (%.1f accepts/s).\n",
+                         static_cast<unsigned long long>(accepts),
+                         (last > first) ?
+                           (accepts - 1) * 1000.0 / (last - first) :
+                           0.0);
+
+                  ::CloseHandle(stop_event);
+
+                  return EXIT_SUCCESS;
+                } else {
+                  fprintf(stderr, "Error listening on '%s'.\n", argv[i]);
+                }
+              } else {
+                fprintf(stderr, "Error creating echo server.\n");
+              }
+            } else {
+              fprintf(stderr, "Error installing signal handler.\n");
+            }
+
+            ::CloseHandle(stop_event);
+          } else {
+            fprintf(stderr, "Error creating event.\n");
+          }
+        } else {
+          fprintf(stderr, "Error loading functions.\n");
+        }
+      } else {
+        fprintf(stderr, "Error building socket address '%s'.\n", argv[i]);
+      }
+    } else {
+      fprintf(stderr, "Error initiating use of the Winsock DLL.\n");
+    }
+  } else {
+    fprintf(stderr,
+            "Usage: %s [--number-connections <count>] <address>\n",
+            argv[0]);
+  }
+
+  return EXIT_FAILURE;
+}
+
+BOOL WINAPI signal_handler(DWORD control_type)
+{
+  switch (control_type) {
+    case CTRL_C_EVENT:
+    case CTRL_CLOSE_EVENT:
+      ::SetEvent(stop_event);
+
+      return TRUE;
+    default:
+      return FALSE;
+  }
+}
+
+bool parse(const char* s, size_t& n)
+{
+  if (*s) {
+    size_t res = 0;
+
+    do {
+      // Digit?
+      if ((*s >= '0') && (*s <= '9')) {
+        const size_t tmp = (res * 10) + (*s - '0');
+
+        // If the number doesn't overflow...
+        if (tmp >= res) {
+          res = tmp;
+        } else {
+          return false;
+        }
+      } else {
+        return false;
+      }
+    } while (*++s);
+
+    n = res;
+    return true;
+  }
+
+  return false;
+}
\ No newline at end of file
@@ -1,25 +1,126 @@
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include "net/tcp/proxy.hpp"
 #include "net/library.hpp"
 
 static BOOL WINAPI signal_handler(DWORD control_type);
+static bool parse(const char* s, size_t& n);
+static bool parse(const char* s, net::tcp::balancer::policy& policy);
+// Parse the addresses of the backends (a comma-separated list of candidate
+// addresses or a host name and a port per backend).
+// Returns the index of the first invalid backend (`count` if all of them
+// are valid).
+static size_t parse(const char** addresses,
+                    size_t count,
+                    net::tcp::balancer::addresses* backends);
+
+// Parse `<host-name>:<port>`.
+static bool parse_host(const char* s, char* host, size_t size, in_port_t& port);
+
+static net::tcp::balancer::addresses backends[
+  net::tcp::balancer::max_backends
+];
+
+// Host names of the backends.
+static char hosts[net::tcp::balancer::max_backends][256];
 
 static HANDLE stop_event = nullptr;
 
 int main(int argc, const char* argv[])
 {
+  // Thread-per-core mode?
+  bool per_core = false;
+
+  // Number of pre-connected upstream connections.
+  size_t upstreams = 0;
+
+  // Balancing policy.
+  net::tcp::balancer::policy policy = net::tcp::balancer::policy::round_robin;
+
+  // Health checking.
+  size_t max_failures = net::tcp::balancer::default_max_failures;
+  size_t ejection_time = net::tcp::balancer::default_ejection_time;
+  size_t probe_interval = net::tcp::balancer::default_probe_interval;
+
+  // Timeout of a connect attempt.
+  size_t connect_timeout = net::tcp::proxy::default_connect_timeout;
+
+  // DNS server.
+  const char* dns_server = nullptr;
+
+  // Parse options.
+  int i = 1;
+  bool valid = true;
+  while ((valid) && (i < argc) && (strncmp(argv[i], "--", 2) == 0)) {
+    if (strcmp(argv[i], "--thread-per-core") == 0) {
+      per_core = true;
+      i++;
+    } else if ((strcmp(argv[i], "--preconnect") == 0) && (i + 1 < argc)) {
+      valid = parse(argv[i + 1], upstreams);
+      i += 2;
+    } else if ((strcmp(argv[i], "--balance") == 0) && (i + 1 < argc)) {
+      valid = parse(argv[i + 1], policy);
+      i += 2;
+    } else if ((strcmp(argv[i], "--max-failures") == 0) && (i + 1 < argc)) {
+      valid = (parse(argv[i + 1], max_failures)) &&
+              (max_failures <= UINT32_MAX);
+
+      i += 2;
+    } else if ((strcmp(argv[i], "--ejection-time") == 0) &&
+               (i + 1 < argc)) {
+      valid = (parse(argv[i + 1], ejection_time)) &&
+              (ejection_time <= UINT32_MAX);
+
+      i += 2;
+    } else if ((strcmp(argv[i], "--probe-interval") == 0) &&
+               (i + 1 < argc)) {
+      valid = (parse(argv[i + 1], probe_interval)) &&
+              (probe_interval <= UINT32_MAX);
+
+      i += 2;
+    } else if ((strcmp(argv[i], "--connect-timeout") == 0) &&
+               (i + 1 < argc)) {
+      valid = (parse(argv[i + 1], connect_timeout)) &&
+              (connect_timeout >= net::tcp::proxy::min_connect_timeout) &&
+              (connect_timeout <= net::tcp::proxy::max_connect_timeout);
+
+      i += 2;
+    } else if ((strcmp(argv[i], "--dns-server") == 0) && (i + 1 < argc)) {
+      dns_server = argv[i + 1];
+      i += 2;
+    } else {
+      valid = false;
+    }
+  }
+
+  // Skip options.
+  const char** const args = argv + i - 1;
+
+  // Number of backends.
+  const size_t nbackends = (argc - i > 1) ? argc - i - 1 : 0;
+
   // Check usage.
-  if (argc == 3) {
+  if ((valid) &&
+      (nbackends > 0) &&
+      (nbackends <= net::tcp::balancer::max_backends)) {
     // Initiate use of the Winsock DLL.
     net::library library;
     if (library.init()) {
-      // Parse local address.
+      // Parse local address and the address of the DNS server.
       net::socket::address local;
-      if (local.build(argv[1])) {
-        // Parse remote address.
-        net::socket::address remote;
-        if (remote.build(argv[2])) {
+      net::socket::address dns;
+      const char* invalid_address = nullptr;
+      if (!local.build(args[1])) {
+        invalid_address = args[1];
+      } else if ((dns_server) && (!dns.build(dns_server))) {
+        invalid_address = dns_server;
+      }
+
+      if (!invalid_address) {
+        // Parse the addresses of the backends.
+        const size_t invalid = parse(args + 2, nbackends, backends);
+        if (invalid == nbackends) {
           // Load functions.
           if (net::async::stream::socket::load_functions()) {
             // Create event.
@@ -31,9 +132,25 @@ int main(int argc, const char* argv[])
               if (::SetConsoleCtrlHandler(signal_handler, TRUE)) {
                 // Create proxy.
                 net::tcp::proxy proxy;
-                if (proxy.create()) {
+                if ((per_core ? proxy.create_per_core() : proxy.create()) &&
+                    (proxy.preconnect(upstreams))) {
+                  // Set health checking.
+                  proxy.health_check(static_cast<uint32_t>(max_failures),
+                                     static_cast<uint32_t>(ejection_time),
+                                     static_cast<uint32_t>(probe_interval));
+
+                  // Set connect timeout.
+                  proxy.connect_timeout(
+                    static_cast<uint32_t>(connect_timeout)
+                  );
+
+                  // Set DNS server.
+                  if (dns_server) {
+                    proxy.dns_server(dns);
+                  }
+
                   // Listen.
-                  if (proxy.listen(local, remote)) {
+                  if (proxy.listen(local, backends, nbackends, policy)) {
                     printf("Waiting for signal to arrive.\n");
 
                     // Wait for signal to arrive.
@@ -45,7 +162,7 @@ int main(int argc, const char* argv[])
 
                     return EXIT_SUCCESS;
                   } else {
-                    fprintf(stderr, "Error listening on '%s'.\n", argv[1]);
+                    fprintf(stderr, "Error listening on '%s'.\n", args[1]);
                   }
                 } else {
                   fprintf(stderr, "Error creating proxy.\n");
@@ -62,16 +179,29 @@ int main(int argc, const char* argv[])
             fprintf(stderr, "Error loading functions.\n");
           }
         } else {
-          fprintf(stderr, "Invalid address '%s'.\n", argv[2]);
+          fprintf(stderr, "Invalid address '%s'.\n", args[2 + invalid]);
         }
       } else {
-        fprintf(stderr, "Invalid address '%s'\n", argv[1]);
+        fprintf(stderr, "Invalid address '%s'\n", invalid_address);
       }
     } else {
       fprintf(stderr, "Error initiating use of the Winsock DLL.\n");
     }
   } else {
-    fprintf(stderr, "Usage: %s <local-address> <remote-address>\n", argv[0]);
+    fprintf(stderr,
+            "Usage: %s [--thread-per-core] [--preconnect <count>] "
+            "[--balance <policy>] [--max-failures <count>] "
+            "[--ejection-time <seconds>] [--probe-interval <seconds>] "
+            "[--connect-timeout <milliseconds>] "
+            "[--dns-server <address>] "
+            "<local-address> <backend> [<backend> ...]\n"
+            "\n"
+            "<policy> ::= round-robin (default) | least-outstanding | p2c | "
+            "consistent-hash\n"
+            "<backend> ::= <address>[,<address> ...] (up to %zu addresses) | "
+            "<host-name>:<port>\n",
+            argv[0],
+            net::tcp::balancer::max_addresses);
   }
 
   return EXIT_FAILURE;
@@ -88,4 +218,126 @@ BOOL WINAPI signal_handler(DWORD control_type)
     default:
       return FALSE;
   }
+}
+
+bool parse(const char* s, size_t& n)
+{
+  if (*s) {
+    size_t res = 0;
+
+    do {
+      // Digit?
+      if ((*s >= '0') && (*s <= '9')) {
+        const size_t tmp = (res * 10) + (*s - '0');
+
+        // If the number doesn't overflow...
+        if (tmp >= res) {
+          res = tmp;
+        } else {
+          return false;
+        }
+      } else {
+        return false;
+      }
+    } while (*++s);
+
+    n = res;
+    return true;
+  }
+
+  return false;
+}
+
+bool parse(const char* s, net::tcp::balancer::policy& policy)
+{
+  if (strcmp(s, "round-robin") == 0) {
+    policy = net::tcp::balancer::policy::round_robin;
+  } else if (strcmp(s, "least-outstanding") == 0) {
+    policy = net::tcp::balancer::policy::least_outstanding;
+  } else if (strcmp(s, "p2c") == 0) {
+    policy = net::tcp::balancer::policy::power_of_two_choices;
+  } else if (strcmp(s, "consistent-hash") == 0) {
+    policy = net::tcp::balancer::policy::consistent_hash;
+  } else {
+    return false;
+  }
+
+  return true;
+}
+
+size_t parse(const char** addresses,
+             size_t count,
+             net::tcp::balancer::addresses* backends)
+{
+  for (size_t i = 0; i < count; i++) {
+    net::tcp::balancer::addresses& backend = backends[i];
+    backend.count = 0;
+    backend.host = nullptr;
+
+    const char* s = addresses[i];
+
+    // Host name?
+    if (parse_host(s, hosts[i], sizeof(hosts[i]), backend.port)) {
+      backend.host = hosts[i];
+      continue;
+    }
+
+    do {
+      // Find the end of the address.
+      const char* end = strchr(s, ',');
+      const size_t len = end ? static_cast<size_t>(end - s) : strlen(s);
+
+      char address[256];
+
+      // If the address is empty, too long or there are too many of them...
+      if ((len == 0) ||
+          (len >= sizeof(address)) ||
+          (backend.count == net::tcp::balancer::max_addresses)) {
+        return i;
+      }
+
+      memcpy(address, s, len);
+      address[len] = 0;
+
+      if (!backend.addrs[backend.count].build(address)) {
+        return i;
+      }
+
+      backend.count++;
+
+      s = end ? end + 1 : nullptr;
+    } while (s);
+  }
+
+  return count;
+}
+
+bool parse_host(const char* s, char* host, size_t size, in_port_t& port)
+{
+  // Find the port.
+  const char* colon = strrchr(s, ':');
+  if (colon) {
+    const size_t len = colon - s;
+
+    size_t n;
+    if ((len > 0) &&
+        (len < size) &&
+        (*s != '[') &&
+        (strcspn(s, ",/\\") == strlen(s)) &&
+        (parse(colon + 1, n)) &&
+        (n > 0) &&
+        (n <= 65535)) {
+      memcpy(host, s, len);
+      host[len] = 0;
+
+      // If the host is not an IP address...
+      net::socket::address addr;
+      if (!addr.build(host, static_cast<in_port_t>(n))) {
+        port = static_cast<in_port_t>(n);
+        return true;
+      }
+    }
+  }
+
+  return false;
 }
\ No newline at end of file
@@ -1,16 +1,19 @@
 #include <stdint.h>
 #include <stdlib.h>
-#include <string.h>
 #include <stdio.h>
-#include <fcntl.h>
-#include <sys/stat.h>
-#include <io.h>
-#include <share.h>
-#include <limits.h>
 #include <new>
 #include "net/async/thread_pool.hpp"
 #include "net/async/stream/socket.hpp"
+#include "net/tcp/connector/configuration.hpp"
+#include "net/tcp/connector/reporter.hpp"
+#include "net/tcp/connector/statistics.hpp"
 #include "net/library.hpp"
+#include "util/slab.hpp"
+#include "util/timer.hpp"
+
+using net::tcp::connector::configuration;
+using net::tcp::connector::statistics;
+using net::tcp::connector::reporter;
 
 static BOOL WINAPI signal_handler(DWORD control_type);
 
@@ -20,630 +23,820 @@ static HANDLE stop_event = nullptr;
 ////////////////////////////////////////////////////////////////////////////////
 ////////////////////////////////////////////////////////////////////////////////
 //                                                                            //
-// Configuration.                                                             //
+// Connection.                                                                //
 //                                                                            //
 ////////////////////////////////////////////////////////////////////////////////
 ////////////////////////////////////////////////////////////////////////////////
 
-class configuration {
+class connection {
   public:
+    // Size of the receive buffer (echo mode and faults).
+    static constexpr const size_t receive_buffer_size = 64 * 1024;
+
     // Constructor.
-    configuration() = default;
+    // The last connection of a shard to finish decrements the number of
+    // running shards `nshards`.
+    connection(const configuration& config,
+               size_t index,
+               size_t* nconnections,
+               uint32_t* nshards,
+               statistics& stats,
+               uint8_t* recvbuf,
+               PTP_CALLBACK_ENVIRON callbackenv = nullptr);
 
     // Destructor.
-    ~configuration();
-
-    // Parse.
-    bool parse(int argc, const char* argv[]);
-
-    // Get address to connect to.
-    const net::socket::address& address() const;
+    ~connection() = default;
 
-    // Get number of connections.
-    size_t number_connections() const;
+    // Create connection.
+    bool create(PTP_CALLBACK_ENVIRON callbackenv = nullptr);
 
-    // Get number of transfers per connection.
-    unsigned number_transfers_per_connection() const;
+    // Connect.
+    void connect();
 
-    // Get number of loops.
-    unsigned number_loops() const;
+    // Connect at a fixed rate (churn): the first connect is scheduled at
+    // `first` and, after every disconnect, the next one `period`
+    // nanoseconds after the previous one. The connect latency is measured
+    // from the scheduled time.
+    void churn(uint64_t first, uint64_t period);
 
-    // Get data to be sent.
-    const void* data() const;
+    // Start the next connect (now or at its scheduled time). If `defer`
+    // is set, the connect is started from the timer even if it is due.
+    void start_connect(uint64_t now, bool defer = false);
 
-    // Get length of the data to be sent.
-    size_t length() const;
+    // Send at a fixed rate (open loop): the first transfer is scheduled at
+    // `first` and the next ones every `period` nanoseconds. The latency of
+    // every transfer is measured from its scheduled start, so that the
+    // time a transfer waits because the previous ones are late is counted
+    // (no coordinated omission).
+    void schedule(uint64_t first, uint64_t period);
 
   private:
-    // Minimum number of connections.
-    static constexpr const size_t min_connections = 1;
-
-    // Maximum number of connections.
-    static constexpr const size_t max_connections = 4096;
+    // Buffer view.
+    struct buffer_view {
+      const uint8_t* data;
+      DWORD length;
+    };
 
-    // Default number of connections.
-    static constexpr const size_t default_connections = 4;
+    // What the timer is waiting for.
+    enum class timer_wait {
+      // Nothing (the timer might still fire, and is then ignored).
+      none,
 
-    // Minimum number of transfers per connection.
-    static constexpr const unsigned min_transfers = 1;
+      // A connect (churn).
+      connect,
 
-    // Maximum number of transfers per connection.
-    static constexpr const unsigned max_transfers = 1000 * 1000;
+      // A transfer (open loop).
+      transfer,
 
-    // Default number of transfers per connection.
-    static constexpr const unsigned default_transfers = 1;
+      // The next byte trickled or the end of the hold (faults).
+      fault
+    };
 
-    // Minimum number of loops.
-    static constexpr const unsigned min_loops = 1;
+    // State of a faulty connection.
+    enum class fault_state {
+      // No fault (normal traffic).
+      none,
 
-    // Maximum number of loops.
-    static constexpr const unsigned max_loops = 1000 * 1000;
+      // Sending the data before the reset or the half-close.
+      sending,
 
-    // Default number of loops.
-    static constexpr const unsigned default_loops = 1;
+      // Held open until the peer closes it.
+      holding,
 
-    // Minimum number of bytes to be transferred.
-    static constexpr const size_t min_data_transfer = 1;
+      // Closing.
+      closing
+    };
 
-    // Maximum number of bytes to be transferred.
-    static constexpr const size_t max_data_transfer = 64ul * 1024ul * 1024ul;
+    // Notify of a completed socket I/O operation.
+    void complete(net::async::stream::socket::operation op,
+                  DWORD error,
+                  DWORD transferred);
 
-    // Address to connect to.
-    net::socket::address _M_address;
+    // Socket.
+    net::async::stream::basic_socket<
+      net::async::stream::member_handler<connection, &connection::complete>
+    > _M_sock;
 
-    // Number of connections.
-    size_t _M_nconnections;
+    // Index of the connection.
+    const size_t _M_index;
 
     // Number of transfers per connection.
     unsigned _M_ntransfers;
 
     // Number of loops.
-    unsigned _M_nloops;
+    unsigned _M_nloops = 0;
 
-    // Data to be sent.
-    uint8_t* _M_data = nullptr;
+    // Payload of the next transfer.
+    size_t _M_payload;
 
-    // Length of the data to be sent.
+    // Length of the current transfer.
     size_t _M_length;
 
-    // Load file.
-    bool load_file(const char* filename);
+    // Send buffer view.
+    buffer_view _M_sendbuf;
 
-    // Print usage.
-    static void usage(const char* program);
+    // Receive buffer (echo mode and faults, shared by the connections of
+    // the shard: the data received is only counted).
+    uint8_t* const _M_recvbuf;
 
-    // Parse number.
-    static bool parse(const char* s,
-                      uint64_t& n,
-                      uint64_t min = 0,
-                      uint64_t max = ULLONG_MAX);
+    // Number of bytes of the current transfer which have been echoed back.
+    size_t _M_received;
 
-    // Disable copy constructor and assignment operator.
-    configuration(const configuration&) = delete;
-    configuration& operator=(const configuration&) = delete;
-};
+    // Number of running connections of the shard.
+    size_t* _M_nconnections;
 
-configuration::~configuration()
-{
-  if (_M_data) {
-    free(_M_data);
-  }
-}
+    // Number of running shards.
+    uint32_t* _M_nshards;
 
-bool configuration::parse(int argc, const char* argv[])
-{
-  const char* address = nullptr;
-  _M_nconnections = default_connections;
-  _M_ntransfers = default_transfers;
-  _M_nloops = default_loops;
+    // Statistics.
+    statistics& _M_stats;
 
-  int i = 1;
-  while (i < argc) {
-    if (_stricmp(argv[i], "--address") == 0) {
-      // If not the last argument...
-      if (i + 1 < argc) {
-        // If the address has not been provided yet...
-        if (!address) {
-          // Build address.
-          if (_M_address.build(argv[i + 1])) {
-            address = argv[i + 1];
+    // Start of the connect (nanoseconds).
+    uint64_t _M_connect_start;
 
-            i += 2;
-          } else {
-            fprintf(stderr, "Invalid address '%s'.\n", argv[i + 1]);
-            return false;
-          }
-        } else {
-          fprintf(stderr, "\"--address\" has been already provided.\n");
-          return false;
-        }
-      } else {
-        fprintf(stderr, "Expected argument after \"--address\".\n");
-        return false;
-      }
-    } else if (_stricmp(argv[i], "--number-connections") == 0) {
-      // If not the last argument...
-      if (i + 1 < argc) {
-        uint64_t n;
-        if (parse(argv[i + 1], n, min_connections, max_connections)) {
-          _M_nconnections = static_cast<size_t>(n);
-
-          i += 2;
-        } else {
-          fprintf(stderr,
-                  "Invalid number of connections '%s' "
-                  "(valid range: %zu .. %zu).\n",
-                  argv[i + 1],
-                  min_connections,
-                  max_connections);
-
-          return false;
-        }
-      } else {
-        fprintf(stderr, "Expected argument after \"--number-connections\".\n");
-        return false;
-      }
-    } else if (_stricmp(argv[i], "--number-transfers-per-connection") == 0) {
-      // If not the last argument...
-      if (i + 1 < argc) {
-        uint64_t n;
-        if (parse(argv[i + 1], n, min_transfers, max_transfers)) {
-          _M_ntransfers = static_cast<unsigned>(n);
-
-          i += 2;
-        } else {
-          fprintf(stderr,
-                  "Invalid number of transfers '%s' (valid range: %u .. %u).\n",
-                  argv[i + 1],
-                  min_transfers,
-                  max_transfers);
+    // Scheduled start of the next connect (nanoseconds, churn).
+    uint64_t _M_next_connect = 0;
 
-          return false;
-        }
-      } else {
-        fprintf(stderr,
-                "Expected argument after "
-                "\"--number-transfers-per-connection\".\n");
+    // Interval between connects (nanoseconds, 0: no churn).
+    uint64_t _M_connect_period = 0;
 
-        return false;
-      }
-    } else if (_stricmp(argv[i], "--number-loops") == 0) {
-      // If not the last argument...
-      if (i + 1 < argc) {
-        uint64_t n;
-        if (parse(argv[i + 1], n, min_loops, max_loops)) {
-          _M_nloops = static_cast<unsigned>(n);
-
-          i += 2;
-        } else {
-          fprintf(stderr,
-                  "Invalid number of loops '%s' (valid range: %u .. %u).\n",
-                  argv[i + 1],
-                  min_loops,
-                  max_loops);
+    // What the timer is waiting for.
+    timer_wait _M_timer_wait = timer_wait::none;
 
-          return false;
-        }
-      } else {
-        fprintf(stderr, "Expected argument after \"--number-loops\".\n");
-        return false;
-      }
-    } else if (_stricmp(argv[i], "--file") == 0) {
-      // If not the last argument...
-      if (i + 1 < argc) {
-        // If the `_M_data` buffer has not been created yet...
-        if (!_M_data) {
-          // Load file.
-          if (load_file(argv[i + 1])) {
-            i += 2;
-          } else {
-            return false;
-          }
-        } else {
-          fprintf(stderr,
-                  "\"--file\" or \"--data\" has been already provided.\n");
+    // Has the disconnect of the current connection been started?
+    bool _M_closing = false;
 
-          return false;
-        }
-      } else {
-        fprintf(stderr, "Expected argument after \"--file\".\n");
-        return false;
-      }
-    } else if (_stricmp(argv[i], "--data") == 0) {
-      // If not the last argument...
-      if (i + 1 < argc) {
-        // If the `_M_data` buffer has not been created yet...
-        if (!_M_data) {
-          uint64_t n;
-          if (parse(argv[i + 1], n, min_data_transfer, max_data_transfer)) {
-            _M_length = static_cast<size_t>(n);
-
-            // Allocate memory.
-            _M_data = static_cast<uint8_t*>(malloc(_M_length));
-
-            // If the data could be allocated...
-            if (_M_data) {
-              memset(_M_data, '0', _M_length);
-
-              i += 2;
-            } else {
-              fprintf(stderr, "Error allocating memory.\n");
-              return false;
-            }
-          } else {
-            fprintf(stderr,
-                    "Invalid data transfer '%s' (valid range: %zu .. %zu).\n",
-                    argv[i + 1],
-                    min_data_transfer,
-                    max_data_transfer);
+    // Establishment of the connection (nanoseconds).
+    uint64_t _M_connected;
 
-            return false;
-          }
-        } else {
-          fprintf(stderr,
-                  "\"--file\" or \"--data\" has been already provided.\n");
+    // Start of the current transfer (nanoseconds).
+    uint64_t _M_transfer_start;
 
-          return false;
-        }
-      } else {
-        fprintf(stderr, "Expected argument after \"--data\".\n");
-        return false;
-      }
-    } else if (_stricmp(argv[i], "--help") == 0) {
-      usage(argv[0]);
-      return false;
-    } else {
-      fprintf(stderr, "Invalid option '%s'.\n", argv[i]);
-      return false;
-    }
+    // Scheduled start of the next transfer (nanoseconds, open loop).
+    uint64_t _M_next_transfer = 0;
+
+    // Interval between transfers (nanoseconds, 0: closed loop).
+    uint64_t _M_period = 0;
+
+    // Has the first send completed?
+    bool _M_first_byte;
+
+    // Fault injected into the current connection.
+    configuration::fault _M_fault = configuration::fault::none;
+
+    // State of the current connection, if faulty.
+    fault_state _M_fault_state = fault_state::none;
+
+    // Payload of the faulty connection.
+    const configuration::payload* _M_fault_payload;
+
+    // End of the hold (nanoseconds).
+    uint64_t _M_hold_deadline;
+
+    // Time of the next byte trickled (nanoseconds).
+    uint64_t _M_next_trickle;
+
+    // Offset of the next byte trickled in the payload.
+    size_t _M_trickled;
+
+    // Is a byte being trickled?
+    bool _M_trickling;
+
+    // Configuration.
+    const configuration& _M_config;
+
+    // Timer.
+    void timer();
+
+    // Timer of the scheduled connects and transfers (and of the faults).
+    util::basic_timer<
+      util::timer_member_handler<connection, &connection::timer>
+    > _M_timer;
+
+    // Connected.
+    void connected();
+
+    // Start the next transfer (now or at its scheduled time).
+    void start_transfer(uint64_t now);
+
+    // Send the next payload.
+    void send_payload();
+
+    // Send.
+    void send(const void* buf, DWORD len);
+
+    // Data has been sent.
+    void sent(DWORD count);
+
+    // Receive the data echoed back.
+    void receive();
+
+    // Data has been received.
+    void received(DWORD transferred);
+
+    // The current transfer has completed.
+    void transferred(uint64_t now);
+
+    // Close connection.
+    void close();
+
+    // Disconnected.
+    void disconnected();
+
+    // The connect has failed.
+    void connect_failed(DWORD error);
+
+    // Inject the fault of the connection.
+    void inject_fault(uint64_t now);
+
+    // Data of a faulty connection has been sent.
+    void fault_sent(DWORD count);
+
+    // Data has been received on a faulty connection.
+    void fault_received(DWORD transferred);
+
+    // A send or a receive of a faulty connection has failed.
+    void fault_failed(DWORD error);
+
+    // Hold the connection open until the peer closes it (or until the hold
+    // limit).
+    void hold(uint64_t now);
+
+    // Wait for the peer to close the connection.
+    void wait_close();
+
+    // The peer has closed the held connection.
+    void hold_ended();
+
+    // Timer of a faulty connection.
+    void fault_timer();
+
+    // Arm the timer for the next byte trickled or the end of the hold.
+    void arm_fault_timer(uint64_t now);
+
+    // Start the next loop (if any).
+    void next_loop(uint64_t now, bool defer = false);
+
+    // Disable copy constructor and assignment operation.
+    connection(const connection&) = delete;
+    connection& operator=(const connection&) = delete;
+};
+
+connection::connection(const configuration& config,
+                       size_t index,
+                       size_t* nconnections,
+                       uint32_t* nshards,
+                       statistics& stats,
+                       uint8_t* recvbuf,
+                       PTP_CALLBACK_ENVIRON callbackenv)
+  : _M_sock{this, callbackenv},
+    _M_index{index},
+    _M_payload{index % config.number_payloads()},
+    _M_recvbuf{recvbuf},
+    _M_nconnections{nconnections},
+    _M_nshards{nshards},
+    _M_stats{stats},
+    _M_config{config},
+    _M_timer{this}
+{
+  // Send directly from the payloads?
+  _M_sock.zero_copy_send(config.zero_copy());
+
+  // Spread the connections over the source addresses.
+  if (config.number_source_addresses() > 0) {
+    _M_sock.source_address(
+      &config.source_addresses()[index % config.number_source_addresses()]
+    );
   }
+}
 
-  // If at least one argument has been provided...
-  if (argc > 1) {
-    // If the address has been provided...
-    if (address) {
-      if (_M_data) {
-        return true;
-      } else {
-        fprintf(stderr,
-                "Either the argument \"--file\" or \"--data\" has to be "
-                "provided.\n");
-      }
-    } else {
-      fprintf(stderr, "Argument \"--address\" has to be provided.\n");
-    }
+bool connection::create(PTP_CALLBACK_ENVIRON callbackenv)
+{
+  // Create timer.
+  return _M_timer.create(callbackenv);
+}
+
+void connection::connect()
+{
+  // Churn?
+  if (_M_connect_period > 0) {
+    // Measure from the scheduled time.
+    _M_connect_start = _M_next_connect - _M_connect_period;
   } else {
-    usage(argv[0]);
+    _M_connect_start = statistics::now();
   }
 
-  return false;
+  _M_first_byte = false;
+
+  // Start an asynchronous connect.
+  _M_sock.connect(_M_config.address());
 }
 
-const net::socket::address& configuration::address() const
+void connection::churn(uint64_t first, uint64_t period)
 {
-  return _M_address;
+  _M_next_connect = first;
+  _M_connect_period = period;
 }
 
-size_t configuration::number_connections() const
+void connection::start_connect(uint64_t now, bool defer)
 {
-  return _M_nconnections;
+  // Churn?
+  if (_M_connect_period > 0) {
+    const uint64_t start = _M_next_connect;
+    _M_next_connect += _M_connect_period;
+
+    // If the connect is not due yet...
+    if (start > now) {
+      // Wait for its scheduled time.
+      _M_timer_wait = timer_wait::connect;
+      _M_timer.expires_in((start - now) / 1000);
+      return;
+    }
+  }
+
+  if (defer) {
+    _M_timer_wait = timer_wait::connect;
+    _M_timer.expires_in(0);
+  } else {
+    // Start an asynchronous connect.
+    connect();
+  }
 }
 
-unsigned configuration::number_transfers_per_connection() const
+void connection::schedule(uint64_t first, uint64_t period)
 {
-  return _M_ntransfers;
+  _M_next_transfer = first;
+  _M_period = period;
 }
 
-unsigned configuration::number_loops() const
+void connection::timer()
 {
-  return _M_nloops;
+  const timer_wait wait = _M_timer_wait;
+  _M_timer_wait = timer_wait::none;
+
+  switch (wait) {
+    case timer_wait::connect:
+      // Start an asynchronous connect.
+      connect();
+      break;
+    case timer_wait::transfer:
+      // Start an asynchronous send.
+      send_payload();
+      break;
+    case timer_wait::fault:
+      fault_timer();
+      break;
+    case timer_wait::none:
+    default:
+      // Stale expiration (the callback was already queued when the timer
+      // was disarmed).
+      break;
+  }
 }
 
-const void* configuration::data() const
+void connection::connected()
 {
-  return _M_data;
+  _M_connected = statistics::now();
+
+  _M_stats.record(statistics::latency::connect,
+                  _M_connected - _M_connect_start);
+
+  // If the connect has reused the socket of the previous connection...
+  if (_M_sock.reused()) {
+    _M_stats.count(statistics::event::socket_reuse);
+  }
+
+  // Reset number of transfers per connection.
+  _M_ntransfers = 0;
+
+  _M_closing = false;
+
+  // Fault of the connection (the connects of all the connections are
+  // numbered loop by loop).
+  _M_fault = _M_config.fault_for(
+               (static_cast<uint64_t>(_M_nloops) *
+                _M_config.number_connections()) + _M_index
+             );
+
+  if (_M_fault == configuration::fault::none) {
+    _M_fault_state = fault_state::none;
+
+    // Start the first transfer.
+    start_transfer(_M_connected);
+  } else {
+    inject_fault(_M_connected);
+  }
 }
 
-size_t configuration::length() const
+void connection::start_transfer(uint64_t now)
 {
-  return _M_length;
+  // Closed loop?
+  if (_M_period == 0) {
+    _M_transfer_start = now;
+  } else {
+    _M_transfer_start = _M_next_transfer;
+    _M_next_transfer += _M_period;
+
+    // If the transfer is not due yet...
+    if (_M_transfer_start > now) {
+      // Wait for its scheduled time.
+      _M_timer_wait = timer_wait::transfer;
+      _M_timer.expires_in((_M_transfer_start - now) / 1000);
+      return;
+    }
+  }
+
+  // Start an asynchronous send.
+  send_payload();
 }
 
-bool configuration::load_file(const char* filename)
+void connection::send_payload()
 {
-  // If `filename` exists and is a regular file...
-  struct _stat64 sbuf;
-  if ((_stat64(filename, &sbuf) == 0) && ((sbuf.st_mode & _S_IFREG) != 0)) {
-    // If the file is neither too small nor too big...
-    if ((sbuf.st_size >= static_cast<int64_t>(min_data_transfer)) &&
-        (sbuf.st_size <= static_cast<int64_t>(max_data_transfer))) {
-      // Open file for reading.
-      int fd;
-      if (_sopen_s(&fd,
-                   filename,
-                   _O_RDONLY | _O_BINARY,
-                   _SH_DENYNO,
-                   0) == 0) {
-        // Allocate memory.
-        _M_data = static_cast<uint8_t*>(malloc(sbuf.st_size));
+  const configuration::payload& p = _M_config.payloads()[_M_payload];
 
-        // If the data could be allocated...
-        if (_M_data) {
-          // Read file.
-          _M_length = 0;
-          do {
-            // Read from file.
-            const int ret = _read(fd,
-                                  _M_data + _M_length,
-                                  sbuf.st_size - _M_length);
+  // Cycle through the payloads (the connections start at different ones).
+  if (++_M_payload == _M_config.number_payloads()) {
+    _M_payload = 0;
+  }
 
-            if (ret > 0) {
-              _M_length += ret;
+  _M_length = p.length;
 
-              // If we have read the whole file...
-              if (static_cast<int64_t>(_M_length) == sbuf.st_size) {
-                _close(fd);
+  // Start an asynchronous send.
+  send(p.data, static_cast<DWORD>(p.length));
+}
 
-                return true;
-              }
-            } else if (ret < 0) {
-              fprintf(stderr, "Error reading from '%s'.\n", filename);
+void connection::send(const void* buf, DWORD len)
+{
+  // Save view.
+  _M_sendbuf.data = static_cast<const uint8_t*>(buf);
+  _M_sendbuf.length = len;
 
-              _close(fd);
+  // Start an asynchronous send.
+  _M_sock.send(buf, len);
+}
 
-              return false;
-            }
-          } while (true);
-        } else {
-          fprintf(stderr, "Error allocating memory.\n");
-        }
+void connection::sent(DWORD count)
+{
+  const uint64_t now = statistics::now();
 
-        _close(fd);
-      } else {
-        fprintf(stderr, "Error opening file '%s' for reading.\n", filename);
-      }
+  // If this is the first send of the connection...
+  if (!_M_first_byte) {
+    _M_stats.record(statistics::latency::first_byte, now - _M_connect_start);
+    _M_first_byte = true;
+  }
+
+  // If we have sent all the data...
+  if (count == _M_sendbuf.length) {
+    _M_stats.record(statistics::latency::send, now - _M_transfer_start);
+    _M_stats.count_bytes(_M_length);
+
+    // Echo mode?
+    if (_M_config.echo()) {
+      // Wait for the data to be echoed back.
+      _M_received = 0;
+      receive();
     } else {
-      fprintf(stderr,
-              "File size (%lld) out of range (valid range: %zu .. %zu).\n",
-              sbuf.st_size,
-              min_data_transfer,
-              max_data_transfer);
+      transferred(now);
     }
   } else {
-    fprintf(stderr,
-            "File '%s' doesn't exist or is not a regular file.\n",
-            filename);
+    // Send the rest.
+    send(_M_sendbuf.data + count, _M_sendbuf.length - count);
   }
-
-  return false;
 }
 
-void configuration::usage(const char* program)
+void connection::receive()
 {
-  fprintf(stderr,
-          "Usage: %s [OPTIONS] --address <address> "
-          "(--file <filename> | --data <number-bytes>)\n\n",
-          program);
-
-  fprintf(stderr, "Options:\n");
-  fprintf(stderr, "  --help\n");
-  fprintf(stderr, "  --number-connections <number-connections>\n");
-  fprintf(stderr,
-          "  --number-transfers-per-connection "
-          "<number-transfers-per-connection>\n");
+  const size_t left = _M_length - _M_received;
 
-  fprintf(stderr, "  --number-loops <number-loops>\n\n");
+  // Start an asynchronous receive.
+  _M_sock.receive(_M_recvbuf,
+                  (left < receive_buffer_size) ? left : receive_buffer_size);
+}
 
-  fprintf(stderr, "Valid values:\n");
-  fprintf(stderr,
-          "  <number-connections> ::= %zu .. %zu (default: %zu)\n",
-          min_connections,
-          max_connections,
-          default_connections);
+void connection::received(DWORD transferred)
+{
+  // If some data has been received...
+  if (transferred > 0) {
+    _M_received += transferred;
 
-  fprintf(stderr,
-          "  <number-transfers-per-connection> ::= %u .. %u (default: %u)\n",
-          min_transfers,
-          max_transfers,
-          default_transfers);
+    // If all the data has been echoed back...
+    if (_M_received >= _M_length) {
+      const uint64_t now = statistics::now();
 
-  fprintf(stderr,
-          "  <number-loops> ::= %u .. %u (default: %u)\n",
-          min_loops,
-          max_loops,
-          default_loops);
+      _M_stats.record(statistics::latency::round_trip,
+                      now - _M_transfer_start);
 
-  fprintf(stderr,
-          "  <number-bytes> ::= %zu .. %zu\n",
-          min_data_transfer,
-          max_data_transfer);
+      this->transferred(now);
+    } else {
+      // Receive the rest.
+      receive();
+    }
+  } else {
+    // The peer has closed the connection.
+    close();
+  }
 }
 
-bool configuration::parse(const char* s,
-                          uint64_t& n,
-                          uint64_t min,
-                          uint64_t max)
+void connection::transferred(uint64_t now)
 {
-  if (*s) {
-    uint64_t res = 0;
+  // If not the last transfer of the connection...
+  if (++_M_ntransfers < _M_config.number_transfers_per_connection()) {
+    // Start the next transfer.
+    start_transfer(now);
+  } else {
+    _M_stats.record(statistics::latency::transfer, now - _M_connected);
 
-    do {
-      // Digit?
-      if ((*s >= '0') && (*s <= '9')) {
-        const uint64_t tmp = (res * 10) + (*s - '0');
+    // Close connection.
+    close();
+  }
+}
 
-        // If the number doesn't overflow and is not too big...
-        if ((tmp >= res) && (tmp <= max)) {
-          res = tmp;
-        } else {
-          return false;
-        }
-      } else {
-        return false;
-      }
-    } while (*++s);
+void connection::close()
+{
+  // If the disconnect has already been started (the connection can be
+  // closed from both the timer and a completion)...
+  if (_M_closing) {
+    return;
+  }
 
-    // If the number is not too small...
-    if (res >= min) {
-      n = res;
-      return true;
-    }
+  _M_closing = true;
+
+  // If the fault timer is armed, disarm it, so that it doesn't expire in
+  // the next loop of the connection (this might be the timer callback, so
+  // don't wait for it).
+  if (_M_timer_wait == timer_wait::fault) {
+    _M_timer_wait = timer_wait::none;
+    _M_timer.disarm();
   }
 
-  return false;
+  // Cancel outstanding requests.
+  _M_sock.cancel(net::async::stream::socket::operation::send);
+  _M_sock.cancel(net::async::stream::socket::operation::receive);
+
+  // Disconnect.
+  _M_sock.disconnect();
 }
 
+void connection::disconnected()
+{
+  _M_stats.count(statistics::event::disconnect);
 
-////////////////////////////////////////////////////////////////////////////////
-////////////////////////////////////////////////////////////////////////////////
-//                                                                            //
-// Connection.                                                                //
-//                                                                            //
-////////////////////////////////////////////////////////////////////////////////
-////////////////////////////////////////////////////////////////////////////////
+  next_loop(statistics::now());
+}
 
-class connection {
-  public:
-    // Constructor.
-    connection(const configuration& config,
-               uint32_t* nconnections,
-               PTP_CALLBACK_ENVIRON callbackenv = nullptr);
+void connection::connect_failed(DWORD error)
+{
+  _M_stats.error(statistics::event::connect_error, error);
 
-    // Destructor.
-    ~connection() = default;
+  // Retry from the timer (the connect might have failed synchronously, and
+  // retrying from here could recurse for every remaining loop).
+  next_loop(statistics::now(), true);
+}
 
-    // Connect.
-    void connect();
+void connection::next_loop(uint64_t now, bool defer)
+{
+  // If not the last loop...
+  if (++_M_nloops < _M_config.number_loops()) {
+    // Start the next connect.
+    start_connect(now, defer);
+  } else {
+    // Decrement number of running connections of the shard (only updated
+    // from the thread of the shard).
+    if (--*_M_nconnections == 0) {
+      // Decrement number of running shards.
+      if (::InterlockedDecrement(_M_nshards) == 0) {
+        ::SetEvent(stop_event);
+      }
+    }
+  }
+}
 
-  private:
-    // Buffer view.
-    struct buffer_view {
-      const uint8_t* data;
-      DWORD length;
-    };
+void connection::inject_fault(uint64_t now)
+{
+  const configuration::payload& p = _M_config.payloads()[_M_payload];
+
+  // Cycle through the payloads.
+  if (++_M_payload == _M_config.number_payloads()) {
+    _M_payload = 0;
+  }
 
-    // Socket.
-    net::async::stream::socket _M_sock;
+  _M_fault_payload = &p;
 
-    // Number of transfers per connection.
-    unsigned _M_ntransfers;
+  // The faulty connections record neither transfers nor bytes, so that the
+  // throughput only counts the normal traffic.
+  switch (_M_fault) {
+    case configuration::fault::idle:
+      _M_stats.count(statistics::event::idle);
 
-    // Number of loops.
-    unsigned _M_nloops = 0;
+      // Send nothing.
+      hold(now);
 
-    // Send buffer view.
-    buffer_view _M_sendbuf;
+      break;
+    case configuration::fault::trickle:
+      _M_stats.count(statistics::event::trickle);
 
-    // Number of connections.
-    uint32_t* _M_nconnections;
+      // Send the first byte at once, and the next ones from the timer.
+      _M_trickled = 0;
+      _M_trickling = false;
+      _M_next_trickle = now;
 
-    // Configuration.
-    const configuration& _M_config;
+      hold(now);
 
-    // Connected.
-    void connected();
+      break;
+    case configuration::fault::reset:
+      _M_stats.count(statistics::event::reset);
+      _M_fault_state = fault_state::sending;
 
-    // Send.
-    void send(const void* buf, DWORD len);
+      // Send the first half of the payload.
+      send(p.data, (p.length > 1) ? static_cast<DWORD>(p.length / 2) : 1);
 
-    // Data has been sent.
-    void sent(DWORD count);
+      break;
+    case configuration::fault::half_close:
+      _M_stats.count(statistics::event::half_close);
+      _M_fault_state = fault_state::sending;
 
-    // Close connection.
-    void close();
+      // Send the payload.
+      send(p.data, static_cast<DWORD>(p.length));
 
-    // Disconnected.
-    void disconnected();
+      break;
+    case configuration::fault::none:
+    default:
+      break;
+  }
+}
 
-    // Notify of a completed socket I/O operation.
-    void complete(net::async::stream::socket::operation op,
-                  DWORD error,
-                  DWORD transferred);
+void connection::fault_sent(DWORD count)
+{
+  switch (_M_fault_state) {
+    case fault_state::sending:
+      // If not all the data has been sent...
+      if (count < _M_sendbuf.length) {
+        // Send the rest.
+        send(_M_sendbuf.data + count, _M_sendbuf.length - count);
+      } else if (_M_fault == configuration::fault::reset) {
+        _M_fault_state = fault_state::closing;
+
+        // Reset the connection in the middle of the transfer (there are no
+        // outstanding operations).
+        _M_sock.abort();
+
+        _M_stats.count(statistics::event::disconnect);
+
+        // Reconnect from the timer (the send might have completed
+        // synchronously).
+        next_loop(statistics::now(), true);
+      } else {
+        // Half-close the connection.
+        if (_M_sock.shutdown_send()) {
+          hold(statistics::now());
+        } else {
+          _M_stats.error(statistics::event::io_error, ::WSAGetLastError());
 
-    // Notify of a completed socket I/O operation.
-    static void complete(net::async::stream::socket::operation op,
-                         DWORD error,
-                         DWORD transferred,
-                         void* user);
+          _M_fault_state = fault_state::closing;
 
-    // Disable copy constructor and assignment operation.
-    connection(const connection&) = delete;
-    connection& operator=(const connection&) = delete;
-};
+          // Close connection.
+          close();
+        }
+      }
 
-connection::connection(const configuration& config,
-                       uint32_t* nconnections,
-                       PTP_CALLBACK_ENVIRON callbackenv)
-  : _M_sock{complete, this, callbackenv},
-    _M_nconnections{nconnections},
-    _M_config{config}
-{
+      break;
+    case fault_state::holding:
+      // The byte has been trickled.
+      _M_trickling = false;
+      break;
+    case fault_state::closing:
+    case fault_state::none:
+    default:
+      break;
+  }
 }
 
-void connection::connect()
+void connection::fault_received(DWORD transferred)
 {
-  // Start an asynchronous connect.
-  _M_sock.connect(_M_config.address());
+  // If the connection is held open...
+  if (_M_fault_state == fault_state::holding) {
+    // If some data has been received (discarded)...
+    if (transferred > 0) {
+      wait_close();
+    } else {
+      // The peer has closed the connection.
+      hold_ended();
+    }
+  }
 }
 
-void connection::connected()
+void connection::fault_failed(DWORD error)
 {
-  // Reset number of transfers per connection.
-  _M_ntransfers = 0;
+  switch (_M_fault_state) {
+    case fault_state::holding:
+      // The peer has reset the connection.
+      hold_ended();
+      break;
+    case fault_state::sending:
+      _M_stats.error(statistics::event::io_error, error);
 
-  // Start an asynchronous send.
-  send(_M_config.data(), _M_config.length());
+      _M_fault_state = fault_state::closing;
+
+      // Close connection.
+      close();
+
+      break;
+    case fault_state::closing:
+    case fault_state::none:
+    default:
+      break;
+  }
 }
 
-void connection::send(const void* buf, DWORD len)
+void connection::hold(uint64_t now)
 {
-  // Save view.
-  _M_sendbuf.data = static_cast<const uint8_t*>(buf);
-  _M_sendbuf.length = len;
+  _M_fault_state = fault_state::holding;
+  _M_hold_deadline = now + (_M_config.fault_hold() * 1000000000ull);
 
-  // Start an asynchronous send.
-  _M_sock.send(buf, len);
+  // Arm the timer before receiving: the receive might complete
+  // synchronously and close the connection.
+  arm_fault_timer(now);
+
+  // Wait for the peer to close the connection.
+  wait_close();
 }
 
-void connection::sent(DWORD count)
+void connection::wait_close()
 {
-  // If we have sent all the data...
-  if (count == _M_sendbuf.length) {
-    // If not the last transfer of the connection...
-    if (++_M_ntransfers < _M_config.number_transfers_per_connection()) {
-      // Start an asynchronous send.
-      send(_M_config.data(), _M_config.length());
-    } else {
-      // Close connection.
-      close();
-    }
-  } else {
-    // Send the rest.
-    send(_M_sendbuf.data + count, _M_sendbuf.length - count);
-  }
+  // Start an asynchronous receive.
+  _M_sock.receive(_M_recvbuf, receive_buffer_size);
 }
 
-void connection::close()
+void connection::hold_ended()
 {
-  // Cancel outstanding requests.
-  _M_sock.cancel(net::async::stream::socket::operation::send);
+  _M_stats.record(statistics::latency::hold,
+                  statistics::now() - _M_connected);
 
-  // Disconnect.
-  _M_sock.disconnect();
+  _M_fault_state = fault_state::closing;
+
+  // Close connection.
+  close();
 }
 
-void connection::disconnected()
+void connection::fault_timer()
 {
-  // If not the last loop...
-  if (++_M_nloops < _M_config.number_loops()) {
-    // Start an asynchronous connect.
-    connect();
-  } else {
-    // Decrement number of running connections.
-    if (::InterlockedDecrement(_M_nconnections) == 0) {
-      ::SetEvent(stop_event);
+  // If the connection is not held open anymore...
+  if (_M_fault_state != fault_state::holding) {
+    return;
+  }
+
+  const uint64_t now = statistics::now();
+
+  // If the peer hasn't closed the connection in time...
+  if (now >= _M_hold_deadline) {
+    _M_stats.count(statistics::event::hold_expired);
+
+    _M_fault_state = fault_state::closing;
+
+    // Close connection.
+    close();
+
+    return;
+  }
+
+  // If the next byte has to be trickled (and the previous one has been
+  // sent)...
+  if ((_M_fault == configuration::fault::trickle) &&
+      (now >= _M_next_trickle) &&
+      (!_M_trickling)) {
+    _M_next_trickle = now + (_M_config.trickle_interval() * 1000000000ull);
+
+    // Arm the timer before sending: the send might complete synchronously
+    // and close the connection.
+    arm_fault_timer(now);
+
+    const configuration::payload& p = *_M_fault_payload;
+
+    const size_t offset = _M_trickled;
+    if (++_M_trickled == p.length) {
+      _M_trickled = 0;
     }
+
+    _M_trickling = true;
+
+    // Send a single byte.
+    send(p.data + offset, 1);
+  } else {
+    arm_fault_timer(now);
+  }
+}
+
+void connection::arm_fault_timer(uint64_t now)
+{
+  uint64_t due = _M_hold_deadline;
+
+  // Trickle?
+  if ((_M_fault == configuration::fault::trickle) && (_M_next_trickle < due)) {
+    due = _M_next_trickle;
   }
+
+  _M_timer_wait = timer_wait::fault;
+  _M_timer.expires_in((due > now) ? (due - now) / 1000 : 0);
 }
 
 void connection::complete(net::async::stream::socket::operation op,
@@ -655,7 +848,11 @@ void connection::complete(net::async::stream::socket::operation op,
     switch (op) {
       case net::async::stream::socket::operation::send:
         // Data has been sent.
-        sent(transferred);
+        if (_M_fault_state == fault_state::none) {
+          sent(transferred);
+        } else {
+          fault_sent(transferred);
+        }
 
         break;
       case net::async::stream::socket::operation::disconnect:
@@ -668,17 +865,32 @@ void connection::complete(net::async::stream::socket::operation op,
         connected();
 
         break;
-      case net::async::stream::socket::operation::accept:
       case net::async::stream::socket::operation::receive:
+        // Data has been received.
+        if (_M_fault_state == fault_state::none) {
+          received(transferred);
+        } else {
+          fault_received(transferred);
+        }
+
+        break;
+      case net::async::stream::socket::operation::accept:
       default:
         break;
     }
   } else {
     switch (op) {
       case net::async::stream::socket::operation::send:
+      case net::async::stream::socket::operation::receive:
         if (error != WSA_OPERATION_ABORTED) {
-          // Close connection.
-          close();
+          if (_M_fault_state == fault_state::none) {
+            _M_stats.error(statistics::event::io_error, error);
+
+            // Close connection.
+            close();
+          } else {
+            fault_failed(error);
+          }
         }
 
         break;
@@ -687,97 +899,298 @@ void connection::complete(net::async::stream::socket::operation op,
         disconnected();
 
         break;
-      case net::async::stream::socket::operation::accept:
       case net::async::stream::socket::operation::connect:
-      case net::async::stream::socket::operation::receive:
+        // The connect has failed (the socket has been closed).
+        connect_failed(error);
+
+        break;
+      case net::async::stream::socket::operation::accept:
       default:
         break;
     }
   }
 }
 
-void connection::complete(net::async::stream::socket::operation op,
-                          DWORD error,
-                          DWORD transferred,
-                          void* user)
-{
-  static_cast<connection*>(user)->complete(op, error, transferred);
-}
-
 
 ////////////////////////////////////////////////////////////////////////////////
 ////////////////////////////////////////////////////////////////////////////////
 //                                                                            //
-// Connections.                                                               //
+// Shard.                                                                     //
 //                                                                            //
 ////////////////////////////////////////////////////////////////////////////////
 ////////////////////////////////////////////////////////////////////////////////
 
-class connections {
+// Connections driven by a thread pool with a single thread.
+// The connections are started from the thread of the shard, so all their
+// completions (including the ones which complete synchronously) run on that
+// thread: the counters of the shard are not shared with other threads, and
+// the statistics are only aggregated when they are printed or saved.
+class shard {
   public:
     // Constructor.
-    connections() = default;
+    shard() = default;
 
     // Destructor.
-    ~connections();
+    ~shard();
 
-    // Create.
+    // Create the connections `first` .. `first + count - 1`.
     bool create(const configuration& config,
-                PTP_CALLBACK_ENVIRON callbackenv = nullptr);
+                size_t first,
+                size_t count,
+                uint32_t* nshards,
+                statistics& stats);
+
+    // Schedule the transfers (open loop) and the connects (churn) of the
+    // connections from `start` (nanoseconds).
+    void schedule(uint64_t start);
+
+    // Start the connections (from the thread of the shard).
+    bool start();
 
   private:
+    // Thread pool.
+    net::async::thread_pool _M_thread_pool;
+
+    // Allocator of connections.
+    util::slab _M_slab;
+
     // Connections.
     connection** _M_connections = nullptr;
+    size_t _M_nconnections = 0;
 
-    // Number of connections.
-    size_t _M_nconnections;
+    // Index of the first connection.
+    size_t _M_first;
 
     // Number of running connections.
-    uint32_t _M_nrunning;
+    size_t _M_nrunning;
+
+    // Receive buffer (echo mode and faults).
+    uint8_t* _M_recvbuf = nullptr;
+
+    // Configuration.
+    const configuration* _M_config = nullptr;
+
+    // Start the connections.
+    static void CALLBACK start_callback(PTP_CALLBACK_INSTANCE instance,
+                                        void* context);
 
     // Disable copy constructor and assignment operator.
-    connections(const connections&) = delete;
-    connections& operator=(const connections&) = delete;
+    shard(const shard&) = delete;
+    shard& operator=(const shard&) = delete;
 };
 
-connections::~connections()
+shard::~shard()
 {
   if (_M_connections) {
     for (size_t i = 0; i < _M_nconnections; i++) {
-      delete _M_connections[i];
+      _M_slab.destroy(_M_connections[i]);
     }
 
     free(_M_connections);
   }
+
+  free(_M_recvbuf);
 }
 
-bool connections::create(const configuration& config,
-                         PTP_CALLBACK_ENVIRON callbackenv)
+bool shard::create(const configuration& config,
+                   size_t first,
+                   size_t count,
+                   uint32_t* nshards,
+                   statistics& stats)
 {
-  const size_t nconnections = config.number_connections();
+  _M_config = &config;
+  _M_first = first;
+
+  // Create thread pool (a single thread).
+  if (!_M_thread_pool.create(1, 1)) {
+    return false;
+  }
+
+  // Echo mode or faults?
+  if ((config.echo()) || (config.faults())) {
+    // Allocate receive buffer.
+    _M_recvbuf = static_cast<uint8_t*>(
+                   malloc(connection::receive_buffer_size)
+                 );
+
+    if (!_M_recvbuf) {
+      return false;
+    }
+  }
 
   _M_connections = static_cast<connection**>(
-                     malloc(nconnections * sizeof(connection*))
+                     malloc(count * sizeof(connection*))
                    );
 
-  if (_M_connections) {
+  // Create slab allocator of connections.
+  if ((_M_connections) && (_M_slab.create(sizeof(connection), count))) {
+    PTP_CALLBACK_ENVIRON callbackenv = _M_thread_pool.callback_environment();
+
     // Create connections.
-    for (_M_nconnections = 0;
-         _M_nconnections < nconnections;
-         _M_nconnections++) {
-      _M_connections[_M_nconnections] =
-        new (std::nothrow) connection{config, &_M_nrunning, callbackenv};
+    for (; _M_nconnections < count; _M_nconnections++) {
+      connection* const
+        conn = _M_slab.construct<connection>(config,
+                                             first + _M_nconnections,
+                                             &_M_nrunning,
+                                             nshards,
+                                             stats,
+                                             _M_recvbuf,
+                                             callbackenv);
+
+      if (!conn) {
+        return false;
+      }
 
-      if (!_M_connections[_M_nconnections]) {
+      _M_connections[_M_nconnections] = conn;
+
+      if (!conn->create(callbackenv)) {
         return false;
       }
     }
 
-    _M_nrunning = static_cast<uint32_t>(_M_nconnections);
+    _M_nrunning = _M_nconnections;
+
+    return true;
+  }
+
+  return false;
+}
+
+void shard::schedule(uint64_t start)
+{
+  const size_t nconnections = _M_config->number_connections();
+
+  // Open loop?
+  if (_M_config->rate() > 0) {
+    // Every connection sends at `rate / nconnections`, the connections
+    // (of all the shards) being evenly staggered.
+    const double interval = 1e9 / static_cast<double>(_M_config->rate());
+
+    for (size_t i = 0; i < _M_nconnections; i++) {
+      _M_connections[i]->schedule(
+        start + static_cast<uint64_t>((_M_first + i) * interval),
+        static_cast<uint64_t>(nconnections * interval)
+      );
+    }
+  }
+
+  // Churn?
+  if (_M_config->churn() > 0) {
+    // Every connection reconnects at `churn / nconnections`, the
+    // connections (of all the shards) being evenly staggered.
+    const double interval = 1e9 / static_cast<double>(_M_config->churn());
+
+    for (size_t i = 0; i < _M_nconnections; i++) {
+      _M_connections[i]->churn(
+        start + static_cast<uint64_t>((_M_first + i) * interval),
+        static_cast<uint64_t>(nconnections * interval)
+      );
+    }
+  }
+}
+
+bool shard::start()
+{
+  return (::TrySubmitThreadpoolCallback(
+            start_callback,
+            this,
+            _M_thread_pool.callback_environment()
+          ) != FALSE);
+}
 
+void shard::start_callback(PTP_CALLBACK_INSTANCE instance, void* context)
+{
+  shard* const s = static_cast<shard*>(context);
+
+  // Churn?
+  if (s->_M_config->churn() > 0) {
+    // Connect (at the scheduled times).
+    const uint64_t now = statistics::now();
+    for (size_t i = 0; i < s->_M_nconnections; i++) {
+      s->_M_connections[i]->start_connect(now);
+    }
+  } else {
     // Connect.
-    for (size_t i = 0; i < nconnections; i++) {
-      _M_connections[i]->connect();
+    for (size_t i = 0; i < s->_M_nconnections; i++) {
+      s->_M_connections[i]->connect();
+    }
+  }
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+//                                                                            //
+// Connections.                                                               //
+//                                                                            //
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+
+// Connections, split between the shards (one per thread).
+class connections {
+  public:
+    // Constructor.
+    connections() = default;
+
+    // Destructor.
+    ~connections();
+
+    // Create.
+    bool create(const configuration& config, statistics& stats);
+
+  private:
+    // Shards.
+    shard* _M_shards = nullptr;
+
+    // Number of running shards.
+    uint32_t _M_nrunning;
+
+    // Disable copy constructor and assignment operator.
+    connections(const connections&) = delete;
+    connections& operator=(const connections&) = delete;
+};
+
+connections::~connections()
+{
+  delete [] _M_shards;
+}
+
+bool connections::create(const configuration& config, statistics& stats)
+{
+  const size_t nshards = config.number_threads();
+
+  _M_shards = new (std::nothrow) shard[nshards];
+
+  if (_M_shards) {
+    const size_t nconnections = config.number_connections();
+
+    // Create shards (splitting the connections evenly).
+    for (size_t i = 0; i < nshards; i++) {
+      const size_t first = (i * nconnections) / nshards;
+      const size_t last = ((i + 1) * nconnections) / nshards;
+
+      if (!_M_shards[i].create(config,
+                               first,
+                               last - first,
+                               &_M_nrunning,
+                               stats)) {
+        return false;
+      }
+    }
+
+    _M_nrunning = static_cast<uint32_t>(nshards);
+
+    // Schedule the connections.
+    const uint64_t start = statistics::now();
+    for (size_t i = 0; i < nshards; i++) {
+      _M_shards[i].schedule(start);
+    }
+
+    // Start the shards.
+    for (size_t i = 0; i < nshards; i++) {
+      if (!_M_shards[i].start()) {
+        return false;
+      }
     }
 
     return true;
@@ -805,42 +1218,92 @@ int main(int argc, const char* argv[])
     if (library.init()) {
       // Load functions.
       if (net::async::stream::socket::load_functions()) {
-        // Create thread pool.
-        net::async::thread_pool thread_pool;
-        if (thread_pool.create()) {
-          // Create event.
-          stop_event = ::CreateEvent(nullptr, TRUE, FALSE, nullptr);
-
-          // If the event could be created...
-          if (stop_event) {
-            // Install signal handler.
-            if (::SetConsoleCtrlHandler(signal_handler, TRUE)) {
-              // Create connections.
-              connections connections;
-              if (connections.create(config)) {
-                printf("Waiting for signal to arrive or tests to finish.\n");
-
-                // Wait for signal to arrive or tests to finish.
-                ::WaitForSingleObject(stop_event, INFINITE);
-
+        // Create event.
+        stop_event = ::CreateEvent(nullptr, TRUE, FALSE, nullptr);
+
+        // If the event could be created...
+        if (stop_event) {
+          // Install signal handler.
+          if (::SetConsoleCtrlHandler(signal_handler, TRUE)) {
+            // Create connections.
+            statistics stats;
+            connections connections;
+
+            statistics::run run;
+            uint64_t user, kernel;
+            statistics::cpu_time(user, kernel);
+
+            const uint64_t start = statistics::now();
+            if (connections.create(config, stats)) {
+              printf("%zu connections on %zu threads.\n",
+                     config.number_connections(),
+                     config.number_threads());
+
+              // Live report of the latency of the transfers (of the
+              // round trips in echo mode, of the connects when churning).
+              reporter reporter{
+                stats,
+                (config.churn() > 0) ? statistics::latency::connect :
+                config.echo() ? statistics::latency::round_trip :
+                                statistics::latency::send
+              };
+
+              if ((config.report_interval() > 0) &&
+                  (!reporter.start(config.report_interval()))) {
+                fprintf(stderr, "Error starting the live report.\n");
                 ::CloseHandle(stop_event);
+                return EXIT_FAILURE;
+              }
+
+              printf("Waiting for signal to arrive or tests to finish.\n");
+
+              // Wait for signal to arrive or tests to finish.
+              ::WaitForSingleObject(stop_event, INFINITE);
+
+              run.elapsed = statistics::now() - start;
+
+              reporter.stop();
 
-                printf("Exiting...\n");
+              statistics::cpu_time(run.cpu_user, run.cpu_kernel);
+              run.cpu_user -= user;
+              run.cpu_kernel -= kernel;
 
-                return EXIT_SUCCESS;
-              } else {
-                fprintf(stderr, "Error creating connections.\n");
+              ::CloseHandle(stop_event);
+
+              // Open loop?
+              if (config.rate() > 0) {
+                printf("Target rate: %llu transfers/s (send latencies are "
+                       "measured from the scheduled start times).\n",
+                       static_cast<unsigned long long>(config.rate()));
+              } else if (config.churn() > 0) {
+                printf("Target connection rate: %llu connects/s (connect "
+                       "latencies are measured from the scheduled "
+                       "times).\n",
+                       static_cast<unsigned long long>(config.churn()));
+              }
+
+              // Print statistics.
+              stats.print(run);
+
+              // Save statistics.
+              if ((config.output()) &&
+                  (!stats.save(run, config))) {
+                return EXIT_FAILURE;
               }
+
+              printf("Exiting...\n");
+
+              return EXIT_SUCCESS;
             } else {
-              fprintf(stderr, "Error installing signal handler.\n");
+              fprintf(stderr, "Error creating connections.\n");
             }
-
-            ::CloseHandle(stop_event);
           } else {
-            fprintf(stderr, "Error creating event.\n");
+            fprintf(stderr, "Error installing signal handler.\n");
           }
+
+          ::CloseHandle(stop_event);
         } else {
-          fprintf(stderr, "Error creating thread pool.\n");
+          fprintf(stderr, "Error creating event.\n");
         }
       } else {
         fprintf(stderr, "Error loading functions.\n");
@@ -0,0 +1,92 @@
+#pragma once
+
+// Requires `-std=c++20`.
+
+#include "util/timer.hpp"
+#include "util/coroutine.hpp"
+
+namespace util {
+
+// Asynchronous timer awaitable from coroutines.
+// `co_await t.sleep(interval)` resumes the coroutine on a thread of the
+// callback environment once `interval` microseconds have elapsed.
+class awaitable_timer {
+  public:
+    // Constructor.
+    awaitable_timer();
+
+    // Destructor.
+    ~awaitable_timer() = default;
+
+    // Create timer.
+    bool create(PTP_CALLBACK_ENVIRON callbackenv = nullptr);
+
+    // Sleep `interval` microseconds.
+    auto sleep(uint64_t interval);
+
+    // Sleep until `expiry_time` (time in microseconds).
+    auto sleep_until(uint64_t expiry_time);
+
+  private:
+    // Timer handler.
+    class handler {
+      public:
+        // Constructor.
+        handler(awaitable_timer* t);
+
+        // Resume the sleeping coroutine.
+        void operator()() const;
+
+      private:
+        // Timer.
+        awaitable_timer* const _M_timer;
+    };
+
+    // Timer.
+    basic_timer<handler> _M_timer;
+
+    // Operation state.
+    coroutine::operation_state _M_state;
+
+    // Disable copy constructor and assignment operator.
+    awaitable_timer(const awaitable_timer&) = delete;
+    awaitable_timer& operator=(const awaitable_timer&) = delete;
+};
+
+inline awaitable_timer::awaitable_timer()
+  : _M_timer{this}
+{
+}
+
+inline bool awaitable_timer::create(PTP_CALLBACK_ENVIRON callbackenv)
+{
+  return _M_timer.create(callbackenv);
+}
+
+inline auto awaitable_timer::sleep(uint64_t interval)
+{
+  return coroutine::awaiter{_M_state,
+                            [this, interval]() {
+                              _M_timer.expires_in(interval);
+                            }};
+}
+
+inline auto awaitable_timer::sleep_until(uint64_t expiry_time)
+{
+  return coroutine::awaiter{_M_state,
+                            [this, expiry_time]() {
+                              _M_timer.expires_at(expiry_time);
+                            }};
+}
+
+inline awaitable_timer::handler::handler(awaitable_timer* t)
+  : _M_timer{t}
+{
+}
+
+inline void awaitable_timer::handler::operator()() const
+{
+  _M_timer->_M_state.complete(0, 0);
+}
+
+} // namespace util
\ No newline at end of file
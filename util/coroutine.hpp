@@ -0,0 +1,342 @@
+#pragma once
+
+// C++20 coroutine support for the asynchronous classes.
+// Requires `-std=c++20`; the rest of the library still builds as C++11.
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <coroutine>
+#include <windows.h>
+
+namespace util {
+namespace coroutine {
+
+// Per-thread pool of coroutine frames.
+// Frames are cached in size classes of `granularity` bytes; frames bigger
+// than `max_size` are allocated with malloc(). A frame released on another
+// thread is cached by that thread.
+class frame_pool {
+  public:
+    // Allocate frame.
+    static void* allocate(size_t size);
+
+    // Release frame.
+    static void deallocate(void* frame, size_t size);
+
+  private:
+    // Size class granularity.
+    static constexpr const size_t granularity = 64;
+
+    // Maximum size of a pooled frame.
+    static constexpr const size_t max_size = 4096;
+
+    // Number of size classes.
+    static constexpr const size_t size_classes = max_size / granularity;
+
+    // Maximum number of cached frames per size class.
+    static constexpr const size_t max_cached = 256;
+
+    // Free frame.
+    struct free_frame {
+      free_frame* next;
+    };
+
+    // Frame cache.
+    class cache {
+      public:
+        // Constructor.
+        cache() = default;
+
+        // Destructor.
+        ~cache();
+
+        // Pop frame of size class `n`.
+        void* pop(size_t n);
+
+        // Push frame of size class `n`.
+        bool push(size_t n, void* frame);
+
+      private:
+        // Free frames per size class.
+        free_frame* _M_frames[size_classes] = {};
+
+        // Number of free frames per size class.
+        size_t _M_count[size_classes] = {};
+    };
+
+    // Cache of the current thread.
+    static thread_local cache _M_cache;
+};
+
+// Coroutine which runs detached: it starts immediately and its frame is
+// released when it finishes.
+class task {
+  public:
+    class promise_type {
+      public:
+        task get_return_object() noexcept;
+        std::suspend_never initial_suspend() noexcept;
+        std::suspend_never final_suspend() noexcept;
+        void return_void() noexcept;
+        void unhandled_exception() noexcept;
+
+        // Frames are allocated from the frame pool of the current thread.
+        static void* operator new(size_t size) noexcept;
+        static void operator delete(void* frame, size_t size) noexcept;
+
+        // If the frame cannot be allocated, the coroutine doesn't run.
+        static task get_return_object_on_allocation_failure() noexcept;
+    };
+};
+
+// Result of an asynchronous operation.
+struct result {
+  // Error code (0 on success).
+  DWORD error;
+
+  // Number of bytes transferred.
+  DWORD transferred;
+};
+
+// State of an asynchronous operation awaited by a coroutine.
+// The operation might complete on another thread before the coroutine has
+// been suspended, or even inline while it is being started; whoever comes
+// last resumes the coroutine.
+class operation_state {
+  public:
+    // Constructor.
+    operation_state() = default;
+
+    // Destructor.
+    ~operation_state() = default;
+
+    // Prepare for a new operation awaited by `coroutine`.
+    void reset(std::coroutine_handle<> coroutine);
+
+    // The operation has been started.
+    // Returns true if the coroutine has been suspended, false if the
+    // operation has already completed and the coroutine should go on.
+    bool suspend();
+
+    // The operation has completed.
+    void complete(DWORD error, DWORD transferred);
+
+    // Get result.
+    struct result result() const;
+
+  private:
+    // States.
+    static constexpr const uint32_t started = 0;
+    static constexpr const uint32_t suspended = 1;
+    static constexpr const uint32_t completed = 2;
+
+    // Awaiting coroutine.
+    std::coroutine_handle<> _M_coroutine;
+
+    // Result.
+    struct result _M_result;
+
+    // State.
+    uint32_t _M_state = completed;
+
+    // Disable copy constructor and assignment operator.
+    operation_state(const operation_state&) = delete;
+    operation_state& operator=(const operation_state&) = delete;
+};
+
+// Awaiter of an asynchronous operation.
+// `Start` starts the operation, whose completion has to be notified to
+// `state`.
+template<typename Start>
+class awaiter {
+  public:
+    // Constructor.
+    awaiter(operation_state& state, Start start);
+
+    // The operation is always started on suspension.
+    bool await_ready() const noexcept;
+
+    // Start the operation.
+    bool await_suspend(std::coroutine_handle<> coroutine);
+
+    // Get the result of the operation.
+    struct result await_resume() const noexcept;
+
+  private:
+    // Operation state.
+    operation_state& _M_state;
+
+    // Start the operation.
+    Start _M_start;
+};
+
+inline thread_local frame_pool::cache frame_pool::_M_cache;
+
+inline frame_pool::cache::~cache()
+{
+  for (size_t i = 0; i < size_classes; i++) {
+    while (_M_frames[i]) {
+      free_frame* const next = _M_frames[i]->next;
+      free(_M_frames[i]);
+      _M_frames[i] = next;
+    }
+  }
+}
+
+inline void* frame_pool::cache::pop(size_t n)
+{
+  free_frame* const frame = _M_frames[n];
+  if (frame) {
+    _M_frames[n] = frame->next;
+    _M_count[n]--;
+  }
+
+  return frame;
+}
+
+inline bool frame_pool::cache::push(size_t n, void* frame)
+{
+  if (_M_count[n] < max_cached) {
+    free_frame* const f = static_cast<free_frame*>(frame);
+    f->next = _M_frames[n];
+    _M_frames[n] = f;
+    _M_count[n]++;
+
+    return true;
+  }
+
+  return false;
+}
+
+inline void* frame_pool::allocate(size_t size)
+{
+  // If the frame is not too big...
+  if (size <= max_size) {
+    // Compute size class.
+    const size_t n = (size + granularity - 1) / granularity - 1;
+
+    void* const frame = _M_cache.pop(n);
+    return frame ? frame : malloc((n + 1) * granularity);
+  }
+
+  return malloc(size);
+}
+
+inline void frame_pool::deallocate(void* frame, size_t size)
+{
+  // If the frame might be cached...
+  if (size <= max_size) {
+    if (_M_cache.push((size + granularity - 1) / granularity - 1, frame)) {
+      return;
+    }
+  }
+
+  free(frame);
+}
+
+inline task task::promise_type::get_return_object() noexcept
+{
+  return {};
+}
+
+inline std::suspend_never task::promise_type::initial_suspend() noexcept
+{
+  return {};
+}
+
+inline std::suspend_never task::promise_type::final_suspend() noexcept
+{
+  return {};
+}
+
+inline void task::promise_type::return_void() noexcept
+{
+}
+
+inline void task::promise_type::unhandled_exception() noexcept
+{
+  abort();
+}
+
+inline void* task::promise_type::operator new(size_t size) noexcept
+{
+  return frame_pool::allocate(size);
+}
+
+inline void task::promise_type::operator delete(void* frame,
+                                                size_t size) noexcept
+{
+  frame_pool::deallocate(frame, size);
+}
+
+inline task task::promise_type::get_return_object_on_allocation_failure()
+  noexcept
+{
+  return {};
+}
+
+inline void operation_state::reset(std::coroutine_handle<> coroutine)
+{
+  _M_coroutine = coroutine;
+  _M_state = started;
+}
+
+inline bool operation_state::suspend()
+{
+  // The coroutine is suspended if the operation hasn't completed yet.
+  return (::InterlockedCompareExchange(&_M_state, suspended, started) ==
+          started);
+}
+
+inline void operation_state::complete(DWORD error, DWORD transferred)
+{
+  // Save result.
+  _M_result.error = error;
+  _M_result.transferred = transferred;
+
+  // If the coroutine has already been suspended...
+  if (::InterlockedExchange(&_M_state, completed) == suspended) {
+    // Resume coroutine.
+    _M_coroutine.resume();
+  }
+}
+
+inline struct result operation_state::result() const
+{
+  return _M_result;
+}
+
+template<typename Start>
+inline awaiter<Start>::awaiter(operation_state& state, Start start)
+  : _M_state{state},
+    _M_start{start}
+{
+}
+
+template<typename Start>
+inline bool awaiter<Start>::await_ready() const noexcept
+{
+  return false;
+}
+
+template<typename Start>
+inline bool awaiter<Start>::await_suspend(std::coroutine_handle<> coroutine)
+{
+  // Prepare operation state.
+  _M_state.reset(coroutine);
+
+  // Start operation.
+  _M_start();
+
+  // Suspend unless the operation has already completed.
+  return _M_state.suspend();
+}
+
+template<typename Start>
+inline struct result awaiter<Start>::await_resume() const noexcept
+{
+  return _M_state.result();
+}
+
+} // namespace coroutine
+} // namespace util
\ No newline at end of file
@@ -0,0 +1,119 @@
+#include <string.h>
+#include "util/histogram.hpp"
+
+namespace util {
+
+histogram::histogram()
+{
+  reset();
+}
+
+void histogram::merge(const histogram& other)
+{
+  for (size_t i = 0; i < ncounts; i++) {
+    _M_counts[i] += other._M_counts[i];
+  }
+
+  if (other._M_count > 0) {
+    if (other._M_min < _M_min) {
+      _M_min = other._M_min;
+    }
+
+    if (other._M_max > _M_max) {
+      _M_max = other._M_max;
+    }
+
+    _M_count += other._M_count;
+    _M_sum += other._M_sum;
+  }
+}
+
+void histogram::subtract(const histogram& other)
+{
+  _M_count = 0;
+  _M_min = UINT64_MAX;
+  _M_max = 0;
+
+  for (size_t i = 0; i < ncounts; i++) {
+    // Copies taken while values are being recorded might be slightly
+    // inconsistent: never let a counter wrap around.
+    _M_counts[i] = (_M_counts[i] > other._M_counts[i]) ?
+                     _M_counts[i] - other._M_counts[i] :
+                     0;
+
+    if (_M_counts[i] > 0) {
+      const uint64_t value = highest_value(i);
+
+      if (_M_count == 0) {
+        _M_min = value;
+      }
+
+      _M_max = value;
+      _M_count += _M_counts[i];
+    }
+  }
+
+  _M_sum = (_M_count > 0) ? _M_sum - other._M_sum : 0.0;
+}
+
+void histogram::reset()
+{
+  memset(_M_counts, 0, sizeof(_M_counts));
+
+  _M_count = 0;
+  _M_min = UINT64_MAX;
+  _M_max = 0;
+  _M_sum = 0.0;
+}
+
+uint64_t histogram::percentile(double p) const
+{
+  if (_M_count > 0) {
+    if (p > 100.0) {
+      p = 100.0;
+    }
+
+    // Number of values at or below the percentile (at least one).
+    uint64_t target = static_cast<uint64_t>(
+                        ((p / 100.0) * static_cast<double>(_M_count)) + 0.5
+                      );
+
+    if (target == 0) {
+      target = 1;
+    } else if (target >= _M_count) {
+      return _M_max;
+    }
+
+    uint64_t total = 0;
+    for (size_t i = 0; i < ncounts; i++) {
+      total += _M_counts[i];
+
+      if (total >= target) {
+        const uint64_t value = highest_value(i);
+
+        // The values are never reported above the maximum.
+        return (value < _M_max) ? value : _M_max;
+      }
+    }
+
+    return _M_max;
+  }
+
+  return 0;
+}
+
+uint64_t histogram::highest_value(size_t index)
+{
+  int bucket = static_cast<int>(index >> (sub_bucket_bits - 1)) - 1;
+  uint64_t sub_bucket = (index & (half_sub_buckets - 1)) + half_sub_buckets;
+
+  // First bucket (including its lower half)?
+  if (bucket < 0) {
+    sub_bucket -= half_sub_buckets;
+    bucket = 0;
+  }
+
+  return ((sub_bucket + 1) << bucket) - 1;
+}
+
+} // namespace util
\ No newline at end of file
@@ -0,0 +1,154 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+namespace util {
+
+// Histogram of values (for instance, latencies in nanoseconds), in the
+// style of HdrHistogram: the values are counted in buckets whose width
+// doubles with every power of two, each one split in `sub_buckets`
+// sub-buckets, so that every recorded value is kept with a relative error
+// below 1 / `sub_buckets` (0.8%) in a fixed amount of memory.
+// Recording a value is a few arithmetic operations and an increment, with
+// no allocation and no synchronization: every thread records into its own
+// histograms, which are merged when they are reported.
+class histogram {
+  public:
+    // Number of sub-buckets per bucket (power of two).
+    static constexpr const unsigned sub_bucket_bits = 7;
+    static constexpr const uint64_t sub_buckets = 1ull << sub_bucket_bits;
+
+    // Highest trackable value: 2^`max_magnitude` - 1 (values above it are
+    // counted as the highest trackable value, but `max()` is exact).
+    static constexpr const unsigned max_magnitude = 42;
+
+    // Constructor.
+    histogram();
+
+    // Destructor.
+    ~histogram() = default;
+
+    // Record value.
+    void record(uint64_t value);
+
+    // Add the values of another histogram.
+    void merge(const histogram& other);
+
+    // Remove the values of `other`, an earlier copy of this histogram, so
+    // that only the values recorded since then are left. The minimum and the
+    // maximum become the highest values of the lowest and of the highest
+    // non-empty counters.
+    void subtract(const histogram& other);
+
+    // Clear histogram.
+    void reset();
+
+    // Get number of values.
+    uint64_t count() const;
+
+    // Get minimum value (0 if the histogram is empty).
+    uint64_t min() const;
+
+    // Get maximum value.
+    uint64_t max() const;
+
+    // Get mean value.
+    double mean() const;
+
+    // Get the value at the percentile `p` (0 .. 100): the highest value
+    // equivalent to the value below which `p`% of the values fall.
+    uint64_t percentile(double p) const;
+
+  private:
+    // Number of sub-buckets in the upper half of a bucket (the lower half
+    // of every bucket but the first one overlaps the previous bucket).
+    static constexpr const uint64_t half_sub_buckets = sub_buckets / 2;
+
+    // Number of buckets.
+    static constexpr const unsigned nbuckets = max_magnitude -
+                                               sub_bucket_bits +
+                                               1;
+
+    // Number of counters.
+    static constexpr const size_t ncounts = (nbuckets + 1) * half_sub_buckets;
+
+    // Counters.
+    uint64_t _M_counts[ncounts];
+
+    // Number of values.
+    uint64_t _M_count;
+
+    // Minimum and maximum values.
+    uint64_t _M_min;
+    uint64_t _M_max;
+
+    // Sum of the values.
+    double _M_sum;
+
+    // Get the index of the counter of a value.
+    static size_t index(uint64_t value);
+
+    // Get the highest value counted by a counter.
+    static uint64_t highest_value(size_t index);
+};
+
+inline void histogram::record(uint64_t value)
+{
+  _M_counts[index(value)]++;
+
+  if (value < _M_min) {
+    _M_min = value;
+  }
+
+  if (value > _M_max) {
+    _M_max = value;
+  }
+
+  _M_count++;
+  _M_sum += static_cast<double>(value);
+}
+
+inline uint64_t histogram::count() const
+{
+  return _M_count;
+}
+
+inline uint64_t histogram::min() const
+{
+  return (_M_count > 0) ? _M_min : 0;
+}
+
+inline uint64_t histogram::max() const
+{
+  return _M_max;
+}
+
+inline double histogram::mean() const
+{
+  return (_M_count > 0) ? _M_sum / static_cast<double>(_M_count) : 0.0;
+}
+
+inline size_t histogram::index(uint64_t value)
+{
+  static constexpr const uint64_t highest = (1ull << max_magnitude) - 1;
+
+  if (value > highest) {
+    value = highest;
+  }
+
+  // Bucket: number of doublings above the first bucket (whose values all
+  // fit in `sub_bucket_bits` bits).
+  const unsigned bucket = 64 -
+                          sub_bucket_bits -
+                          __builtin_clzll(value | (sub_buckets - 1));
+
+  // Sub-bucket (in the upper half of the bucket, except for the first
+  // bucket).
+  const uint64_t sub_bucket = value >> bucket;
+
+  return ((bucket + 1) << (sub_bucket_bits - 1)) +
+         (sub_bucket - half_sub_buckets);
+}
+
+} // namespace util
\ No newline at end of file
@@ -0,0 +1,145 @@
+#pragma once
+
+#include <stdint.h>
+#include <windows.h>
+
+namespace util {
+
+// Lifecycle of a connection.
+// The state (closed, open or closing) and the number of outstanding
+// operations are kept in a single word which is only modified with
+// compare-and-swap, so concurrent closes, timeouts and completions never
+// block each other:
+//   - Every operation acquires a reference before it is started and
+//     releases it when its completion has been processed.
+//   - Only one thread wins close(); it cancels the outstanding operations
+//     while holding its own reference.
+//   - Whoever releases the last reference of a closing connection finishes
+//     closing it (the connection is then closed).
+class lifecycle {
+  public:
+    // Constructor.
+    lifecycle() = default;
+
+    // Destructor.
+    ~lifecycle() = default;
+
+    // Open the connection.
+    // Returns false if the connection was not closed.
+    bool open();
+
+    // Is the connection open?
+    bool is_open() const;
+
+    // Acquire a reference for a new operation.
+    // Returns false if the connection is not open.
+    bool acquire();
+
+    // Acquire a reference on behalf of a caller which already holds one
+    // (succeeds even if the connection is closing).
+    void retain();
+
+    // Release a reference.
+    // Returns true if the connection was closing and this was the last
+    // reference: the connection is now closed and the caller has to finish
+    // closing it.
+    bool release();
+
+    // Start closing the connection.
+    // Returns false if the connection was not open. Otherwise the caller
+    // holds a reference, which it has to release once it has canceled the
+    // outstanding operations.
+    bool close();
+
+  private:
+    // States.
+    static constexpr const uint32_t state_closed = 0;
+    static constexpr const uint32_t state_open = 1;
+    static constexpr const uint32_t state_closing = 2;
+    static constexpr const uint32_t state_mask = 3;
+
+    // One reference.
+    static constexpr const uint32_t reference = 4;
+
+    // State and number of references.
+    uint32_t _M_word = state_closed;
+
+    // Disable copy constructor and assignment operator.
+    lifecycle(const lifecycle&) = delete;
+    lifecycle& operator=(const lifecycle&) = delete;
+};
+
+inline bool lifecycle::open()
+{
+  return (::InterlockedCompareExchange(&_M_word,
+                                       state_open,
+                                       state_closed) == state_closed);
+}
+
+inline bool lifecycle::is_open() const
+{
+  return ((_M_word & state_mask) == state_open);
+}
+
+inline bool lifecycle::acquire()
+{
+  do {
+    const uint32_t word = _M_word;
+
+    // If the connection is not open...
+    if ((word & state_mask) != state_open) {
+      return false;
+    }
+
+    if (::InterlockedCompareExchange(&_M_word,
+                                     word + reference,
+                                     word) == word) {
+      return true;
+    }
+  } while (true);
+}
+
+inline void lifecycle::retain()
+{
+  ::InterlockedExchangeAdd(&_M_word, reference);
+}
+
+inline bool lifecycle::release()
+{
+  do {
+    const uint32_t word = _M_word;
+
+    uint32_t newword = word - reference;
+
+    // If this is the last reference of a closing connection...
+    const bool last = (newword == state_closing);
+    if (last) {
+      newword = state_closed;
+    }
+
+    if (::InterlockedCompareExchange(&_M_word, newword, word) == word) {
+      return last;
+    }
+  } while (true);
+}
+
+inline bool lifecycle::close()
+{
+  do {
+    const uint32_t word = _M_word;
+
+    // If the connection is not open...
+    if ((word & state_mask) != state_open) {
+      return false;
+    }
+
+    // Switch to closing and take a reference for the caller.
+    const uint32_t newword = (word & ~state_mask) + state_closing + reference;
+
+    if (::InterlockedCompareExchange(&_M_word, newword, word) == word) {
+      return true;
+    }
+  } while (true);
+}
+
+} // namespace util
\ No newline at end of file
@@ -0,0 +1,61 @@
+#include "util/mapped_file.hpp"
+
+namespace util {
+
+bool mapped_file::open(const char* filename)
+{
+  // Open file for reading.
+  HANDLE file = ::CreateFile(filename,
+                             GENERIC_READ,
+                             FILE_SHARE_READ,
+                             nullptr,
+                             OPEN_EXISTING,
+                             FILE_ATTRIBUTE_NORMAL,
+                             nullptr);
+
+  if (file != INVALID_HANDLE_VALUE) {
+    // Get file size.
+    LARGE_INTEGER size;
+    if ((::GetFileSizeEx(file, &size)) &&
+        (size.QuadPart > 0) &&
+        (static_cast<uint64_t>(size.QuadPart) <= SIZE_MAX)) {
+      // Create file mapping.
+      HANDLE mapping = ::CreateFileMapping(file,
+                                           nullptr,
+                                           PAGE_READONLY,
+                                           0,
+                                           0,
+                                           nullptr);
+
+      if (mapping) {
+        // Map the whole file (the view keeps the mapping alive).
+        _M_data = static_cast<const uint8_t*>(
+                    ::MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0)
+                  );
+
+        ::CloseHandle(mapping);
+      }
+    }
+
+    ::CloseHandle(file);
+
+    if (_M_data) {
+      _M_size = static_cast<uint64_t>(size.QuadPart);
+      return true;
+    }
+  }
+
+  return false;
+}
+
+void mapped_file::close()
+{
+  if (_M_data) {
+    ::UnmapViewOfFile(_M_data);
+
+    _M_data = nullptr;
+    _M_size = 0;
+  }
+}
+
+} // namespace util
\ No newline at end of file
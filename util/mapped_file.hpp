@@ -0,0 +1,58 @@
+#pragma once
+
+#include <stdint.h>
+#include <windows.h>
+
+namespace util {
+
+// Read-only memory mapping of a whole file.
+// The pages are read on demand and shared with the file cache, so big files
+// can be used without copying them into the heap.
+class mapped_file {
+  public:
+    // Constructor.
+    mapped_file() = default;
+
+    // Destructor.
+    ~mapped_file();
+
+    // Map file (empty files cannot be mapped).
+    bool open(const char* filename);
+
+    // Unmap file.
+    void close();
+
+    // Get the mapped data.
+    const uint8_t* data() const;
+
+    // Get the size of the file.
+    uint64_t size() const;
+
+  private:
+    // Mapped data.
+    const uint8_t* _M_data = nullptr;
+
+    // Size of the file.
+    uint64_t _M_size = 0;
+
+    // Disable copy constructor and assignment operator.
+    mapped_file(const mapped_file&) = delete;
+    mapped_file& operator=(const mapped_file&) = delete;
+};
+
+inline mapped_file::~mapped_file()
+{
+  close();
+}
+
+inline const uint8_t* mapped_file::data() const
+{
+  return _M_data;
+}
+
+inline uint64_t mapped_file::size() const
+{
+  return _M_size;
+}
+
+} // namespace util
\ No newline at end of file
@@ -0,0 +1,132 @@
+#include "util/slab.hpp"
+
+namespace util {
+
+slab::~slab()
+{
+  while (_M_slabs) {
+    header* const next = _M_slabs->next;
+    ::VirtualFree(_M_slabs, 0, MEM_RELEASE);
+    _M_slabs = next;
+  }
+}
+
+bool slab::create(size_t size, size_t count, ULONG node, bool large_pages)
+{
+  // Sanity checks.
+  if ((size > 0) && (count > 0)) {
+    // Round up the object size to a whole number of cache lines.
+    _M_size = (size + cache_line_size - 1) & ~(cache_line_size - 1);
+
+    _M_count = count;
+    _M_node = node;
+    _M_large_pages = large_pages;
+
+    return true;
+  }
+
+  return false;
+}
+
+void* slab::allocate()
+{
+  ::AcquireSRWLockExclusive(&_M_lock);
+
+  // If there are no free objects, allocate a new slab.
+  if ((!_M_free) && (!grow())) {
+    ::ReleaseSRWLockExclusive(&_M_lock);
+    return nullptr;
+  }
+
+  free_object* const obj = _M_free;
+  _M_free = obj->next;
+
+  ::ReleaseSRWLockExclusive(&_M_lock);
+
+  return obj;
+}
+
+void slab::deallocate(void* obj)
+{
+  if (obj) {
+    free_object* const o = static_cast<free_object*>(obj);
+
+    ::AcquireSRWLockExclusive(&_M_lock);
+
+    o->next = _M_free;
+    _M_free = o;
+
+    ::ReleaseSRWLockExclusive(&_M_lock);
+  }
+}
+
+bool slab::grow()
+{
+  if (_M_size == 0) {
+    return false;
+  }
+
+  // Size of the slab (the header takes the first cache line).
+  size_t size = cache_line_size + _M_count * _M_size;
+
+  void* ptr = nullptr;
+
+  // If large pages should be used...
+  if (_M_large_pages) {
+    const size_t large_page_size = ::GetLargePageMinimum();
+
+    if (large_page_size > 0) {
+      // Round up to a whole number of large pages.
+      const size_t s = (size + large_page_size - 1) & ~(large_page_size - 1);
+
+      ptr = ::VirtualAllocExNuma(::GetCurrentProcess(),
+                                 nullptr,
+                                 s,
+                                 MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES,
+                                 PAGE_READWRITE,
+                                 _M_node);
+
+      if (ptr) {
+        size = s;
+      }
+    }
+
+    // If the slab couldn't be allocated on large pages, don't try again.
+    if (!ptr) {
+      _M_large_pages = false;
+    }
+  }
+
+  if (!ptr) {
+    ptr = ::VirtualAllocExNuma(::GetCurrentProcess(),
+                               nullptr,
+                               size,
+                               MEM_RESERVE | MEM_COMMIT,
+                               PAGE_READWRITE,
+                               _M_node);
+
+    if (!ptr) {
+      return false;
+    }
+  }
+
+  // Link slab.
+  header* const h = static_cast<header*>(ptr);
+  h->next = _M_slabs;
+  h->size = size;
+  _M_slabs = h;
+
+  // Add the objects to the free list (in address order).
+  uint8_t* const objects = static_cast<uint8_t*>(ptr) + cache_line_size;
+  for (size_t i = (size - cache_line_size) / _M_size; i > 0; i--) {
+    free_object* const obj =
+      reinterpret_cast<free_object*>(objects + (i - 1) * _M_size);
+
+    obj->next = _M_free;
+    _M_free = obj;
+  }
+
+  return true;
+}
+
+} // namespace util
\ No newline at end of file
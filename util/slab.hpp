@@ -0,0 +1,108 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <new>
+#include <utility>
+#include <windows.h>
+
+namespace util {
+
+// Size of a cache line.
+static constexpr const size_t cache_line_size = 64;
+
+// Slab allocator of objects of a fixed size.
+// Objects are carved out of slabs allocated on a NUMA node (optionally on
+// large pages). Every object starts on a cache line and its size is rounded
+// up to a whole number of cache lines, so two objects never share a cache
+// line. Released objects are reused; the slabs are released by the
+// destructor.
+class slab {
+  public:
+    // Constructor.
+    slab() = default;
+
+    // Destructor.
+    ~slab();
+
+    // Create slab allocator of objects of `size` bytes, allocating `count`
+    // objects at a time.
+    // If `large_pages` is set, slabs are allocated on large pages when
+    // possible (requires the "Lock pages in memory" privilege).
+    bool create(size_t size,
+                size_t count,
+                ULONG node = NUMA_NO_PREFERRED_NODE,
+                bool large_pages = false);
+
+    // Allocate object.
+    void* allocate();
+
+    // Release object.
+    void deallocate(void* obj);
+
+    // Construct object.
+    template<typename T, typename... Args>
+    T* construct(Args&&... args);
+
+    // Destroy object.
+    template<typename T>
+    void destroy(T* obj);
+
+  private:
+    // Slab header (first cache line of every slab).
+    struct header {
+      header* next;
+      size_t size;
+    };
+
+    // Free object.
+    struct free_object {
+      free_object* next;
+    };
+
+    // Object size.
+    size_t _M_size = 0;
+
+    // Number of objects per slab.
+    size_t _M_count = 0;
+
+    // NUMA node.
+    ULONG _M_node = NUMA_NO_PREFERRED_NODE;
+
+    // Use large pages?
+    bool _M_large_pages = false;
+
+    // Slabs.
+    header* _M_slabs = nullptr;
+
+    // Free objects.
+    free_object* _M_free = nullptr;
+
+    // Lock.
+    SRWLOCK _M_lock = SRWLOCK_INIT;
+
+    // Allocate a new slab.
+    bool grow();
+
+    // Disable copy constructor and assignment operator.
+    slab(const slab&) = delete;
+    slab& operator=(const slab&) = delete;
+};
+
+template<typename T, typename... Args>
+inline T* slab::construct(Args&&... args)
+{
+  void* const obj = (sizeof(T) <= _M_size) ? allocate() : nullptr;
+  return obj ? new (obj) T{std::forward<Args>(args)...} : nullptr;
+}
+
+template<typename T>
+inline void slab::destroy(T* obj)
+{
+  if (obj) {
+    obj->~T();
+    deallocate(obj);
+  }
+}
+
+} // namespace util
\ No newline at end of file
@@ -2,13 +2,12 @@
 
 namespace util {
 
-timer::timer(callbackfn callback, void* user)
-  : _M_callback{callback},
-    _M_user{user}
+timer_base::timer_base(PTP_TIMER_CALLBACK timer_callback)
+  : _M_timer_callback{timer_callback}
 {
 }
 
-timer::~timer()
+timer_base::~timer_base()
 {
   // Cancel timer.
   cancel();
@@ -19,25 +18,25 @@ timer::~timer()
   }
 }
 
-bool timer::create(PTP_CALLBACK_ENVIRON callbackenv)
+bool timer_base::create(PTP_CALLBACK_ENVIRON callbackenv)
 {
   // Create timer.
-  _M_timer = ::CreateThreadpoolTimer(timer_callback, this, callbackenv);
+  _M_timer = ::CreateThreadpoolTimer(_M_timer_callback, this, callbackenv);
 
   return (_M_timer != nullptr);
 }
 
-void timer::expires_in(uint64_t interval)
+void timer_base::expires_in(uint64_t interval)
 {
   set_timer(static_cast<ULONGLONG>(-10 * interval));
 }
 
-void timer::expires_at(uint64_t expiry_time)
+void timer_base::expires_at(uint64_t expiry_time)
 {
   set_timer(static_cast<ULONGLONG>(10 * expiry_time));
 }
 
-void timer::cancel()
+void timer_base::cancel()
 {
   if (_M_timer) {
     ::SetThreadpoolTimer(_M_timer, nullptr, 0, 0);
@@ -48,7 +47,14 @@ void timer::cancel()
   }
 }
 
-void timer::set_timer(ULONGLONG duetime)
+void timer_base::disarm()
+{
+  if (_M_timer) {
+    ::SetThreadpoolTimer(_M_timer, nullptr, 0, 0);
+  }
+}
+
+void timer_base::set_timer(ULONGLONG duetime)
 {
   ULARGE_INTEGER ul;
   ul.QuadPart = duetime;
@@ -61,13 +67,4 @@ void timer::set_timer(ULONGLONG duetime)
   ::SetThreadpoolTimer(_M_timer, &ft, 0, 0);
 }
 
-void CALLBACK timer::timer_callback(PTP_CALLBACK_INSTANCE instance,
-                                    void* context,
-                                    PTP_TIMER timer)
-{
-  // Invoke callback.
-  util::timer* const t = static_cast<util::timer*>(context);
-  t->_M_callback(*t, t->_M_user);
-}
-
 } // namespace util
\ No newline at end of file
@@ -5,18 +5,9 @@
 
 namespace util {
 
-// Asynchronous timer.
-class timer {
+// Asynchronous timer (part independent of the callback handler).
+class timer_base {
   public:
-    // Callback.
-    typedef void (*callbackfn)(timer&, void*);
-
-    // Constructor.
-    timer(callbackfn callback, void* user = nullptr);
-
-    // Destructor.
-    ~timer();
-
     // Create timer.
     bool create(PTP_CALLBACK_ENVIRON callbackenv = nullptr);
 
@@ -29,27 +20,154 @@ class timer {
     // Cancel timer.
     void cancel();
 
-  private:
+    // Disarm timer without waiting for outstanding timer callbacks (can be
+    // called from the timer callback).
+    void disarm();
+
+  protected:
+    // Constructor.
+    timer_base(PTP_TIMER_CALLBACK timer_callback);
+
+    // Destructor.
+    ~timer_base();
+
     // Timer.
     PTP_TIMER _M_timer = nullptr;
 
-    // Callback.
-    const callbackfn _M_callback;
-
-    // Pointer to user data.
-    void* _M_user;
+    // Timer callback.
+    const PTP_TIMER_CALLBACK _M_timer_callback;
 
     // Set timer.
     void set_timer(ULONGLONG duetime);
 
+    // Disable copy constructor and assignment operator.
+    timer_base(const timer_base&) = delete;
+    timer_base& operator=(const timer_base&) = delete;
+};
+
+// Asynchronous timer.
+// `Handler` is invoked as `handler()` when the timer expires. The handler is
+// stored by value and called directly from the timer callback, so the
+// compiler can inline it.
+template<typename Handler>
+class basic_timer : public timer_base {
+  public:
+    // Constructor.
+    basic_timer(Handler handler);
+
+    // Destructor.
+    ~basic_timer() = default;
+
+  private:
+    // Handler.
+    Handler _M_handler;
+
     // Timer callback.
     static void CALLBACK timer_callback(PTP_CALLBACK_INSTANCE instance,
                                         void* context,
                                         PTP_TIMER timer);
+};
 
-    // Disable copy constructor and assignment operator.
-    timer(const timer&) = delete;
-    timer& operator=(const timer&) = delete;
+// Forward declaration.
+class timer;
+
+// Timer handler calling a function pointer.
+class timer_callback_handler {
+  public:
+    // Callback.
+    typedef void (*callbackfn)(timer&, void*);
+
+    // Constructor.
+    timer_callback_handler(timer& t, callbackfn callback, void* user);
+
+    // Invoke callback.
+    void operator()() const;
+
+  private:
+    // Timer.
+    timer& _M_timer;
+
+    // Callback.
+    const callbackfn _M_callback;
+
+    // Pointer to user data.
+    void* const _M_user;
+};
+
+// Timer handler calling the member function `fn` of an object.
+template<typename T, void (T::*fn)()>
+class timer_member_handler {
+  public:
+    // Constructor.
+    timer_member_handler(T* object);
+
+    // Invoke member function.
+    void operator()() const;
+
+  private:
+    // Object.
+    T* const _M_object;
+};
+
+// Asynchronous timer with a function pointer callback.
+class timer : public basic_timer<timer_callback_handler> {
+  public:
+    // Callback.
+    typedef timer_callback_handler::callbackfn callbackfn;
+
+    // Constructor.
+    timer(callbackfn callback, void* user = nullptr);
+
+    // Destructor.
+    ~timer() = default;
 };
 
+template<typename Handler>
+inline basic_timer<Handler>::basic_timer(Handler handler)
+  : timer_base{timer_callback},
+    _M_handler{handler}
+{
+}
+
+template<typename Handler>
+void CALLBACK
+basic_timer<Handler>::timer_callback(PTP_CALLBACK_INSTANCE instance,
+                                     void* context,
+                                     PTP_TIMER timer)
+{
+  // Invoke handler.
+  static_cast<basic_timer*>(static_cast<timer_base*>(context))->_M_handler();
+}
+
+inline timer_callback_handler::timer_callback_handler(timer& t,
+                                                      callbackfn callback,
+                                                      void* user)
+  : _M_timer{t},
+    _M_callback{callback},
+    _M_user{user}
+{
+}
+
+inline void timer_callback_handler::operator()() const
+{
+  _M_callback(_M_timer, _M_user);
+}
+
+template<typename T, void (T::*fn)()>
+inline timer_member_handler<T, fn>::timer_member_handler(T* object)
+  : _M_object{object}
+{
+}
+
+template<typename T, void (T::*fn)()>
+inline void timer_member_handler<T, fn>::operator()() const
+{
+  (_M_object->*fn)();
+}
+
+inline timer::timer(callbackfn callback, void* user)
+  : basic_timer{timer_callback_handler{*this, callback, user}}
+{
+}
+
 } // namespace util
\ No newline at end of file
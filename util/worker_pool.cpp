@@ -0,0 +1,241 @@
+#include <stdlib.h>
+#include <limits.h>
+#include <new>
+#include "util/worker_pool.hpp"
+
+namespace util {
+
+thread_local worker_pool::worker* worker_pool::_M_current = nullptr;
+
+worker_pool::~worker_pool()
+{
+  // Stop worker pool.
+  stop();
+}
+
+bool worker_pool::create(size_t nworkers)
+{
+  // Sanity checks.
+  if ((nworkers >= min_workers) && (nworkers <= max_workers)) {
+    // Create semaphore.
+    _M_semaphore = ::CreateSemaphore(nullptr, 0, LONG_MAX, nullptr);
+
+    // If the semaphore could be created...
+    if (_M_semaphore) {
+      // Create workers.
+      _M_workers = new (std::nothrow) worker[nworkers];
+
+      // If the workers could be created...
+      if (_M_workers) {
+        for (_M_nworkers = 0; _M_nworkers < nworkers; _M_nworkers++) {
+          worker& w = _M_workers[_M_nworkers];
+
+          w.pool = this;
+          w.index = _M_nworkers;
+
+          // Create thread.
+          w.thread = ::CreateThread(nullptr, 0, run, &w, 0, nullptr);
+
+          // If the thread could not be created...
+          if (!w.thread) {
+            stop();
+            return false;
+          }
+        }
+
+        return true;
+      }
+
+      ::CloseHandle(_M_semaphore);
+      _M_semaphore = nullptr;
+    }
+  }
+
+  return false;
+}
+
+void worker_pool::stop()
+{
+  if (_M_workers) {
+    ::InterlockedExchange(&_M_stop, 1);
+
+    // Wake up all the workers.
+    if (_M_nworkers > 0) {
+      ::ReleaseSemaphore(_M_semaphore,
+                         static_cast<LONG>(_M_nworkers),
+                         nullptr);
+    }
+
+    // Wait for the workers to finish.
+    for (size_t i = 0; i < _M_nworkers; i++) {
+      ::WaitForSingleObject(_M_workers[i].thread, INFINITE);
+      ::CloseHandle(_M_workers[i].thread);
+    }
+
+    delete [] _M_workers;
+    _M_workers = nullptr;
+    _M_nworkers = 0;
+
+    ::CloseHandle(_M_semaphore);
+    _M_semaphore = nullptr;
+  }
+}
+
+bool worker_pool::submit(taskfn fn, void* arg)
+{
+  if (_M_nworkers > 0) {
+    worker* w = _M_current;
+    queue* q;
+
+    // If the task is being submitted from a worker of this pool...
+    if ((w) && (w->pool == this)) {
+      q = &w->tasks;
+    } else {
+      w = &_M_workers[::InterlockedIncrement(&_M_next) % _M_nworkers];
+      q = &w->submissions;
+    }
+
+    // Push task.
+    if (q->push(task{fn, arg})) {
+      wakeup();
+      return true;
+    }
+  }
+
+  return false;
+}
+
+bool worker_pool::next(worker& w, task& t)
+{
+  // If there is a task in the own queues (the newest local task or the
+  // oldest submission)...
+  if ((w.tasks.pop(t)) || (w.submissions.steal(t))) {
+    return true;
+  }
+
+  // Steal a task from another worker.
+  for (size_t i = 1; i < _M_nworkers; i++) {
+    worker& other = _M_workers[(w.index + i) % _M_nworkers];
+
+    if ((other.submissions.steal(t)) || (other.tasks.steal(t))) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+void worker_pool::wakeup()
+{
+  // If there are idle workers...
+  if (::InterlockedCompareExchange(&_M_idle, 0, 0) > 0) {
+    ::ReleaseSemaphore(_M_semaphore, 1, nullptr);
+  }
+}
+
+DWORD WINAPI worker_pool::run(void* param)
+{
+  worker& w = *static_cast<worker*>(param);
+  worker_pool& pool = *w.pool;
+
+  _M_current = &w;
+
+  do {
+    task t;
+
+    // If there is a task to run...
+    if (pool.next(w, t)) {
+      t.fn(t.arg);
+    } else {
+      ::InterlockedIncrement(&pool._M_idle);
+
+      // Check again: a task might have been submitted before the worker was
+      // counted as idle.
+      if (pool.next(w, t)) {
+        ::InterlockedDecrement(&pool._M_idle);
+
+        t.fn(t.arg);
+      } else if (::InterlockedCompareExchange(&pool._M_stop, 0, 0) != 0) {
+        ::InterlockedDecrement(&pool._M_idle);
+
+        _M_current = nullptr;
+        return 0;
+      } else {
+        // Wait for a task to be submitted.
+        ::WaitForSingleObject(pool._M_semaphore, INFINITE);
+
+        ::InterlockedDecrement(&pool._M_idle);
+      }
+    }
+  } while (true);
+}
+
+worker_pool::queue::~queue()
+{
+  free(_M_tasks);
+}
+
+bool worker_pool::queue::push(const task& t)
+{
+  ::AcquireSRWLockExclusive(&_M_lock);
+
+  // If the queue is full...
+  if (_M_count == _M_size) {
+    const size_t size = (_M_size > 0) ? _M_size * 2 : initial_size;
+
+    task* tasks = static_cast<task*>(malloc(size * sizeof(task)));
+    if (!tasks) {
+      ::ReleaseSRWLockExclusive(&_M_lock);
+      return false;
+    }
+
+    // Copy tasks.
+    for (size_t i = 0; i < _M_count; i++) {
+      tasks[i] = _M_tasks[(_M_head + i) % _M_size];
+    }
+
+    free(_M_tasks);
+
+    _M_tasks = tasks;
+    _M_size = size;
+    _M_head = 0;
+  }
+
+  _M_tasks[(_M_head + _M_count++) % _M_size] = t;
+
+  ::ReleaseSRWLockExclusive(&_M_lock);
+
+  return true;
+}
+
+bool worker_pool::queue::pop(task& t)
+{
+  ::AcquireSRWLockExclusive(&_M_lock);
+
+  const bool ret = (_M_count > 0);
+  if (ret) {
+    t = _M_tasks[(_M_head + --_M_count) % _M_size];
+  }
+
+  ::ReleaseSRWLockExclusive(&_M_lock);
+
+  return ret;
+}
+
+bool worker_pool::queue::steal(task& t)
+{
+  ::AcquireSRWLockExclusive(&_M_lock);
+
+  const bool ret = (_M_count > 0);
+  if (ret) {
+    t = _M_tasks[_M_head];
+    _M_head = (_M_head + 1) % _M_size;
+    _M_count--;
+  }
+
+  ::ReleaseSRWLockExclusive(&_M_lock);
+
+  return ret;
+}
+
+} // namespace util
\ No newline at end of file
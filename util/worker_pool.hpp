@@ -0,0 +1,142 @@
+#pragma once
+
+#include <stdint.h>
+#include <windows.h>
+
+namespace util {
+
+// Pool of worker threads for CPU-bound or blocking tasks which don't
+// perform asynchronous I/O (compression, checksums, file rotation...), so
+// that they don't hold the threads of `net::async::thread_pool`.
+// Every worker has its own run queues: a task submitted from a worker is
+// pushed to the local queue of that worker (and run LIFO, while its data is
+// still in the cache); tasks submitted from other threads are spread
+// round-robin over the submission queues of the workers, and run FIFO (so
+// that a stream of new tasks doesn't starve the oldest ones). A worker runs
+// its local tasks first. Idle workers steal the oldest tasks from the queues
+// of the other workers.
+class worker_pool {
+  public:
+    // Task.
+    typedef void (*taskfn)(void* arg);
+
+    // Minimum number of workers.
+    static constexpr const size_t min_workers = 1;
+
+    // Maximum number of workers.
+    static constexpr const size_t max_workers = 256;
+
+    // Default number of workers.
+    static constexpr const size_t default_workers = 4;
+
+    // Constructor.
+    worker_pool() = default;
+
+    // Destructor.
+    ~worker_pool();
+
+    // Create worker pool.
+    bool create(size_t nworkers = default_workers);
+
+    // Stop.
+    // Waits for the submitted tasks to be run.
+    void stop();
+
+    // Submit task.
+    bool submit(taskfn fn, void* arg);
+
+  private:
+    // Task.
+    struct task {
+      taskfn fn;
+      void* arg;
+    };
+
+    // Run queue.
+    class queue {
+      public:
+        // Constructor.
+        queue() = default;
+
+        // Destructor.
+        ~queue();
+
+        // Push task (back).
+        bool push(const task& t);
+
+        // Pop task (back).
+        bool pop(task& t);
+
+        // Steal task (front).
+        bool steal(task& t);
+
+      private:
+        // Initial number of tasks.
+        static constexpr const size_t initial_size = 64;
+
+        // Lock.
+        SRWLOCK _M_lock = SRWLOCK_INIT;
+
+        // Tasks (circular buffer).
+        task* _M_tasks = nullptr;
+        size_t _M_size = 0;
+        size_t _M_head = 0;
+        size_t _M_count = 0;
+
+        // Disable copy constructor and assignment operator.
+        queue(const queue&) = delete;
+        queue& operator=(const queue&) = delete;
+    };
+
+    // Worker.
+    struct worker {
+      // Run queue of the tasks submitted by the worker itself (LIFO).
+      queue tasks;
+
+      // Run queue of the tasks submitted from outside the pool (FIFO).
+      queue submissions;
+
+      // Thread.
+      HANDLE thread = nullptr;
+
+      // Pool.
+      worker_pool* pool = nullptr;
+
+      // Index.
+      size_t index = 0;
+    };
+
+    // Workers.
+    worker* _M_workers = nullptr;
+    size_t _M_nworkers = 0;
+
+    // Semaphore on which the idle workers wait.
+    HANDLE _M_semaphore = nullptr;
+
+    // Number of idle workers.
+    uint32_t _M_idle = 0;
+
+    // Queue for the next task submitted from outside the pool.
+    uint32_t _M_next = 0;
+
+    // Stop?
+    uint32_t _M_stop = 0;
+
+    // Worker of the current thread (if any).
+    static thread_local worker* _M_current;
+
+    // Get next task for worker `w`.
+    bool next(worker& w, task& t);
+
+    // Wake up an idle worker (if any).
+    void wakeup();
+
+    // Worker thread.
+    static DWORD WINAPI run(void* param);
+
+    // Disable copy constructor and assignment operator.
+    worker_pool(const worker_pool&) = delete;
+    worker_pool& operator=(const worker_pool&) = delete;
+};
+
+} // namespace util
\ No newline at end of file